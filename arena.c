@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "frame_stats.h"
+
+static struct Arena frame;
+static struct Arena persistent;
+
+bool createArena(const char *name, size_t capacity, struct Arena *arena) {
+    *arena = (struct Arena) { .name = name };
+    arena->base = statsMalloc(capacity);
+    if (!arena->base) {
+        fprintf(stderr, "Arena %s: failed to allocate %zu bytes\n", name, capacity);
+        return false;
+    }
+    arena->capacity = capacity;
+    return true;
+}
+
+void cleanupArena(struct Arena *arena) {
+    statsFree(arena->base);
+    *arena = (struct Arena) { 0 };
+}
+
+void *arenaAlloc(struct Arena *arena, size_t size, size_t alignment) {
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    uintptr_t start = (uintptr_t) arena->base + arena->offset;
+    start = (start + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    size_t offset = (size_t) (start - (uintptr_t) arena->base);
+
+    if (offset > arena->capacity || size > arena->capacity - offset) {
+        fprintf(stderr, "FATAL: arena %s out of memory, %zu of %zu bytes used, %zu requested\n",
+            arena->name, arena->offset, arena->capacity, size);
+        abort();
+    }
+
+    arena->offset = offset + size;
+    if (arena->offset > arena->peak) arena->peak = arena->offset;
+    return arena->base + offset;
+}
+
+void arenaReset(struct Arena *arena, size_t mark) {
+    assert(mark <= arena->offset);
+    arena->offset = mark;
+}
+
+bool arenasInit(void) {
+    if (!createArena("frame", FRAME_ARENA_SIZE, &frame)) return false;
+    if (!createArena("persistent", PERSISTENT_ARENA_SIZE, &persistent)) {
+        cleanupArena(&frame);
+        return false;
+    }
+    return true;
+}
+
+void arenasShutdown(void) {
+    cleanupArena(&frame);
+    cleanupArena(&persistent);
+}
+
+struct Arena *frameArena(void) {
+    return &frame;
+}
+
+struct Arena *persistentArena(void) {
+    return &persistent;
+}
+
+void arenaReport(FILE *out) {
+    const struct Arena *arenas[] = { &frame, &persistent };
+    for (size_t i = 0; i < sizeof(arenas) / sizeof(arenas[0]); i++) {
+        fprintf(out, "Arena %-10s %8zu bytes used, peak %8zu of %8zu\n",
+            arenas[i]->name, arenas[i]->offset, arenas[i]->peak, arenas[i]->capacity);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Bump allocators for CPU memory with an obvious end of life. The frame
+// arena is reset at the start of every frame, so its allocations are scratch
+// space that can't be kept past the current frame, or past init for init
+// code. The persistent arena holds arrays that live until shutdown. Both are
+// main thread only.
+//
+// Running out is a sizing bug rather than something to recover from, so
+// arenaAlloc aborts instead of returning NULL.
+
+#define FRAME_ARENA_SIZE (1 << 20)
+#define PERSISTENT_ARENA_SIZE (64 << 10)
+
+struct Arena {
+    const char *name;
+    char *base;
+    size_t capacity;
+    size_t offset;
+    size_t peak;
+};
+
+bool createArena(const char *name, size_t capacity, struct Arena *arena);
+void cleanupArena(struct Arena *arena);
+
+// `alignment` must be a power of two
+void *arenaAlloc(struct Arena *arena, size_t size, size_t alignment);
+
+#define ARENA_ARRAY(arena, type, count) \
+    ((type *) arenaAlloc((arena), (size_t) (count) * sizeof(type), _Alignof(type)))
+
+static inline size_t arenaMark(const struct Arena *arena) { return arena->offset; }
+
+// Frees everything allocated since `mark`, 0 frees everything
+void arenaReset(struct Arena *arena, size_t mark);
+
+bool arenasInit(void);
+void arenasShutdown(void);
+
+struct Arena *frameArena(void);
+struct Arena *persistentArena(void);
+
+void arenaReport(FILE *out);
+
+#endif // ARENA_H
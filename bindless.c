@@ -0,0 +1,428 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "bindless.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+
+static const VkDescriptorType bindingTypes[BINDLESS_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+};
+
+static inline uint32_t uint_min(uint32_t a, uint32_t b) { return a < b ? a : b; }
+
+bool queryDescriptorIndexingSupport(
+    VkPhysicalDevice physicalDevice,
+    VkPhysicalDeviceDescriptorIndexingFeatures *outFeatures
+) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Descriptor indexing is core in 1.2, don't bother with the extension
+    if (properties.apiVersion < VK_API_VERSION_1_2) {
+        fprintf(stderr, "Descriptor indexing: not available (device is Vulkan %d.%d)\n",
+            VK_VERSION_MAJOR(properties.apiVersion),
+            VK_VERSION_MINOR(properties.apiVersion));
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &indexingFeatures,
+    };
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    bool supported = indexingFeatures.runtimeDescriptorArray
+        && indexingFeatures.descriptorBindingPartiallyBound
+        && indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+        && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+        && indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind
+        && indexingFeatures.shaderSampledImageArrayNonUniformIndexing
+        && indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+
+    fprintf(stderr, "Descriptor indexing: %s\n", supported ? "yes" : "no");
+    if (!supported) return false;
+
+    // Only the fields we query are enabled, the chain is owned by the caller
+    indexingFeatures.pNext = NULL;
+    *outFeatures = indexingFeatures;
+    return true;
+}
+
+static void getDescriptorCounts(
+    VkPhysicalDevice physicalDevice,
+    bool descriptorIndexing,
+    uint32_t counts[BINDLESS_BINDING_COUNT]
+) {
+    if (descriptorIndexing) {
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES,
+        };
+
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &indexingProperties,
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        counts[BINDLESS_BINDING_SAMPLED_IMAGES] = uint_min(
+            BINDLESS_MAX_SAMPLED_IMAGES,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages
+        );
+        counts[BINDLESS_BINDING_SAMPLERS] = uint_min(
+            BINDLESS_MAX_SAMPLERS,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers
+        );
+        counts[BINDLESS_BINDING_STORAGE_BUFFERS] = uint_min(
+            BINDLESS_MAX_STORAGE_BUFFERS,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers
+        );
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    counts[BINDLESS_BINDING_SAMPLED_IMAGES] = uint_min(
+        BINDLESS_FALLBACK_SAMPLED_IMAGES,
+        properties.limits.maxPerStageDescriptorSampledImages
+    );
+    counts[BINDLESS_BINDING_SAMPLERS] = uint_min(
+        BINDLESS_FALLBACK_SAMPLERS,
+        properties.limits.maxPerStageDescriptorSamplers
+    );
+    counts[BINDLESS_BINDING_STORAGE_BUFFERS] = uint_min(
+        BINDLESS_FALLBACK_STORAGE_BUFFERS,
+        properties.limits.maxPerStageDescriptorStorageBuffers
+    );
+}
+
+static VkResult createSlots(uint32_t capacity, struct BindlessSlots *slots) {
+    slots->capacity = capacity;
+    slots->highWater = 0;
+    slots->freeCount = 0;
+    slots->retiredCount = 0;
+    slots->freeList = statsMalloc(capacity * sizeof(uint32_t));
+    slots->retired = statsMalloc(capacity * sizeof(struct BindlessRetired));
+    if (!slots->freeList || !slots->retired) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    return VK_SUCCESS;
+}
+
+VkResult createBindlessHeap(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    bool descriptorIndexing,
+    uint32_t framesInFlight,
+    struct BindlessHeap *heap
+) {
+    VkResult result;
+    assert(framesInFlight <= BINDLESS_MAX_SETS);
+
+    *heap = (struct BindlessHeap) { 0 };
+    heap->descriptorIndexing = descriptorIndexing;
+    heap->framesInFlight = framesInFlight;
+    heap->setCount = descriptorIndexing ? 1 : framesInFlight;
+
+    uint32_t counts[BINDLESS_BINDING_COUNT];
+    getDescriptorCounts(physicalDevice, descriptorIndexing, counts);
+
+    fprintf(stderr, "Bindless heap: %u images, %u samplers, %u buffers, %u set(s)\n",
+        counts[BINDLESS_BINDING_SAMPLED_IMAGES],
+        counts[BINDLESS_BINDING_SAMPLERS],
+        counts[BINDLESS_BINDING_STORAGE_BUFFERS],
+        heap->setCount);
+
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT];
+    VkDescriptorBindingFlags bindingFlags[BINDLESS_BINDING_COUNT];
+    VkDescriptorPoolSize poolSizes[BINDLESS_BINDING_COUNT];
+
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        bindings[i] = (VkDescriptorSetLayoutBinding) {
+            .binding = i,
+            .descriptorType = bindingTypes[i],
+            .descriptorCount = counts[i],
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        };
+
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+            | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+        poolSizes[i] = (VkDescriptorPoolSize) {
+            .type = bindingTypes[i],
+            .descriptorCount = counts[i] * heap->setCount,
+        };
+
+        result = createSlots(counts[i], &heap->slots[i]);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate bindless slot lists");
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = BINDLESS_BINDING_COUNT,
+        .pBindingFlags = bindingFlags,
+    };
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = BINDLESS_BINDING_COUNT,
+        .pBindings = bindings,
+    };
+
+    if (descriptorIndexing) {
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+
+    result = COUNT_VK_CREATE(vkCreateDescriptorSetLayout(device, &layoutInfo, hostAllocator(), &heap->setLayout));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create bindless descriptor set layout");
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = heap->setCount,
+        .poolSizeCount = BINDLESS_BINDING_COUNT,
+        .pPoolSizes = poolSizes,
+    };
+
+    if (descriptorIndexing) {
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    }
+
+    result = COUNT_VK_CREATE(vkCreateDescriptorPool(device, &poolInfo, hostAllocator(), &heap->pool));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create bindless descriptor pool");
+
+    VkDescriptorSetLayout setLayouts[BINDLESS_MAX_SETS];
+    for (uint32_t i = 0; i < heap->setCount; i++) {
+        setLayouts[i] = heap->setLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = heap->pool,
+        .descriptorSetCount = heap->setCount,
+        .pSetLayouts = setLayouts,
+    };
+
+    result = COUNT_VK_CREATE(vkAllocateDescriptorSets(device, &allocInfo, heap->sets));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate bindless descriptor sets");
+
+    return VK_SUCCESS;
+}
+
+void cleanupBindlessHeap(
+    VkDevice device,
+    struct BindlessHeap *heap
+) {
+    // Sets are freed along with the pool
+    vkDestroyDescriptorPool(device, heap->pool, hostAllocator());
+    vkDestroyDescriptorSetLayout(device, heap->setLayout, hostAllocator());
+
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        statsFree(heap->slots[i].freeList);
+        statsFree(heap->slots[i].retired);
+    }
+    statsFree(heap->pending);
+    *heap = (struct BindlessHeap) { 0 };
+}
+
+static uint32_t allocateSlot(struct BindlessSlots *slots) {
+    if (slots->freeCount > 0) {
+        return slots->freeList[--slots->freeCount];
+    }
+    if (slots->highWater < slots->capacity) {
+        return slots->highWater++;
+    }
+    return BINDLESS_INVALID_INDEX;
+}
+
+static void writeDescriptor(
+    VkDevice device,
+    VkDescriptorSet set,
+    const struct BindlessWrite *write
+) {
+    VkWriteDescriptorSet descriptorWrite = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = write->binding,
+        .dstArrayElement = write->index,
+        .descriptorCount = 1,
+        .descriptorType = bindingTypes[write->binding],
+    };
+
+    if (write->binding == BINDLESS_BINDING_STORAGE_BUFFERS) {
+        descriptorWrite.pBufferInfo = &write->bufferInfo;
+    } else {
+        descriptorWrite.pImageInfo = &write->imageInfo;
+    }
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, NULL);
+}
+
+static uint32_t submitWrite(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    struct BindlessWrite *write
+) {
+    write->index = allocateSlot(&heap->slots[write->binding]);
+    if (write->index == BINDLESS_INVALID_INDEX) {
+        fprintf(stderr, "Bindless heap: binding %d is full\n", write->binding);
+        return BINDLESS_INVALID_INDEX;
+    }
+
+    // Update-after-bind lets us write straight into the live set
+    if (heap->descriptorIndexing) {
+        writeDescriptor(device, heap->sets[0], write);
+        return write->index;
+    }
+
+    if (heap->pendingCount == heap->pendingCapacity) {
+        uint32_t capacity = heap->pendingCapacity ? heap->pendingCapacity * 2 : 64;
+        struct BindlessWrite *pending = statsRealloc(heap->pending, capacity * sizeof(struct BindlessWrite));
+        if (!pending) {
+            fprintf(stderr, "Bindless heap: failed to grow pending writes\n");
+            return BINDLESS_INVALID_INDEX;
+        }
+        heap->pending = pending;
+        heap->pendingCapacity = capacity;
+    }
+    heap->pending[heap->pendingCount++] = *write;
+
+    return write->index;
+}
+
+uint32_t bindlessRegisterImage(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkImageView imageView,
+    VkImageLayout imageLayout
+) {
+    struct BindlessWrite write = {
+        .binding = BINDLESS_BINDING_SAMPLED_IMAGES,
+        .imageInfo = {
+            .imageView = imageView,
+            .imageLayout = imageLayout,
+        },
+    };
+    return submitWrite(device, heap, &write);
+}
+
+uint32_t bindlessRegisterSampler(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkSampler sampler
+) {
+    struct BindlessWrite write = {
+        .binding = BINDLESS_BINDING_SAMPLERS,
+        .imageInfo = {
+            .sampler = sampler,
+        },
+    };
+    return submitWrite(device, heap, &write);
+}
+
+uint32_t bindlessRegisterBuffer(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize range
+) {
+    struct BindlessWrite write = {
+        .binding = BINDLESS_BINDING_STORAGE_BUFFERS,
+        .bufferInfo = {
+            .buffer = buffer,
+            .offset = offset,
+            .range = range,
+        },
+    };
+    return submitWrite(device, heap, &write);
+}
+
+void bindlessRelease(
+    struct BindlessHeap *heap,
+    enum BindlessBinding binding,
+    uint32_t index
+) {
+    struct BindlessSlots *slots = &heap->slots[binding];
+    assert(index < slots->highWater);
+    assert(slots->retiredCount < slots->capacity);
+
+    slots->retired[slots->retiredCount++] = (struct BindlessRetired) {
+        .index = index,
+        .frame = heap->frameNumber,
+    };
+}
+
+void bindlessBeginFrame(struct BindlessHeap *heap) {
+    heap->frameNumber++;
+
+    // A slot released in frame N may still be read until frame N + framesInFlight
+    for (uint32_t b = 0; b < BINDLESS_BINDING_COUNT; b++) {
+        struct BindlessSlots *slots = &heap->slots[b];
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < slots->retiredCount; i++) {
+            if (slots->retired[i].frame + heap->framesInFlight < heap->frameNumber) {
+                slots->freeList[slots->freeCount++] = slots->retired[i].index;
+            } else {
+                slots->retired[kept++] = slots->retired[i];
+            }
+        }
+        slots->retiredCount = kept;
+    }
+}
+
+void bindlessFlushWrites(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    uint32_t frame
+) {
+    if (heap->descriptorIndexing) return;
+
+    // Fallback: this frame's set is idle now, so it can catch up on writes
+    assert(frame < heap->setCount);
+    for (uint32_t i = heap->appliedCount[frame]; i < heap->pendingCount; i++) {
+        writeDescriptor(device, heap->sets[frame], &heap->pending[i]);
+    }
+    heap->appliedCount[frame] = heap->pendingCount;
+
+    for (uint32_t i = 0; i < heap->setCount; i++) {
+        if (heap->appliedCount[i] != heap->pendingCount) return;
+    }
+    for (uint32_t i = 0; i < heap->setCount; i++) {
+        heap->appliedCount[i] = 0;
+    }
+    heap->pendingCount = 0;
+}
+
+VkDescriptorSet bindlessGetSet(
+    const struct BindlessHeap *heap,
+    uint32_t frame
+) {
+    return heap->descriptorIndexing ? heap->sets[0] : heap->sets[frame];
+}
+
+VkPushConstantRange bindlessPushConstantRange(void) {
+    VkPushConstantRange range = {
+        .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(struct BindlessPushConstants),
+    };
+    return range;
+}
+
+VkDescriptorType bindlessBindingType(enum BindlessBinding binding) {
+    return bindingTypes[binding];
+}
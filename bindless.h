@@ -0,0 +1,150 @@
+#pragma once
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Requested array sizes. These get clamped to the device limits.
+#define BINDLESS_MAX_SAMPLED_IMAGES 16384
+#define BINDLESS_MAX_SAMPLERS 256
+#define BINDLESS_MAX_STORAGE_BUFFERS 16384
+
+// Array sizes used when the device has no descriptor indexing.
+#define BINDLESS_FALLBACK_SAMPLED_IMAGES 64
+#define BINDLESS_FALLBACK_SAMPLERS 16
+#define BINDLESS_FALLBACK_STORAGE_BUFFERS 32
+
+// Without update-after-bind there is one descriptor set per frame in flight
+#define BINDLESS_MAX_SETS 4
+
+#define BINDLESS_INVALID_INDEX UINT32_MAX
+
+enum BindlessBinding {
+    BINDLESS_BINDING_SAMPLED_IMAGES = 0,
+    BINDLESS_BINDING_SAMPLERS = 1,
+    BINDLESS_BINDING_STORAGE_BUFFERS = 2,
+    BINDLESS_BINDING_COUNT
+};
+
+// Pushed once per draw. Shaders index the global arrays with these.
+struct BindlessPushConstants {
+    uint32_t imageIndex;
+    uint32_t samplerIndex;
+    uint32_t bufferIndex;
+    uint32_t instanceOffset;
+};
+
+struct BindlessRetired {
+    uint32_t index;
+    uint64_t frame;
+};
+
+struct BindlessSlots {
+    uint32_t capacity;
+    uint32_t highWater;          // slots below this have been handed out at least once
+    uint32_t freeCount;
+    uint32_t *freeList;          // has `capacity` elements
+    uint32_t retiredCount;
+    struct BindlessRetired *retired; // has `capacity` elements
+};
+
+struct BindlessWrite {
+    enum BindlessBinding binding;
+    uint32_t index;
+    VkDescriptorImageInfo imageInfo;
+    VkDescriptorBufferInfo bufferInfo;
+};
+
+struct BindlessHeap {
+    bool descriptorIndexing;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool pool;
+
+    uint32_t setCount;
+    VkDescriptorSet sets[BINDLESS_MAX_SETS];
+
+    struct BindlessSlots slots[BINDLESS_BINDING_COUNT];
+
+    // Fallback path only: writes are replayed into each set when its frame flushes
+    uint32_t pendingCount;
+    uint32_t pendingCapacity;
+    struct BindlessWrite *pending;
+    uint32_t appliedCount[BINDLESS_MAX_SETS];
+
+    uint32_t framesInFlight;
+    uint64_t frameNumber;
+};
+
+bool queryDescriptorIndexingSupport(
+    VkPhysicalDevice physicalDevice,
+    VkPhysicalDeviceDescriptorIndexingFeatures *outFeatures
+);
+
+VkResult createBindlessHeap(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    bool descriptorIndexing,
+    uint32_t framesInFlight,
+    struct BindlessHeap *heap
+);
+
+void cleanupBindlessHeap(
+    VkDevice device,
+    struct BindlessHeap *heap
+);
+
+uint32_t bindlessRegisterImage(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkImageView imageView,
+    VkImageLayout imageLayout
+);
+
+uint32_t bindlessRegisterSampler(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkSampler sampler
+);
+
+uint32_t bindlessRegisterBuffer(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize range
+);
+
+// The slot is recycled once every frame that could reference it has retired
+void bindlessRelease(
+    struct BindlessHeap *heap,
+    enum BindlessBinding binding,
+    uint32_t index
+);
+
+// Call after waiting on the frame's fence, before anything registers or
+// releases slots for the frame
+void bindlessBeginFrame(struct BindlessHeap *heap);
+
+// Call once everything registered for the frame has been, before recording.
+// Without descriptor indexing that's when this frame's set catches up.
+void bindlessFlushWrites(
+    VkDevice device,
+    struct BindlessHeap *heap,
+    uint32_t frame
+);
+
+VkDescriptorSet bindlessGetSet(
+    const struct BindlessHeap *heap,
+    uint32_t frame
+);
+
+VkPushConstantRange bindlessPushConstantRange(void);
+
+// What each binding of the set holds, to check shaders against it
+VkDescriptorType bindlessBindingType(enum BindlessBinding binding);
+
+#endif // BINDLESS_H
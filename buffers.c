@@ -0,0 +1,167 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "defines.h"
+#include "buffers.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+
+uint32_t findMemoryType(
+    VkPhysicalDevice physicalDevice,
+    uint32_t typeFilter,
+    VkMemoryPropertyFlags properties
+) {
+    // Cached by memoryInit, queried directly before that
+    const VkPhysicalDeviceMemoryProperties *memProperties = memoryProperties();
+    VkPhysicalDeviceMemoryProperties queried;
+    if (memProperties->memoryTypeCount == 0) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &queried);
+        memProperties = &queried;
+    }
+
+    for (uint32_t i = 0; i < memProperties->memoryTypeCount; i++) {
+        if (
+            (typeFilter & (1 << i)) &&
+            (memProperties->memoryTypes[i].propertyFlags & properties) == properties
+        ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+VkResult createBuffer(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer *outBuffer,
+    VkDeviceMemory *outBufferMemory
+) {
+    VkResult result;
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+
+    VkBuffer buffer;
+    result = COUNT_VK_CREATE(vkCreateBuffer(device, &bufferInfo, hostAllocator(), &buffer));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create buffer");
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    uint32_t memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+    if (memoryType == UINT32_MAX) {
+        fprintf(stderr, "No suitable memory type for buffer\n");
+        vkDestroyBuffer(device, buffer, hostAllocator());
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = memoryType
+    };
+
+    // Host-visible buffers that are only ever copied from are staging
+    bool staging = usage == VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+        && (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+    VkDeviceMemory bufferMemory;
+    result = memoryAllocate(device, &allocInfo, staging ? MEMORY_CATEGORY_STAGING : MEMORY_CATEGORY_BUFFER, &bufferMemory);
+    if (result != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, hostAllocator());
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate buffer memory");
+    }
+
+    result = vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    if (result != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, hostAllocator());
+        memoryFree(device, bufferMemory);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to bind buffer memory");
+    }
+
+    *outBuffer = buffer;
+    *outBufferMemory = bufferMemory;
+
+    return VK_SUCCESS;
+}
+
+VkResult createFrameRing(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize frameSize,
+    uint32_t frameCount,
+    VkBufferUsageFlags usage,
+    struct FrameRing *ring
+) {
+    VkResult result;
+    assert(frameCount <= MAX_FRAME_RING_FRAMES);
+
+    *ring = (struct FrameRing) { 0 };
+    ring->frameSize = frameSize;
+    ring->frameCount = frameCount;
+
+    result = createBuffer(
+        physicalDevice,
+        device,
+        frameSize * frameCount,
+        usage,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &ring->buffer,
+        &ring->memory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create frame ring buffer");
+
+    void *mapped;
+    result = vkMapMemory(device, ring->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to map frame ring buffer");
+    ring->mapped = mapped;
+
+    return VK_SUCCESS;
+}
+
+void cleanupFrameRing(
+    VkDevice device,
+    struct FrameRing *ring
+) {
+    vkUnmapMemory(device, ring->memory);
+    vkDestroyBuffer(device, ring->buffer, hostAllocator());
+    memoryFree(device, ring->memory);
+    *ring = (struct FrameRing) { 0 };
+}
+
+void frameRingBegin(struct FrameRing *ring, uint32_t frame) {
+    assert(frame < ring->frameCount);
+    ring->frame = frame;
+    ring->offset = 0;
+}
+
+void *frameRingAlloc(
+    struct FrameRing *ring,
+    VkDeviceSize size,
+    VkDeviceSize alignment,
+    VkDeviceSize *outOffset
+) {
+    VkDeviceSize base = (VkDeviceSize) ring->frame * ring->frameSize;
+    VkDeviceSize offset = ring->offset;
+    if (alignment > 1) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+    }
+
+    if (offset + size > ring->frameSize) {
+        return NULL;
+    }
+
+    ring->offset = offset + size;
+    if (outOffset) *outOffset = base + offset;
+    return ring->mapped + base + offset;
+}
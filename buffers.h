@@ -0,0 +1,67 @@
+#pragma once
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+#define MAX_FRAME_RING_FRAMES 4
+
+uint32_t findMemoryType(
+    VkPhysicalDevice physicalDevice,
+    uint32_t typeFilter,
+    VkMemoryPropertyFlags properties
+);
+
+VkResult createBuffer(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer *outBuffer,
+    VkDeviceMemory *outBufferMemory
+);
+
+// One persistently mapped, host-coherent buffer split into a region per frame
+// in flight. Each frame bump-allocates from its own region, which the GPU is
+// done with once that frame's fence has signalled.
+struct FrameRing {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    char *mapped;
+
+    VkDeviceSize frameSize;
+    uint32_t frameCount;
+
+    uint32_t frame;
+    VkDeviceSize offset; // relative to the start of the current frame's region
+};
+
+VkResult createFrameRing(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize frameSize,
+    uint32_t frameCount,
+    VkBufferUsageFlags usage,
+    struct FrameRing *ring
+);
+
+void cleanupFrameRing(
+    VkDevice device,
+    struct FrameRing *ring
+);
+
+void frameRingBegin(struct FrameRing *ring, uint32_t frame);
+
+// Returns NULL when the frame's region is exhausted.
+// `outOffset` is relative to the start of the whole buffer.
+void *frameRingAlloc(
+    struct FrameRing *ring,
+    VkDeviceSize size,
+    VkDeviceSize alignment,
+    VkDeviceSize *outOffset
+);
+
+#endif // BUFFERS_H
@@ -0,0 +1,633 @@
+#include <vulkan/vulkan.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define CAPTURE_SSE2
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   define CAPTURE_NEON
+#   include <arm_neon.h>
+#endif
+
+#include "defines.h"
+#include "buffers.h"
+#include "capture.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+
+static uint32_t crcTable[256];
+
+static void initCrcTable(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+VkResult createCaptureSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    VkPipelineLayout pipelineLayout,
+    uint32_t slotCount,
+    enum CaptureFormat format,
+    struct CaptureSystem *system
+) {
+    if (slotCount > CAPTURE_MAX_SLOTS) {
+        fprintf(stderr, "Capture: at most %u slots\n", CAPTURE_MAX_SLOTS);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // Before any job can read it
+    initCrcTable();
+
+    *system = (struct CaptureSystem) {
+        .physicalDevice = physicalDevice,
+        .device = device,
+        .bindlessHeap = bindlessHeap,
+        .format = format,
+        .slotCount = slotCount,
+        .writerWorker = jobsWorkerCount() - 1,
+    };
+    for (uint32_t i = 0; i < CAPTURE_MAX_SLOTS; i++) {
+        system->slots[i].bufferIndex = BINDLESS_INVALID_INDEX;
+    }
+
+    // Without the shader the other formats still work
+    system->yuvAvailable = createYuvConverter(device, bindlessHeap, pipelineLayout, &system->yuv) == VK_SUCCESS;
+    if (!system->yuvAvailable) {
+        cleanupYuvConverter(&system->yuv);
+        if (system->format == CAPTURE_FORMAT_Y4M) {
+            fprintf(stderr, "Capture: YUV conversion unavailable, writing PNG\n");
+            system->format = CAPTURE_FORMAT_PNG;
+        }
+    }
+    return VK_SUCCESS;
+}
+
+bool captureSetFormat(struct CaptureSystem *system, enum CaptureFormat format) {
+    if (format == CAPTURE_FORMAT_Y4M && !system->yuvAvailable) return false;
+    system->format = format;
+    return true;
+}
+
+static void finishSlots(struct CaptureSystem *system) {
+    for (uint32_t i = 0; i < system->slotCount; i++) {
+        jobsWait(&system->slots[i].job);
+    }
+}
+
+static void destroySlots(struct CaptureSystem *system) {
+    for (uint32_t i = 0; i < system->slotCount; i++) {
+        struct CaptureSlot *slot = &system->slots[i];
+        if (slot->bufferIndex != BINDLESS_INVALID_INDEX) {
+            bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_STORAGE_BUFFERS, slot->bufferIndex);
+        }
+        if (slot->mapped) vkUnmapMemory(system->device, slot->memory);
+        vkDestroyBuffer(system->device, slot->buffer, hostAllocator());
+        memoryFree(system->device, slot->memory);
+        statsFree(slot->scanlines);
+        *slot = (struct CaptureSlot) { .bufferIndex = BINDLESS_INVALID_INDEX };
+    }
+
+    if (system->imageIndices) {
+        for (uint32_t i = 0; i < system->imageCount; i++) {
+            bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_SAMPLED_IMAGES, system->imageIndices[i]);
+        }
+        statsFree(system->imageIndices);
+        system->imageIndices = NULL;
+    }
+
+    if (system->stream && system->stream != stdout) fclose(system->stream);
+    system->stream = NULL;
+}
+
+void cleanupCaptureSystem(struct CaptureSystem *system) {
+    finishSlots(system);
+    destroySlots(system);
+    if (system->yuvAvailable) cleanupYuvConverter(&system->yuv);
+
+    if (system->dropped > 0) {
+        fprintf(stderr, "Capture: %u frames dropped\n", system->dropped);
+    }
+}
+
+// Reading back through uncached memory is painfully slow, so prefer a cached
+// type and invalidate when it isn't coherent
+static VkResult createReadbackBuffer(
+    const struct CaptureSystem *system,
+    struct CaptureSlot *slot
+) {
+    VkResult result;
+    VkDevice device = system->device;
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = system->frameSize,
+        .usage = system->format == CAPTURE_FORMAT_Y4M
+            ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+            : VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    result = COUNT_VK_CREATE(vkCreateBuffer(device, &bufferInfo, hostAllocator(), &slot->buffer));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create readback buffer");
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, slot->buffer, &memRequirements);
+
+    VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    uint32_t memoryType = findMemoryType(system->physicalDevice, memRequirements.memoryTypeBits, cached | coherent);
+    slot->coherent = memoryType != UINT32_MAX;
+    if (memoryType == UINT32_MAX) {
+        memoryType = findMemoryType(system->physicalDevice, memRequirements.memoryTypeBits, cached);
+    }
+    if (memoryType == UINT32_MAX) {
+        memoryType = findMemoryType(system->physicalDevice, memRequirements.memoryTypeBits, coherent);
+        slot->coherent = true;
+    }
+    if (memoryType == UINT32_MAX) {
+        fprintf(stderr, "No suitable memory type for readback buffer\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = memoryType
+    };
+    result = memoryAllocate(device, &allocInfo, MEMORY_CATEGORY_STAGING, &slot->memory);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate readback memory");
+
+    result = vkBindBufferMemory(device, slot->buffer, slot->memory, 0);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to bind readback memory");
+
+    void *mapped;
+    result = vkMapMemory(device, slot->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to map readback memory");
+    slot->mapped = mapped;
+
+    return VK_SUCCESS;
+}
+
+static VkResult resizeY4m(struct CaptureSystem *system, const struct SwapChain *swapChain) {
+    if (!(swapChain->imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT)) {
+        fprintf(stderr, "Capture: swap chain images can't be sampled\n");
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    bool srgb = swapChain->imageFormat == VK_FORMAT_B8G8R8A8_SRGB
+        || swapChain->imageFormat == VK_FORMAT_R8G8B8A8_SRGB;
+    VkResult result = yuvConverterPrepare(&system->yuv, srgb);
+    if (result != VK_SUCCESS) return result;
+
+    system->imageIndices = statsMalloc(swapChain->imageCount * sizeof(uint32_t));
+    if (!system->imageIndices) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t i = 0; i < swapChain->imageCount; i++) {
+        system->imageIndices[i] = bindlessRegisterImage(
+            system->device,
+            system->bindlessHeap,
+            swapChain->imageViews[i],
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+    }
+    return VK_SUCCESS;
+}
+
+VkResult captureResize(
+    struct CaptureSystem *system,
+    const struct SwapChain *swapChain
+) {
+    finishSlots(system);
+    if (system->stream == stdout) {
+        fflush(stdout);
+        system->stdoutEnded = true;
+        fprintf(stderr, "Capture: the stream on stdout can't change size, it ends here\n");
+    }
+    destroySlots(system);
+    system->frameSize = 0;
+    system->streamStarted = false;
+
+    switch (swapChain->imageFormat) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        system->swizzle = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        system->swizzle = false;
+        break;
+    default:
+        fprintf(stderr, "Capture: unsupported swap chain format %d\n", swapChain->imageFormat);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    VkExtent2D extent = swapChain->extent;
+    system->extent = extent;
+    system->imageCount = swapChain->imageCount;
+    system->images = swapChain->images;
+
+    if (system->format == CAPTURE_FORMAT_Y4M) {
+        VkResult result = resizeY4m(system, swapChain);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to prepare Y4M capture");
+        system->frameSize = yuvLayout(extent).size;
+    } else {
+        system->frameSize = (VkDeviceSize) extent.width * extent.height * 4;
+    }
+
+    size_t scanlineSize = (size_t) extent.height * (1 + (size_t) extent.width * 4);
+    for (uint32_t i = 0; i < system->slotCount; i++) {
+        struct CaptureSlot *slot = &system->slots[i];
+
+        VkResult result = createReadbackBuffer(system, slot);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create capture slot");
+
+        if (system->format == CAPTURE_FORMAT_Y4M) {
+            slot->bufferIndex = bindlessRegisterBuffer(
+                system->device,
+                system->bindlessHeap,
+                slot->buffer,
+                0, system->frameSize
+            );
+            continue;
+        }
+
+        slot->scanlines = statsMalloc(scanlineSize);
+        if (!slot->scanlines) {
+            fprintf(stderr, "Capture: failed to allocate %zu bytes\n", scanlineSize);
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+void captureConvertRow(const uint8_t *src, uint8_t *dst, uint32_t pixels, bool swizzle) {
+    uint32_t i = 0;
+
+#if defined(CAPTURE_SSE2)
+    // Swapping R and B is a 16-bit rotate of the R_B_ byte lanes
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000u);
+    const __m128i redBlue = _mm_set1_epi32(0x00FF00FF);
+    const __m128i green = _mm_set1_epi32(0x0000FF00);
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + i * 4));
+        if (swizzle) {
+            __m128i rb = _mm_and_si128(x, redBlue);
+            rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+            x = _mm_or_si128(_mm_and_si128(x, green), _mm_and_si128(rb, redBlue));
+        }
+        _mm_storeu_si128((__m128i *) (dst + i * 4), _mm_or_si128(x, alpha));
+    }
+#elif defined(CAPTURE_NEON)
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t x = vld4q_u8(src + i * 4);
+        if (swizzle) {
+            uint8x16_t blue = x.val[0];
+            x.val[0] = x.val[2];
+            x.val[2] = blue;
+        }
+        x.val[3] = vdupq_n_u8(0xFF);
+        vst4q_u8(dst + i * 4, x);
+    }
+#endif
+
+    // Swap chains don't promise anything about alpha, captures are opaque
+    for (; i < pixels; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        d[0] = swizzle ? s[2] : s[0];
+        d[1] = s[1];
+        d[2] = swizzle ? s[0] : s[2];
+        d[3] = 0xFF;
+    }
+}
+
+static uint32_t crcUpdate(uint32_t crc, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void writeBigEndian(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t) (value >> 24);
+    out[1] = (uint8_t) (value >> 16);
+    out[2] = (uint8_t) (value >> 8);
+    out[3] = (uint8_t) value;
+}
+
+// Writes `size` bytes and folds them into the chunk's CRC
+static bool writeChunkData(FILE *file, uint32_t *crc, const void *data, size_t size) {
+    *crc = crcUpdate(*crc, data, size);
+    return fwrite(data, 1, size, file) == size;
+}
+
+#define DEFLATE_STORED_MAX 65535
+
+// One IDAT holding a zlib stream of stored deflate blocks. No compression,
+// but it runs at memcpy speed and every decoder reads it.
+static bool writePng(FILE *file, uint32_t width, uint32_t height, const uint8_t *scanlines) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (fwrite(signature, 1, sizeof(signature), file) != sizeof(signature)) return false;
+
+    uint8_t header[4 + 4 + 13];
+    writeBigEndian(header, 13);
+    memcpy(header + 4, "IHDR", 4);
+    writeBigEndian(header + 8, width);
+    writeBigEndian(header + 12, height);
+    header[16] = 8; // bit depth
+    header[17] = 6; // RGBA
+    header[18] = 0; // deflate
+    header[19] = 0; // adaptive filtering, every row uses filter 0
+    header[20] = 0; // no interlace
+
+    uint32_t crc = crcUpdate(0xFFFFFFFFu, header + 4, sizeof(header) - 4);
+    uint8_t crcBytes[4];
+    writeBigEndian(crcBytes, crc ^ 0xFFFFFFFFu);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) return false;
+    if (fwrite(crcBytes, 1, 4, file) != 4) return false;
+
+    size_t rawSize = (size_t) height * (1 + (size_t) width * 4);
+    size_t blockCount = (rawSize + DEFLATE_STORED_MAX - 1) / DEFLATE_STORED_MAX;
+    size_t idatSize = 2 + blockCount * 5 + rawSize + 4;
+    if (idatSize > 0x7FFFFFFFu) return false;
+
+    uint8_t idatHeader[8];
+    writeBigEndian(idatHeader, (uint32_t) idatSize);
+    memcpy(idatHeader + 4, "IDAT", 4);
+    if (fwrite(idatHeader, 1, 4, file) != 4) return false;
+
+    crc = 0xFFFFFFFFu;
+    const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+    if (!writeChunkData(file, &crc, idatHeader + 4, 4)) return false;
+    if (!writeChunkData(file, &crc, zlibHeader, 2)) return false;
+
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < rawSize; offset += DEFLATE_STORED_MAX) {
+        size_t size = rawSize - offset < DEFLATE_STORED_MAX ? rawSize - offset : DEFLATE_STORED_MAX;
+        uint8_t blockHeader[5] = {
+            offset + size == rawSize ? 1 : 0,
+            (uint8_t) size, (uint8_t) (size >> 8),
+            (uint8_t) ~size, (uint8_t) (~size >> 8),
+        };
+        if (!writeChunkData(file, &crc, blockHeader, 5)) return false;
+        if (!writeChunkData(file, &crc, scanlines + offset, size)) return false;
+
+        // Reduced well before the 5552 bytes that could overflow 32 bits
+        for (size_t i = 0; i < size; i++) {
+            adlerA += scanlines[offset + i];
+            adlerB += adlerA;
+            if ((i & 4095) == 4095) {
+                adlerA %= 65521;
+                adlerB %= 65521;
+            }
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+    }
+
+    uint8_t adler[4];
+    writeBigEndian(adler, (adlerB << 16) | adlerA);
+    if (!writeChunkData(file, &crc, adler, 4)) return false;
+
+    writeBigEndian(crcBytes, crc ^ 0xFFFFFFFFu);
+    if (fwrite(crcBytes, 1, 4, file) != 4) return false;
+
+    uint8_t end[12] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 };
+    return fwrite(end, 1, sizeof(end), file) == sizeof(end);
+}
+
+// Copies the planes without their row padding. Frames of one stream arrive in
+// order because they all run on the same worker.
+static void writeY4mJob(void *data, uint32_t index) {
+    UNUSED_INTENTIONAL(index);
+    struct CaptureSlot *slot = data;
+    const struct YuvLayout *layout = &slot->yuv;
+    FILE *file = slot->stream;
+
+    bool ok = true;
+    if (slot->writeHeader) {
+        // The frame rate is nominal, frames are captured as they are presented
+        ok = fprintf(file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n", layout->width, layout->height) > 0;
+    }
+    ok = ok && fputs("FRAME\n", file) >= 0;
+
+    for (uint32_t y = 0; ok && y < layout->height; y++) {
+        const uint8_t *row = slot->mapped + (size_t) y * layout->lumaStride;
+        ok = fwrite(row, 1, layout->width, file) == layout->width;
+    }
+    VkDeviceSize planes[2] = { layout->uOffset, layout->vOffset };
+    for (uint32_t p = 0; p < 2; p++) {
+        for (uint32_t y = 0; ok && y < layout->chromaHeight; y++) {
+            const uint8_t *row = slot->mapped + planes[p] + (size_t) y * layout->chromaStride;
+            ok = fwrite(row, 1, layout->chromaWidth, file) == layout->chromaWidth;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Capture: failed to write frame %u\n", slot->number);
+        slot->failed = true;
+    }
+}
+
+// "capture_NNNNN.y4m" named after its first frame, or stdout when
+// CAPTURE_STREAM is "-" so the frames can be piped into an encoder
+static FILE *openStream(uint32_t number) {
+    const char *target = getenv("CAPTURE_STREAM");
+    if (target && strcmp(target, "-") == 0) {
+#ifdef _WIN32
+        // Text mode would turn every 0x0A byte into CR LF
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return stdout;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "capture_%05u.y4m", number);
+    FILE *file = fopen(path, "wb");
+    if (!file) fprintf(stderr, "Capture: failed to open %s\n", path);
+    return file;
+}
+
+static void writeCaptureJob(void *data, uint32_t index) {
+    UNUSED_INTENTIONAL(index);
+    struct CaptureSlot *slot = data;
+
+    size_t rowSize = (size_t) slot->width * 4;
+    for (uint32_t y = 0; y < slot->height; y++) {
+        uint8_t *row = slot->scanlines + y * (1 + rowSize);
+        row[0] = 0; // PNG filter: none
+        captureConvertRow(slot->mapped + y * rowSize, row + 1, slot->width, slot->swizzle);
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "capture_%05u.%s",
+        slot->number, slot->format == CAPTURE_FORMAT_PNG ? "png" : "rgba");
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Capture: failed to open %s\n", path);
+        slot->failed = true;
+        return;
+    }
+
+    bool ok = true;
+    if (slot->format == CAPTURE_FORMAT_PNG) {
+        ok = writePng(file, slot->width, slot->height, slot->scanlines);
+    } else {
+        for (uint32_t y = 0; ok && y < slot->height; y++) {
+            const uint8_t *row = slot->scanlines + y * (1 + rowSize) + 1;
+            ok = fwrite(row, 1, rowSize, file) == rowSize;
+        }
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) {
+        fprintf(stderr, "Capture: failed to write %s\n", path);
+        slot->failed = true;
+    }
+}
+
+static void invalidateSlot(const struct CaptureSystem *system, const struct CaptureSlot *slot) {
+    if (slot->coherent) return;
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = slot->memory,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+    vkInvalidateMappedMemoryRanges(system->device, 1, &range);
+}
+
+bool captureTake(struct CaptureSystem *system, uint32_t slotIndex, uint8_t *rgba) {
+    struct CaptureSlot *slot = &system->slots[slotIndex];
+    if (slot->state != CAPTURE_SLOT_COPYING || system->format == CAPTURE_FORMAT_Y4M) return false;
+
+    invalidateSlot(system, slot);
+    size_t rowSize = (size_t) system->extent.width * 4;
+    for (uint32_t y = 0; y < system->extent.height; y++) {
+        captureConvertRow(slot->mapped + y * rowSize, rgba + y * rowSize, system->extent.width, system->swizzle);
+    }
+
+    slot->state = CAPTURE_SLOT_IDLE;
+    return true;
+}
+
+bool captureBeginFrame(
+    struct CaptureSystem *system,
+    uint32_t slotIndex,
+    bool capture
+) {
+    struct CaptureSlot *slot = &system->slots[slotIndex];
+
+    if (slot->state == CAPTURE_SLOT_COPYING) {
+        invalidateSlot(system, slot);
+
+        slot->number = system->nextNumber++;
+        slot->width = system->extent.width;
+        slot->height = system->extent.height;
+        slot->swizzle = system->swizzle;
+        slot->format = system->format;
+        slot->failed = false;
+        slot->state = CAPTURE_SLOT_WRITING;
+
+        if (slot->format == CAPTURE_FORMAT_Y4M) {
+            // Opened lazily so the file is named after its first frame
+            slot->writeHeader = !system->streamStarted;
+            if (!system->streamStarted) {
+                system->stream = openStream(slot->number);
+                system->streamStarted = true;
+            }
+            slot->yuv = yuvLayout(system->extent);
+            slot->stream = system->stream;
+        }
+
+        if (slot->format != CAPTURE_FORMAT_Y4M) {
+            jobsRunRange(writeCaptureJob, slot, 1, &slot->job);
+        } else if (slot->stream) {
+            struct JobDecl job = {
+                .function = writeY4mJob,
+                .data = slot,
+                .index = 0,
+                .affinity = system->writerWorker,
+            };
+            jobsRun(&job, 1, &slot->job);
+        }
+
+        // Nobody else would ever pick the job up
+        if (jobsWorkerCount() == 1) jobsWait(&slot->job);
+    }
+
+    if (slot->state == CAPTURE_SLOT_WRITING && jobsDone(&slot->job)) {
+        slot->state = CAPTURE_SLOT_IDLE;
+    }
+
+    if (!capture || system->frameSize == 0) return false;
+    if (system->format == CAPTURE_FORMAT_Y4M && system->stdoutEnded) return false;
+
+    if (slot->state != CAPTURE_SLOT_IDLE) {
+        system->dropped++;
+        return false;
+    }
+
+    slot->state = CAPTURE_SLOT_COPYING;
+    return true;
+}
+
+void captureRecord(
+    const struct CaptureSystem *system,
+    VkCommandBuffer commandBuffer,
+    uint32_t slotIndex,
+    uint32_t imageIndex
+) {
+    const struct CaptureSlot *slot = &system->slots[slotIndex];
+
+    if (system->format == CAPTURE_FORMAT_Y4M) {
+        // One slot per frame in flight, so the slot is also the frame's set
+        yuvRecord(
+            &system->yuv,
+            commandBuffer,
+            bindlessGetSet(system->bindlessHeap, slotIndex),
+            system->imageIndices[imageIndex],
+            slot->bufferIndex,
+            system->extent
+        );
+        return;
+    }
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0, // tightly packed
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { system->extent.width, system->extent.height, 1 },
+    };
+    VKD(vkCmdCopyImageToBuffer)(
+        commandBuffer,
+        system->images[imageIndex],
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        slot->buffer,
+        1, &region
+    );
+}
@@ -0,0 +1,144 @@
+#pragma once
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bindless.h"
+#include "jobs.h"
+#include "swap_chain.h"
+#include "yuv.h"
+
+// Frame capture without stalls. Each frame in flight owns a host-visible
+// readback buffer that the frame copies its swap chain image into. By the
+// time that frame's fence is waited on again the copy is done, so the pixels
+// are handed to a job that swizzles them to RGBA and writes them to disk. A
+// slot whose previous capture is still being written drops the frame.
+//
+// Y4M converts to YUV 4:2:0 on the GPU first, which cuts readback to 1.5
+// bytes per pixel. Those frames are appended to one stream, so their write
+// jobs all go to the same worker, whose mailbox runs them in order.
+
+#define CAPTURE_MAX_SLOTS 4
+
+enum CaptureFormat {
+    CAPTURE_FORMAT_RAW, // tightly packed RGBA8, one file per frame
+    CAPTURE_FORMAT_PNG, // uncompressed deflate, fast to write and still a valid PNG
+    CAPTURE_FORMAT_Y4M, // one capture_NNNNN.y4m stream per capture session
+};
+
+enum CaptureSlotState {
+    CAPTURE_SLOT_IDLE,
+    CAPTURE_SLOT_COPYING, // the copy is recorded in a frame that hasn't retired yet
+    CAPTURE_SLOT_WRITING, // a job owns the buffer
+};
+
+struct CaptureSlot {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    const uint8_t *mapped;
+    bool coherent;
+    uint32_t bufferIndex; // bindless slot, Y4M only
+
+    enum CaptureSlotState state;
+    struct JobCounter job;
+
+    // Copied from the system when the job starts, the job reads nothing else
+    uint32_t number;
+    uint32_t width;
+    uint32_t height;
+    bool swizzle;
+    enum CaptureFormat format;
+    uint8_t *scanlines; // RGBA rows, each preceded by a PNG filter byte
+    struct YuvLayout yuv;
+    FILE *stream;
+    bool writeHeader;
+    bool failed;
+};
+
+struct CaptureSystem {
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    struct BindlessHeap *bindlessHeap;
+    enum CaptureFormat format;
+
+    bool yuvAvailable;
+    struct YuvConverter yuv;
+
+    VkExtent2D extent;
+    bool swizzle; // BGRA swap chain
+    VkDeviceSize frameSize;
+
+    // Borrowed from the swap chain at the last resize
+    uint32_t imageCount;
+    const VkImage *images;
+    uint32_t *imageIndices; // bindless slots of the image views, Y4M only
+
+    FILE *stream;
+    bool streamStarted;
+    bool stdoutEnded; // a pipe only takes one header, Y4M capture stops after a resize
+    uint32_t writerWorker;
+
+    uint32_t slotCount;
+    struct CaptureSlot slots[CAPTURE_MAX_SLOTS];
+
+    uint32_t nextNumber;
+    uint32_t dropped;
+};
+
+// `pipelineLayout` is the bindless layout, used by the YUV conversion
+VkResult createCaptureSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    VkPipelineLayout pipelineLayout,
+    uint32_t slotCount,
+    enum CaptureFormat format,
+    struct CaptureSystem *system
+);
+
+// Waits for pending writes, call after vkDeviceWaitIdle
+void cleanupCaptureSystem(struct CaptureSystem *system);
+
+// False if the format isn't available. Takes effect at the next resize.
+bool captureSetFormat(struct CaptureSystem *system, enum CaptureFormat format);
+
+// (Re)creates the readback buffers, e.g. on swap chain recreation. Pending
+// captures are finished first and an open Y4M stream is closed. Streams
+// to stdout can't restart, so Y4M capture ends there instead.
+VkResult captureResize(
+    struct CaptureSystem *system,
+    const struct SwapChain *swapChain
+);
+
+// Call once the slot's frame fence has been waited on. Hands a finished
+// capture to a job, and returns whether this frame should be captured, which
+// it isn't when not capturing or when the slot is still busy.
+bool captureBeginFrame(
+    struct CaptureSystem *system,
+    uint32_t slot,
+    bool capture
+);
+
+// Instead of handing the slot's finished copy to a write job, converts it to
+// tightly packed RGBA into `rgba` and frees the slot. Call after the slot's
+// frame fence, raw formats only. False if the slot holds no capture.
+bool captureTake(struct CaptureSystem *system, uint32_t slot, uint8_t *rgba);
+
+// The swap chain image is in TRANSFER_SRC_OPTIMAL for the raw formats and in
+// SHADER_READ_ONLY_OPTIMAL for Y4M, which dispatches the YUV conversion
+void captureRecord(
+    const struct CaptureSystem *system,
+    VkCommandBuffer commandBuffer,
+    uint32_t slot,
+    uint32_t imageIndex
+);
+
+// Scalar, SSE2 or NEON depending on the target. `dst` may not alias `src`.
+void captureConvertRow(const uint8_t *src, uint8_t *dst, uint32_t pixels, bool swizzle);
+
+#endif // CAPTURE_H
@@ -4,6 +4,8 @@
 #include "defines.h"
 #include "debug_messenger.h"
 #include "extensions.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
 
 #include <vulkan/vulkan.h>
 
@@ -58,7 +60,7 @@ VkResult createDebugMessenger(
     result = getExtensionFunction(instance, "vkCreateDebugUtilsMessengerEXT", (PFN_vkVoidFunction*) &func);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to load extension function: vkCreateDebugUtilsMessengerEXT");
 
-    result = func(instance, &messengerInfo, NULL, debugMessenger);
+    result = COUNT_VK_CREATE(func(instance, &messengerInfo, hostAllocator(), debugMessenger));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create debug messenger");
 
     fprintf(stderr, "Debug messenger created\n");
@@ -79,7 +81,7 @@ VkResult cleanupDebugMessenger(
     result = getExtensionFunction(instance, "vkDestroyDebugUtilsMessengerEXT", (PFN_vkVoidFunction*) &func);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to load extension function: vkDestroyDebugUtilsMessengerEXT");
 
-    func(instance, *debugMessenger, NULL);
+    func(instance, *debugMessenger, hostAllocator());
 
     fprintf(stderr, "Debug messenger destroyed\n");
     return result;
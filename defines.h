@@ -41,4 +41,14 @@
 #   define alloca _alloca
 #endif
 
+#if defined(_WIN32)
+#   include <malloc.h>
+#   define ALIGNED_ALLOC(alignment, size) _aligned_malloc((size), (alignment))
+#   define ALIGNED_FREE(ptr) _aligned_free(ptr)
+#else
+#   include <stdlib.h>
+#   define ALIGNED_ALLOC(alignment, size) aligned_alloc((alignment), (size))
+#   define ALIGNED_FREE(ptr) free(ptr)
+#endif
+
 #endif // GLOBALS_H
@@ -0,0 +1,59 @@
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "device_dispatch.h"
+
+struct DeviceDispatch deviceDispatch;
+
+#ifdef DEVICE_DISPATCH_COUNT_CALLS
+uint32_t deviceDispatchCalls[DEVICE_FUNCTION_COUNT];
+static uint32_t lastFrameCalls[DEVICE_FUNCTION_COUNT];
+#endif
+
+static const char *functionNames[DEVICE_FUNCTION_COUNT] = {
+#define DEVICE_FUNCTION_NAME(name) [DEVICE_FUNCTION_##name] = #name,
+    DEVICE_FUNCTIONS(DEVICE_FUNCTION_NAME)
+#undef DEVICE_FUNCTION_NAME
+};
+
+VkResult loadDeviceDispatch(VkDevice device) {
+    memset(&deviceDispatch, 0, sizeof(deviceDispatch));
+
+    // Report every missing one before failing
+    uint32_t missing = 0;
+#define DEVICE_FUNCTION_LOAD(name) \
+    deviceDispatch.name = (PFN_##name) vkGetDeviceProcAddr(device, #name); \
+    if (!deviceDispatch.name) { \
+        fprintf(stderr, "Failed to load device function: %s\n", #name); \
+        missing++; \
+    }
+    DEVICE_FUNCTIONS(DEVICE_FUNCTION_LOAD)
+#undef DEVICE_FUNCTION_LOAD
+
+    return missing == 0 ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+}
+
+void dispatchBeginFrame(void) {
+#ifdef DEVICE_DISPATCH_COUNT_CALLS
+    memcpy(lastFrameCalls, deviceDispatchCalls, sizeof(lastFrameCalls));
+    memset(deviceDispatchCalls, 0, sizeof(deviceDispatchCalls));
+#endif
+}
+
+void dispatchReport(FILE *out) {
+#ifdef DEVICE_DISPATCH_COUNT_CALLS
+    uint32_t total = 0;
+    for (uint32_t f = 0; f < DEVICE_FUNCTION_COUNT; f++) total += lastFrameCalls[f];
+    fprintf(out, "Device calls last frame: %u\n", total);
+    for (uint32_t f = 0; f < DEVICE_FUNCTION_COUNT; f++) {
+        if (lastFrameCalls[f] == 0) continue;
+        fprintf(out, "  %-32s %6u\n", functionNames[f], lastFrameCalls[f]);
+    }
+#else
+    (void) functionNames;
+    fprintf(out, "Device calls: build with DEVICE_DISPATCH_COUNT_CALLS to count them\n");
+#endif
+}
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef DEVICE_DISPATCH_H
+#define DEVICE_DISPATCH_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Device functions loaded straight from the driver with vkGetDeviceProcAddr,
+// which skips the loader's trampoline and its dispatch through the handle on
+// every call. Hot paths call through VKD(vkCmdDraw)(...); setup code can keep
+// using the exported functions.
+//
+// With DEVICE_DISPATCH_COUNT_CALLS defined, VKD also counts calls per entry
+// point, closed per frame by dispatchBeginFrame. Counting is main thread only.
+
+// Every device-level function the renderer uses
+#define DEVICE_FUNCTIONS(X) \
+    X(vkAcquireNextImageKHR) \
+    X(vkAllocateCommandBuffers) \
+    X(vkAllocateDescriptorSets) \
+    X(vkAllocateMemory) \
+    X(vkBeginCommandBuffer) \
+    X(vkBindBufferMemory) \
+    X(vkBindImageMemory) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdBindIndexBuffer) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdCopyBufferToImage) \
+    X(vkCmdCopyImage) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdDispatch) \
+    X(vkCmdDispatchIndirect) \
+    X(vkCmdDraw) \
+    X(vkCmdDrawIndexed) \
+    X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndirect) \
+    X(vkCmdEndQuery) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdFillBuffer) \
+    X(vkCmdNextSubpass) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdPushConstants) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdSetScissor) \
+    X(vkCmdSetViewport) \
+    X(vkCreateBuffer) \
+    X(vkCreateCommandPool) \
+    X(vkCreateComputePipelines) \
+    X(vkCreateDescriptorPool) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkCreateFence) \
+    X(vkCreateFramebuffer) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkCreateImage) \
+    X(vkCreateImageView) \
+    X(vkCreatePipelineCache) \
+    X(vkCreatePipelineLayout) \
+    X(vkCreateQueryPool) \
+    X(vkCreateRenderPass) \
+    X(vkCreateSampler) \
+    X(vkCreateSemaphore) \
+    X(vkCreateShaderModule) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroyBuffer) \
+    X(vkDestroyCommandPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkDestroyDevice) \
+    X(vkDestroyFence) \
+    X(vkDestroyFramebuffer) \
+    X(vkDestroyImage) \
+    X(vkDestroyImageView) \
+    X(vkDestroyPipeline) \
+    X(vkDestroyPipelineCache) \
+    X(vkDestroyPipelineLayout) \
+    X(vkDestroyQueryPool) \
+    X(vkDestroyRenderPass) \
+    X(vkDestroySampler) \
+    X(vkDestroySemaphore) \
+    X(vkDestroyShaderModule) \
+    X(vkDestroySwapchainKHR) \
+    X(vkDeviceWaitIdle) \
+    X(vkEndCommandBuffer) \
+    X(vkFreeCommandBuffers) \
+    X(vkFreeMemory) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkGetDeviceQueue) \
+    X(vkGetFenceStatus) \
+    X(vkGetImageMemoryRequirements) \
+    X(vkGetQueryPoolResults) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkInvalidateMappedMemoryRanges) \
+    X(vkMapMemory) \
+    X(vkQueuePresentKHR) \
+    X(vkQueueSubmit) \
+    X(vkResetCommandBuffer) \
+    X(vkResetFences) \
+    X(vkUnmapMemory) \
+    X(vkUpdateDescriptorSets) \
+    X(vkWaitForFences)
+
+enum DeviceFunction {
+#define DEVICE_FUNCTION_ENUM(name) DEVICE_FUNCTION_##name,
+    DEVICE_FUNCTIONS(DEVICE_FUNCTION_ENUM)
+#undef DEVICE_FUNCTION_ENUM
+    DEVICE_FUNCTION_COUNT
+};
+
+struct DeviceDispatch {
+#define DEVICE_FUNCTION_MEMBER(name) PFN_##name name;
+    DEVICE_FUNCTIONS(DEVICE_FUNCTION_MEMBER)
+#undef DEVICE_FUNCTION_MEMBER
+};
+
+extern struct DeviceDispatch deviceDispatch;
+
+#ifdef DEVICE_DISPATCH_COUNT_CALLS
+extern uint32_t deviceDispatchCalls[DEVICE_FUNCTION_COUNT];
+#   define VKD(name) (deviceDispatchCalls[DEVICE_FUNCTION_##name]++, deviceDispatch.name)
+#else
+#   define VKD(name) (deviceDispatch.name)
+#endif
+
+// Call right after vkCreateDevice. Fails if the driver is missing any entry
+// point, which means an extension in the list wasn't enabled.
+VkResult loadDeviceDispatch(VkDevice device);
+
+void dispatchBeginFrame(void);
+
+// Last frame's calls per entry point, nothing without DEVICE_DISPATCH_COUNT_CALLS
+void dispatchReport(FILE *out);
+
+#endif // DEVICE_DISPATCH_H
@@ -0,0 +1,246 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defines.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+
+struct MemoryAllocation {
+    VkDeviceMemory memory; // VK_NULL_HANDLE for an empty entry
+    VkDeviceSize size;
+    uint32_t heap;
+    enum MemoryCategory category;
+};
+
+static struct {
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceMemoryProperties properties;
+    bool budgetExtension;
+    uint32_t framesUntilRefresh;
+
+    struct MemoryHeapStats heaps[VK_MAX_MEMORY_HEAPS];
+
+    uint32_t allocationCount;
+    struct MemoryAllocation allocations[MEMORY_MAX_ALLOCATIONS];
+} memory;
+
+static const char *categoryNames[MEMORY_CATEGORY_COUNT] = {
+    [MEMORY_CATEGORY_BUFFER] = "buffers",
+    [MEMORY_CATEGORY_IMAGE] = "images",
+    [MEMORY_CATEGORY_STAGING] = "staging",
+};
+
+bool queryMemoryBudgetSupport(VkPhysicalDevice physicalDevice) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
+
+    VkExtensionProperties *extensions = ARENA_ARRAY(frameArena(), VkExtensionProperties, extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions);
+
+    bool supported = false;
+    for (uint32_t i = 0; i < extensionCount && !supported; i++) {
+        supported = strcmp(extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    }
+    return supported;
+}
+
+static VkDeviceSize trackedTotal(const struct MemoryHeapStats *heap) {
+    VkDeviceSize total = 0;
+    for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++) total += heap->tracked[c];
+    return total;
+}
+
+static void refreshBudget(void) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceMemoryProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budget,
+    };
+    if (memory.budgetExtension) {
+        vkGetPhysicalDeviceMemoryProperties2(memory.physicalDevice, &properties);
+    }
+
+    for (uint32_t h = 0; h < memory.properties.memoryHeapCount; h++) {
+        struct MemoryHeapStats *heap = &memory.heaps[h];
+        heap->trackedAtRefresh = trackedTotal(heap);
+        if (memory.budgetExtension) {
+            heap->budget = budget.heapBudget[h];
+            heap->usage = budget.heapUsage[h];
+        } else {
+            heap->budget = heap->size / 100 * MEMORY_FALLBACK_BUDGET_PERCENT;
+            heap->usage = heap->trackedAtRefresh;
+        }
+    }
+    memory.framesUntilRefresh = MEMORY_BUDGET_REFRESH_FRAMES;
+}
+
+void memoryInit(VkPhysicalDevice physicalDevice, bool budgetExtension) {
+    memory.physicalDevice = physicalDevice;
+    memory.budgetExtension = budgetExtension;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memory.properties);
+
+    for (uint32_t h = 0; h < memory.properties.memoryHeapCount; h++) {
+        memory.heaps[h] = (struct MemoryHeapStats) {
+            .size = memory.properties.memoryHeaps[h].size,
+        };
+    }
+    refreshBudget();
+
+    fprintf(stderr, "Memory: %u heaps, budget from %s\n",
+        memory.properties.memoryHeapCount,
+        budgetExtension ? "VK_EXT_memory_budget" : "heap sizes");
+}
+
+const VkPhysicalDeviceMemoryProperties *memoryProperties(void) {
+    return &memory.properties;
+}
+
+// Driver usage moves between refreshes only through our own allocations
+static VkDeviceSize currentUsage(const struct MemoryHeapStats *heap) {
+    VkDeviceSize tracked = trackedTotal(heap);
+    if (tracked >= heap->trackedAtRefresh) return heap->usage + (tracked - heap->trackedAtRefresh);
+    VkDeviceSize freed = heap->trackedAtRefresh - tracked;
+    return heap->usage > freed ? heap->usage - freed : 0;
+}
+
+static uint32_t slotFor(VkDeviceMemory handle) {
+    uint64_t h = (uint64_t) (uintptr_t) handle;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return (uint32_t) h & (MEMORY_MAX_ALLOCATIONS - 1);
+}
+
+static void checkBudget(uint32_t h) {
+    struct MemoryHeapStats *heap = &memory.heaps[h];
+    VkDeviceSize usage = currentUsage(heap);
+    bool over = usage > heap->budget / 100 * MEMORY_WARN_PERCENT;
+    if (over && !heap->warned) {
+        fprintf(stderr, "Memory: heap %u at %llu of %llu MiB budget\n", h,
+            (unsigned long long) (usage >> 20), (unsigned long long) (heap->budget >> 20));
+    }
+    heap->warned = over;
+}
+
+VkResult memoryAllocate(
+    VkDevice device,
+    const VkMemoryAllocateInfo *allocInfo,
+    enum MemoryCategory category,
+    VkDeviceMemory *outMemory
+) {
+    // The table only stays fast while it's mostly empty
+    if (memory.allocationCount >= MEMORY_MAX_ALLOCATIONS * 3 / 4) {
+        fprintf(stderr, "Memory: more than %u live allocations\n", MEMORY_MAX_ALLOCATIONS * 3 / 4);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkResult result = COUNT_VK_CREATE(vkAllocateMemory(device, allocInfo, hostAllocator(), outMemory));
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "Memory: failed to allocate %llu bytes of %s\n",
+            (unsigned long long) allocInfo->allocationSize, categoryNames[category]);
+        return result;
+    }
+
+    uint32_t heapIndex = memory.properties.memoryTypes[allocInfo->memoryTypeIndex].heapIndex;
+    uint32_t slot = slotFor(*outMemory);
+    while (memory.allocations[slot].memory != VK_NULL_HANDLE) {
+        slot = (slot + 1) & (MEMORY_MAX_ALLOCATIONS - 1);
+    }
+    memory.allocations[slot] = (struct MemoryAllocation) {
+        .memory = *outMemory,
+        .size = allocInfo->allocationSize,
+        .heap = heapIndex,
+        .category = category,
+    };
+    memory.allocationCount++;
+
+    struct MemoryHeapStats *heap = &memory.heaps[heapIndex];
+    heap->tracked[category] += allocInfo->allocationSize;
+    heap->allocations++;
+    checkBudget(heapIndex);
+    return VK_SUCCESS;
+}
+
+void memoryFree(VkDevice device, VkDeviceMemory handle) {
+    if (handle == VK_NULL_HANDLE) return;
+    vkFreeMemory(device, handle, hostAllocator());
+
+    uint32_t slot = slotFor(handle);
+    while (memory.allocations[slot].memory != handle) {
+        // Not allocated through memoryAllocate
+        if (memory.allocations[slot].memory == VK_NULL_HANDLE) return;
+        slot = (slot + 1) & (MEMORY_MAX_ALLOCATIONS - 1);
+    }
+
+    const struct MemoryAllocation *allocation = &memory.allocations[slot];
+    struct MemoryHeapStats *heap = &memory.heaps[allocation->heap];
+    heap->tracked[allocation->category] -= allocation->size;
+    heap->allocations--;
+    memory.allocationCount--;
+
+    // Backward shift deletion, so probes never need tombstones
+    uint32_t hole = slot;
+    uint32_t next = (hole + 1) & (MEMORY_MAX_ALLOCATIONS - 1);
+    while (memory.allocations[next].memory != VK_NULL_HANDLE) {
+        uint32_t home = slotFor(memory.allocations[next].memory);
+        uint32_t distanceToHole = (hole - home) & (MEMORY_MAX_ALLOCATIONS - 1);
+        uint32_t distanceToNext = (next - home) & (MEMORY_MAX_ALLOCATIONS - 1);
+        if (distanceToHole < distanceToNext) {
+            memory.allocations[hole] = memory.allocations[next];
+            hole = next;
+        }
+        next = (next + 1) & (MEMORY_MAX_ALLOCATIONS - 1);
+    }
+    memory.allocations[hole] = (struct MemoryAllocation) { 0 };
+}
+
+void memoryBeginFrame(void) {
+    if (--memory.framesUntilRefresh > 0) return;
+    refreshBudget();
+    for (uint32_t h = 0; h < memory.properties.memoryHeapCount; h++) checkBudget(h);
+}
+
+VkDeviceSize memoryHeadroom(VkMemoryPropertyFlags properties) {
+    for (uint32_t i = 0; i < memory.properties.memoryTypeCount; i++) {
+        if ((memory.properties.memoryTypes[i].propertyFlags & properties) != properties) continue;
+
+        const struct MemoryHeapStats *heap = &memory.heaps[memory.properties.memoryTypes[i].heapIndex];
+        VkDeviceSize limit = heap->budget / 100 * MEMORY_WARN_PERCENT;
+        VkDeviceSize usage = currentUsage(heap);
+        return usage < limit ? limit - usage : 0;
+    }
+    return 0;
+}
+
+const struct MemoryHeapStats *memoryHeapStats(uint32_t heap) {
+    assert(heap < memory.properties.memoryHeapCount);
+    return &memory.heaps[heap];
+}
+
+void memoryReport(FILE *out) {
+    refreshBudget();
+
+    fprintf(out, "Memory: %u live allocations\n", memory.allocationCount);
+    for (uint32_t h = 0; h < memory.properties.memoryHeapCount; h++) {
+        const struct MemoryHeapStats *heap = &memory.heaps[h];
+        bool deviceLocal = memory.properties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        fprintf(out, "  heap %u%s: %8.1f MiB used of %8.1f MiB budget, %8.1f MiB size\n",
+            h, deviceLocal ? " (device local)" : "",
+            (double) currentUsage(heap) / (1 << 20),
+            (double) heap->budget / (1 << 20),
+            (double) heap->size / (1 << 20));
+        fprintf(out, "    ours: %u allocations", heap->allocations);
+        for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            fprintf(out, ", %s %.1f MiB", categoryNames[c], (double) heap->tracked[c] / (1 << 20));
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef DEVICE_MEMORY_H
+#define DEVICE_MEMORY_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Device memory accounting. The memory properties are queried once, every
+// allocation made through memoryAllocate is tracked per heap and category,
+// and with VK_EXT_memory_budget the driver's own usage and budget are read
+// back every few frames. Main thread only, like resource creation.
+
+#define MEMORY_MAX_ALLOCATIONS 4096      // power of two
+#define MEMORY_BUDGET_REFRESH_FRAMES 60
+#define MEMORY_WARN_PERCENT 90           // of the budget, also the limit headroom is measured against
+#define MEMORY_FALLBACK_BUDGET_PERCENT 80 // of the heap size without the extension
+
+enum MemoryCategory {
+    MEMORY_CATEGORY_BUFFER,
+    MEMORY_CATEGORY_IMAGE,
+    MEMORY_CATEGORY_STAGING, // host-visible upload and readback
+    MEMORY_CATEGORY_COUNT
+};
+
+struct MemoryHeapStats {
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    VkDeviceSize usage;          // the driver's, or what we tracked without the extension
+    VkDeviceSize trackedAtRefresh;
+    VkDeviceSize tracked[MEMORY_CATEGORY_COUNT];
+    uint32_t allocations;
+    bool warned;
+};
+
+bool queryMemoryBudgetSupport(VkPhysicalDevice physicalDevice);
+
+// `budgetExtension` says whether VK_EXT_memory_budget was enabled on the device
+void memoryInit(VkPhysicalDevice physicalDevice, bool budgetExtension);
+
+const VkPhysicalDeviceMemoryProperties *memoryProperties(void);
+
+VkResult memoryAllocate(
+    VkDevice device,
+    const VkMemoryAllocateInfo *allocInfo,
+    enum MemoryCategory category,
+    VkDeviceMemory *outMemory
+);
+
+// Accepts VK_NULL_HANDLE like vkFreeMemory
+void memoryFree(VkDevice device, VkDeviceMemory memory);
+
+// Refreshes the budget every MEMORY_BUDGET_REFRESH_FRAMES and warns once per
+// heap that goes past MEMORY_WARN_PERCENT of it
+void memoryBeginFrame(void);
+
+// How much more the heap behind the first memory type with `properties` can
+// take before it reaches MEMORY_WARN_PERCENT of its budget
+VkDeviceSize memoryHeadroom(VkMemoryPropertyFlags properties);
+
+const struct MemoryHeapStats *memoryHeapStats(uint32_t heap);
+
+void memoryReport(FILE *out);
+
+#endif // DEVICE_MEMORY_H
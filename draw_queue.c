@@ -0,0 +1,175 @@
+#include <vulkan/vulkan.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bindless.h"
+#include "device_dispatch.h"
+#include "draw_queue.h"
+#include "frame_stats.h"
+#include "radix_sort.h"
+
+bool createDrawQueue(uint32_t capacity, struct DrawQueue *queue) {
+    memset(queue, 0, sizeof(*queue));
+    queue->capacity = capacity;
+
+    queue->packets = statsMalloc((size_t) capacity * sizeof(struct DrawPacket));
+    queue->keys = statsMalloc((size_t) capacity * sizeof(struct RadixItem));
+    queue->scratch = statsMalloc((size_t) capacity * sizeof(struct RadixItem));
+    if (!queue->packets || !queue->keys || !queue->scratch) {
+        cleanupDrawQueue(queue);
+        return false;
+    }
+    return true;
+}
+
+void cleanupDrawQueue(struct DrawQueue *queue) {
+    statsFree(queue->packets);
+    statsFree(queue->keys);
+    statsFree(queue->scratch);
+    memset(queue, 0, sizeof(*queue));
+}
+
+// Top bits of a multiplicative hash of the handle's bits
+static uint64_t hashHandle(const void *handle, size_t size, uint32_t bits) {
+    uint64_t value = 0;
+    memcpy(&value, handle, size < sizeof(value) ? size : sizeof(value));
+    return (value * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+}
+
+uint64_t drawPacketKey(uint8_t layer, VkPipeline pipeline, VkBuffer vertexBuffer, float depth) {
+    float clamped = depth < 0.0f ? 0.0f : depth > 1.0f ? 1.0f : depth;
+    uint64_t depthBits = (uint64_t) (clamped * 65535.0f);
+
+    return (uint64_t) layer << DRAW_KEY_LAYER_SHIFT
+        | hashHandle(&pipeline, sizeof(pipeline), 20) << DRAW_KEY_PIPELINE_SHIFT
+        | hashHandle(&vertexBuffer, sizeof(vertexBuffer), 20) << DRAW_KEY_VERTEX_BUFFER_SHIFT
+        | depthBits << DRAW_KEY_DEPTH_SHIFT;
+}
+
+void drawQueueBegin(struct DrawQueue *queue) {
+    queue->lastFrame = queue->stats;
+    queue->stats = (struct DrawQueueStats) { 0 };
+    atomic_store_explicit(&queue->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->dropped, 0, memory_order_relaxed);
+}
+
+bool drawQueuePush(struct DrawQueue *queue, const struct DrawPacket *packet) {
+    uint32_t index = atomic_fetch_add_explicit(&queue->count, 1, memory_order_relaxed);
+    if (index >= queue->capacity) {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    queue->packets[index] = *packet;
+    queue->keys[index] = (struct RadixItem) { .key = packet->key, .value = index };
+    return true;
+}
+
+void drawQueueSort(struct DrawQueue *queue) {
+    // Pushes past the end bumped the count without writing anything
+    uint32_t count = atomic_load_explicit(&queue->count, memory_order_acquire);
+    if (count > queue->capacity) count = queue->capacity;
+    atomic_store_explicit(&queue->count, count, memory_order_relaxed);
+
+    radixSortParallel(queue->keys, queue->scratch, count);
+
+    queue->stats.packets = count;
+    queue->stats.dropped = atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+}
+
+// First sorted position whose key is at least `key`
+static uint32_t lowerBound(const struct RadixItem *keys, uint32_t count, uint64_t key) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (keys[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void drawQueueRecord(
+    struct DrawQueue *queue,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    uint8_t layer
+) {
+    uint32_t count = atomic_load_explicit(&queue->count, memory_order_relaxed);
+    uint32_t begin = lowerBound(queue->keys, count, (uint64_t) layer << DRAW_KEY_LAYER_SHIFT);
+    uint32_t end = layer == UINT8_MAX
+        ? count
+        : lowerBound(queue->keys, count, (uint64_t) (layer + 1) << DRAW_KEY_LAYER_SHIFT);
+
+    VkPushConstantRange pushConstantRange = bindlessPushConstantRange();
+    struct DrawQueueStats *stats = &queue->stats;
+    queue->boundPipeline = VK_NULL_HANDLE;
+    queue->boundVertexBuffer = VK_NULL_HANDLE;
+    queue->boundVertexOffset = 0;
+    queue->pushed = false;
+
+    for (uint32_t i = begin; i < end; i++) {
+        const struct DrawPacket *packet = &queue->packets[queue->keys[i].value];
+
+        if (packet->pipeline != queue->boundPipeline) {
+            VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet->pipeline);
+            queue->boundPipeline = packet->pipeline;
+            stats->pipelineBinds++;
+        }
+
+        if (packet->vertexBuffer != queue->boundVertexBuffer || packet->vertexOffset != queue->boundVertexOffset) {
+            VKD(vkCmdBindVertexBuffers)(commandBuffer, 0, 1, &packet->vertexBuffer, &packet->vertexOffset);
+            queue->boundVertexBuffer = packet->vertexBuffer;
+            queue->boundVertexOffset = packet->vertexOffset;
+            stats->vertexBufferBinds++;
+        }
+
+        if (!queue->pushed || memcmp(&packet->pushConstants, &queue->boundPushConstants, sizeof(packet->pushConstants)) != 0) {
+            VKD(vkCmdPushConstants)(
+                commandBuffer,
+                layout,
+                pushConstantRange.stageFlags,
+                0, sizeof(packet->pushConstants),
+                &packet->pushConstants
+            );
+            queue->boundPushConstants = packet->pushConstants;
+            queue->pushed = true;
+            stats->pushConstantUpdates++;
+        }
+
+        VKD(vkCmdDraw)(
+            commandBuffer,
+            packet->vertexCount,
+            packet->instanceCount,
+            packet->firstVertex,
+            packet->firstInstance
+        );
+        stats->draws++;
+    }
+
+    // Every draw would otherwise set its pipeline, vertex buffer and constants
+    uint32_t issued = stats->pipelineBinds + stats->vertexBufferBinds + stats->pushConstantUpdates;
+    stats->redundantBinds = stats->draws * 3 - issued;
+}
+
+void drawQueueReport(const struct DrawQueue *queue, FILE *out) {
+    const struct DrawQueueStats *stats = &queue->lastFrame;
+    fprintf(
+        out,
+        "Draw queue last frame: %u packets, %u draws, %u pipeline binds, %u vertex buffer binds, "
+        "%u push constant updates, %u redundant binds skipped",
+        stats->packets,
+        stats->draws,
+        stats->pipelineBinds,
+        stats->vertexBufferBinds,
+        stats->pushConstantUpdates,
+        stats->redundantBinds
+    );
+    if (stats->dropped > 0) fprintf(out, ", %u dropped", stats->dropped);
+    fprintf(out, "\n");
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef DRAW_QUEUE_H
+#define DRAW_QUEUE_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bindless.h"
+#include "radix_sort.h"
+
+// Draw packets collected from any thread during the frame, sorted by a packed
+// key and recorded with only the binds that differ from the previous packet.
+// Packets with equal keys draw in push order, which is unspecified between
+// threads.
+
+#define DRAW_QUEUE_DEFAULT_CAPACITY (1u << 16)
+
+// Key layout, most significant first. The layer splits packets between
+// subpasses; within one, packets sharing a pipeline and then a vertex buffer
+// end up next to each other, front to back.
+#define DRAW_KEY_LAYER_SHIFT 56         // 8 bits
+#define DRAW_KEY_PIPELINE_SHIFT 36      // 20 bits, hashed handle
+#define DRAW_KEY_VERTEX_BUFFER_SHIFT 16 // 20 bits, hashed handle
+#define DRAW_KEY_DEPTH_SHIFT 0          // 16 bits
+
+struct DrawPacket {
+    uint64_t key; // drawPacketKey
+    VkPipeline pipeline;
+    VkBuffer vertexBuffer;
+    VkDeviceSize vertexOffset;
+    struct BindlessPushConstants pushConstants;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+};
+
+struct DrawQueueStats {
+    uint32_t packets;
+    uint32_t draws;
+    uint32_t pipelineBinds;
+    uint32_t vertexBufferBinds;
+    uint32_t pushConstantUpdates;
+    uint32_t redundantBinds; // skipped, against binding everything per draw
+    uint32_t dropped;        // pushed into a full queue
+};
+
+struct DrawQueue {
+    uint32_t capacity;
+    atomic_uint count;
+    atomic_uint dropped;
+    struct DrawPacket *packets;
+    struct RadixItem *keys;
+    struct RadixItem *scratch;
+
+    // What the command buffer has bound, as of the last recorded packet of
+    // the current drawQueueRecord
+    VkPipeline boundPipeline;
+    VkBuffer boundVertexBuffer;
+    VkDeviceSize boundVertexOffset;
+    bool pushed;
+    struct BindlessPushConstants boundPushConstants;
+
+    struct DrawQueueStats stats;
+    struct DrawQueueStats lastFrame;
+};
+
+bool createDrawQueue(uint32_t capacity, struct DrawQueue *queue);
+void cleanupDrawQueue(struct DrawQueue *queue);
+
+// Pipeline and vertex buffer are hashed, so two of them can share a bucket.
+// That only costs a bind, a collision never changes what gets drawn.
+uint64_t drawPacketKey(uint8_t layer, VkPipeline pipeline, VkBuffer vertexBuffer, float depth);
+
+// Main thread, before anything is pushed for the frame
+void drawQueueBegin(struct DrawQueue *queue);
+
+// Any thread. Returns false when the queue is full.
+bool drawQueuePush(struct DrawQueue *queue, const struct DrawPacket *packet);
+
+// Main thread, once every push has finished and before recording
+void drawQueueSort(struct DrawQueue *queue);
+
+// Records the packets of one layer, inside the render pass with the bindless
+// set bound. No binds carry over between calls, since calls are usually in
+// different subpasses or windows with other draws recorded between them.
+void drawQueueRecord(
+    struct DrawQueue *queue,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    uint8_t layer
+);
+
+// Last frame's packets, draws and the binds they needed
+void drawQueueReport(const struct DrawQueue *queue, FILE *out);
+
+#endif // DRAW_QUEUE_H
@@ -0,0 +1,43 @@
+# Writes OUTPUT, a C file with every SPIR-V module in SPIRV_DIR named in
+# SHADERS (comma separated) as a uint32_t array, and the table
+# embedded_shaders.h declares. Run by the build with cmake -P.
+#
+# SPIR-V is a stream of words, glslc writes them little-endian. They're
+# emitted as word literals, so the arrays are right on any host and have
+# the 4 byte alignment vkCreateShaderModule wants for pCode.
+
+string(REPLACE "," ";" SHADERS "${SHADERS}")
+
+set(arrays "")
+set(entries "")
+foreach (name IN LISTS SHADERS)
+    file(READ "${SPIRV_DIR}/${name}.spv" hex HEX)
+    string(LENGTH "${hex}" length)
+    math(EXPR remainder "${length} % 8")
+    if (length EQUAL 0 OR NOT remainder EQUAL 0)
+        message(FATAL_ERROR "${SPIRV_DIR}/${name}.spv is not a whole number of words")
+    endif ()
+
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " words "${hex}")
+    # Eight words a line; CMake regexes have no counted repeats
+    set(word "0x[0-9a-f]+, ")
+    string(REGEX REPLACE "(${word}${word}${word}${word}${word}${word}${word}${word})" "\\1\n    " words "${words}")
+    string(REGEX REPLACE " +\n" "\n" words "${words}")
+    string(STRIP "${words}" words)
+
+    string(MAKE_C_IDENTIFIER "${name}Spirv" identifier)
+    string(APPEND arrays "static const uint32_t ${identifier}[] = {\n    ${words}\n};\n\n")
+    string(APPEND entries "    { \"shaders/${name}.spv\", ${identifier}, sizeof(${identifier}) },\n")
+endforeach ()
+
+list(LENGTH SHADERS count)
+set(source "// Generated by embed_shaders.cmake, do not edit\n\n")
+string(APPEND source "#include \"embedded_shaders.h\"\n\n")
+string(APPEND source "${arrays}")
+string(APPEND source "const struct EmbeddedShader embeddedShaders[] = {\n${entries}};\n\n")
+string(APPEND source "const uint32_t embeddedShaderCount = ${count};\n")
+
+# Left alone when nothing changed, so it isn't recompiled
+file(WRITE "${OUTPUT}.tmp" "${source}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
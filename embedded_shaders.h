@@ -0,0 +1,23 @@
+#pragma once
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SPIR-V compiled with glslc, optimized with spirv-opt -O and linked into
+// the executable by the build when EMBED_SHADERS is on, see CMakeLists.txt
+// and embed_shaders.cmake. Entries are keyed by the path the module would
+// be loaded from, e.g. "shaders/vert.spv", which loadShaderModule looks up
+// before touching the file system.
+
+struct EmbeddedShader {
+    const char *path;
+    const uint32_t *code;
+    size_t size; // in bytes
+};
+
+extern const struct EmbeddedShader embeddedShaders[];
+extern const uint32_t embeddedShaderCount;
+
+#endif // EMBEDDED_SHADERS_H
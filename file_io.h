@@ -13,10 +13,23 @@ size_t file_size(FILE *file);
 int read_all_bytes(FILE *file, char *buffer, size_t bytes);
 const char *read_entire_file(const char *filename, size_t *size);
 
+// Read-only mapping of the whole file, released with unmap_file
+const void *map_entire_file(const char *filename, size_t *size);
+void unmap_file(const void *data, size_t size);
+
 #endif // FILE_IO_H
 
 #ifdef FILE_IO_IMPLEMENTATION
 
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
 size_t file_size(FILE *file) {
 	struct stat file_stat;
 	if (fstat(fileno(file), &file_stat) != 0) return 0;
@@ -62,4 +75,70 @@ const char *read_entire_file(const char *filename, size_t *bytes_read) {
 	return buffer;
 }
 
+const void *map_entire_file(const char *filename, size_t *size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error opening file %s\n", filename);
+		return NULL;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) {
+		fprintf(stderr, "Error mapping file %s\n", filename);
+		return NULL;
+	}
+
+	const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!data) {
+		fprintf(stderr, "Error mapping file %s\n", filename);
+		return NULL;
+	}
+
+	if (size) *size = (size_t) file_size.QuadPart;
+	return data;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error opening file %s\n", filename);
+		return NULL;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping keeps its own reference to the file
+	void *data = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Error mapping file %s\n", filename);
+		return NULL;
+	}
+
+	if (size) *size = (size_t) file_stat.st_size;
+	return data;
+#endif
+}
+
+void unmap_file(const void *data, size_t size) {
+	if (!data) return;
+#ifdef _WIN32
+	(void) size;
+	UnmapViewOfFile(data);
+#else
+	munmap((void *) data, size);
+#endif
+}
+
 #endif // FILE_IO_IMPLEMENTATION
@@ -0,0 +1,115 @@
+#include <vulkan/vulkan.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+
+static struct {
+    atomic_ullong counters[FRAME_COUNTER_COUNT];
+    struct FrameStats frameStart;
+    struct FrameStats lastFrame;
+    uint64_t frames;
+} stats;
+
+static const char *counterNames[FRAME_COUNTER_COUNT] = {
+    [FRAME_COUNTER_HEAP_ALLOCATIONS] = "heap allocations",
+    [FRAME_COUNTER_HEAP_FREES] = "heap frees",
+    [FRAME_COUNTER_HEAP_BYTES] = "heap bytes",
+    [FRAME_COUNTER_VK_CREATES] = "vulkan creates",
+    [FRAME_COUNTER_DRIVER_ALLOCATIONS] = "driver allocations",
+};
+
+void frameStatsCount(enum FrameCounter counter, uint64_t amount) {
+    atomic_fetch_add_explicit(&stats.counters[counter], amount, memory_order_relaxed);
+}
+
+static void countAllocation(size_t size) {
+    frameStatsCount(FRAME_COUNTER_HEAP_ALLOCATIONS, 1);
+    frameStatsCount(FRAME_COUNTER_HEAP_BYTES, size);
+}
+
+void *statsMalloc(size_t size) {
+    countAllocation(size);
+    return malloc(size);
+}
+
+void *statsCalloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return calloc(count, size);
+}
+
+void *statsRealloc(void *memory, size_t size) {
+    countAllocation(size);
+    return realloc(memory, size);
+}
+
+void statsFree(void *memory) {
+    if (!memory) return;
+    frameStatsCount(FRAME_COUNTER_HEAP_FREES, 1);
+    free(memory);
+}
+
+void *statsAlignedAlloc(size_t alignment, size_t size) {
+    countAllocation(size);
+    return ALIGNED_ALLOC(alignment, size);
+}
+
+void statsAlignedFree(void *memory) {
+    if (!memory) return;
+    frameStatsCount(FRAME_COUNTER_HEAP_FREES, 1);
+    ALIGNED_FREE(memory);
+}
+
+struct FrameStats frameStatsTotal(void) {
+    struct FrameStats total = { 0 };
+    for (uint32_t c = 0; c < FRAME_COUNTER_COUNT; c++) {
+        total.counters[c] = atomic_load_explicit(&stats.counters[c], memory_order_relaxed);
+    }
+
+    // The host allocator already counts these, no need for a second hook
+    for (uint32_t s = 0; s < HOST_ALLOCATOR_SCOPE_COUNT; s++) {
+        total.counters[FRAME_COUNTER_DRIVER_ALLOCATIONS] +=
+            hostAllocatorStats((VkSystemAllocationScope) s).allocations;
+    }
+    return total;
+}
+
+void frameStatsBeginFrame(void) {
+    struct FrameStats now = frameStatsTotal();
+    if (stats.frames > 0) {
+        for (uint32_t c = 0; c < FRAME_COUNTER_COUNT; c++) {
+            stats.lastFrame.counters[c] = now.counters[c] - stats.frameStart.counters[c];
+        }
+    }
+    stats.frameStart = now;
+    stats.frames++;
+}
+
+const struct FrameStats *frameStatsLastFrame(void) {
+    return &stats.lastFrame;
+}
+
+bool frameStatsAllocationFree(const struct FrameStats *frame) {
+    return frame->counters[FRAME_COUNTER_HEAP_ALLOCATIONS] == 0
+        && frame->counters[FRAME_COUNTER_VK_CREATES] == 0;
+}
+
+void frameStatsPrint(FILE *out, const char *label, const struct FrameStats *frame) {
+    fprintf(out, "%s:", label);
+    for (uint32_t c = 0; c < FRAME_COUNTER_COUNT; c++) {
+        fprintf(out, "%s %llu %s", c == 0 ? "" : ",",
+            (unsigned long long) frame->counters[c], counterNames[c]);
+    }
+    fprintf(out, "\n");
+}
+
+void frameStatsReport(FILE *out) {
+    struct FrameStats total = frameStatsTotal();
+    frameStatsPrint(out, "Last frame", &stats.lastFrame);
+    frameStatsPrint(out, "Since startup", &total);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Counts heap allocations and Vulkan object creation, so a frame that does
+// either in steady state shows up before it turns into a hitch. Our own heap
+// use goes through the stats* wrappers below instead of malloc and free, and
+// vkCreate* and vkAllocate* calls are wrapped in COUNT_VK_CREATE. Driver host
+// allocations are picked up from the host allocator. Counting is atomic, so
+// worker jobs can use the wrappers too.
+
+enum FrameCounter {
+    FRAME_COUNTER_HEAP_ALLOCATIONS,   // stats{Malloc,Calloc,Realloc,AlignedAlloc}
+    FRAME_COUNTER_HEAP_FREES,
+    FRAME_COUNTER_HEAP_BYTES,         // requested, not live
+    FRAME_COUNTER_VK_CREATES,         // vkCreate* and vkAllocate* calls
+    FRAME_COUNTER_DRIVER_ALLOCATIONS, // through hostAllocator(), every scope
+    FRAME_COUNTER_COUNT
+};
+
+struct FrameStats {
+    uint64_t counters[FRAME_COUNTER_COUNT];
+};
+
+void frameStatsCount(enum FrameCounter counter, uint64_t amount);
+
+#define COUNT_VK_CREATE(call) (frameStatsCount(FRAME_COUNTER_VK_CREATES, 1), (call))
+
+void *statsMalloc(size_t size);
+void *statsCalloc(size_t count, size_t size);
+void *statsRealloc(void *memory, size_t size);
+void statsFree(void *memory);
+void *statsAlignedAlloc(size_t alignment, size_t size);
+void statsAlignedFree(void *memory);
+
+// Closes the previous frame's counts, call at the top of the frame
+void frameStatsBeginFrame(void);
+
+// What the last completed frame did
+const struct FrameStats *frameStatsLastFrame(void);
+
+// Everything since startup, subtract two of these to measure a span of frames
+struct FrameStats frameStatsTotal(void);
+
+// True when `stats` has no heap allocations and no Vulkan object creation.
+// Driver allocations don't count, recording commands may allocate in the
+// driver's command pools.
+bool frameStatsAllocationFree(const struct FrameStats *stats);
+
+void frameStatsPrint(FILE *out, const char *label, const struct FrameStats *stats);
+void frameStatsReport(FILE *out);
+
+#endif // FRAME_STATS_H
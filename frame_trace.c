@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "file_io.h"
+#include "frame_trace.h"
+
+static void writeBytes(struct FrameTraceWriter *writer, const void *data, size_t size) {
+    if (writer->failed || size == 0) return;
+    if (fwrite(data, 1, size, writer->file) != size) {
+        fprintf(stderr, "Trace: write failed after %u frames\n", writer->frames);
+        writer->failed = true;
+        return;
+    }
+    writer->bytes += size;
+}
+
+static void writeRecord(struct FrameTraceWriter *writer, enum FrameTraceRecord type) {
+    uint32_t tag = (uint32_t) type;
+    writeBytes(writer, &tag, sizeof(tag));
+}
+
+bool frameTraceCreate(const char *path, uint32_t width, uint32_t height, struct FrameTraceWriter *writer) {
+    *writer = (struct FrameTraceWriter) { 0 };
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Trace: failed to open %s\n", path);
+        return false;
+    }
+
+    struct FrameTraceHeader header = {
+        .magic = FRAME_TRACE_MAGIC,
+        .version = FRAME_TRACE_VERSION,
+        .drawSize = sizeof(struct SceneDraw),
+        .spriteSize = sizeof(struct Sprite),
+        .width = width,
+        .height = height,
+    };
+    writeBytes(writer, &header, sizeof(header));
+    return !writer->failed;
+}
+
+void frameTraceWriteResize(struct FrameTraceWriter *writer, uint32_t window, uint32_t width, uint32_t height) {
+    struct FrameTraceResize resize = { .window = window, .width = width, .height = height };
+    writeRecord(writer, FRAME_TRACE_RECORD_RESIZE);
+    writeBytes(writer, &resize, sizeof(resize));
+}
+
+void frameTraceWriteFrame(
+    struct FrameTraceWriter *writer,
+    const struct FrameTraceFrame *frame,
+    const struct SceneDraw *draws,
+    const struct Sprite *sprites
+) {
+    writeRecord(writer, FRAME_TRACE_RECORD_FRAME);
+    writeBytes(writer, frame, sizeof(*frame));
+    writeBytes(writer, draws, (size_t) frame->drawCount * sizeof(*draws));
+    writeBytes(writer, sprites, (size_t) frame->spriteCount * sizeof(*sprites));
+    writer->frames++;
+}
+
+bool frameTraceClose(struct FrameTraceWriter *writer) {
+    if (!writer->file) return false;
+
+    bool ok = !writer->failed;
+    if (fclose(writer->file) != 0) ok = false;
+    fprintf(
+        stderr,
+        "Trace: %u frames, %.1f KB%s\n",
+        writer->frames,
+        (double) writer->bytes / 1024.0,
+        ok ? "" : ", incomplete"
+    );
+    *writer = (struct FrameTraceWriter) { 0 };
+    return ok;
+}
+
+bool frameTraceOpen(const char *path, struct FrameTraceReader *reader) {
+    *reader = (struct FrameTraceReader) { 0 };
+
+    size_t size;
+    const void *data = map_entire_file(path, &size);
+    if (!data) {
+        fprintf(stderr, "Trace: failed to open %s\n", path);
+        return false;
+    }
+    reader->data = data;
+    reader->size = size;
+
+    struct FrameTraceHeader *header = &reader->header;
+    if (size < sizeof(*header)) {
+        fprintf(stderr, "Trace: %s is too short\n", path);
+        frameTraceCloseReader(reader);
+        return false;
+    }
+    memcpy(header, data, sizeof(*header));
+
+    if (header->magic != FRAME_TRACE_MAGIC || header->version != FRAME_TRACE_VERSION) {
+        fprintf(stderr, "Trace: %s isn't a version %u trace\n", path, FRAME_TRACE_VERSION);
+        frameTraceCloseReader(reader);
+        return false;
+    }
+    // Layout changes without a version bump would misread every payload
+    if (header->drawSize != sizeof(struct SceneDraw) || header->spriteSize != sizeof(struct Sprite)) {
+        fprintf(stderr, "Trace: %s was recorded with different record layouts\n", path);
+        frameTraceCloseReader(reader);
+        return false;
+    }
+
+    reader->offset = sizeof(*header);
+    return true;
+}
+
+void frameTraceCloseReader(struct FrameTraceReader *reader) {
+    if (reader->data) unmap_file(reader->data, reader->size);
+    *reader = (struct FrameTraceReader) { 0 };
+}
+
+// Advances past `size` bytes if they're all there
+static const uint8_t *take(struct FrameTraceReader *reader, size_t size) {
+    if (reader->size - reader->offset < size) return NULL;
+    const uint8_t *bytes = reader->data + reader->offset;
+    reader->offset += size;
+    return bytes;
+}
+
+bool frameTraceNext(struct FrameTraceReader *reader, struct FrameTraceEntry *entry) {
+    if (reader->failed || reader->offset == reader->size) return false;
+
+    size_t start = reader->offset;
+    const uint8_t *tag = take(reader, sizeof(uint32_t));
+    uint32_t type = 0;
+    if (tag) memcpy(&type, tag, sizeof(type));
+
+    bool ok = false;
+    switch (type) {
+    case FRAME_TRACE_RECORD_RESIZE: {
+        const uint8_t *payload = take(reader, sizeof(entry->resize));
+        if (payload) {
+            entry->type = FRAME_TRACE_RECORD_RESIZE;
+            memcpy(&entry->resize, payload, sizeof(entry->resize));
+            ok = true;
+        }
+    } break;
+    case FRAME_TRACE_RECORD_FRAME: {
+        const uint8_t *payload = take(reader, sizeof(entry->frame));
+        if (!payload) break;
+        entry->type = FRAME_TRACE_RECORD_FRAME;
+        memcpy(&entry->frame, payload, sizeof(entry->frame));
+
+        // Every payload size is a multiple of 4, so these stay aligned
+        entry->draws = (const struct SceneDraw *) take(reader, (size_t) entry->frame.drawCount * sizeof(struct SceneDraw));
+        entry->sprites = (const struct Sprite *) take(reader, (size_t) entry->frame.spriteCount * sizeof(struct Sprite));
+        ok = (entry->draws || entry->frame.drawCount == 0) && (entry->sprites || entry->frame.spriteCount == 0);
+    } break;
+    default: { } break;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Trace: malformed record at byte %zu\n", start);
+        reader->failed = true;
+    }
+    return ok;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sprites.h"
+
+// Renderer-level command traces, recorded with `--record <file>` and run
+// back with `--replay <file>`. A trace holds what the frame loop feeds the
+// renderer rather than Vulkan calls: the clock, the pipeline state toggles,
+// swap chain resizes, the scene draws and the sprites. Nothing in it is a
+// handle, pipelines are named by the variant they were built from, so a
+// trace recorded by one build replays on another and both do the same work.
+//
+// Instance uploads are a pure function of the recorded time, the replay
+// animates and uploads the same matrices rather than storing 6MB a frame.
+//
+// The file is a header followed by records, each a uint32_t type and a
+// fixed-size payload. A frame record is followed by its draws and then its
+// sprites. Everything is in host byte order; traces are meant for the
+// machine, or at least the architecture, that recorded them.
+
+#define FRAME_TRACE_MAGIC 0x52544b56u // "VKTR"
+#define FRAME_TRACE_VERSION 2
+
+enum FrameTraceRecord {
+    FRAME_TRACE_RECORD_RESIZE = 1, // struct FrameTraceResize
+    FRAME_TRACE_RECORD_FRAME = 2,  // struct FrameTraceFrame, then its draws and sprites
+};
+
+struct FrameTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t drawSize;   // sizeof(struct SceneDraw) when recorded
+    uint32_t spriteSize; // sizeof(struct Sprite) when recorded
+    uint32_t width;      // primary window when recording started
+    uint32_t height;
+};
+
+// A scene draw with its pipeline named by variant, resolved through the
+// pipeline cache when it's pushed
+struct SceneDraw {
+    uint8_t layer;      // enum DrawLayer
+    uint8_t depthMode;  // enum DepthMode
+    uint8_t features;   // enum PipelineFeature
+    uint8_t reserved;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+};
+
+struct FrameTraceResize {
+    uint32_t window;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct FrameTraceFrame {
+    float time;
+    float deltaTime;
+    uint32_t instanceCount; // world matrices uploaded
+    uint32_t textureIndex;  // demo texture's bindless index, sprites using it are remapped
+    uint32_t drawCount;
+    uint32_t spriteCount;
+    uint8_t sceneFeatures;
+    uint8_t depthPrePass;
+    uint8_t particles;
+    uint8_t sprites;
+    uint8_t meshlets;
+    uint8_t reserved[3];
+};
+
+_Static_assert(sizeof(struct SceneDraw) % 4 == 0, "records must keep the payloads after them aligned");
+_Static_assert(sizeof(struct Sprite) % 4 == 0, "records must keep the payloads after them aligned");
+_Static_assert(sizeof(struct FrameTraceFrame) % 4 == 0, "records must keep the payloads after them aligned");
+
+struct FrameTraceWriter {
+    FILE *file;
+    bool failed;
+    uint32_t frames;
+    uint64_t bytes;
+};
+
+// `width` and `height` are the primary window's, replay starts at that size
+bool frameTraceCreate(const char *path, uint32_t width, uint32_t height, struct FrameTraceWriter *writer);
+void frameTraceWriteResize(struct FrameTraceWriter *writer, uint32_t window, uint32_t width, uint32_t height);
+void frameTraceWriteFrame(
+    struct FrameTraceWriter *writer,
+    const struct FrameTraceFrame *frame,
+    const struct SceneDraw *draws,
+    const struct Sprite *sprites
+);
+// False if anything failed to write
+bool frameTraceClose(struct FrameTraceWriter *writer);
+
+// A parsed record, pointing into the mapped trace
+struct FrameTraceEntry {
+    enum FrameTraceRecord type;
+    struct FrameTraceResize resize;
+    struct FrameTraceFrame frame;
+    const struct SceneDraw *draws;
+    const struct Sprite *sprites;
+};
+
+struct FrameTraceReader {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    bool failed; // stopped at a malformed record rather than the end
+    struct FrameTraceHeader header;
+};
+
+// Maps the whole trace, so replay never touches the disk between frames
+bool frameTraceOpen(const char *path, struct FrameTraceReader *reader);
+void frameTraceCloseReader(struct FrameTraceReader *reader);
+
+// False at the end of the trace or on a truncated record, which is reported
+bool frameTraceNext(struct FrameTraceReader *reader, struct FrameTraceEntry *entry);
+
+#endif // FRAME_TRACE_H
@@ -0,0 +1,208 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "device_dispatch.h"
+#include "frame_stats.h"
+#include "gpu_queries.h"
+#include "host_allocator.h"
+
+static const VkQueryPipelineStatisticFlags statisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+    | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+VkResult createGpuQueries(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t framesInFlight,
+    struct GpuQueries *queries
+) {
+    VkResult result;
+
+    assert(framesInFlight <= GPU_QUERY_MAX_FRAMES);
+    *queries = (struct GpuQueries) { 0 };
+    queries->device = device;
+    queries->frameCount = framesInFlight;
+
+    // The device is created with every supported feature enabled
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    queries->precise = features.occlusionQueryPrecise;
+    if (!features.pipelineStatisticsQuery) {
+        fprintf(stderr, "GPU queries: no pipeline statistics, occlusion only\n");
+    }
+
+    for (uint32_t f = 0; f < framesInFlight; f++) {
+        struct GpuQueryFrame *frame = &queries->frames[f];
+
+        VkQueryPoolCreateInfo occlusionInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_OCCLUSION,
+            .queryCount = GPU_QUERY_MAX_PASSES,
+        };
+        result = COUNT_VK_CREATE(vkCreateQueryPool(device, &occlusionInfo, hostAllocator(), &frame->occlusionPool));
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create occlusion query pool");
+
+        if (!features.pipelineStatisticsQuery) continue;
+
+        VkQueryPoolCreateInfo statisticsInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = GPU_QUERY_MAX_PASSES,
+            .pipelineStatistics = statisticFlags,
+        };
+        result = COUNT_VK_CREATE(vkCreateQueryPool(device, &statisticsInfo, hostAllocator(), &frame->statisticsPool));
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create pipeline statistics query pool");
+    }
+
+    return VK_SUCCESS;
+}
+
+void cleanupGpuQueries(struct GpuQueries *queries) {
+    for (uint32_t f = 0; f < queries->frameCount; f++) {
+        vkDestroyQueryPool(queries->device, queries->frames[f].occlusionPool, hostAllocator());
+        vkDestroyQueryPool(queries->device, queries->frames[f].statisticsPool, hostAllocator());
+    }
+    *queries = (struct GpuQueries) { 0 };
+}
+
+void gpuQueriesCollect(struct GpuQueries *queries, uint32_t frame) {
+    assert(frame < queries->frameCount);
+    struct GpuQueryFrame *slot = &queries->frames[frame];
+    uint32_t count = slot->passCount;
+    if (count == 0) return;
+    slot->passCount = 0;
+
+    uint64_t samples[GPU_QUERY_MAX_PASSES];
+    VkResult result = VKD(vkGetQueryPoolResults)(
+        queries->device,
+        slot->occlusionPool,
+        0, count,
+        sizeof(samples), samples, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT
+    );
+    // Only after the fence, so anything but success means the frame was lost
+    if (result != VK_SUCCESS) return;
+
+    uint64_t statistics[GPU_QUERY_MAX_PASSES][GPU_STATISTIC_COUNT];
+    bool statisticsValid = slot->statisticsPool != VK_NULL_HANDLE;
+    if (statisticsValid) {
+        result = VKD(vkGetQueryPoolResults)(
+            queries->device,
+            slot->statisticsPool,
+            0, count,
+            sizeof(statistics), statistics, sizeof(statistics[0]),
+            VK_QUERY_RESULT_64_BIT
+        );
+        statisticsValid = result == VK_SUCCESS;
+    }
+
+    for (uint32_t p = 0; p < count; p++) {
+        struct GpuPassStats *pass = &queries->results[p];
+        *pass = slot->passes[p];
+        pass->samplesPassed = samples[p];
+        pass->statisticsValid = statisticsValid;
+        if (statisticsValid) memcpy(pass->statistics, statistics[p], sizeof(pass->statistics));
+    }
+    queries->resultCount = count;
+}
+
+void gpuQueriesBeginFrame(struct GpuQueries *queries, VkCommandBuffer commandBuffer, uint32_t frame) {
+    assert(frame < queries->frameCount);
+    struct GpuQueryFrame *slot = &queries->frames[frame];
+    slot->passCount = 0;
+
+    VKD(vkCmdResetQueryPool)(commandBuffer, slot->occlusionPool, 0, GPU_QUERY_MAX_PASSES);
+    if (slot->statisticsPool != VK_NULL_HANDLE) {
+        VKD(vkCmdResetQueryPool)(commandBuffer, slot->statisticsPool, 0, GPU_QUERY_MAX_PASSES);
+    }
+    queries->recording = slot;
+}
+
+void gpuQueriesEndFrame(struct GpuQueries *queries) {
+    assert(!queries->passOpen);
+    queries->recording = NULL;
+}
+
+void gpuQueriesBeginPass(struct GpuQueries *queries, VkCommandBuffer commandBuffer, const char *name, uint64_t pixels) {
+    struct GpuQueryFrame *slot = queries->recording;
+    if (!slot || slot->passCount == GPU_QUERY_MAX_PASSES) return;
+    assert(!queries->passOpen);
+
+    uint32_t query = slot->passCount;
+    slot->passes[query] = (struct GpuPassStats) { .name = name, .pixels = pixels };
+
+    VkQueryControlFlags control = queries->precise ? VK_QUERY_CONTROL_PRECISE_BIT : 0;
+    VKD(vkCmdBeginQuery)(commandBuffer, slot->occlusionPool, query, control);
+    if (slot->statisticsPool != VK_NULL_HANDLE) {
+        VKD(vkCmdBeginQuery)(commandBuffer, slot->statisticsPool, query, 0);
+    }
+    queries->passOpen = true;
+}
+
+void gpuQueriesEndPass(struct GpuQueries *queries, VkCommandBuffer commandBuffer) {
+    struct GpuQueryFrame *slot = queries->recording;
+    if (!slot || !queries->passOpen) return;
+
+    uint32_t query = slot->passCount++;
+    VKD(vkCmdEndQuery)(commandBuffer, slot->occlusionPool, query);
+    if (slot->statisticsPool != VK_NULL_HANDLE) {
+        VKD(vkCmdEndQuery)(commandBuffer, slot->statisticsPool, query);
+    }
+    queries->passOpen = false;
+}
+
+const struct GpuPassStats *gpuQueriesLastFrame(const struct GpuQueries *queries, uint32_t *count) {
+    *count = queries->resultCount;
+    return queries->results;
+}
+
+static double ratio(uint64_t numerator, uint64_t denominator) {
+    return denominator > 0 ? (double) numerator / (double) denominator : 0.0;
+}
+
+void gpuQueriesReport(const struct GpuQueries *queries, FILE *out) {
+    if (queries->resultCount == 0) {
+        fprintf(out, "GPU queries: no results, toggle them with Q\n");
+        return;
+    }
+
+    fprintf(out, "GPU queries, %u passes:\n", queries->resultCount);
+    for (uint32_t p = 0; p < queries->resultCount; p++) {
+        const struct GpuPassStats *pass = &queries->results[p];
+        fprintf(out, "  %-10s samples %llu", pass->name, (unsigned long long) pass->samplesPassed);
+        if (!queries->precise) fprintf(out, " (imprecise)");
+
+        if (pass->statisticsValid) {
+            const uint64_t *s = pass->statistics;
+            fprintf(
+                out,
+                ", vertices %llu, primitives %llu, VS %llu, clipped in %llu out %llu, FS %llu, CS %llu",
+                (unsigned long long) s[GPU_STATISTIC_INPUT_VERTICES],
+                (unsigned long long) s[GPU_STATISTIC_INPUT_PRIMITIVES],
+                (unsigned long long) s[GPU_STATISTIC_VERTEX_INVOCATIONS],
+                (unsigned long long) s[GPU_STATISTIC_CLIPPING_INVOCATIONS],
+                (unsigned long long) s[GPU_STATISTIC_CLIPPING_PRIMITIVES],
+                (unsigned long long) s[GPU_STATISTIC_FRAGMENT_INVOCATIONS],
+                (unsigned long long) s[GPU_STATISTIC_COMPUTE_INVOCATIONS]
+            );
+            // Shaded fragments per pixel is the overdraw, per passed sample
+            // it's how much of that work the depth test threw away
+            fprintf(
+                out,
+                ", FS/pixel %.2f, FS/sample %.2f",
+                ratio(s[GPU_STATISTIC_FRAGMENT_INVOCATIONS], pass->pixels),
+                ratio(s[GPU_STATISTIC_FRAGMENT_INVOCATIONS], pass->samplesPassed)
+            );
+        }
+        fprintf(out, "\n");
+    }
+}
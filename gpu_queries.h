@@ -0,0 +1,92 @@
+#pragma once
+#ifndef GPU_QUERIES_H
+#define GPU_QUERIES_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-pass GPU counters. Every render graph pass recorded while queries are
+// on is wrapped in a pipeline statistics query, where the device supports
+// them, and an occlusion query. Each frame in flight has its own pools, so
+// a frame's results are read without waiting once its fence has been, a
+// full ring of frames later.
+//
+// Fragment invocations against samples passed and against the pass's pixels
+// show overdraw; vertex invocations against input vertices and clipped
+// primitives show passes that are vertex bound or mostly off screen.
+
+#define GPU_QUERY_MAX_FRAMES 4
+#define GPU_QUERY_MAX_PASSES 16 // per frame, passes past this aren't measured
+
+// In the order Vulkan writes the enabled statistics
+enum GpuStatistic {
+    GPU_STATISTIC_INPUT_VERTICES,
+    GPU_STATISTIC_INPUT_PRIMITIVES,
+    GPU_STATISTIC_VERTEX_INVOCATIONS,
+    GPU_STATISTIC_CLIPPING_INVOCATIONS,
+    GPU_STATISTIC_CLIPPING_PRIMITIVES,
+    GPU_STATISTIC_FRAGMENT_INVOCATIONS,
+    GPU_STATISTIC_COMPUTE_INVOCATIONS,
+    GPU_STATISTIC_COUNT
+};
+
+struct GpuPassStats {
+    const char *name;    // the render graph pass
+    uint64_t pixels;     // render area, for overdraw
+    bool statisticsValid;
+    uint64_t statistics[GPU_STATISTIC_COUNT];
+    uint64_t samplesPassed;
+};
+
+struct GpuQueryFrame {
+    VkQueryPool statisticsPool; // VK_NULL_HANDLE without pipelineStatisticsQuery
+    VkQueryPool occlusionPool;
+    uint32_t passCount;         // recorded into the frame's command buffer
+    struct GpuPassStats passes[GPU_QUERY_MAX_PASSES];
+};
+
+struct GpuQueries {
+    VkDevice device;
+    uint32_t frameCount;
+    bool precise; // exact sample counts rather than zero or not
+    struct GpuQueryFrame frames[GPU_QUERY_MAX_FRAMES];
+
+    // Recording state of the current frame
+    struct GpuQueryFrame *recording;
+    bool passOpen;
+
+    // Read back from the most recently retired frame
+    uint32_t resultCount;
+    struct GpuPassStats results[GPU_QUERY_MAX_PASSES];
+};
+
+VkResult createGpuQueries(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t framesInFlight,
+    struct GpuQueries *queries
+);
+void cleanupGpuQueries(struct GpuQueries *queries);
+
+// Reads `frame`'s results from its last submission. Call once its fence has
+// been waited on and before it's recorded again; never blocks.
+void gpuQueriesCollect(struct GpuQueries *queries, uint32_t frame);
+
+// Resets `frame`'s pools, outside any render pass. Passes recorded before
+// the next gpuQueriesEndFrame are measured.
+void gpuQueriesBeginFrame(struct GpuQueries *queries, VkCommandBuffer commandBuffer, uint32_t frame);
+void gpuQueriesEndFrame(struct GpuQueries *queries);
+
+// Wrap one pass each, outside any render pass. Passes can't nest.
+void gpuQueriesBeginPass(struct GpuQueries *queries, VkCommandBuffer commandBuffer, const char *name, uint64_t pixels);
+void gpuQueriesEndPass(struct GpuQueries *queries, VkCommandBuffer commandBuffer);
+
+// The most recently read back frame's passes
+const struct GpuPassStats *gpuQueriesLastFrame(const struct GpuQueries *queries, uint32_t *count);
+
+void gpuQueriesReport(const struct GpuQueries *queries, FILE *out);
+
+#endif // GPU_QUERIES_H
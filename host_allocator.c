@@ -0,0 +1,316 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_allocator.h"
+
+#define HOST_HEADER_SIZE 32
+#define HOST_POOL_NONE 0xFF
+#define HOST_POOL_MIN_SIZE 64
+#define HOST_POOL_MAX_ALIGNMENT 16 // what chunk and block starts guarantee
+
+// Sits right before every pointer handed to the driver
+struct HostHeader {
+    void *base;        // what malloc returned, NULL for pooled blocks
+    size_t size;
+    uint8_t scope;
+    uint8_t sizeClass; // HOST_POOL_NONE when not pooled
+};
+_Static_assert(sizeof(struct HostHeader) <= HOST_HEADER_SIZE, "header must fit its reserved space");
+
+struct HostPoolBlock {
+    struct HostPoolBlock *next;
+};
+
+struct HostPoolChunk {
+    struct HostPoolChunk *next;
+};
+
+struct HostPool {
+    atomic_flag lock;
+    struct HostPoolBlock *freeList;
+    struct HostPoolChunk *chunks;
+};
+
+struct HostScopeCounters {
+    atomic_ullong liveBytes;
+    atomic_ullong liveCount;
+    atomic_ullong peakBytes;
+    atomic_ullong allocations;
+    atomic_ullong pooled;
+    atomic_ullong internalBytes;
+};
+
+static struct {
+    bool initialized;
+    bool pooled;
+    VkAllocationCallbacks callbacks;
+    struct HostPool pools[HOST_POOL_CLASS_COUNT];
+    struct HostScopeCounters scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+    uint64_t reported[HOST_ALLOCATOR_SCOPE_COUNT];
+} host = {
+    .pools = {
+        { .lock = ATOMIC_FLAG_INIT }, { .lock = ATOMIC_FLAG_INIT }, { .lock = ATOMIC_FLAG_INIT },
+        { .lock = ATOMIC_FLAG_INIT }, { .lock = ATOMIC_FLAG_INIT },
+    },
+};
+
+static const char *scopeNames[HOST_ALLOCATOR_SCOPE_COUNT] = {
+    [VK_SYSTEM_ALLOCATION_SCOPE_COMMAND] = "command",
+    [VK_SYSTEM_ALLOCATION_SCOPE_OBJECT] = "object",
+    [VK_SYSTEM_ALLOCATION_SCOPE_CACHE] = "cache",
+    [VK_SYSTEM_ALLOCATION_SCOPE_DEVICE] = "device",
+    [VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE] = "instance",
+};
+
+static size_t classSize(uint32_t sizeClass) {
+    return (size_t) HOST_POOL_MIN_SIZE << sizeClass;
+}
+
+static void lockPool(struct HostPool *pool) {
+    while (atomic_flag_test_and_set_explicit(&pool->lock, memory_order_acquire)) { }
+}
+
+static void unlockPool(struct HostPool *pool) {
+    atomic_flag_clear_explicit(&pool->lock, memory_order_release);
+}
+
+// Carves a fresh chunk into blocks, the first block's space holds the chunk link
+static bool growPool(struct HostPool *pool, uint32_t sizeClass) {
+    size_t stride = classSize(sizeClass);
+    char *chunk = malloc(HOST_POOL_CHUNK_SIZE);
+    if (!chunk) return false;
+
+    ((struct HostPoolChunk *) chunk)->next = pool->chunks;
+    pool->chunks = (struct HostPoolChunk *) chunk;
+
+    for (size_t offset = stride; offset + stride <= HOST_POOL_CHUNK_SIZE; offset += stride) {
+        struct HostPoolBlock *block = (struct HostPoolBlock *) (chunk + offset);
+        block->next = pool->freeList;
+        pool->freeList = block;
+    }
+    return true;
+}
+
+static void *poolAlloc(uint32_t sizeClass) {
+    struct HostPool *pool = &host.pools[sizeClass];
+    lockPool(pool);
+    if (!pool->freeList && !growPool(pool, sizeClass)) {
+        unlockPool(pool);
+        return NULL;
+    }
+    struct HostPoolBlock *block = pool->freeList;
+    pool->freeList = block->next;
+    unlockPool(pool);
+    return block;
+}
+
+static void poolFree(uint32_t sizeClass, void *memory) {
+    struct HostPool *pool = &host.pools[sizeClass];
+    struct HostPoolBlock *block = memory;
+    lockPool(pool);
+    block->next = pool->freeList;
+    pool->freeList = block;
+    unlockPool(pool);
+}
+
+static uint8_t pickClass(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (!host.pooled || alignment > HOST_POOL_MAX_ALIGNMENT) return HOST_POOL_NONE;
+    if (scope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && scope != VK_SYSTEM_ALLOCATION_SCOPE_OBJECT) {
+        return HOST_POOL_NONE;
+    }
+    for (uint8_t c = 0; c < HOST_POOL_CLASS_COUNT; c++) {
+        if (size + HOST_HEADER_SIZE <= classSize(c)) return c;
+    }
+    return HOST_POOL_NONE;
+}
+
+static void countAllocation(VkSystemAllocationScope scope, size_t size, bool pooled) {
+    struct HostScopeCounters *counters = &host.scopes[scope];
+    uint64_t live = atomic_fetch_add_explicit(&counters->liveBytes, size, memory_order_relaxed) + size;
+    atomic_fetch_add_explicit(&counters->liveCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->allocations, 1, memory_order_relaxed);
+    if (pooled) atomic_fetch_add_explicit(&counters->pooled, 1, memory_order_relaxed);
+
+    uint64_t peak = atomic_load_explicit(&counters->peakBytes, memory_order_relaxed);
+    while (live > peak
+        && !atomic_compare_exchange_weak_explicit(&counters->peakBytes, &peak, live,
+            memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+static void *VKAPI_PTR hostAllocate(
+    void *user,
+    size_t size,
+    size_t alignment,
+    VkSystemAllocationScope scope
+) {
+    (void) user;
+    if (size == 0) return NULL;
+    if (alignment < sizeof(void *)) alignment = sizeof(void *);
+
+    struct HostHeader header = {
+        .size = size,
+        .scope = (uint8_t) scope,
+        .sizeClass = pickClass(size, alignment, scope),
+    };
+
+    char *memory;
+    if (header.sizeClass != HOST_POOL_NONE) {
+        char *block = poolAlloc(header.sizeClass);
+        if (!block) return NULL;
+        memory = block + HOST_HEADER_SIZE;
+    } else {
+        // Room for the header in front and for aligning the start past it
+        char *base = malloc(size + HOST_HEADER_SIZE + alignment);
+        if (!base) return NULL;
+        uintptr_t start = (uintptr_t) base + HOST_HEADER_SIZE;
+        start = (start + alignment - 1) & ~(uintptr_t) (alignment - 1);
+        memory = (char *) start;
+        header.base = base;
+    }
+
+    memcpy(memory - HOST_HEADER_SIZE, &header, sizeof(header));
+    countAllocation(scope, size, header.sizeClass != HOST_POOL_NONE);
+    return memory;
+}
+
+static void VKAPI_PTR hostFree(void *user, void *memory) {
+    (void) user;
+    if (!memory) return;
+
+    struct HostHeader header;
+    memcpy(&header, (char *) memory - HOST_HEADER_SIZE, sizeof(header));
+
+    struct HostScopeCounters *counters = &host.scopes[header.scope];
+    atomic_fetch_sub_explicit(&counters->liveBytes, header.size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&counters->liveCount, 1, memory_order_relaxed);
+
+    if (header.sizeClass != HOST_POOL_NONE) {
+        poolFree(header.sizeClass, (char *) memory - HOST_HEADER_SIZE);
+    } else {
+        free(header.base);
+    }
+}
+
+static void *VKAPI_PTR hostReallocate(
+    void *user,
+    void *original,
+    size_t size,
+    size_t alignment,
+    VkSystemAllocationScope scope
+) {
+    if (!original) return hostAllocate(user, size, alignment, scope);
+    if (size == 0) {
+        hostFree(user, original);
+        return NULL;
+    }
+
+    struct HostHeader header;
+    memcpy(&header, (char *) original - HOST_HEADER_SIZE, sizeof(header));
+
+    void *memory = hostAllocate(user, size, alignment, scope);
+    if (!memory) return NULL; // the original stays valid, as the spec requires
+    memcpy(memory, original, header.size < size ? header.size : size);
+    hostFree(user, original);
+    return memory;
+}
+
+static void VKAPI_PTR hostInternalAllocation(
+    void *user,
+    size_t size,
+    VkInternalAllocationType type,
+    VkSystemAllocationScope scope
+) {
+    (void) user;
+    (void) type;
+    atomic_fetch_add_explicit(&host.scopes[scope].internalBytes, size, memory_order_relaxed);
+}
+
+static void VKAPI_PTR hostInternalFree(
+    void *user,
+    size_t size,
+    VkInternalAllocationType type,
+    VkSystemAllocationScope scope
+) {
+    (void) user;
+    (void) type;
+    atomic_fetch_sub_explicit(&host.scopes[scope].internalBytes, size, memory_order_relaxed);
+}
+
+void hostAllocatorInit(bool pooled) {
+    assert(!host.initialized);
+    host.pooled = pooled;
+    host.callbacks = (VkAllocationCallbacks) {
+        .pUserData = NULL,
+        .pfnAllocation = hostAllocate,
+        .pfnReallocation = hostReallocate,
+        .pfnFree = hostFree,
+        .pfnInternalAllocation = hostInternalAllocation,
+        .pfnInternalFree = hostInternalFree,
+    };
+    host.initialized = true;
+}
+
+void hostAllocatorShutdown(void) {
+    for (uint32_t c = 0; c < HOST_POOL_CLASS_COUNT; c++) {
+        struct HostPoolChunk *chunk = host.pools[c].chunks;
+        while (chunk) {
+            struct HostPoolChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        host.pools[c].chunks = NULL;
+        host.pools[c].freeList = NULL;
+    }
+
+    uint64_t leaked = 0;
+    for (uint32_t s = 0; s < HOST_ALLOCATOR_SCOPE_COUNT; s++) {
+        leaked += atomic_load(&host.scopes[s].liveCount);
+    }
+    if (leaked > 0) {
+        fprintf(stderr, "Host allocator: %llu allocations still live at shutdown\n", (unsigned long long) leaked);
+    }
+    host.initialized = false;
+}
+
+const VkAllocationCallbacks *hostAllocator(void) {
+    return host.initialized ? &host.callbacks : NULL;
+}
+
+struct HostAllocatorStats hostAllocatorStats(VkSystemAllocationScope scope) {
+    const struct HostScopeCounters *counters = &host.scopes[scope];
+    return (struct HostAllocatorStats) {
+        .liveBytes = atomic_load_explicit(&counters->liveBytes, memory_order_relaxed),
+        .liveCount = atomic_load_explicit(&counters->liveCount, memory_order_relaxed),
+        .peakBytes = atomic_load_explicit(&counters->peakBytes, memory_order_relaxed),
+        .allocations = atomic_load_explicit(&counters->allocations, memory_order_relaxed),
+        .pooled = atomic_load_explicit(&counters->pooled, memory_order_relaxed),
+        .internalBytes = atomic_load_explicit(&counters->internalBytes, memory_order_relaxed),
+    };
+}
+
+void hostAllocatorReport(FILE *out) {
+    fprintf(out, "Host allocator (%s):\n", host.pooled ? "pooled" : "malloc");
+    for (uint32_t s = 0; s < HOST_ALLOCATOR_SCOPE_COUNT; s++) {
+        struct HostAllocatorStats stats = hostAllocatorStats((VkSystemAllocationScope) s);
+        uint64_t recent = stats.allocations - host.reported[s];
+        host.reported[s] = stats.allocations;
+        fprintf(out, "  %-8s %6llu live %9.1f KiB (peak %9.1f KiB), %8llu allocations (%llu pooled, %llu since last report)",
+            scopeNames[s],
+            (unsigned long long) stats.liveCount,
+            (double) stats.liveBytes / 1024.0,
+            (double) stats.peakBytes / 1024.0,
+            (unsigned long long) stats.allocations,
+            (unsigned long long) stats.pooled,
+            (unsigned long long) recent);
+        if (stats.internalBytes > 0) {
+            fprintf(out, ", internal %.1f KiB", (double) stats.internalBytes / 1024.0);
+        }
+        fprintf(out, "\n");
+    }
+}
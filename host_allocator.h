@@ -0,0 +1,46 @@
+#pragma once
+#ifndef HOST_ALLOCATOR_H
+#define HOST_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// VkAllocationCallbacks that count the driver's host allocations per
+// VkSystemAllocationScope. With pooling, small command and object scope
+// allocations come from per-size free lists instead of malloc, which keeps
+// command recording and object churn off the global heap lock.
+//
+// Every Vulkan object has to be destroyed with the callbacks it was created
+// with, so initialize before the instance and shut down after it.
+
+#define HOST_ALLOCATOR_SCOPE_COUNT 5 // VkSystemAllocationScope values
+#define HOST_POOL_CLASS_COUNT 5      // 64, 128, 256, 512 and 1024 byte blocks
+#define HOST_POOL_CHUNK_SIZE (64 * 1024)
+
+struct HostAllocatorStats {
+    uint64_t liveBytes;
+    uint64_t liveCount;
+    uint64_t peakBytes;
+    uint64_t allocations; // every allocation and reallocation since startup
+    uint64_t pooled;      // how many of those came from a pool
+    uint64_t internalBytes; // reported through the internal notification callbacks
+};
+
+void hostAllocatorInit(bool pooled);
+
+// Frees the pools, call after vkDestroyInstance
+void hostAllocatorShutdown(void);
+
+// What to pass as pAllocator. NULL before hostAllocatorInit.
+const VkAllocationCallbacks *hostAllocator(void);
+
+struct HostAllocatorStats hostAllocatorStats(VkSystemAllocationScope scope);
+
+// Includes the allocations made since the previous report, which is what the
+// frame loop costs when the report is taken twice in a row
+void hostAllocatorReport(FILE *out);
+
+#endif // HOST_ALLOCATOR_H
@@ -0,0 +1,465 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "jobs.h"
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+typedef HANDLE thread_handle;
+typedef SRWLOCK mutex_handle;
+typedef CONDITION_VARIABLE cond_handle;
+#else
+#   include <pthread.h>
+#   include <sched.h>
+#   include <unistd.h>
+typedef pthread_t thread_handle;
+typedef pthread_mutex_t mutex_handle;
+typedef pthread_cond_t cond_handle;
+#endif
+
+struct Job {
+    void (*function)(void *data, uint32_t index);
+    void *data;
+    uint32_t index;
+    struct JobCounter *counter;
+};
+
+// Chase-Lev deque as described in "Correct and Efficient Work-Stealing for
+// Weak Memory Models" (Le et al. 2013). The buffer never grows, a full deque
+// makes the owner run the job inline instead.
+struct JobDeque {
+    _Alignas(64) atomic_llong top;
+    _Alignas(64) atomic_llong bottom;
+    struct Job buffer[JOBS_DEQUE_CAPACITY];
+};
+
+struct JobMailbox {
+    atomic_flag lock;
+    atomic_uint waiting; // pushed but not yet popped, read without the lock to park
+    uint32_t head;
+    uint32_t count;
+    struct Job jobs[JOBS_MAILBOX_CAPACITY];
+};
+
+struct JobWorker {
+    struct JobDeque deque;
+    struct JobMailbox mailbox;
+    thread_handle thread;
+    uint32_t index;
+    uint32_t rng;
+};
+
+static struct JobSystem {
+    uint32_t workerCount;
+    struct JobWorker workers[JOBS_MAX_WORKERS];
+
+    atomic_bool running;
+    atomic_uint queued;   // stealable jobs not yet taken, used to park idle workers
+    atomic_uint sleepers;
+    mutex_handle sleepMutex;
+    cond_handle sleepCond;
+} jobs;
+
+static _Thread_local uint32_t currentWorker = JOBS_AFFINITY_ANY;
+
+// Platform layer
+
+static void mutexInit(mutex_handle *m) {
+#ifdef _WIN32
+    InitializeSRWLock(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+static void mutexLock(mutex_handle *m) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static void mutexUnlock(mutex_handle *m) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+static void condInit(cond_handle *c) {
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
+
+static void condWait(cond_handle *c, mutex_handle *m) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(c, m, INFINITE, 0);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+static void condWakeAll(cond_handle *c) {
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+static void threadYield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static uint32_t hardwareThreadCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t) info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t) count : 1;
+#endif
+}
+
+// Deque
+
+static bool dequePush(struct JobDeque *deque, const struct Job *job) {
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (b - t >= JOBS_DEQUE_CAPACITY) return false;
+
+    deque->buffer[b & (JOBS_DEQUE_CAPACITY - 1)] = *job;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static bool dequeTake(struct JobDeque *deque, struct Job *job) {
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *job = deque->buffer[b & (JOBS_DEQUE_CAPACITY - 1)];
+    if (t == b) {
+        // Last job, race the thieves for it
+        bool won = atomic_compare_exchange_strong_explicit(
+            &deque->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed
+        );
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+static bool dequeSteal(struct JobDeque *deque, struct Job *job) {
+    long long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b) return false;
+
+    // The slot can only be rewritten once `top` moves past it, in which
+    // case the CAS below fails and the copy is discarded
+    *job = deque->buffer[t & (JOBS_DEQUE_CAPACITY - 1)];
+    return atomic_compare_exchange_strong_explicit(
+        &deque->top, &t, t + 1,
+        memory_order_seq_cst, memory_order_relaxed
+    );
+}
+
+// Mailbox
+
+static void mailboxLock(struct JobMailbox *mailbox) {
+    while (atomic_flag_test_and_set_explicit(&mailbox->lock, memory_order_acquire)) {
+        threadYield();
+    }
+}
+
+static void mailboxUnlock(struct JobMailbox *mailbox) {
+    atomic_flag_clear_explicit(&mailbox->lock, memory_order_release);
+}
+
+static bool mailboxPush(struct JobMailbox *mailbox, const struct Job *job) {
+    mailboxLock(mailbox);
+    bool pushed = mailbox->count < JOBS_MAILBOX_CAPACITY;
+    if (pushed) {
+        uint32_t slot = (mailbox->head + mailbox->count++) % JOBS_MAILBOX_CAPACITY;
+        mailbox->jobs[slot] = *job;
+    }
+    mailboxUnlock(mailbox);
+    return pushed;
+}
+
+static bool mailboxPop(struct JobMailbox *mailbox, struct Job *job) {
+    mailboxLock(mailbox);
+    bool popped = mailbox->count > 0;
+    if (popped) {
+        *job = mailbox->jobs[mailbox->head];
+        mailbox->head = (mailbox->head + 1) % JOBS_MAILBOX_CAPACITY;
+        mailbox->count--;
+    }
+    mailboxUnlock(mailbox);
+    return popped;
+}
+
+// Scheduling
+
+static void execute(const struct Job *job) {
+    job->function(job->data, job->index);
+    if (job->counter) {
+        atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+    }
+}
+
+static void wakeSleepers(void) {
+    if (atomic_load(&jobs.sleepers) == 0) return;
+    mutexLock(&jobs.sleepMutex);
+    condWakeAll(&jobs.sleepCond);
+    mutexUnlock(&jobs.sleepMutex);
+}
+
+static uint32_t xorshift(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static bool findJob(struct JobWorker *self, struct Job *job) {
+    // Only this worker can take what's in its mailbox, so those jobs are
+    // counted apart from the ones anybody can steal
+    if (mailboxPop(&self->mailbox, job)) {
+        atomic_fetch_sub(&self->mailbox.waiting, 1);
+        return true;
+    }
+
+    bool found = dequeTake(&self->deque, job);
+
+    if (!found && jobs.workerCount > 1) {
+        uint32_t start = xorshift(&self->rng) % jobs.workerCount;
+        for (uint32_t i = 0; i < jobs.workerCount && !found; i++) {
+            uint32_t victim = (start + i) % jobs.workerCount;
+            if (victim == self->index) continue;
+            found = dequeSteal(&jobs.workers[victim].deque, job);
+        }
+    }
+
+    if (found) atomic_fetch_sub(&jobs.queued, 1);
+    return found;
+}
+
+static void submit(struct JobWorker *self, const struct Job *job, uint32_t affinity) {
+    // Counts are raised first so a job can never be taken before it is counted
+    bool queued;
+    if (affinity != JOBS_AFFINITY_ANY && affinity < jobs.workerCount) {
+        struct JobMailbox *mailbox = &jobs.workers[affinity].mailbox;
+        atomic_fetch_add(&mailbox->waiting, 1);
+        queued = mailboxPush(mailbox, job);
+        if (!queued) atomic_fetch_sub(&mailbox->waiting, 1);
+    } else {
+        atomic_fetch_add(&jobs.queued, 1);
+        queued = dequePush(&self->deque, job);
+        if (!queued) atomic_fetch_sub(&jobs.queued, 1);
+    }
+
+    // Out of space: do the work now rather than block
+    if (!queued) execute(job);
+}
+
+static void workerLoop(struct JobWorker *self) {
+    currentWorker = self->index;
+
+    uint32_t idleSpins = 0;
+    while (atomic_load_explicit(&jobs.running, memory_order_acquire)) {
+        struct Job job;
+        if (findJob(self, &job)) {
+            execute(&job);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (++idleSpins < 64) {
+            threadYield();
+            continue;
+        }
+
+        // Park until there is something this worker can take: a stealable
+        // job or one in its own mailbox. Sleepers is raised before the
+        // counts are checked, and producers check sleepers after raising
+        // them, so one side always sees the other.
+        mutexLock(&jobs.sleepMutex);
+        atomic_fetch_add(&jobs.sleepers, 1);
+        while (atomic_load(&jobs.queued) == 0
+            && atomic_load(&self->mailbox.waiting) == 0
+            && atomic_load(&jobs.running)) {
+            condWait(&jobs.sleepCond, &jobs.sleepMutex);
+        }
+        atomic_fetch_sub(&jobs.sleepers, 1);
+        mutexUnlock(&jobs.sleepMutex);
+        idleSpins = 0;
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workerEntry(LPVOID param) {
+    workerLoop(param);
+    return 0;
+}
+#else
+static void *workerEntry(void *param) {
+    workerLoop(param);
+    return NULL;
+}
+#endif
+
+bool jobsInit(uint32_t workerCount) {
+    if (workerCount == 0) workerCount = hardwareThreadCount();
+    if (workerCount > JOBS_MAX_WORKERS) workerCount = JOBS_MAX_WORKERS;
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.workerCount = workerCount;
+    atomic_init(&jobs.running, true);
+    atomic_init(&jobs.queued, 0);
+    atomic_init(&jobs.sleepers, 0);
+    mutexInit(&jobs.sleepMutex);
+    condInit(&jobs.sleepCond);
+
+    for (uint32_t i = 0; i < workerCount; i++) {
+        struct JobWorker *worker = &jobs.workers[i];
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+        atomic_flag_clear(&worker->mailbox.lock);
+        atomic_init(&worker->mailbox.waiting, 0);
+        worker->index = i;
+        worker->rng = 0x9E3779B9u * (i + 1);
+    }
+
+    // The calling thread is worker 0 and only runs jobs while it waits
+    currentWorker = JOBS_AFFINITY_MAIN;
+
+    for (uint32_t i = 1; i < workerCount; i++) {
+        struct JobWorker *worker = &jobs.workers[i];
+#ifdef _WIN32
+        worker->thread = CreateThread(NULL, 0, workerEntry, worker, 0, NULL);
+        bool created = worker->thread != NULL;
+#else
+        bool created = pthread_create(&worker->thread, NULL, workerEntry, worker) == 0;
+#endif
+        if (!created) {
+            fprintf(stderr, "Failed to create job worker %u\n", i);
+            jobs.workerCount = i;
+            jobsShutdown();
+            return false;
+        }
+    }
+
+    fprintf(stderr, "Job system: %u workers\n", workerCount);
+    return true;
+}
+
+void jobsShutdown(void) {
+    atomic_store(&jobs.running, false);
+
+    mutexLock(&jobs.sleepMutex);
+    condWakeAll(&jobs.sleepCond);
+    mutexUnlock(&jobs.sleepMutex);
+
+    for (uint32_t i = 1; i < jobs.workerCount; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(jobs.workers[i].thread, INFINITE);
+        CloseHandle(jobs.workers[i].thread);
+#else
+        pthread_join(jobs.workers[i].thread, NULL);
+#endif
+    }
+
+    jobs.workerCount = 0;
+    currentWorker = JOBS_AFFINITY_ANY;
+}
+
+uint32_t jobsWorkerCount(void) {
+    return jobs.workerCount;
+}
+
+uint32_t jobsCurrentWorker(void) {
+    return currentWorker;
+}
+
+void jobsRun(const struct JobDecl *decls, uint32_t count, struct JobCounter *counter) {
+    assert(currentWorker != JOBS_AFFINITY_ANY && "jobsRun called from a foreign thread");
+    struct JobWorker *self = &jobs.workers[currentWorker];
+
+    if (counter) atomic_fetch_add_explicit(&counter->pending, count, memory_order_relaxed);
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct Job job = {
+            .function = decls[i].function,
+            .data = decls[i].data,
+            .index = decls[i].index,
+            .counter = counter,
+        };
+        submit(self, &job, decls[i].affinity);
+    }
+
+    wakeSleepers();
+}
+
+void jobsRunRange(
+    void (*function)(void *data, uint32_t index),
+    void *data,
+    uint32_t count,
+    struct JobCounter *counter
+) {
+    assert(currentWorker != JOBS_AFFINITY_ANY && "jobsRunRange called from a foreign thread");
+    struct JobWorker *self = &jobs.workers[currentWorker];
+
+    if (counter) atomic_fetch_add_explicit(&counter->pending, count, memory_order_relaxed);
+
+    // Pushed in reverse so the owner pops index 0 first and thieves take the tail
+    for (uint32_t i = count; i-- > 0;) {
+        struct Job job = {
+            .function = function,
+            .data = data,
+            .index = i,
+            .counter = counter,
+        };
+        submit(self, &job, JOBS_AFFINITY_ANY);
+    }
+
+    wakeSleepers();
+}
+
+void jobsWait(struct JobCounter *counter) {
+    uint32_t worker = currentWorker;
+
+    while (!jobsDone(counter)) {
+        struct Job job;
+        if (worker != JOBS_AFFINITY_ANY && findJob(&jobs.workers[worker], &job)) {
+            execute(&job);
+        } else {
+            threadYield();
+        }
+    }
+}
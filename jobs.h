@@ -0,0 +1,61 @@
+#pragma once
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Work-stealing job scheduler. Every worker, including the main thread as
+// worker 0, owns a Chase-Lev deque: it pushes and pops at the bottom while
+// idle workers steal from the top. Jobs with an affinity hint skip the deques
+// and go to the target worker's mailbox, which nobody else can steal from.
+
+#define JOBS_MAX_WORKERS 32
+#define JOBS_DEQUE_CAPACITY 4096 // per worker, must be a power of two
+#define JOBS_MAILBOX_CAPACITY 256
+
+#define JOBS_AFFINITY_ANY UINT32_MAX
+#define JOBS_AFFINITY_MAIN 0
+
+// Incremented when jobs are queued and decremented as they finish. A job can
+// depend on earlier work by waiting on that work's counter.
+struct JobCounter {
+    atomic_uint pending;
+};
+
+struct JobDecl {
+    void (*function)(void *data, uint32_t index);
+    void *data;
+    uint32_t index;
+    uint32_t affinity; // JOBS_AFFINITY_ANY or a worker index
+};
+
+// `workerCount` includes the main thread. 0 uses one worker per hardware thread.
+bool jobsInit(uint32_t workerCount);
+void jobsShutdown(void);
+
+uint32_t jobsWorkerCount(void);
+
+// Index of the calling worker, or JOBS_AFFINITY_ANY on foreign threads
+uint32_t jobsCurrentWorker(void);
+
+// Must be called from a worker thread (the main thread counts)
+void jobsRun(const struct JobDecl *jobs, uint32_t count, struct JobCounter *counter);
+
+// Queues `function(data, i)` for every i in [0, count) without a decl array
+void jobsRunRange(
+    void (*function)(void *data, uint32_t index),
+    void *data,
+    uint32_t count,
+    struct JobCounter *counter
+);
+
+// Runs other jobs until the counter reaches zero
+void jobsWait(struct JobCounter *counter);
+
+static inline bool jobsDone(struct JobCounter *counter) {
+    return atomic_load_explicit(&counter->pending, memory_order_acquire) == 0;
+}
+
+#endif // JOBS_H
@@ -0,0 +1,150 @@
+// Microbenchmark for the job system's scheduling overhead, and for the
+// parallel radix sort built on it.
+// Build the `jobs_bench` target and run it in Release.
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "radix_sort.h"
+
+#define ROUNDS 20
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void emptyJob(void *data, uint32_t index) {
+    (void) data;
+    (void) index;
+}
+
+static void busyJob(void *data, uint32_t index) {
+    volatile uint32_t *sink = data;
+    uint32_t x = index;
+    for (uint32_t i = 0; i < 256; i++) x = x * 1664525u + 1013904223u;
+    *sink = x;
+}
+
+struct NestedData {
+    uint32_t fanOut;
+};
+
+static void nestedJob(void *data, uint32_t index) {
+    (void) index;
+    struct NestedData *nested = data;
+    struct JobCounter counter = { 0 };
+    jobsRunRange(emptyJob, NULL, nested->fanOut, &counter);
+    jobsWait(&counter);
+}
+
+static void benchRange(const char *name, void (*function)(void *, uint32_t), void *data, uint32_t count) {
+    double best = 1e30;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        struct JobCounter counter = { 0 };
+        double start = nowSeconds();
+        jobsRunRange(function, data, count, &counter);
+        jobsWait(&counter);
+        double elapsed = nowSeconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    printf("%-28s %8u jobs  %10.3f ms  %8.1f ns/job\n",
+        name, count, best * 1e3, best * 1e9 / count);
+}
+
+static void benchAffinity(uint32_t count) {
+    uint32_t workers = jobsWorkerCount();
+    struct JobDecl *decls = malloc(count * sizeof(struct JobDecl));
+    if (!decls) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        decls[i] = (struct JobDecl) {
+            .function = emptyJob,
+            .index = i,
+            .affinity = i % workers,
+        };
+    }
+
+    double best = 1e30;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        double start = nowSeconds();
+        // Mailboxes are bounded, so submit in slices that fit
+        for (uint32_t i = 0; i < count; i += JOBS_MAILBOX_CAPACITY) {
+            uint32_t slice = count - i < JOBS_MAILBOX_CAPACITY ? count - i : JOBS_MAILBOX_CAPACITY;
+            struct JobCounter counter = { 0 };
+            jobsRun(decls + i, slice, &counter);
+            jobsWait(&counter);
+        }
+        double elapsed = nowSeconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    printf("%-28s %8u jobs  %10.3f ms  %8.1f ns/job\n",
+        "pinned to workers", count, best * 1e3, best * 1e9 / count);
+
+    free(decls);
+}
+
+static void benchSort(const char *name, void (*sort)(struct RadixItem *, struct RadixItem *, uint32_t), uint32_t count) {
+    struct RadixItem *input = malloc(count * sizeof(struct RadixItem));
+    struct RadixItem *items = malloc(count * sizeof(struct RadixItem));
+    struct RadixItem *scratch = malloc(count * sizeof(struct RadixItem));
+    if (!input || !items || !scratch) {
+        free(input);
+        free(items);
+        free(scratch);
+        return;
+    }
+
+    // Draw-key-like: a few layers, hashed handles and depth in the low bits
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        input[i] = (struct RadixItem) { .key = (x & 0x03FFFFFFFFFFFFFFull) | ((uint64_t) (i & 1) << 56), .value = i };
+    }
+
+    double best = 1e30;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        memcpy(items, input, count * sizeof(struct RadixItem));
+        double start = nowSeconds();
+        sort(items, scratch, count);
+        double elapsed = nowSeconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    printf("%-28s %8u keys  %10.3f ms  %8.1f ns/key\n",
+        name, count, best * 1e3, best * 1e9 / count);
+
+    free(input);
+    free(items);
+    free(scratch);
+}
+
+int main(int argc, char **argv) {
+    uint32_t workers = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 0;
+    if (!jobsInit(workers)) return 1;
+
+    printf("workers: %u\n", jobsWorkerCount());
+
+    volatile uint32_t sink = 0;
+    benchRange("empty", emptyJob, NULL, 1000);
+    benchRange("empty", emptyJob, NULL, JOBS_DEQUE_CAPACITY);
+    benchRange("256 LCG steps", busyJob, (void *) &sink, JOBS_DEQUE_CAPACITY);
+
+    struct NestedData nested = { .fanOut = 64 };
+    benchRange("nested (64 children each)", nestedJob, &nested, 64);
+
+    benchAffinity(4096);
+
+    benchSort("radix sort", radixSort, 1u << 20);
+    benchSort("radix sort, parallel", radixSortParallel, 1u << 20);
+
+    jobsShutdown();
+    return 0;
+}
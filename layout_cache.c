@@ -0,0 +1,235 @@
+#include <vulkan/vulkan.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "layout_cache.h"
+
+static const char *bindlessNames[BINDLESS_BINDING_COUNT] = { "images", "samplers", "buffers" };
+
+void createLayoutCache(
+    VkDevice device,
+    const struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *cache
+) {
+    memset(cache, 0, sizeof(*cache));
+    cache->device = device;
+    cache->bindlessHeap = bindlessHeap;
+}
+
+void cleanupLayoutCache(struct LayoutCache *cache) {
+    for (uint32_t i = 0; i < cache->shaderCount; i++) {
+        statsFree(cache->shaderCode[i]);
+    }
+    for (uint32_t i = 0; i < cache->pipelineCount; i++) {
+        vkDestroyPipelineLayout(cache->device, cache->pipelines[i].layout, hostAllocator());
+    }
+    for (uint32_t i = 0; i < cache->setCount; i++) {
+        vkDestroyDescriptorSetLayout(cache->device, cache->sets[i].layout, hostAllocator());
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+const struct ShaderReflection *layoutCacheReflect(
+    struct LayoutCache *cache,
+    const uint32_t *code,
+    size_t size
+) {
+    // The hash only narrows it down, two modules may share one
+    uint64_t hash = spirvHash(code, size);
+    for (uint32_t i = 0; i < cache->shaderCount; i++) {
+        if (cache->shaders[i].hash != hash || cache->shaderSizes[i] != size) continue;
+        if (memcmp(cache->shaderCode[i], code, size) != 0) continue;
+        cache->reflectionHits++;
+        return &cache->shaders[i];
+    }
+
+    if (cache->shaderCount == LAYOUT_CACHE_MAX_SHADERS) {
+        fprintf(stderr, "Layout cache: more than %u shader modules\n", LAYOUT_CACHE_MAX_SHADERS);
+        return NULL;
+    }
+    struct ShaderReflection *reflection = &cache->shaders[cache->shaderCount];
+    if (!spirvReflect(code, size, reflection)) return NULL;
+
+    // The caller's copy is usually freed once the module is created
+    uint32_t *copy = statsMalloc(size);
+    if (!copy) {
+        fprintf(stderr, "Layout cache: failed to keep shader code\n");
+        return NULL;
+    }
+    memcpy(copy, code, size);
+    cache->shaderCode[cache->shaderCount] = copy;
+    cache->shaderSizes[cache->shaderCount] = size;
+    cache->shaderCount++;
+    return reflection;
+}
+
+// The heap sizes its arrays at startup and the shaders take the size as a
+// specialization constant, so only a fixed size larger than the heap's is wrong
+static bool matchesBindless(const struct LayoutCache *cache, const struct ShaderBinding *binding) {
+    if (binding->binding >= BINDLESS_BINDING_COUNT) {
+        fprintf(stderr, "Layout cache: set 0 binding %u is outside the bindless set\n", binding->binding);
+        return false;
+    }
+    uint32_t capacity = cache->bindlessHeap->slots[binding->binding].capacity;
+    if (binding->type != bindlessBindingType(binding->binding) || binding->count > capacity) {
+        fprintf(stderr, "Layout cache: set 0 binding %u doesn't match the bindless %s array of %u\n",
+            binding->binding, bindlessNames[binding->binding], capacity);
+        return false;
+    }
+    return true;
+}
+
+// Adds `binding` to `set` in binding order. Stages may share a binding as
+// long as they agree on it.
+static bool mergeBinding(struct LayoutCacheSet *set, const struct ShaderBinding *binding) {
+    uint32_t i = 0;
+    for (; i < set->bindingCount && set->bindings[i].binding < binding->binding; i++) { }
+    if (i < set->bindingCount && set->bindings[i].binding == binding->binding) {
+        if (set->bindings[i].type == binding->type && set->bindings[i].count == binding->count) return true;
+        fprintf(stderr, "Layout cache: stages disagree on set %u binding %u\n", binding->set, binding->binding);
+        return false;
+    }
+    if (set->bindingCount == SHADER_REFLECTION_MAX_BINDINGS) {
+        fprintf(stderr, "Layout cache: more than %u bindings in set %u\n", SHADER_REFLECTION_MAX_BINDINGS, binding->set);
+        return false;
+    }
+    memmove(&set->bindings[i + 1], &set->bindings[i], (set->bindingCount - i) * sizeof(set->bindings[0]));
+    set->bindings[i] = *binding;
+    set->bindingCount++;
+    return true;
+}
+
+static VkResult getSetLayout(struct LayoutCache *cache, const struct LayoutCacheSet *set, VkDescriptorSetLayout *outLayout) {
+    for (uint32_t i = 0; i < cache->setCount; i++) {
+        const struct LayoutCacheSet *existing = &cache->sets[i];
+        if (existing->bindingCount != set->bindingCount) continue;
+        if (memcmp(existing->bindings, set->bindings, set->bindingCount * sizeof(set->bindings[0])) != 0) continue;
+        *outLayout = existing->layout;
+        return VK_SUCCESS;
+    }
+    if (cache->setCount == LAYOUT_CACHE_MAX_SET_LAYOUTS) {
+        fprintf(stderr, "Layout cache: more than %u descriptor set layouts\n", LAYOUT_CACHE_MAX_SET_LAYOUTS);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[SHADER_REFLECTION_MAX_BINDINGS];
+    for (uint32_t i = 0; i < set->bindingCount; i++) {
+        const struct ShaderBinding *binding = &set->bindings[i];
+        // Only the bindless set can leave its sizes to the pipeline
+        if (binding->count == 0) {
+            fprintf(stderr, "Layout cache: set %u binding %u has no fixed size\n", binding->set, binding->binding);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        bindings[i] = (VkDescriptorSetLayoutBinding) {
+            .binding = binding->binding,
+            .descriptorType = binding->type,
+            .descriptorCount = binding->count,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        };
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = set->bindingCount,
+        .pBindings = bindings,
+    };
+
+    struct LayoutCacheSet *entry = &cache->sets[cache->setCount];
+    *entry = *set;
+    VkResult result = COUNT_VK_CREATE(vkCreateDescriptorSetLayout(cache->device, &layoutInfo, hostAllocator(), &entry->layout));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create reflected descriptor set layout");
+    cache->setCount++;
+    *outLayout = entry->layout;
+    return VK_SUCCESS;
+}
+
+VkResult layoutCacheGetPipelineLayout(
+    struct LayoutCache *cache,
+    const struct ShaderReflection *const *stages,
+    uint32_t stageCount,
+    VkPipelineLayout *outLayout
+) {
+    VkResult result;
+    *outLayout = VK_NULL_HANDLE;
+
+    struct LayoutCacheSet sets[LAYOUT_CACHE_MAX_SETS] = { 0 };
+    uint32_t setCount = 1;
+    uint32_t pushConstantSize = sizeof(struct BindlessPushConstants);
+    for (uint32_t s = 0; s < stageCount; s++) {
+        const struct ShaderReflection *stage = stages[s];
+        if (stage->pushConstantSize > pushConstantSize) pushConstantSize = stage->pushConstantSize;
+
+        for (uint32_t b = 0; b < stage->bindingCount; b++) {
+            const struct ShaderBinding *binding = &stage->bindings[b];
+            if (binding->set >= LAYOUT_CACHE_MAX_SETS) {
+                fprintf(stderr, "Layout cache: set %u is past the %u supported\n", binding->set, LAYOUT_CACHE_MAX_SETS);
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            bool ok = binding->set == 0 ? matchesBindless(cache, binding) : mergeBinding(&sets[binding->set], binding);
+            if (!ok) return VK_ERROR_INITIALIZATION_FAILED;
+            if (binding->set + 1 > setCount) setCount = binding->set + 1;
+        }
+    }
+    pushConstantSize = (pushConstantSize + 15) & ~15u;
+
+    // Sets skipped between used ones still need a layout, an empty one
+    VkDescriptorSetLayout setLayouts[LAYOUT_CACHE_MAX_SETS] = { cache->bindlessHeap->setLayout };
+    for (uint32_t set = 1; set < setCount; set++) {
+        result = getSetLayout(cache, &sets[set], &setLayouts[set]);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    for (uint32_t i = 0; i < cache->pipelineCount; i++) {
+        const struct LayoutCachePipeline *existing = &cache->pipelines[i];
+        if (existing->setCount != setCount || existing->pushConstantSize != pushConstantSize) continue;
+        if (memcmp(existing->sets, setLayouts, setCount * sizeof(setLayouts[0])) != 0) continue;
+        cache->layoutHits++;
+        *outLayout = existing->layout;
+        return VK_SUCCESS;
+    }
+    if (cache->pipelineCount == LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS) {
+        fprintf(stderr, "Layout cache: more than %u pipeline layouts\n", LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkPushConstantRange pushConstantRange = bindlessPushConstantRange();
+    pushConstantRange.size = pushConstantSize;
+    VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = setCount,
+        .pSetLayouts = setLayouts,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange,
+    };
+
+    struct LayoutCachePipeline *entry = &cache->pipelines[cache->pipelineCount];
+    *entry = (struct LayoutCachePipeline) {
+        .setCount = setCount,
+        .pushConstantSize = pushConstantSize,
+    };
+    memcpy(entry->sets, setLayouts, sizeof(entry->sets));
+    result = COUNT_VK_CREATE(vkCreatePipelineLayout(cache->device, &layoutInfo, hostAllocator(), &entry->layout));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create reflected pipeline layout");
+    cache->pipelineCount++;
+    *outLayout = entry->layout;
+    return VK_SUCCESS;
+}
+
+void layoutCacheReport(const struct LayoutCache *cache, FILE *out) {
+    fprintf(
+        out,
+        "Layouts: %u modules reflected (%u reused), %u set layouts, %u pipeline layouts (%u shared)\n",
+        cache->shaderCount,
+        cache->reflectionHits,
+        cache->setCount,
+        cache->pipelineCount,
+        cache->layoutHits
+    );
+    for (uint32_t i = 0; i < cache->pipelineCount; i++) {
+        const struct LayoutCachePipeline *pipeline = &cache->pipelines[i];
+        fprintf(out, "  %u set(s), %u bytes of push constants\n", pipeline->setCount, pipeline->pushConstantSize);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef LAYOUT_CACHE_H
+#define LAYOUT_CACHE_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bindless.h"
+#include "spirv_reflect.h"
+
+// Pipeline layouts built from shader reflection (spirv_reflect.h), one per
+// distinct layout however many pipelines ask for it.
+//
+// Set 0 is always the bindless heap's: what a shader declares there is
+// checked against the heap's bindings instead of becoming a new layout, so
+// one descriptor set bind serves every pipeline. Further sets get layouts
+// built from their reflected bindings, shared between identical sets.
+//
+// There is one push constant range, the bindless range's stages from
+// offset 0, as large as the largest block of any stage rounded up to 16
+// bytes and never smaller than BindlessPushConstants. Everything that fits
+// the regular 16 bytes therefore gets the same layout, and pushes and the
+// bound set stay valid across pipeline switches.
+//
+// Reflections are kept with a copy of the module's code, found by its hash
+// and confirmed by comparing the code, so a module used by several programs
+// is parsed once.
+
+#define LAYOUT_CACHE_MAX_SHADERS 32
+#define LAYOUT_CACHE_MAX_SET_LAYOUTS 8
+#define LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS 8
+#define LAYOUT_CACHE_MAX_SETS 4
+
+struct LayoutCacheSet {
+    uint32_t bindingCount;
+    struct ShaderBinding bindings[SHADER_REFLECTION_MAX_BINDINGS];
+    VkDescriptorSetLayout layout;
+};
+
+struct LayoutCachePipeline {
+    uint32_t setCount;
+    VkDescriptorSetLayout sets[LAYOUT_CACHE_MAX_SETS];
+    uint32_t pushConstantSize;
+    VkPipelineLayout layout;
+};
+
+struct LayoutCache {
+    VkDevice device;
+    const struct BindlessHeap *bindlessHeap;
+
+    uint32_t shaderCount;
+    struct ShaderReflection shaders[LAYOUT_CACHE_MAX_SHADERS];
+    uint32_t *shaderCode[LAYOUT_CACHE_MAX_SHADERS];
+    size_t shaderSizes[LAYOUT_CACHE_MAX_SHADERS];
+
+    uint32_t setCount;
+    struct LayoutCacheSet sets[LAYOUT_CACHE_MAX_SET_LAYOUTS];
+
+    uint32_t pipelineCount;
+    struct LayoutCachePipeline pipelines[LAYOUT_CACHE_MAX_PIPELINE_LAYOUTS];
+
+    uint32_t reflectionHits; // modules found again instead of parsed
+    uint32_t layoutHits;     // layouts handed out again instead of created
+};
+
+void createLayoutCache(
+    VkDevice device,
+    const struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *cache
+);
+void cleanupLayoutCache(struct LayoutCache *cache);
+
+// `size` in bytes. NULL if the module doesn't reflect or the cache is full.
+const struct ShaderReflection *layoutCacheReflect(
+    struct LayoutCache *cache,
+    const uint32_t *code,
+    size_t size
+);
+
+// The layout for a pipeline made of `stages`. With no stages it's the plain
+// bindless layout. Fails with a message naming the binding when a stage's
+// set 0 doesn't match the bindless heap.
+VkResult layoutCacheGetPipelineLayout(
+    struct LayoutCache *cache,
+    const struct ShaderReflection *const *stages,
+    uint32_t stageCount,
+    VkPipelineLayout *outLayout
+);
+
+void layoutCacheReport(const struct LayoutCache *cache, FILE *out);
+
+#endif // LAYOUT_CACHE_H
@@ -0,0 +1,348 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_simplify.h"
+
+// A full pass over the edges collapses about a third of the vertices, a
+// mesh is usually done in a handful
+#define MAX_PASSES 64
+
+// Plane distances squared, summed and weighted by triangle area. The
+// weight is kept so the error reads back as a distance.
+struct Quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double weight;
+};
+
+struct Collapse {
+    float error; // squared distance
+    uint32_t from;
+    uint32_t to;
+};
+
+struct SortedPosition {
+    float position[3];
+    uint32_t vertex;
+};
+
+static int comparePositions(const void *a, const void *b) {
+    const struct SortedPosition *pa = a;
+    const struct SortedPosition *pb = b;
+    for (uint32_t i = 0; i < 3; i++) {
+        if (pa->position[i] < pb->position[i]) return -1;
+        if (pa->position[i] > pb->position[i]) return 1;
+    }
+    return (pa->vertex > pb->vertex) - (pa->vertex < pb->vertex);
+}
+
+static int compareCollapses(const void *a, const void *b) {
+    const struct Collapse *ca = a;
+    const struct Collapse *cb = b;
+    return (ca->error > cb->error) - (ca->error < cb->error);
+}
+
+static void quadricAddPlane(struct Quadric *q, const double plane[4], double weight) {
+    double a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+    q->a2 += weight * a * a;
+    q->ab += weight * a * b;
+    q->ac += weight * a * c;
+    q->ad += weight * a * d;
+    q->b2 += weight * b * b;
+    q->bc += weight * b * c;
+    q->bd += weight * b * d;
+    q->c2 += weight * c * c;
+    q->cd += weight * c * d;
+    q->d2 += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadricAdd(struct Quadric *q, const struct Quadric *other) {
+    q->a2 += other->a2;
+    q->ab += other->ab;
+    q->ac += other->ac;
+    q->ad += other->ad;
+    q->b2 += other->b2;
+    q->bc += other->bc;
+    q->bd += other->bd;
+    q->c2 += other->c2;
+    q->cd += other->cd;
+    q->d2 += other->d2;
+    q->weight += other->weight;
+}
+
+// Mean squared distance from `p` to the quadric's planes
+static double quadricError(const struct Quadric *q, const float *p) {
+    if (q->weight <= 0.0) return 0.0;
+    double x = p[0], y = p[1], z = p[2];
+    double error = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x
+        + q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y
+        + q->c2 * z * z + 2.0 * q->cd * z
+        + q->d2;
+    return fabs(error) / q->weight;
+}
+
+static void triangleNormal(const float *p0, const float *p1, const float *p2, double out[3]) {
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static bool degenerate(const uint32_t *triangle) {
+    return triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2];
+}
+
+// Compacts `indices` in place, dropping triangles that lost a corner
+static uint32_t removeDegenerate(uint32_t *indices, uint32_t indexCount) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        if (degenerate(&indices[i])) continue;
+        indices[kept++] = indices[i];
+        indices[kept++] = indices[i + 1];
+        indices[kept++] = indices[i + 2];
+    }
+    return kept;
+}
+
+// Maps every vertex to the first one at the same position
+static bool mergePositions(const struct MeshVertex *vertices, uint32_t vertexCount, uint32_t *canonical) {
+    struct SortedPosition *sorted = malloc((size_t) vertexCount * sizeof(*sorted) + 1);
+    if (!sorted) return false;
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        memcpy(sorted[v].position, vertices[v].position, sizeof(sorted[v].position));
+        sorted[v].vertex = v;
+    }
+    qsort(sorted, vertexCount, sizeof(*sorted), comparePositions);
+
+    for (uint32_t s = 0; s < vertexCount; s++) {
+        bool same = s > 0 && memcmp(sorted[s].position, sorted[s - 1].position, sizeof(sorted[s].position)) == 0;
+        canonical[sorted[s].vertex] = same ? canonical[sorted[s - 1].vertex] : sorted[s].vertex;
+    }
+    free(sorted);
+    return true;
+}
+
+// Triangles around each vertex, `first` has vertexCount + 1 entries
+static void buildAdjacency(
+    const uint32_t *indices,
+    uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t *first,
+    uint32_t *triangles
+) {
+    memset(first, 0, ((size_t) vertexCount + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < indexCount; i++) first[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++) first[v + 1] += first[v];
+    for (uint32_t i = 0; i < indexCount; i++) triangles[first[indices[i]]++] = i / 3;
+    // The fill advanced every start to the next vertex's, shift them back
+    for (uint32_t v = vertexCount; v > 0; v--) first[v] = first[v - 1];
+    first[0] = 0;
+}
+
+// An edge with anything but two triangles is a border or a non-manifold
+// seam, both its ends stay where they are
+static void lockBorders(
+    const uint32_t *indices,
+    uint32_t vertexCount,
+    const uint32_t *first,
+    const uint32_t *triangles,
+    uint8_t *locked
+) {
+    memset(locked, 0, vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        for (uint32_t a = first[v]; a < first[v + 1] && !locked[v]; a++) {
+            const uint32_t *triangle = &indices[triangles[a] * 3];
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t w = triangle[corner];
+                if (w == v) continue;
+
+                uint32_t shared = 0;
+                for (uint32_t b = first[v]; b < first[v + 1]; b++) {
+                    const uint32_t *other = &indices[triangles[b] * 3];
+                    if (other[0] == w || other[1] == w || other[2] == w) shared++;
+                }
+                if (shared != 2) {
+                    locked[v] = 1;
+                    locked[w] = 1;
+                }
+            }
+        }
+    }
+}
+
+// Moving `from` onto `to` must not turn any surviving triangle over
+static bool collapseFlips(
+    const struct MeshVertex *vertices,
+    const uint32_t *indices,
+    const uint32_t *first,
+    const uint32_t *triangles,
+    const uint32_t *remap,
+    uint32_t from,
+    uint32_t to
+) {
+    for (uint32_t a = first[from]; a < first[from + 1]; a++) {
+        const uint32_t *triangle = &indices[triangles[a] * 3];
+        uint32_t before[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+        if (degenerate(before) || before[0] == to || before[1] == to || before[2] == to) continue;
+
+        uint32_t after[3];
+        for (uint32_t corner = 0; corner < 3; corner++) after[corner] = before[corner] == from ? to : before[corner];
+
+        double n0[3], n1[3];
+        triangleNormal(vertices[before[0]].position, vertices[before[1]].position, vertices[before[2]].position, n0);
+        triangleNormal(vertices[after[0]].position, vertices[after[1]].position, vertices[after[2]].position, n1);
+        if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0) return true;
+    }
+    return false;
+}
+
+// Triangles around `from` that also hold `to`, and vanish with the edge
+static uint32_t collapseRemoves(
+    const uint32_t *indices,
+    const uint32_t *first,
+    const uint32_t *triangles,
+    const uint32_t *remap,
+    uint32_t from,
+    uint32_t to
+) {
+    uint32_t removed = 0;
+    for (uint32_t a = first[from]; a < first[from + 1]; a++) {
+        const uint32_t *triangle = &indices[triangles[a] * 3];
+        uint32_t current[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+        if (!degenerate(current) && (current[0] == to || current[1] == to || current[2] == to)) removed++;
+    }
+    return removed;
+}
+
+// Collapses the cheapest edges whose ends no earlier collapse of this pass
+// touched, so every cost stays exact. Returns the number of collapses.
+static uint32_t simplifyPass(
+    const struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    uint32_t *indices,
+    uint32_t *indexCount,
+    uint32_t targetIndexCount,
+    struct Quadric *quadrics,
+    uint32_t *first,
+    uint32_t *triangles,
+    uint8_t *locked,
+    uint8_t *touched,
+    uint32_t *remap,
+    struct Collapse *collapses,
+    double *maxError
+) {
+    buildAdjacency(indices, *indexCount, vertexCount, first, triangles);
+    lockBorders(indices, vertexCount, first, triangles, locked);
+
+    // Both directions are priced; a locked end can only be the target
+    uint32_t collapseCount = 0;
+    for (uint32_t i = 0; i < *indexCount; i++) {
+        uint32_t u = indices[i];
+        uint32_t v = indices[i - i % 3 + (i + 1) % 3];
+        if (u > v) continue; // the neighbor triangle lists it the other way round
+        if (locked[u] && locked[v]) continue;
+
+        struct Quadric q = quadrics[u];
+        quadricAdd(&q, &quadrics[v]);
+        double toV = locked[u] ? INFINITY : quadricError(&q, vertices[v].position);
+        double toU = locked[v] ? INFINITY : quadricError(&q, vertices[u].position);
+        collapses[collapseCount++] = toV <= toU
+            ? (struct Collapse) { .error = (float) toV, .from = u, .to = v }
+            : (struct Collapse) { .error = (float) toU, .from = v, .to = u };
+    }
+    qsort(collapses, collapseCount, sizeof(*collapses), compareCollapses);
+
+    for (uint32_t v = 0; v < vertexCount; v++) remap[v] = v;
+    memset(touched, 0, vertexCount);
+    uint32_t collapsed = 0;
+    uint32_t remaining = *indexCount;
+    for (uint32_t c = 0; c < collapseCount && remaining > targetIndexCount; c++) {
+        const struct Collapse *collapse = &collapses[c];
+        if (touched[collapse->from] || touched[collapse->to]) continue;
+        if (collapseFlips(vertices, indices, first, triangles, remap, collapse->from, collapse->to)) continue;
+
+        remaining -= collapseRemoves(indices, first, triangles, remap, collapse->from, collapse->to) * 3;
+        remap[collapse->from] = collapse->to;
+        quadricAdd(&quadrics[collapse->to], &quadrics[collapse->from]);
+        touched[collapse->from] = 1;
+        touched[collapse->to] = 1;
+        if (collapse->error > *maxError) *maxError = collapse->error;
+        collapsed++;
+    }
+
+    for (uint32_t i = 0; i < *indexCount; i++) indices[i] = remap[indices[i]];
+    *indexCount = removeDegenerate(indices, *indexCount);
+    return collapsed;
+}
+
+uint32_t meshSimplify(
+    const struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    uint32_t targetIndexCount,
+    uint32_t *outIndices,
+    float *outError
+) {
+    *outError = 0.0f;
+    indexCount -= indexCount % 3;
+
+    uint32_t *remap = malloc((size_t) vertexCount * sizeof(uint32_t) + 1);
+    uint32_t *first = malloc(((size_t) vertexCount + 1) * sizeof(uint32_t));
+    uint32_t *triangles = malloc((size_t) indexCount * sizeof(uint32_t) + 1);
+    uint8_t *locked = malloc((size_t) vertexCount + 1);
+    uint8_t *touched = malloc((size_t) vertexCount + 1);
+    struct Quadric *quadrics = calloc((size_t) vertexCount + 1, sizeof(struct Quadric));
+    struct Collapse *collapses = malloc((size_t) indexCount * sizeof(struct Collapse) + 1);
+    bool ok = remap && first && triangles && locked && touched && quadrics && collapses
+        && mergePositions(vertices, vertexCount, remap);
+
+    uint32_t count = 0;
+    if (ok) {
+        for (uint32_t i = 0; i < indexCount; i += 3) {
+            const uint32_t *triangle = &indices[i];
+            if (triangle[0] >= vertexCount || triangle[1] >= vertexCount || triangle[2] >= vertexCount) continue;
+            for (uint32_t corner = 0; corner < 3; corner++) outIndices[count++] = remap[triangle[corner]];
+        }
+        count = removeDegenerate(outIndices, count);
+
+        for (uint32_t i = 0; i < count; i += 3) {
+            const uint32_t *triangle = &outIndices[i];
+            double n[3];
+            triangleNormal(vertices[triangle[0]].position, vertices[triangle[1]].position, vertices[triangle[2]].position, n);
+            double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length == 0.0) continue;
+
+            const float *p = vertices[triangle[0]].position;
+            double plane[4] = { n[0] / length, n[1] / length, n[2] / length, 0.0 };
+            plane[3] = -(plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2]);
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                quadricAddPlane(&quadrics[triangle[corner]], plane, length * 0.5);
+            }
+        }
+
+        double maxError = 0.0;
+        for (uint32_t pass = 0; pass < MAX_PASSES && count > targetIndexCount; pass++) {
+            uint32_t collapsed = simplifyPass(
+                vertices, vertexCount, outIndices, &count, targetIndexCount,
+                quadrics, first, triangles, locked, touched, remap, collapses, &maxError
+            );
+            if (collapsed == 0) break;
+        }
+        *outError = (float) sqrt(maxError);
+    }
+
+    free(remap);
+    free(first);
+    free(triangles);
+    free(locked);
+    free(touched);
+    free(quadrics);
+    free(collapses);
+    return ok ? count : 0;
+}
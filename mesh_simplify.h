@@ -0,0 +1,34 @@
+#pragma once
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <stdint.h>
+
+#include "meshlet_builder.h"
+
+// Quadric error metric simplification (Garland and Heckbert). Every vertex
+// carries the sum of the planes of the triangles around it, and the edge
+// whose collapse moves the fewest of those planes goes first. Collapses
+// only ever move a vertex onto a neighbor, so the result indexes the same
+// vertex array and every level of detail shares one vertex buffer.
+//
+// Vertices at the same position are merged first, so UV and normal seams
+// collapse as one and don't open cracks. Border and non-manifold edges are
+// locked, and collapses that would flip a triangle are refused, so the
+// simplified mesh keeps its outline and its winding.
+
+// Writes at most `indexCount` indices to `outIndices`, stopping at or below
+// `targetIndexCount` or when no edge can go. `outError` is the largest
+// distance a collapse moved the surface, in mesh units. Returns the index
+// count, or 0 when out of memory.
+uint32_t meshSimplify(
+    const struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    uint32_t targetIndexCount,
+    uint32_t *outIndices,
+    float *outError
+);
+
+#endif // MESH_SIMPLIFY_H
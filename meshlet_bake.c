@@ -0,0 +1,140 @@
+// Offline meshlet builder: reads a Wavefront OBJ and writes the .meshlets
+// file the renderer loads from meshes/demo.meshlets.
+// Build the `meshlet_bake` target and run
+//     meshlet_bake input.obj meshes/demo.meshlets
+//
+// Only positions and faces are read. Polygons are split into fans, normals
+// are recomputed from the faces, and texture coordinates and materials are
+// ignored since nothing draws them yet. The full level of detail chain is
+// simplified here so the renderer doesn't pay for it at startup.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshlet_builder.h"
+
+struct Growable {
+    void *data;
+    size_t count;
+    size_t capacity;
+    size_t itemSize;
+};
+
+static void *growablePush(struct Growable *array) {
+    if (array->count == array->capacity) {
+        size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+        void *data = realloc(array->data, capacity * array->itemSize);
+        if (!data) return NULL;
+        array->data = data;
+        array->capacity = capacity;
+    }
+    return (char *) array->data + array->count++ * array->itemSize;
+}
+
+// 1-based, negative counts back from the last position read so far
+static bool parseIndex(const char *token, size_t positionCount, uint32_t *outIndex) {
+    long index = strtol(token, NULL, 10);
+    if (index < 0) index += (long) positionCount + 1;
+    if (index < 1 || (size_t) index > positionCount) return false;
+    *outIndex = (uint32_t) (index - 1);
+    return true;
+}
+
+static bool loadObj(const char *path, struct Growable *vertices, struct Growable *indices) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    char line[4096];
+    uint32_t lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (line[0] == 'v' && line[1] == ' ') {
+            struct MeshVertex *vertex = growablePush(vertices);
+            if (!vertex) {
+                ok = false;
+                break;
+            }
+            *vertex = (struct MeshVertex) { 0 };
+            if (sscanf(line + 2, "%f %f %f", &vertex->position[0], &vertex->position[1], &vertex->position[2]) != 3) {
+                fprintf(stderr, "%s:%u: malformed vertex\n", path, lineNumber);
+                ok = false;
+            }
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // Fan around the first corner
+            uint32_t corners[3];
+            uint32_t cornerCount = 0;
+            for (char *token = strtok(line + 2, " \t\r\n"); token && ok; token = strtok(NULL, " \t\r\n")) {
+                uint32_t index;
+                if (!parseIndex(token, vertices->count, &index)) {
+                    fprintf(stderr, "%s:%u: face index out of range\n", path, lineNumber);
+                    ok = false;
+                    break;
+                }
+                if (cornerCount < 2) {
+                    corners[cornerCount++] = index;
+                    continue;
+                }
+                corners[2] = index;
+                for (uint32_t i = 0; i < 3 && ok; i++) {
+                    uint32_t *slot = growablePush(indices);
+                    if (!slot) {
+                        ok = false;
+                        break;
+                    }
+                    *slot = corners[i];
+                }
+                corners[1] = index;
+            }
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s input.obj output.meshlets\n", argv[0]);
+        return 1;
+    }
+
+    struct Growable vertices = { .itemSize = sizeof(struct MeshVertex) };
+    struct Growable indices = { .itemSize = sizeof(uint32_t) };
+    if (!loadObj(argv[1], &vertices, &indices)) return 1;
+    if (vertices.count > UINT32_MAX || indices.count > UINT32_MAX) {
+        fprintf(stderr, "%s is too large\n", argv[1]);
+        return 1;
+    }
+    meshletsComputeNormals(vertices.data, (uint32_t) vertices.count, indices.data, (uint32_t) indices.count);
+
+    struct MeshletMesh mesh;
+    bool ok = meshletsBuild(vertices.data, (uint32_t) vertices.count, indices.data, (uint32_t) indices.count, MESHLET_MAX_LODS, &mesh);
+    free(vertices.data);
+    free(indices.data);
+    if (!ok) return 1;
+
+    uint32_t coned = 0;
+    for (uint32_t m = 0; m < mesh.meshletCount; m++) {
+        if (mesh.meshlets[m].coneCutoff < 1.0f) coned++;
+    }
+    printf("%u vertices, %u triangles -> %u meshlets, %.1f vertices and %.1f triangles each, %u with a normal cone\n",
+        mesh.vertexCount,
+        mesh.triangleCount,
+        mesh.meshletCount,
+        mesh.meshletCount ? (double) mesh.meshletVertexCount / mesh.meshletCount : 0.0,
+        mesh.meshletCount ? (double) mesh.triangleCount / mesh.meshletCount : 0.0,
+        coned);
+    for (uint32_t l = 0; l < mesh.lodCount; l++) {
+        printf("  LOD %u: %u triangles in %u meshlets, error %g\n",
+            l, mesh.lods[l].triangleCount, mesh.lods[l].meshletCount, (double) mesh.lods[l].error);
+    }
+
+    ok = meshletsWrite(argv[2], &mesh);
+    meshletsFree(&mesh);
+    return ok ? 0 : 1;
+}
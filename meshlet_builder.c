@@ -0,0 +1,418 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_simplify.h"
+#include "meshlet_builder.h"
+
+#define NOT_IN_MESHLET 0xffu
+
+// Every level aims for half its parent's triangles. One that can't get
+// under LOD_MIN_REDUCTION of them ends the chain, as does a parent already
+// down to LOD_MIN_TRIANGLES: a couple of meshlets aren't worth a level.
+#define LOD_REDUCTION 0.5
+#define LOD_MIN_REDUCTION 0.8
+#define LOD_MIN_TRIANGLES 256
+
+struct MeshletFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t triangleCount;
+    uint32_t lodCount;
+    float center[3];
+    float radius;
+    struct MeshletLod lods[MESHLET_MAX_LODS];
+};
+
+static void unpackTriangle(uint32_t packed, uint32_t local[3]) {
+    local[0] = packed & 0xffu;
+    local[1] = (packed >> 8) & 0xffu;
+    local[2] = (packed >> 16) & 0xffu;
+}
+
+static void cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// The cross product of two edges, twice the area long
+static void triangleNormal(const float *p0, const float *p1, const float *p2, float out[3]) {
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    cross(e1, e2, out);
+}
+
+void meshletsComputeNormals(
+    struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+) {
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        memset(vertices[v].normal, 0, sizeof(vertices[v].normal));
+    }
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        const uint32_t *triangle = &indices[i];
+        if (triangle[0] >= vertexCount || triangle[1] >= vertexCount || triangle[2] >= vertexCount) continue;
+
+        float n[3];
+        triangleNormal(vertices[triangle[0]].position, vertices[triangle[1]].position, vertices[triangle[2]].position, n);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            float *normal = vertices[triangle[corner]].normal;
+            for (uint32_t k = 0; k < 3; k++) normal[k] += n[k];
+        }
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        float *n = vertices[v].normal;
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f) continue;
+        for (uint32_t k = 0; k < 3; k++) n[k] /= length;
+    }
+}
+
+// Sphere around the bounding box, and the cone holding every triangle's
+// normal. The cone is left open when the normals spread past 90 degrees,
+// there's then no viewpoint that sees only back faces of all of them.
+static void computeBounds(const struct MeshletMesh *mesh, struct Meshlet *meshlet) {
+    const uint32_t *vertices = &mesh->meshletVertices[meshlet->vertexOffset];
+    const uint32_t *triangles = &mesh->meshletTriangles[meshlet->triangleOffset];
+
+    float low[3] = { INFINITY, INFINITY, INFINITY };
+    float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t v = 0; v < meshlet->vertexCount; v++) {
+        const float *p = mesh->vertices[vertices[v]].position;
+        for (uint32_t i = 0; i < 3; i++) {
+            low[i] = fminf(low[i], p[i]);
+            high[i] = fmaxf(high[i], p[i]);
+        }
+    }
+
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < 3; i++) meshlet->center[i] = (low[i] + high[i]) * 0.5f;
+    for (uint32_t v = 0; v < meshlet->vertexCount; v++) {
+        const float *p = mesh->vertices[vertices[v]].position;
+        float dx = p[0] - meshlet->center[0];
+        float dy = p[1] - meshlet->center[1];
+        float dz = p[2] - meshlet->center[2];
+        radius = fmaxf(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+    }
+    meshlet->radius = radius;
+
+    float normals[MESHLET_MAX_TRIANGLES][3];
+    bool valid[MESHLET_MAX_TRIANGLES];
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t t = 0; t < meshlet->triangleCount; t++) {
+        uint32_t local[3];
+        unpackTriangle(triangles[t], local);
+        float *n = normals[t];
+        triangleNormal(
+            mesh->vertices[vertices[local[0]]].position,
+            mesh->vertices[vertices[local[1]]].position,
+            mesh->vertices[vertices[local[2]]].position,
+            n
+        );
+
+        // Degenerate triangles never rasterize, they don't widen the cone
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        valid[t] = length > 1e-12f;
+        if (!valid[t]) continue;
+        for (uint32_t i = 0; i < 3; i++) {
+            n[i] /= length;
+            axis[i] += n[i];
+        }
+    }
+
+    meshlet->coneAxis[0] = meshlet->coneAxis[1] = meshlet->coneAxis[2] = 0.0f;
+    meshlet->coneCutoff = 1.0f;
+
+    float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength < 1e-6f) return;
+    for (uint32_t i = 0; i < 3; i++) axis[i] /= axisLength;
+
+    float minDot = 1.0f;
+    for (uint32_t t = 0; t < meshlet->triangleCount; t++) {
+        if (!valid[t]) continue;
+        const float *n = normals[t];
+        minDot = fminf(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+    }
+    if (minDot <= 0.0f) return;
+
+    for (uint32_t i = 0; i < 3; i++) meshlet->coneAxis[i] = axis[i];
+    meshlet->coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+// Finishes `current` and starts the next meshlet after it
+static void closeMeshlet(struct MeshletMesh *mesh, struct Meshlet *current, uint8_t *local) {
+    for (uint32_t v = 0; v < current->vertexCount; v++) {
+        local[mesh->meshletVertices[current->vertexOffset + v]] = NOT_IN_MESHLET;
+    }
+    computeBounds(mesh, current);
+    mesh->meshlets[mesh->meshletCount++] = *current;
+
+    *current = (struct Meshlet) {
+        .vertexOffset = mesh->meshletVertexCount,
+        .triangleOffset = mesh->triangleCount,
+    };
+}
+
+// Sphere around the bounding box of every vertex
+static void computeMeshBounds(struct MeshletMesh *mesh) {
+    float low[3] = { INFINITY, INFINITY, INFINITY };
+    float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t v = 0; v < mesh->vertexCount; v++) {
+        const float *p = mesh->vertices[v].position;
+        for (uint32_t i = 0; i < 3; i++) {
+            low[i] = fminf(low[i], p[i]);
+            high[i] = fmaxf(high[i], p[i]);
+        }
+    }
+
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < 3; i++) mesh->center[i] = mesh->vertexCount ? (low[i] + high[i]) * 0.5f : 0.0f;
+    for (uint32_t v = 0; v < mesh->vertexCount; v++) {
+        const float *p = mesh->vertices[v].position;
+        float dx = p[0] - mesh->center[0];
+        float dy = p[1] - mesh->center[1];
+        float dz = p[2] - mesh->center[2];
+        radius = fmaxf(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+    }
+    mesh->radius = radius;
+}
+
+// Appends one level's triangles as meshlets after the ones already built
+static void appendMeshlets(struct MeshletMesh *mesh, const uint32_t *indices, uint32_t indexCount, uint8_t *local) {
+    struct Meshlet current = {
+        .vertexOffset = mesh->meshletVertexCount,
+        .triangleOffset = mesh->triangleCount,
+    };
+    for (uint32_t t = 0; t < indexCount / 3; t++) {
+        const uint32_t *triangle = &indices[t * 3];
+        if (triangle[0] >= mesh->vertexCount || triangle[1] >= mesh->vertexCount || triangle[2] >= mesh->vertexCount) {
+            continue;
+        }
+
+        uint32_t added = 0;
+        for (uint32_t i = 0; i < 3; i++) {
+            bool repeated = (i > 0 && triangle[i] == triangle[0]) || (i > 1 && triangle[i] == triangle[1]);
+            if (local[triangle[i]] == NOT_IN_MESHLET && !repeated) added++;
+        }
+        if (current.vertexCount + added > MESHLET_MAX_VERTICES || current.triangleCount == MESHLET_MAX_TRIANGLES) {
+            closeMeshlet(mesh, &current, local);
+        }
+
+        uint32_t packed = 0;
+        for (uint32_t i = 0; i < 3; i++) {
+            uint32_t vertex = triangle[i];
+            if (local[vertex] == NOT_IN_MESHLET) {
+                local[vertex] = (uint8_t) current.vertexCount++;
+                mesh->meshletVertices[mesh->meshletVertexCount++] = vertex;
+            }
+            packed |= (uint32_t) local[vertex] << (i * 8);
+        }
+        mesh->meshletTriangles[mesh->triangleCount++] = packed;
+        current.triangleCount++;
+    }
+    if (current.triangleCount > 0) closeMeshlet(mesh, &current, local);
+}
+
+bool meshletsBuild(
+    const struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    uint32_t maxLods,
+    struct MeshletMesh *mesh
+) {
+    memset(mesh, 0, sizeof(*mesh));
+    if (maxLods < 1) maxLods = 1;
+    if (maxLods > MESHLET_MAX_LODS) maxLods = MESHLET_MAX_LODS;
+
+    // Every level is simplified from the one before, which is cheaper than
+    // starting over from the full mesh each time. Its error is measured
+    // against that parent, so the errors add up along the chain.
+    const uint32_t *levels[MESHLET_MAX_LODS] = { indices };
+    uint32_t levelIndexCounts[MESHLET_MAX_LODS] = { indexCount - indexCount % 3 };
+    float levelErrors[MESHLET_MAX_LODS] = { 0.0f };
+    uint32_t levelCount = 1;
+    while (levelCount < maxLods) {
+        uint32_t parentCount = levelIndexCounts[levelCount - 1];
+        if (parentCount / 3 <= LOD_MIN_TRIANGLES) break;
+
+        uint32_t *level = malloc((size_t) parentCount * sizeof(uint32_t));
+        if (!level) break;
+        uint32_t targetCount = (uint32_t) (parentCount / 3 * LOD_REDUCTION) * 3;
+        float error;
+        uint32_t count = meshSimplify(vertices, vertexCount, levels[levelCount - 1], parentCount, targetCount, level, &error);
+        if (count == 0 || count > parentCount * LOD_MIN_REDUCTION) {
+            free(level);
+            break;
+        }
+        levels[levelCount] = level;
+        levelIndexCounts[levelCount] = count;
+        levelErrors[levelCount] = levelErrors[levelCount - 1] + error;
+        levelCount++;
+    }
+
+    uint32_t triangleCount = 0;
+    for (uint32_t l = 0; l < levelCount; l++) triangleCount += levelIndexCounts[l] / 3;
+
+    // Sized for the worst case, a meshlet per triangle, and trimmed after
+    mesh->vertexCount = vertexCount;
+    mesh->vertices = malloc((size_t) vertexCount * sizeof(struct MeshVertex) + 1);
+    mesh->meshlets = malloc((size_t) triangleCount * sizeof(struct Meshlet) + 1);
+    mesh->meshletVertices = malloc((size_t) triangleCount * 3 * sizeof(uint32_t) + 1);
+    mesh->meshletTriangles = malloc((size_t) triangleCount * sizeof(uint32_t) + 1);
+    uint8_t *local = malloc((size_t) vertexCount + 1);
+    bool ok = mesh->vertices && mesh->meshlets && mesh->meshletVertices && mesh->meshletTriangles && local;
+    if (ok) {
+        memcpy(mesh->vertices, vertices, (size_t) vertexCount * sizeof(struct MeshVertex));
+        memset(local, NOT_IN_MESHLET, vertexCount);
+        computeMeshBounds(mesh);
+
+        for (uint32_t l = 0; l < levelCount; l++) {
+            struct MeshletLod *lod = &mesh->lods[mesh->lodCount++];
+            uint32_t firstTriangle = mesh->triangleCount;
+            lod->firstMeshlet = mesh->meshletCount;
+            appendMeshlets(mesh, levels[l], levelIndexCounts[l], local);
+            lod->meshletCount = mesh->meshletCount - lod->firstMeshlet;
+            lod->triangleCount = mesh->triangleCount - firstTriangle;
+            lod->error = levelErrors[l];
+        }
+    }
+    for (uint32_t l = 1; l < levelCount; l++) free((void *) levels[l]);
+    free(local);
+    if (!ok) {
+        fprintf(stderr, "Meshlets: out of memory for %u triangles\n", triangleCount);
+        meshletsFree(mesh);
+        return false;
+    }
+
+    // Shrinking never fails in practice, the oversized blocks are kept if it does
+    struct Meshlet *meshlets = realloc(mesh->meshlets, (size_t) mesh->meshletCount * sizeof(struct Meshlet) + 1);
+    if (meshlets) mesh->meshlets = meshlets;
+    uint32_t *meshletVertices = realloc(mesh->meshletVertices, (size_t) mesh->meshletVertexCount * sizeof(uint32_t) + 1);
+    if (meshletVertices) mesh->meshletVertices = meshletVertices;
+    return true;
+}
+
+void meshletsFree(struct MeshletMesh *mesh) {
+    free(mesh->vertices);
+    free(mesh->meshlets);
+    free(mesh->meshletVertices);
+    free(mesh->meshletTriangles);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+bool meshletsWrite(const char *path, const struct MeshletMesh *mesh) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Meshlets: failed to create %s\n", path);
+        return false;
+    }
+
+    struct MeshletFileHeader header = {
+        .magic = MESHLET_FILE_MAGIC,
+        .version = MESHLET_FILE_VERSION,
+        .vertexCount = mesh->vertexCount,
+        .meshletCount = mesh->meshletCount,
+        .meshletVertexCount = mesh->meshletVertexCount,
+        .triangleCount = mesh->triangleCount,
+        .lodCount = mesh->lodCount,
+        .center = { mesh->center[0], mesh->center[1], mesh->center[2] },
+        .radius = mesh->radius,
+    };
+    memcpy(header.lods, mesh->lods, sizeof(header.lods));
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(mesh->vertices, sizeof(struct MeshVertex), mesh->vertexCount, file) == mesh->vertexCount;
+    ok = ok && fwrite(mesh->meshlets, sizeof(struct Meshlet), mesh->meshletCount, file) == mesh->meshletCount;
+    ok = ok && fwrite(mesh->meshletVertices, sizeof(uint32_t), mesh->meshletVertexCount, file) == mesh->meshletVertexCount;
+    ok = ok && fwrite(mesh->meshletTriangles, sizeof(uint32_t), mesh->triangleCount, file) == mesh->triangleCount;
+    if (fclose(file) != 0) ok = false;
+
+    if (!ok) fprintf(stderr, "Meshlets: failed to write %s\n", path);
+    return ok;
+}
+
+// Every index the GPU will follow stays inside the arrays it indexes
+static bool meshletsValid(const struct MeshletMesh *mesh) {
+    if (mesh->lodCount < 1 || mesh->lodCount > MESHLET_MAX_LODS) return false;
+    for (uint32_t l = 0; l < mesh->lodCount; l++) {
+        const struct MeshletLod *lod = &mesh->lods[l];
+        if (lod->firstMeshlet > mesh->meshletCount
+            || lod->meshletCount > mesh->meshletCount - lod->firstMeshlet) return false;
+    }
+    for (uint32_t v = 0; v < mesh->meshletVertexCount; v++) {
+        if (mesh->meshletVertices[v] >= mesh->vertexCount) return false;
+    }
+    for (uint32_t m = 0; m < mesh->meshletCount; m++) {
+        const struct Meshlet *meshlet = &mesh->meshlets[m];
+        if (meshlet->vertexCount > MESHLET_MAX_VERTICES || meshlet->triangleCount > MESHLET_MAX_TRIANGLES) return false;
+        if (meshlet->vertexOffset > mesh->meshletVertexCount
+            || meshlet->vertexCount > mesh->meshletVertexCount - meshlet->vertexOffset) return false;
+        if (meshlet->triangleOffset > mesh->triangleCount
+            || meshlet->triangleCount > mesh->triangleCount - meshlet->triangleOffset) return false;
+
+        for (uint32_t t = 0; t < meshlet->triangleCount; t++) {
+            uint32_t local[3];
+            unpackTriangle(mesh->meshletTriangles[meshlet->triangleOffset + t], local);
+            if (local[0] >= meshlet->vertexCount || local[1] >= meshlet->vertexCount || local[2] >= meshlet->vertexCount) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool meshletsRead(const char *path, struct MeshletMesh *mesh) {
+    memset(mesh, 0, sizeof(*mesh));
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    struct MeshletFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == MESHLET_FILE_MAGIC
+        && header.version == MESHLET_FILE_VERSION;
+
+    // Checked against the file before anything is allocated from the counts
+    long fileSize = 0;
+    if (ok && fseek(file, 0, SEEK_END) == 0) fileSize = ftell(file);
+    uint64_t expected = sizeof(header)
+        + (uint64_t) header.vertexCount * sizeof(struct MeshVertex)
+        + (uint64_t) header.meshletCount * sizeof(struct Meshlet)
+        + (uint64_t) header.meshletVertexCount * sizeof(uint32_t)
+        + (uint64_t) header.triangleCount * sizeof(uint32_t);
+    ok = ok && fileSize >= 0 && (uint64_t) fileSize == expected && fseek(file, sizeof(header), SEEK_SET) == 0;
+
+    if (ok) {
+        mesh->vertexCount = header.vertexCount;
+        mesh->meshletCount = header.meshletCount;
+        mesh->meshletVertexCount = header.meshletVertexCount;
+        mesh->triangleCount = header.triangleCount;
+        mesh->lodCount = header.lodCount;
+        memcpy(mesh->center, header.center, sizeof(mesh->center));
+        mesh->radius = header.radius;
+        memcpy(mesh->lods, header.lods, sizeof(mesh->lods));
+        mesh->vertices = malloc((size_t) header.vertexCount * sizeof(struct MeshVertex) + 1);
+        mesh->meshlets = malloc((size_t) header.meshletCount * sizeof(struct Meshlet) + 1);
+        mesh->meshletVertices = malloc((size_t) header.meshletVertexCount * sizeof(uint32_t) + 1);
+        mesh->meshletTriangles = malloc((size_t) header.triangleCount * sizeof(uint32_t) + 1);
+        ok = mesh->vertices && mesh->meshlets && mesh->meshletVertices && mesh->meshletTriangles;
+    }
+    ok = ok && fread(mesh->vertices, sizeof(struct MeshVertex), mesh->vertexCount, file) == mesh->vertexCount;
+    ok = ok && fread(mesh->meshlets, sizeof(struct Meshlet), mesh->meshletCount, file) == mesh->meshletCount;
+    ok = ok && fread(mesh->meshletVertices, sizeof(uint32_t), mesh->meshletVertexCount, file) == mesh->meshletVertexCount;
+    ok = ok && fread(mesh->meshletTriangles, sizeof(uint32_t), mesh->triangleCount, file) == mesh->triangleCount;
+    fclose(file);
+
+    ok = ok && meshletsValid(mesh);
+    if (!ok) {
+        fprintf(stderr, "Meshlets: %s is not a valid version %u meshlet file\n", path, MESHLET_FILE_VERSION);
+        meshletsFree(mesh);
+    }
+    return ok;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef MESHLET_BUILDER_H
+#define MESHLET_BUILDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Splits indexed triangle meshes into meshlets: clusters of at most 64
+// vertices and 124 triangles, each with a bounding sphere and a normal cone
+// so the GPU can drop whole clusters that are off screen or facing away.
+// Used at load time by the renderer and offline by meshlet_bake, which
+// writes the result to a .meshlets file the renderer loads as is.
+//
+// Triangles are taken in index order and a meshlet is closed as soon as the
+// next one doesn't fit, so clusters are only as tight as the input's
+// locality. Feed it meshes in vertex cache order; grids and scans already are.
+//
+// The mesh also carries its levels of detail, made by mesh_simplify.h. Each
+// level is a contiguous run of meshlets over the one shared vertex array,
+// finest first, so drawing a level is culling a different meshlet range.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+#define MESHLET_FILE_MAGIC 0x4c48534du // "MSHL"
+#define MESHLET_FILE_VERSION 2
+
+#define MESHLET_MAX_LODS 8
+
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+};
+
+// std430, the GPU reads the array as is. With coneCutoff at 1 and a zero
+// axis the cluster is never cone culled; its normals spread too far.
+struct Meshlet {
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;        // sine of the cone's half angle
+    uint32_t vertexOffset;   // into meshletVertices
+    uint32_t triangleOffset; // into meshletTriangles
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+_Static_assert(sizeof(struct Meshlet) == 48, "must match Meshlet in meshlets.comp");
+
+// `error` is how far the level's surface may be from the full mesh's, in
+// mesh units, and is what the renderer projects to pick a level
+struct MeshletLod {
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t triangleCount;
+    float error;
+};
+
+struct MeshletMesh {
+    float center[3]; // bounding sphere of every vertex
+    float radius;
+    uint32_t lodCount;
+    struct MeshletLod lods[MESHLET_MAX_LODS];
+    uint32_t vertexCount;
+    struct MeshVertex *vertices;
+    uint32_t meshletCount;
+    struct Meshlet *meshlets;
+    uint32_t meshletVertexCount;
+    uint32_t *meshletVertices;  // meshlet-local vertex to mesh vertex
+    uint32_t triangleCount;
+    uint32_t *meshletTriangles; // three meshlet-local indices, a | b << 8 | c << 16
+};
+
+// Smooth normals, each vertex's faces weighted by their area
+void meshletsComputeNormals(
+    struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+);
+
+// Copies the vertices; triangles with an index out of range are dropped.
+// Level 0 is the mesh as given and every further level has about half the
+// triangles of the one before, up to `maxLods` levels or until
+// simplification stalls.
+bool meshletsBuild(
+    const struct MeshVertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    uint32_t maxLods,
+    struct MeshletMesh *mesh
+);
+void meshletsFree(struct MeshletMesh *mesh);
+
+// Host byte order, like frame traces
+bool meshletsWrite(const char *path, const struct MeshletMesh *mesh);
+// Validates every offset, a truncated or corrupt file is reported and fails
+bool meshletsRead(const char *path, struct MeshletMesh *mesh);
+
+#endif // MESHLET_BUILDER_H
@@ -0,0 +1,516 @@
+#include <vulkan/vulkan.h>
+
+#include <cglm/cglm.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "buffers.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "meshlets.h"
+#include "shader_modules.h"
+
+enum MeshSection {
+    MESH_SECTION_VERTICES,
+    MESH_SECTION_MESHLETS,
+    MESH_SECTION_MESHLET_VERTICES,
+    MESH_SECTION_TRIANGLES,
+    MESH_SECTION_COUNT
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkResult createMeshletPipelines(struct MeshletSystem *system) {
+    // Same specialization scheme as particles.comp, with the stage in id 0
+    const struct BindlessSlots *slots = system->bindlessHeap->slots;
+    uint32_t constants[MESHLET_STAGE_COUNT][4];
+    VkSpecializationMapEntry entries[4];
+    VkSpecializationInfo specializations[MESHLET_STAGE_COUNT];
+    VkComputePipelineCreateInfo pipelineInfos[MESHLET_STAGE_COUNT];
+
+    for (uint32_t i = 0; i < 4; i++) {
+        entries[i] = (VkSpecializationMapEntry) {
+            .constantID = i,
+            .offset = i * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+
+    for (uint32_t stage = 0; stage < MESHLET_STAGE_COUNT; stage++) {
+        constants[stage][0] = stage;
+        constants[stage][1] = slots[BINDLESS_BINDING_SAMPLED_IMAGES].capacity;
+        constants[stage][2] = slots[BINDLESS_BINDING_SAMPLERS].capacity;
+        constants[stage][3] = slots[BINDLESS_BINDING_STORAGE_BUFFERS].capacity;
+
+        specializations[stage] = (VkSpecializationInfo) {
+            .mapEntryCount = sizeof(entries) / sizeof(entries[0]),
+            .pMapEntries = entries,
+            .dataSize = sizeof(constants[stage]),
+            .pData = constants[stage],
+        };
+        pipelineInfos[stage] = (VkComputePipelineCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = system->module,
+                .pName = "main",
+                .pSpecializationInfo = &specializations[stage],
+            },
+            .layout = system->layout,
+        };
+    }
+
+    return COUNT_VK_CREATE(vkCreateComputePipelines(
+        system->device,
+        VK_NULL_HANDLE,
+        MESHLET_STAGE_COUNT,
+        pipelineInfos,
+        hostAllocator(),
+        system->pipelines
+    ));
+}
+
+// Host visible like the scene's vertex buffer, it's written once and the
+// cull pass reads each meshlet only once a frame
+static VkResult uploadMesh(
+    VkPhysicalDevice physicalDevice,
+    struct MeshletSystem *system,
+    const struct MeshletMesh *mesh
+) {
+    VkResult result;
+    VkDevice device = system->device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+    const void *sources[MESH_SECTION_COUNT] = {
+        mesh->vertices,
+        mesh->meshlets,
+        mesh->meshletVertices,
+        mesh->meshletTriangles,
+    };
+    VkDeviceSize sizes[MESH_SECTION_COUNT] = {
+        (VkDeviceSize) mesh->vertexCount * sizeof(struct MeshVertex),
+        (VkDeviceSize) mesh->meshletCount * sizeof(struct Meshlet),
+        (VkDeviceSize) mesh->meshletVertexCount * sizeof(uint32_t),
+        (VkDeviceSize) mesh->triangleCount * sizeof(uint32_t),
+    };
+    VkDeviceSize offsets[MESH_SECTION_COUNT];
+    VkDeviceSize total = 0;
+    for (uint32_t s = 0; s < MESH_SECTION_COUNT; s++) {
+        // Each section is bound whole, so it has to fit one storage buffer range
+        if (sizes[s] > properties.limits.maxStorageBufferRange) {
+            fprintf(stderr, "Meshlets: mesh too large for one storage buffer binding\n");
+            return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        }
+        offsets[s] = total;
+        total = alignUp(total + sizes[s], alignment);
+    }
+
+    result = createBuffer(
+        physicalDevice,
+        device,
+        total,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &system->meshBuffer,
+        &system->meshMemory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet mesh buffer");
+
+    void *data;
+    result = vkMapMemory(device, system->meshMemory, 0, VK_WHOLE_SIZE, 0, &data);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to map meshlet mesh buffer");
+    for (uint32_t s = 0; s < MESH_SECTION_COUNT; s++) {
+        memcpy((char *) data + offsets[s], sources[s], sizes[s]);
+    }
+    vkUnmapMemory(device, system->meshMemory);
+
+    struct BindlessHeap *heap = system->bindlessHeap;
+    system->meshletsIndex = bindlessRegisterBuffer(
+        device, heap, system->meshBuffer, offsets[MESH_SECTION_MESHLETS], sizes[MESH_SECTION_MESHLETS]);
+    system->meshletVerticesIndex = bindlessRegisterBuffer(
+        device, heap, system->meshBuffer, offsets[MESH_SECTION_MESHLET_VERTICES], sizes[MESH_SECTION_MESHLET_VERTICES]);
+    system->trianglesIndex = bindlessRegisterBuffer(
+        device, heap, system->meshBuffer, offsets[MESH_SECTION_TRIANGLES], sizes[MESH_SECTION_TRIANGLES]);
+    return VK_SUCCESS;
+}
+
+VkResult createMeshletSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *layouts,
+    uint32_t framesInFlight,
+    const struct MeshletMesh *mesh,
+    struct MeshletSystem *system
+) {
+    VkResult result;
+
+    *system = (struct MeshletSystem) {
+        .device = device,
+        .bindlessHeap = bindlessHeap,
+        .meshletCount = mesh->meshletCount,
+        .triangleCount = mesh->triangleCount,
+        .center = { mesh->center[0], mesh->center[1], mesh->center[2] },
+        .radius = mesh->radius,
+        .lodCount = mesh->lodCount,
+        .meshletsIndex = BINDLESS_INVALID_INDEX,
+        .meshletVerticesIndex = BINDLESS_INVALID_INDEX,
+        .trianglesIndex = BINDLESS_INVALID_INDEX,
+        .outputIndex = BINDLESS_INVALID_INDEX,
+        .cameraIndex = BINDLESS_INVALID_INDEX,
+        .cullFlags = MESHLET_CULL_ALL,
+    };
+
+    memcpy(system->lods, mesh->lods, sizeof(system->lods));
+
+    if (mesh->meshletCount == 0 || mesh->lodCount == 0) {
+        fprintf(stderr, "Meshlets: empty mesh\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Room for every triangle of the finest level, for when nothing is culled
+    uint32_t maxLodTriangles = 0;
+    for (uint32_t l = 0; l < mesh->lodCount; l++) {
+        if (mesh->lods[l].triangleCount > maxLodTriangles) maxLodTriangles = mesh->lods[l].triangleCount;
+    }
+    VkDeviceSize outputSize = (MESHLET_OUTPUT_INDICES + (VkDeviceSize) maxLodTriangles * 3) * sizeof(uint32_t);
+    if (outputSize > properties.limits.maxStorageBufferRange) {
+        fprintf(stderr, "Meshlets: %u triangles don't fit one storage buffer binding\n", maxLodTriangles);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    result = uploadMesh(physicalDevice, system, mesh);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to upload meshlet mesh");
+
+    result = createBuffer(
+        physicalDevice,
+        device,
+        outputSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+            | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+            | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &system->outputBuffer,
+        &system->outputMemory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet output buffer");
+    system->outputIndex = bindlessRegisterBuffer(device, bindlessHeap, system->outputBuffer, 0, outputSize);
+
+    result = createFrameRing(
+        physicalDevice,
+        device,
+        sizeof(struct MeshletCamera),
+        framesInFlight,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &system->cameraRing
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet camera ring");
+    system->cameraIndex = bindlessRegisterBuffer(device, bindlessHeap, system->cameraRing.buffer, 0, VK_WHOLE_SIZE);
+
+    if (system->meshletsIndex == BINDLESS_INVALID_INDEX
+        || system->meshletVerticesIndex == BINDLESS_INVALID_INDEX
+        || system->trianglesIndex == BINDLESS_INVALID_INDEX
+        || system->outputIndex == BINDLESS_INVALID_INDEX
+        || system->cameraIndex == BINDLESS_INVALID_INDEX) {
+        fprintf(stderr, "Meshlets: no free bindless buffer slots\n");
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    const struct ShaderReflection *reflection;
+    result = loadReflectedShaderModule(device, layouts, "shaders/meshlets_comp.spv", &system->module, &reflection);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet shader module");
+    if (reflection->pushConstantSize != sizeof(struct MeshletPushConstants)) {
+        fprintf(stderr, "Meshlets: the shader's push constants are %u bytes, struct MeshletPushConstants is %zu\n",
+            reflection->pushConstantSize, sizeof(struct MeshletPushConstants));
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // Owned by the layout cache
+    result = layoutCacheGetPipelineLayout(layouts, &reflection, 1, &system->layout);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get meshlet pipeline layout");
+
+    result = createMeshletPipelines(system);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet pipelines");
+
+    fprintf(stderr, "Meshlets: %u vertices, %u triangles in %u meshlets over %u levels of detail, %.1f triangles each\n",
+        mesh->vertexCount,
+        mesh->triangleCount,
+        mesh->meshletCount,
+        mesh->lodCount,
+        mesh->meshletCount ? (double) mesh->triangleCount / mesh->meshletCount : 0.0);
+    return VK_SUCCESS;
+}
+
+void cleanupMeshletSystem(struct MeshletSystem *system) {
+    VkDevice device = system->device;
+    uint32_t indices[] = {
+        system->meshletsIndex,
+        system->meshletVerticesIndex,
+        system->trianglesIndex,
+        system->outputIndex,
+        system->cameraIndex,
+    };
+    for (uint32_t i = 0; i < sizeof(indices) / sizeof(indices[0]); i++) {
+        if (indices[i] == BINDLESS_INVALID_INDEX) continue;
+        bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_STORAGE_BUFFERS, indices[i]);
+    }
+    for (uint32_t stage = 0; stage < MESHLET_STAGE_COUNT; stage++) {
+        vkDestroyPipeline(device, system->pipelines[stage], hostAllocator());
+    }
+    vkDestroyShaderModule(device, system->module, hostAllocator());
+    if (system->cameraRing.buffer != VK_NULL_HANDLE) cleanupFrameRing(device, &system->cameraRing);
+    vkDestroyBuffer(device, system->outputBuffer, hostAllocator());
+    memoryFree(device, system->outputMemory);
+    vkDestroyBuffer(device, system->meshBuffer, hostAllocator());
+    memoryFree(device, system->meshMemory);
+    *system = (struct MeshletSystem) { 0 };
+}
+
+uint16_t addMeshletProgram(struct PipelineCache *cache) {
+    struct PipelineProgramDesc desc = {
+        .vertexPath = "shaders/mesh_vert.spv",
+        .fragmentPath = "shaders/mesh_frag.spv",
+        .binding = {
+            .binding = 0,
+            .stride = sizeof(struct MeshVertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        },
+        // Attributes from the shader, struct MeshVertex is its inputs packed
+    };
+    return pipelineCacheAddProgram(cache, &desc);
+}
+
+void meshletCameraLookAt(
+    vec3 eye,
+    vec3 target,
+    float fovY,
+    float aspect,
+    float nearPlane,
+    float farPlane,
+    struct MeshletCamera *camera
+) {
+    mat4 view;
+    vec3 up = { 0.0f, 1.0f, 0.0f };
+    glm_lookat(eye, target, up, view);
+
+    // Right handed with depth from 0 to 1, y flipped for Vulkan's clip space
+    float f = 1.0f / tanf(fovY * 0.5f);
+    mat4 projection = { { 0.0f } };
+    projection[0][0] = f / aspect;
+    projection[1][1] = -f;
+    projection[2][2] = farPlane / (nearPlane - farPlane);
+    projection[2][3] = -1.0f;
+    projection[3][2] = nearPlane * farPlane / (nearPlane - farPlane);
+    glm_mat4_mul(projection, view, camera->viewProjection);
+
+    // Planes from the rows of the matrix: left, right, bottom, top, near, far
+    mat4 m;
+    glm_mat4_copy(camera->viewProjection, m);
+    for (uint32_t i = 0; i < 4; i++) {
+        float row0 = m[i][0], row1 = m[i][1], row2 = m[i][2], row3 = m[i][3];
+        camera->planes[0][i] = row3 + row0;
+        camera->planes[1][i] = row3 - row0;
+        camera->planes[2][i] = row3 + row1;
+        camera->planes[3][i] = row3 - row1;
+        camera->planes[4][i] = row2;
+        camera->planes[5][i] = row3 - row2;
+    }
+    for (uint32_t p = 0; p < 6; p++) {
+        float *plane = camera->planes[p];
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (uint32_t i = 0; i < 4; i++) plane[i] /= length;
+    }
+
+    camera->position[0] = eye[0];
+    camera->position[1] = eye[1];
+    camera->position[2] = eye[2];
+    camera->position[3] = 1.0f;
+}
+
+// Pixels level `lod`'s error covers at `distance`
+static float lodPixelError(const struct MeshletSystem *system, uint32_t lod, float distance, float lodScale) {
+    return system->lods[lod].error / distance * lodScale;
+}
+
+static uint32_t selectLod(const struct MeshletSystem *system, const struct MeshletCamera *camera, float lodScale) {
+    // To the nearest point of the bounding sphere, so the part of the mesh
+    // closest to the camera is the one held to the threshold
+    float dx = camera->position[0] - system->center[0];
+    float dy = camera->position[1] - system->center[1];
+    float dz = camera->position[2] - system->center[2];
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz) - system->radius;
+    if (distance <= 0.0f) return 0;
+
+    uint32_t lod = system->lod;
+    while (lod > 0 && lodPixelError(system, lod, distance, lodScale) > MESHLET_LOD_PIXEL_ERROR) lod--;
+    while (lod + 1 < system->lodCount
+        && lodPixelError(system, lod + 1, distance, lodScale) <= MESHLET_LOD_PIXEL_ERROR * MESHLET_LOD_HYSTERESIS) {
+        lod++;
+    }
+    return lod;
+}
+
+bool meshletsUpdate(
+    struct MeshletSystem *system,
+    uint32_t frame,
+    const struct MeshletCamera *camera,
+    float lodScale,
+    struct BindlessPushConstants *outPushConstants
+) {
+    // The fence for this frame has been waited on, so its region is free
+    frameRingBegin(&system->cameraRing, frame);
+    VkDeviceSize offset;
+    struct MeshletCamera *slot = frameRingAlloc(
+        &system->cameraRing,
+        sizeof(struct MeshletCamera),
+        sizeof(struct MeshletCamera),
+        &offset
+    );
+    if (!slot) {
+        fprintf(stderr, "Meshlets: camera ring full, the mesh is skipped this frame\n");
+        return false;
+    }
+    *slot = *camera;
+
+    uint32_t lod = selectLod(system, camera, lodScale);
+    if (lod != system->lod) system->lodSwitches++;
+    system->lod = lod;
+    uint32_t cameraSlot = (uint32_t) (offset / sizeof(struct MeshletCamera));
+
+    system->pending = (struct MeshletPushConstants) {
+        .meshletsIndex = system->meshletsIndex,
+        .meshletVerticesIndex = system->meshletVerticesIndex,
+        .trianglesIndex = system->trianglesIndex,
+        .outputIndex = system->outputIndex,
+        .cameraIndex = system->cameraIndex,
+        .cameraSlot = cameraSlot,
+        .firstMeshlet = system->lods[lod].firstMeshlet,
+        .meshletCount = system->lods[lod].meshletCount,
+        .cullFlags = system->cullFlags,
+    };
+
+    *outPushConstants = (struct BindlessPushConstants) {
+        .imageIndex = BINDLESS_INVALID_INDEX,
+        .samplerIndex = BINDLESS_INVALID_INDEX,
+        .bufferIndex = system->cameraIndex,
+        .instanceOffset = cameraSlot,
+    };
+    return true;
+}
+
+static void computeBarrier(
+    VkCommandBuffer commandBuffer,
+    VkPipelineStageFlags srcStages,
+    VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStages,
+    VkAccessFlags dstAccess
+) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    VKD(vkCmdPipelineBarrier)(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void meshletsRecordCull(
+    const struct MeshletSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet
+) {
+    // The graph only orders this pass after last frame's draw. Last frame's
+    // compute writes still have to be made visible to this frame's.
+    computeBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    VKD(vkCmdBindDescriptorSets)(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        system->layout,
+        0, 1, &bindlessSet,
+        0, NULL
+    );
+    VKD(vkCmdPushConstants)(
+        commandBuffer,
+        system->layout,
+        bindlessPushConstantRange().stageFlags,
+        0, sizeof(system->pending),
+        &system->pending
+    );
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, system->pipelines[MESHLET_STAGE_CLEAR]);
+    VKD(vkCmdDispatch)(commandBuffer, 1, 1, 1);
+    computeBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, system->pipelines[MESHLET_STAGE_CULL]);
+    VKD(vkCmdDispatch)(commandBuffer, system->pending.meshletCount, 1, 1);
+}
+
+void meshletsRecordDraw(
+    const struct MeshletSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    const struct BindlessPushConstants *pushConstants
+) {
+    VkPushConstantRange pushConstantRange = bindlessPushConstantRange();
+    VKD(vkCmdPushConstants)(
+        commandBuffer,
+        layout,
+        pushConstantRange.stageFlags,
+        0, sizeof(*pushConstants),
+        pushConstants
+    );
+
+    VkDeviceSize vertexOffset = 0;
+    VKD(vkCmdBindVertexBuffers)(commandBuffer, 0, 1, &system->meshBuffer, &vertexOffset);
+    VKD(vkCmdBindIndexBuffer)(
+        commandBuffer,
+        system->outputBuffer,
+        MESHLET_OUTPUT_INDICES * sizeof(uint32_t),
+        VK_INDEX_TYPE_UINT32
+    );
+    VKD(vkCmdDrawIndexedIndirect)(
+        commandBuffer,
+        system->outputBuffer,
+        MESHLET_OUTPUT_DRAW * sizeof(uint32_t),
+        1,
+        sizeof(VkDrawIndexedIndirectCommand)
+    );
+}
+
+void meshletsReport(const struct MeshletSystem *system, FILE *out) {
+    fprintf(
+        out,
+        "Meshlets: %u meshlets, %u triangles, cluster culling %s, LOD %u of %u, %u switches\n",
+        system->meshletCount,
+        system->triangleCount,
+        system->cullFlags ? "on" : "off",
+        system->lod,
+        system->lodCount,
+        system->lodSwitches
+    );
+    for (uint32_t l = 0; l < system->lodCount; l++) {
+        const struct MeshletLod *lod = &system->lods[l];
+        fprintf(out, "  %sLOD %u: %7u triangles in %5u meshlets, error %.5f\n",
+            l == system->lod ? "*" : " ", l, lod->triangleCount, lod->meshletCount, (double) lod->error);
+    }
+}
@@ -0,0 +1,173 @@
+#pragma once
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <vulkan/vulkan.h>
+
+#include <cglm/cglm.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bindless.h"
+#include "buffers.h"
+#include "meshlet_builder.h"
+#include "pipeline_cache.h"
+
+// GPU cluster culling of one static meshlet mesh (see meshlet_builder.h).
+// The vertices, meshlets, meshlet vertices and triangles are uploaded once.
+// Each frame a compute pass runs one workgroup per meshlet: the first thread
+// tests the bounding sphere against the frustum and the normal cone against
+// the camera position, and the survivors append their triangles, already
+// turned into mesh vertex indices, to an index buffer that's drawn with one
+// indexed indirect draw. Culled clusters cost a workgroup's early out and no
+// vertex work at all.
+//
+// The camera lives in a frame ring registered with the bindless heap, read
+// by the cull pass and, through the regular push constants, by mesh.vert.
+//
+// Levels of detail are picked on the CPU each frame from the projected size
+// of their error: the coarsest level whose error covers at most
+// MESHLET_LOD_PIXEL_ERROR pixels at the mesh's nearest point is culled and
+// drawn, the others aren't touched. Going coarser waits until that level's
+// error is under MESHLET_LOD_HYSTERESIS of the threshold, so a camera
+// resting at a switching distance doesn't flicker between two levels.
+
+#define MESHLET_GROUP_SIZE 64 // local_size_x in meshlets.comp
+
+// Word offsets into the output buffer, must match meshlets.comp
+#define MESHLET_OUTPUT_DRAW 0     // VkDrawIndexedIndirectCommand
+#define MESHLET_OUTPUT_VISIBLE 5  // meshlets that passed, for debugging
+#define MESHLET_OUTPUT_INDICES 16 // compacted indices, 64 bytes in
+
+#define MESHLET_LOD_PIXEL_ERROR 1.0f
+#define MESHLET_LOD_HYSTERESIS 0.75f
+
+enum MeshletStage {
+    MESHLET_STAGE_CLEAR,
+    MESHLET_STAGE_CULL,
+    MESHLET_STAGE_COUNT
+};
+
+enum MeshletCullFlags {
+    MESHLET_CULL_FRUSTUM = 1 << 0,
+    MESHLET_CULL_CONE = 1 << 1,
+    MESHLET_CULL_ALL = MESHLET_CULL_FRUSTUM | MESHLET_CULL_CONE,
+};
+
+// std430, matches meshlets.comp and mesh.vert
+struct MeshletCamera {
+    mat4 viewProjection;
+    vec4 planes[6]; // normalized, xyz·p + w >= 0 inside
+    vec4 position;
+};
+
+// Compute only, the draw uses the regular bindless layout
+struct MeshletPushConstants {
+    uint32_t meshletsIndex;
+    uint32_t meshletVerticesIndex;
+    uint32_t trianglesIndex;
+    uint32_t outputIndex;
+    uint32_t cameraIndex;
+    uint32_t cameraSlot;
+    uint32_t firstMeshlet; // of the selected level of detail
+    uint32_t meshletCount;
+    uint32_t cullFlags; // enum MeshletCullFlags
+};
+
+struct MeshletSystem {
+    VkDevice device;
+    struct BindlessHeap *bindlessHeap;
+    uint32_t meshletCount;
+    uint32_t triangleCount;
+    float center[3];
+    float radius;
+    uint32_t lodCount;
+    struct MeshletLod lods[MESHLET_MAX_LODS];
+    uint32_t lod;         // drawn this frame, kept for the hysteresis
+    uint32_t lodSwitches; // since creation, for the report
+
+    // Vertices first, then the sections the cull pass reads
+    VkBuffer meshBuffer;
+    VkDeviceMemory meshMemory;
+    uint32_t meshletsIndex;
+    uint32_t meshletVerticesIndex;
+    uint32_t trianglesIndex;
+
+    // Draw arguments, then the compacted index stream
+    VkBuffer outputBuffer;
+    VkDeviceMemory outputMemory;
+    uint32_t outputIndex;
+
+    struct FrameRing cameraRing;
+    uint32_t cameraIndex;
+
+    VkPipelineLayout layout;
+    VkShaderModule module;
+    VkPipeline pipelines[MESHLET_STAGE_COUNT];
+
+    uint32_t cullFlags;
+    struct MeshletPushConstants pending; // for this frame's meshletsRecordCull
+};
+
+VkResult createMeshletSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *layouts,
+    uint32_t framesInFlight,
+    const struct MeshletMesh *mesh,
+    struct MeshletSystem *system
+);
+void cleanupMeshletSystem(struct MeshletSystem *system);
+
+// struct MeshVertex attributes, draw with back-face culling and
+// counter-clockwise front faces
+uint16_t addMeshletProgram(struct PipelineCache *cache);
+
+// Perspective looking from `eye` at `target`, Vulkan clip space with y down
+// and depth from 0 to 1
+void meshletCameraLookAt(
+    vec3 eye,
+    vec3 target,
+    float fovY,
+    float aspect,
+    float nearPlane,
+    float farPlane,
+    struct MeshletCamera *camera
+);
+
+// Once per frame before recording, also picks the level of detail.
+// `lodScale` is the viewport height over 2·tan(fovY / 2), the pixels a unit
+// spans at distance 1. Fills in the push constants the draw needs, with the
+// camera in bufferIndex and instanceOffset. False when the camera ring is
+// full, then neither the cull nor the draw may be recorded this frame.
+bool meshletsUpdate(
+    struct MeshletSystem *system,
+    uint32_t frame,
+    const struct MeshletCamera *camera,
+    float lodScale,
+    struct BindlessPushConstants *outPushConstants
+);
+
+// Outside a render pass. Synchronizes with the previous frame's use of the
+// output itself; the draw still needs a barrier to index and indirect reads.
+void meshletsRecordCull(
+    const struct MeshletSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet
+);
+
+// Inside the render pass with the mesh pipeline bound. Binds its own vertex
+// and index buffers and pushes its own constants.
+void meshletsRecordDraw(
+    const struct MeshletSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    const struct BindlessPushConstants *pushConstants
+);
+
+void meshletsReport(const struct MeshletSystem *system, FILE *out);
+
+#endif // MESHLETS_H
@@ -0,0 +1,304 @@
+#include <vulkan/vulkan.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "buffers.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "particles.h"
+#include "shader_modules.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkResult createParticlePipelines(struct ParticleSystem *system) {
+    // Same specialization scheme as rgb_to_yuv.comp, with the stage in id 0
+    const struct BindlessSlots *slots = system->bindlessHeap->slots;
+    uint32_t constants[PARTICLE_STAGE_COUNT][4];
+    VkSpecializationMapEntry entries[4];
+    VkSpecializationInfo specializations[PARTICLE_STAGE_COUNT];
+    VkComputePipelineCreateInfo pipelineInfos[PARTICLE_STAGE_COUNT];
+
+    for (uint32_t i = 0; i < 4; i++) {
+        entries[i] = (VkSpecializationMapEntry) {
+            .constantID = i,
+            .offset = i * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+
+    for (uint32_t stage = 0; stage < PARTICLE_STAGE_COUNT; stage++) {
+        constants[stage][0] = stage;
+        constants[stage][1] = slots[BINDLESS_BINDING_SAMPLED_IMAGES].capacity;
+        constants[stage][2] = slots[BINDLESS_BINDING_SAMPLERS].capacity;
+        constants[stage][3] = slots[BINDLESS_BINDING_STORAGE_BUFFERS].capacity;
+
+        specializations[stage] = (VkSpecializationInfo) {
+            .mapEntryCount = sizeof(entries) / sizeof(entries[0]),
+            .pMapEntries = entries,
+            .dataSize = sizeof(constants[stage]),
+            .pData = constants[stage],
+        };
+        pipelineInfos[stage] = (VkComputePipelineCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = system->module,
+                .pName = "main",
+                .pSpecializationInfo = &specializations[stage],
+            },
+            .layout = system->layout,
+        };
+    }
+
+    return COUNT_VK_CREATE(vkCreateComputePipelines(
+        system->device,
+        VK_NULL_HANDLE,
+        PARTICLE_STAGE_COUNT,
+        pipelineInfos,
+        hostAllocator(),
+        system->pipelines
+    ));
+}
+
+VkResult createParticleSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *layouts,
+    uint32_t capacity,
+    struct ParticleSystem *system
+) {
+    VkResult result;
+
+    *system = (struct ParticleSystem) {
+        .device = device,
+        .bindlessHeap = bindlessHeap,
+        .countersIndex = BINDLESS_INVALID_INDEX,
+        .arrayIndices = { BINDLESS_INVALID_INDEX, BINDLESS_INVALID_INDEX },
+        .reset = true,
+    };
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Each array is bound whole, so it has to fit one storage buffer range
+    uint32_t maxCapacity = properties.limits.maxStorageBufferRange / sizeof(struct Particle);
+    if (capacity > maxCapacity) capacity = maxCapacity;
+
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+    VkDeviceSize headerSize = alignUp(PARTICLE_COUNTER_WORDS * sizeof(uint32_t), alignment);
+    VkDeviceSize arraySize = alignUp((VkDeviceSize) capacity * sizeof(struct Particle), alignment);
+
+    // Rather fewer particles than pushing everything else out of VRAM
+    VkDeviceSize headroom = memoryHeadroom(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    while (capacity > PARTICLE_GROUP_SIZE && headerSize + arraySize * 2 > headroom) {
+        capacity /= 2;
+        arraySize = alignUp((VkDeviceSize) capacity * sizeof(struct Particle), alignment);
+    }
+    system->capacity = capacity;
+    system->arrayOffsets[0] = headerSize;
+    system->arrayOffsets[1] = headerSize + arraySize;
+
+    result = createBuffer(
+        physicalDevice,
+        device,
+        headerSize + arraySize * 2,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+            | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+            | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+            | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &system->buffer,
+        &system->memory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create particle buffer");
+
+    system->countersIndex = bindlessRegisterBuffer(
+        device, bindlessHeap, system->buffer, 0, PARTICLE_COUNTER_WORDS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < 2; i++) {
+        system->arrayIndices[i] = bindlessRegisterBuffer(
+            device, bindlessHeap, system->buffer, system->arrayOffsets[i], arraySize);
+    }
+    if (system->countersIndex == BINDLESS_INVALID_INDEX
+        || system->arrayIndices[0] == BINDLESS_INVALID_INDEX
+        || system->arrayIndices[1] == BINDLESS_INVALID_INDEX) {
+        fprintf(stderr, "Particles: no free bindless buffer slots\n");
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    const struct ShaderReflection *reflection;
+    result = loadReflectedShaderModule(device, layouts, "shaders/particles_comp.spv", &system->module, &reflection);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create particle shader module");
+    if (reflection->pushConstantSize != sizeof(struct ParticlePushConstants)) {
+        fprintf(stderr, "Particles: the shader's push constants are %u bytes, struct ParticlePushConstants is %zu\n",
+            reflection->pushConstantSize, sizeof(struct ParticlePushConstants));
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // Owned by the layout cache
+    result = layoutCacheGetPipelineLayout(layouts, &reflection, 1, &system->layout);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get particle pipeline layout");
+
+    result = createParticlePipelines(system);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create particle pipelines");
+
+    // Enough to keep the pool about full
+    system->emitRate = (float) capacity / PARTICLE_DEFAULT_LIFETIME;
+
+    fprintf(stderr, "Particles: capacity %u, %.1f MiB\n",
+        capacity, (double) (headerSize + arraySize * 2) / (1024.0 * 1024.0));
+    return VK_SUCCESS;
+}
+
+void cleanupParticleSystem(struct ParticleSystem *system) {
+    VkDevice device = system->device;
+    if (system->countersIndex != BINDLESS_INVALID_INDEX) {
+        bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_STORAGE_BUFFERS, system->countersIndex);
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        if (system->arrayIndices[i] == BINDLESS_INVALID_INDEX) continue;
+        bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_STORAGE_BUFFERS, system->arrayIndices[i]);
+    }
+    for (uint32_t stage = 0; stage < PARTICLE_STAGE_COUNT; stage++) {
+        vkDestroyPipeline(device, system->pipelines[stage], hostAllocator());
+    }
+    vkDestroyShaderModule(device, system->module, hostAllocator());
+    vkDestroyBuffer(device, system->buffer, hostAllocator());
+    memoryFree(device, system->memory);
+    *system = (struct ParticleSystem) { 0 };
+}
+
+uint16_t addParticleProgram(struct PipelineCache *cache) {
+    struct PipelineProgramDesc desc = {
+        .vertexPath = "shaders/particles_vert.spv",
+        .fragmentPath = "shaders/particles_frag.spv",
+        .binding = {
+            .binding = 0,
+            .stride = sizeof(struct Particle),
+            .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+        },
+        .attributeCount = 4,
+        .attributes = {
+            { .location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(struct Particle, position) },
+            { .location = 1, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(struct Particle, age) },
+            { .location = 2, .binding = 0, .format = VK_FORMAT_R32_SFLOAT, .offset = offsetof(struct Particle, size) },
+            { .location = 3, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(struct Particle, color) },
+        },
+    };
+    return pipelineCacheAddProgram(cache, &desc);
+}
+
+void particlesReset(struct ParticleSystem *system) {
+    system->reset = true;
+    system->emitCarry = 0.0f;
+    system->seed = 0;
+}
+
+void particlesUpdate(struct ParticleSystem *system, float deltaTime, float time) {
+    float emit = system->emitRate * deltaTime + system->emitCarry;
+    uint32_t emitCount = emit >= (float) system->capacity ? system->capacity : (uint32_t) emit;
+    system->emitCarry = emit >= (float) system->capacity ? 0.0f : emit - (float) emitCount;
+
+    uint32_t source = system->current;
+    uint32_t destination = source ^ 1;
+    system->pending = (struct ParticlePushConstants) {
+        .countersIndex = system->countersIndex,
+        .sourceIndex = system->arrayIndices[source],
+        .destinationIndex = system->arrayIndices[destination],
+        .emitCount = emitCount,
+        .capacity = system->capacity,
+        .seed = system->seed++,
+        .deltaTime = deltaTime,
+        .time = time,
+    };
+    system->current = destination;
+
+    system->clearHeader = system->reset;
+    system->reset = false;
+}
+
+static void computeBarrier(
+    VkCommandBuffer commandBuffer,
+    VkPipelineStageFlags srcStages,
+    VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStages,
+    VkAccessFlags dstAccess
+) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    VKD(vkCmdPipelineBarrier)(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void particlesRecordSimulate(
+    const struct ParticleSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet
+) {
+    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkAccessFlags srcAccess = VK_ACCESS_SHADER_WRITE_BIT;
+    if (system->clearHeader) {
+        VKD(vkCmdFillBuffer)(commandBuffer, system->buffer, 0, PARTICLE_COUNTER_WORDS * sizeof(uint32_t), 0);
+        srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        srcAccess |= VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    // The graph only orders this pass after last frame's draw. Last frame's
+    // compute writes still have to be made visible to this frame's reads.
+    computeBarrier(commandBuffer,
+        srcStages, srcAccess,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    VKD(vkCmdBindDescriptorSets)(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        system->layout,
+        0, 1, &bindlessSet,
+        0, NULL
+    );
+    VKD(vkCmdPushConstants)(
+        commandBuffer,
+        system->layout,
+        bindlessPushConstantRange().stageFlags,
+        0, sizeof(system->pending),
+        &system->pending
+    );
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, system->pipelines[PARTICLE_STAGE_PREPARE]);
+    VKD(vkCmdDispatch)(commandBuffer, 1, 1, 1);
+    computeBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, system->pipelines[PARTICLE_STAGE_SIMULATE]);
+    VKD(vkCmdDispatchIndirect)(commandBuffer, system->buffer, PARTICLE_COUNTER_DISPATCH * sizeof(uint32_t));
+    computeBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, system->pipelines[PARTICLE_STAGE_FINALIZE]);
+    VKD(vkCmdDispatch)(commandBuffer, 1, 1, 1);
+}
+
+void particlesRecordDraw(const struct ParticleSystem *system, VkCommandBuffer commandBuffer) {
+    VkDeviceSize offset = system->arrayOffsets[system->current];
+    VKD(vkCmdBindVertexBuffers)(commandBuffer, 0, 1, &system->buffer, &offset);
+    VKD(vkCmdDrawIndirect)(
+        commandBuffer,
+        system->buffer,
+        PARTICLE_COUNTER_DRAW * sizeof(uint32_t),
+        1,
+        sizeof(VkDrawIndirectCommand)
+    );
+}
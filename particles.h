@@ -0,0 +1,122 @@
+#pragma once
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bindless.h"
+#include "pipeline_cache.h"
+
+// GPU particle system. Particle state lives in one device-local buffer: a
+// header of counters and indirect arguments, then two particle arrays that
+// swap roles every frame. Each frame three compute dispatches run before the
+// render pass: prepare clamps emission to the free space and writes the
+// simulate dispatch size, simulate ages, integrates and spawns particles and
+// appends the survivors to the other array (which compacts out the dead
+// ones), and finalize turns the survivor count into the indirect draw. The
+// CPU only picks how many particles to emit and never reads anything back.
+
+#define PARTICLE_DEFAULT_CAPACITY (1u << 20)
+#define PARTICLE_GROUP_SIZE 256        // local_size_x in particles.comp
+#define PARTICLE_VERTICES 6            // two triangles per particle
+#define PARTICLE_DEFAULT_LIFETIME 3.0f // seconds, the shader varies it by ±50%
+
+// Word offsets into the header, must match particles.comp
+#define PARTICLE_COUNTER_ALIVE 0    // particles in the current array
+#define PARTICLE_COUNTER_APPEND 1   // append cursor into the next array
+#define PARTICLE_COUNTER_EMIT 2     // emission this frame after clamping
+#define PARTICLE_COUNTER_DISPATCH 4 // VkDispatchIndirectCommand for simulate
+#define PARTICLE_COUNTER_DRAW 8     // VkDrawIndirectCommand
+#define PARTICLE_COUNTER_WORDS 12
+
+enum ParticleStage {
+    PARTICLE_STAGE_PREPARE,
+    PARTICLE_STAGE_SIMULATE,
+    PARTICLE_STAGE_FINALIZE,
+    PARTICLE_STAGE_COUNT
+};
+
+// std430, matches particles.comp and the instance attributes of particles.vert
+struct Particle {
+    float position[2];  // normalized device coordinates
+    float velocity[2];
+    float age;
+    float lifetime;
+    float size;
+    uint32_t color;     // RGBA8
+};
+
+// Compute only, the draw uses the regular bindless layout
+struct ParticlePushConstants {
+    uint32_t countersIndex;
+    uint32_t sourceIndex;
+    uint32_t destinationIndex;
+    uint32_t emitCount;
+    uint32_t capacity;
+    uint32_t seed;
+    float deltaTime;
+    float time;
+};
+
+struct ParticleSystem {
+    VkDevice device;
+    struct BindlessHeap *bindlessHeap;
+    uint32_t capacity;
+
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize arrayOffsets[2];
+    uint32_t countersIndex;
+    uint32_t arrayIndices[2];
+
+    VkPipelineLayout layout;
+    VkShaderModule module;
+    VkPipeline pipelines[PARTICLE_STAGE_COUNT];
+
+    float emitRate;   // particles per second
+    float emitCarry;  // fraction of a particle left over from the last frame
+    uint32_t current; // array the last recorded simulate wrote, and the one drawn
+    uint32_t seed;
+    bool reset;       // set until the next particlesUpdate picks it up
+    bool clearHeader; // this frame's simulate zeroes the header first
+    struct ParticlePushConstants pending; // for this frame's particlesRecordSimulate
+};
+
+// `capacity` is clamped to what one storage buffer binding can hold
+VkResult createParticleSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    struct LayoutCache *layouts,
+    uint32_t capacity,
+    struct ParticleSystem *system
+);
+
+void cleanupParticleSystem(struct ParticleSystem *system);
+
+// Instanced quads with per-particle attributes, draw with additive blending
+uint16_t addParticleProgram(struct PipelineCache *cache);
+
+// Drops every particle, the GPU clears the header in the next simulate
+void particlesReset(struct ParticleSystem *system);
+
+// Once per frame before recording. Picks this frame's emission and flips
+// the arrays.
+void particlesUpdate(struct ParticleSystem *system, float deltaTime, float time);
+
+// Outside a render pass. Synchronizes with the previous frame's use of the
+// buffer itself; the draw still needs a barrier to vertex input and indirect
+// reads.
+void particlesRecordSimulate(
+    const struct ParticleSystem *system,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet
+);
+
+// Inside the render pass with the particle pipeline bound
+void particlesRecordDraw(const struct ParticleSystem *system, VkCommandBuffer commandBuffer);
+
+#endif // PARTICLES_H
@@ -0,0 +1,480 @@
+#include <vulkan/vulkan.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "pipeline_cache.h"
+#include "shader_modules.h"
+
+_Static_assert(sizeof(struct PipelineKey) == 24, "PipelineKey must not have implicit padding");
+_Static_assert((PIPELINE_CACHE_CAPACITY & (PIPELINE_CACHE_CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+static const VkDynamicState dynamicStates[] = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR
+};
+
+VkResult createPipelineCache(
+    VkDevice device,
+    struct LayoutCache *layouts,
+    struct PipelineCache *cache
+) {
+    memset(cache, 0, sizeof(*cache));
+    cache->device = device;
+    cache->layouts = layouts;
+    for (uint32_t b = 0; b < BINDLESS_BINDING_COUNT; b++) {
+        cache->bindlessCapacities[b] = layouts->bindlessHeap->slots[b].capacity;
+    }
+
+    VkResult result = layoutCacheGetPipelineLayout(layouts, NULL, 0, &cache->layout);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get the bindless pipeline layout");
+
+    // Lets the driver share compiled state between variants of a program
+    VkPipelineCacheCreateInfo cacheInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    };
+    result = COUNT_VK_CREATE(vkCreatePipelineCache(device, &cacheInfo, hostAllocator(), &cache->driverCache));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create pipeline cache");
+
+    return VK_SUCCESS;
+}
+
+// Both built and failed variants take up their slot
+static bool slotUsed(const struct PipelineCacheEntry *entry) {
+    return entry->pipeline != VK_NULL_HANDLE || entry->failed;
+}
+
+void cleanupPipelineCache(struct PipelineCache *cache) {
+    VkDevice device = cache->device;
+
+    for (uint32_t i = 0; i < PIPELINE_CACHE_CAPACITY; i++) {
+        vkDestroyPipeline(device, cache->entries[i].pipeline, hostAllocator());
+    }
+    for (uint32_t i = 0; i < cache->programCount; i++) {
+        vkDestroyShaderModule(device, cache->programs[i].vertexModule, hostAllocator());
+        vkDestroyShaderModule(device, cache->programs[i].fragmentModule, hostAllocator());
+    }
+    vkDestroyPipelineCache(device, cache->driverCache, hostAllocator());
+
+    memset(cache, 0, sizeof(*cache));
+}
+
+static VkFormat inputFormat(const struct ShaderInput *input) {
+    static const VkFormat formats[3][4] = {
+        [SHADER_BASE_FLOAT] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT },
+        [SHADER_BASE_INT] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT },
+        [SHADER_BASE_UINT] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT },
+    };
+    if (input->baseType == SHADER_BASE_OTHER || input->componentSize != 4) return VK_FORMAT_UNDEFINED;
+    return formats[input->baseType][input->componentCount - 1];
+}
+
+// What a shader input fed from `format` has to be declared as. Normalized
+// and scaled formats arrive as floats.
+static enum ShaderBaseType formatBaseType(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8_UNORM: case VK_FORMAT_R8G8_UNORM: case VK_FORMAT_R8G8B8A8_UNORM: case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_R8_SNORM: case VK_FORMAT_R8G8_SNORM: case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_R16_UNORM: case VK_FORMAT_R16G16_UNORM: case VK_FORMAT_R16G16B16A16_UNORM:
+    case VK_FORMAT_R16_SNORM: case VK_FORMAT_R16G16_SNORM: case VK_FORMAT_R16G16B16A16_SNORM:
+    case VK_FORMAT_R16_SFLOAT: case VK_FORMAT_R16G16_SFLOAT: case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_R32_SFLOAT: case VK_FORMAT_R32G32_SFLOAT: case VK_FORMAT_R32G32B32_SFLOAT: case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return SHADER_BASE_FLOAT;
+    case VK_FORMAT_R8_SINT: case VK_FORMAT_R8G8_SINT: case VK_FORMAT_R8G8B8A8_SINT:
+    case VK_FORMAT_R16_SINT: case VK_FORMAT_R16G16_SINT: case VK_FORMAT_R16G16B16A16_SINT:
+    case VK_FORMAT_R32_SINT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32A32_SINT:
+        return SHADER_BASE_INT;
+    case VK_FORMAT_R8_UINT: case VK_FORMAT_R8G8_UINT: case VK_FORMAT_R8G8B8A8_UINT:
+    case VK_FORMAT_R16_UINT: case VK_FORMAT_R16G16_UINT: case VK_FORMAT_R16G16B16A16_UINT:
+    case VK_FORMAT_R32_UINT: case VK_FORMAT_R32G32_UINT: case VK_FORMAT_R32G32B32_UINT: case VK_FORMAT_R32G32B32A32_UINT:
+        return SHADER_BASE_UINT;
+    default:
+        return SHADER_BASE_OTHER;
+    }
+}
+
+static bool generateAttributes(
+    const struct PipelineProgramDesc *desc,
+    const struct ShaderReflection *vertex,
+    struct PipelineProgram *program
+) {
+    if (vertex->inputCount > PIPELINE_PROGRAM_MAX_ATTRIBUTES) {
+        fprintf(stderr, "Pipeline cache: %s has more than %u inputs\n", desc->vertexPath, PIPELINE_PROGRAM_MAX_ATTRIBUTES);
+        return false;
+    }
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < vertex->inputCount; i++) {
+        const struct ShaderInput *input = &vertex->inputs[i];
+        VkFormat format = inputFormat(input);
+        if (format == VK_FORMAT_UNDEFINED) {
+            fprintf(stderr, "Pipeline cache: %s location %u has no 32-bit attribute format\n", desc->vertexPath, input->location);
+            return false;
+        }
+        program->attributes[i] = (VkVertexInputAttributeDescription) {
+            .location = input->location,
+            .binding = desc->binding.binding,
+            .format = format,
+            .offset = offset,
+        };
+        offset += input->componentCount * input->componentSize;
+    }
+    // The stride may be larger, for trailing padding
+    if (offset > desc->binding.stride) {
+        fprintf(stderr, "Pipeline cache: %s inputs pack to %u bytes, more than the vertex stride of %u\n",
+            desc->vertexPath, offset, desc->binding.stride);
+        return false;
+    }
+    program->attributeCount = vertex->inputCount;
+    return true;
+}
+
+// Every input fed exactly once, from a format of the type it's declared as
+static bool checkAttributes(const struct PipelineProgramDesc *desc, const struct ShaderReflection *vertex) {
+    if (desc->attributeCount != vertex->inputCount) {
+        fprintf(stderr, "Pipeline cache: %s has %u inputs, %u attributes given\n",
+            desc->vertexPath, vertex->inputCount, desc->attributeCount);
+        return false;
+    }
+    for (uint32_t i = 0; i < vertex->inputCount; i++) {
+        const struct ShaderInput *input = &vertex->inputs[i];
+        const VkVertexInputAttributeDescription *attribute = NULL;
+        for (uint32_t a = 0; a < desc->attributeCount; a++) {
+            if (desc->attributes[a].location == input->location) attribute = &desc->attributes[a];
+        }
+        if (!attribute) {
+            fprintf(stderr, "Pipeline cache: %s location %u has no attribute\n", desc->vertexPath, input->location);
+            return false;
+        }
+        if (formatBaseType(attribute->format) != input->baseType) {
+            fprintf(stderr, "Pipeline cache: %s location %u is fed a format of another type\n", desc->vertexPath, input->location);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void destroyProgramModules(const struct PipelineCache *cache, const struct PipelineProgram *program) {
+    vkDestroyShaderModule(cache->device, program->vertexModule, hostAllocator());
+    vkDestroyShaderModule(cache->device, program->fragmentModule, hostAllocator());
+}
+
+uint16_t pipelineCacheAddProgram(
+    struct PipelineCache *cache,
+    const struct PipelineProgramDesc *desc
+) {
+    if (cache->programCount == PIPELINE_CACHE_MAX_PROGRAMS) {
+        fprintf(stderr, "Pipeline cache: too many programs\n");
+        return PIPELINE_PROGRAM_INVALID;
+    }
+
+    struct PipelineProgram program = {
+        .binding = desc->binding,
+        .attributeCount = desc->attributeCount,
+    };
+    memcpy(program.attributes, desc->attributes, desc->attributeCount * sizeof(desc->attributes[0]));
+
+    const struct ShaderReflection *stages[2];
+    uint32_t stageCount = 0;
+    if (loadReflectedShaderModule(cache->device, cache->layouts, desc->vertexPath, &program.vertexModule, &stages[stageCount++]) != VK_SUCCESS) {
+        fprintf(stderr, "Pipeline cache: failed to load %s\n", desc->vertexPath);
+        return PIPELINE_PROGRAM_INVALID;
+    }
+    if (desc->fragmentPath
+        && loadReflectedShaderModule(cache->device, cache->layouts, desc->fragmentPath, &program.fragmentModule, &stages[stageCount++]) != VK_SUCCESS) {
+        fprintf(stderr, "Pipeline cache: failed to load %s\n", desc->fragmentPath);
+        destroyProgramModules(cache, &program);
+        return PIPELINE_PROGRAM_INVALID;
+    }
+
+    // Draws bind the heap and push through the shared layout, so a program
+    // needing anything more can't be drawn with them
+    VkPipelineLayout layout;
+    if (layoutCacheGetPipelineLayout(cache->layouts, stages, stageCount, &layout) != VK_SUCCESS || layout != cache->layout) {
+        fprintf(stderr, "Pipeline cache: %s doesn't fit the shared bindless layout\n", desc->vertexPath);
+        destroyProgramModules(cache, &program);
+        return PIPELINE_PROGRAM_INVALID;
+    }
+
+    bool inputsOk = desc->attributeCount == 0
+        ? generateAttributes(desc, stages[0], &program)
+        : checkAttributes(desc, stages[0]);
+    if (!inputsOk) {
+        destroyProgramModules(cache, &program);
+        return PIPELINE_PROGRAM_INVALID;
+    }
+
+    uint16_t id = (uint16_t) cache->programCount++;
+    cache->programs[id] = program;
+    return id;
+}
+
+static uint64_t hashKey(const struct PipelineKey *key) {
+    uint64_t words[sizeof(*key) / sizeof(uint64_t)];
+    memcpy(words, key, sizeof(words));
+
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        hash = (hash ^ words[i]) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Values behind every specialization constant id, see pipeline_cache.h
+struct SpecializationConstants {
+    VkBool32 features[PIPELINE_FEATURE_COUNT];
+    uint32_t bindlessCapacities[BINDLESS_BINDING_COUNT];
+};
+
+static VkResult buildPipeline(
+    const struct PipelineCache *cache,
+    const struct PipelineKey *key,
+    VkPipeline *outPipeline
+) {
+    const struct PipelineProgram *program = &cache->programs[key->program];
+    bool vertexOnly = (key->flags & PIPELINE_KEY_VERTEX_ONLY) || program->fragmentModule == VK_NULL_HANDLE;
+
+    struct SpecializationConstants constants;
+    VkSpecializationMapEntry entries[PIPELINE_FEATURE_COUNT + BINDLESS_BINDING_COUNT];
+    for (uint32_t i = 0; i < PIPELINE_FEATURE_COUNT; i++) {
+        constants.features[i] = (key->features >> i) & 1;
+        entries[i] = (VkSpecializationMapEntry) {
+            .constantID = i,
+            .offset = offsetof(struct SpecializationConstants, features) + i * sizeof(VkBool32),
+            .size = sizeof(VkBool32),
+        };
+    }
+    for (uint32_t b = 0; b < BINDLESS_BINDING_COUNT; b++) {
+        constants.bindlessCapacities[b] = cache->bindlessCapacities[b];
+        entries[PIPELINE_FEATURE_COUNT + b] = (VkSpecializationMapEntry) {
+            .constantID = PIPELINE_BINDLESS_CONSTANT_ID + b,
+            .offset = offsetof(struct SpecializationConstants, bindlessCapacities) + b * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+
+    // Ids a shader doesn't declare are ignored, so both stages get them all
+    VkSpecializationInfo specialization = {
+        .mapEntryCount = sizeof(entries) / sizeof(entries[0]),
+        .pMapEntries = entries,
+        .dataSize = sizeof(constants),
+        .pData = &constants,
+    };
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = program->vertexModule,
+            .pName = "main",
+            .pSpecializationInfo = &specialization,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = program->fragmentModule,
+            .pName = "main",
+            .pSpecializationInfo = &specialization,
+        },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = program->attributeCount > 0 ? 1 : 0,
+        .pVertexBindingDescriptions = &program->binding,
+        .vertexAttributeDescriptionCount = program->attributeCount,
+        .pVertexAttributeDescriptions = program->attributes,
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = (VkPrimitiveTopology) key->topology,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates
+    };
+
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = (VkPolygonMode) key->polygonMode,
+        .lineWidth = 1.0f,
+        .cullMode = key->cullMode,
+        .frontFace = (VkFrontFace) key->frontFace,
+        .depthBiasEnable = VK_FALSE,
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .minSampleShading = 1.0f,
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+            | VK_COLOR_COMPONENT_G_BIT
+            | VK_COLOR_COMPONENT_B_BIT
+            | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = key->blend != PIPELINE_BLEND_OPAQUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = key->blend == PIPELINE_BLEND_ADDITIVE
+            ? VK_BLEND_FACTOR_ONE
+            : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+    };
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = (key->flags & PIPELINE_KEY_DEPTH_TEST) ? VK_TRUE : VK_FALSE,
+        .depthWriteEnable = (key->flags & PIPELINE_KEY_DEPTH_WRITE) ? VK_TRUE : VK_FALSE,
+        .depthCompareOp = (VkCompareOp) key->depthCompareOp,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_COPY,
+        .attachmentCount = vertexOnly ? 0 : key->colorAttachments,
+        .pAttachments = &colorBlendAttachment,
+    };
+    if (colorBlending.attachmentCount > 1) {
+        fprintf(stderr, "Pipeline cache: only one color attachment is supported\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = vertexOnly ? 1 : 2,
+        .pStages = shaderStages,
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pDepthStencilState = &depthStencil,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = cache->layout,
+        .renderPass = key->renderPass,
+        .subpass = key->subpass,
+        .basePipelineHandle = VK_NULL_HANDLE,
+    };
+
+    VkResult result = COUNT_VK_CREATE(vkCreateGraphicsPipelines(
+        cache->device,
+        cache->driverCache,
+        1,
+        &pipelineInfo,
+        hostAllocator(),
+        outPipeline
+    ));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create graphics pipeline");
+
+    return VK_SUCCESS;
+}
+
+VkPipeline pipelineCacheGet(
+    struct PipelineCache *cache,
+    const struct PipelineKey *key
+) {
+    uint64_t hash = hashKey(key);
+    uint32_t mask = PIPELINE_CACHE_CAPACITY - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+
+    // The table never fills up completely, so an empty slot always ends the probe
+    while (slotUsed(&cache->entries[slot])) {
+        const struct PipelineCacheEntry *entry = &cache->entries[slot];
+        if (entry->hash == hash && memcmp(&entry->key, key, sizeof(*key)) == 0) {
+            return entry->pipeline;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    // Keep probes short: stay under 3/4 full
+    if (cache->count + 1 > PIPELINE_CACHE_CAPACITY / 4 * 3) {
+        if (!cache->fullReported) {
+            fprintf(stderr, "Pipeline cache: table is full, variants that miss aren't built\n");
+            cache->fullReported = true;
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    bool built = false;
+    if (key->program >= cache->programCount) {
+        fprintf(stderr, "Pipeline cache: unknown program %u\n", key->program);
+    } else {
+        built = buildPipeline(cache, key, &pipeline) == VK_SUCCESS;
+    }
+
+    // Remembered either way, so a broken variant costs one attempt and one
+    // report instead of one per draw
+    cache->entries[slot] = (struct PipelineCacheEntry) {
+        .key = *key,
+        .hash = hash,
+        .pipeline = pipeline,
+        .failed = !built,
+    };
+    cache->count++;
+    if (!built) {
+        fprintf(stderr, "Pipeline cache: variant for program %u, subpass %u, features 0x%x failed, not retrying\n",
+            key->program, key->subpass, key->features);
+        return VK_NULL_HANDLE;
+    }
+
+    fprintf(stderr, "Pipeline cache: built variant %u (program %u, subpass %u, features 0x%x)\n",
+        cache->count, key->program, key->subpass, key->features);
+    return pipeline;
+}
+
+void pipelineCacheEvictRenderPass(
+    struct PipelineCache *cache,
+    VkRenderPass renderPass
+) {
+    // Linear probing can't just clear slots, so the survivors are reinserted
+    struct PipelineCacheEntry survivors[PIPELINE_CACHE_CAPACITY];
+    uint32_t survivorCount = 0;
+    for (uint32_t i = 0; i < PIPELINE_CACHE_CAPACITY; i++) {
+        struct PipelineCacheEntry *entry = &cache->entries[i];
+        if (!slotUsed(entry)) continue;
+
+        if (entry->key.renderPass == renderPass) {
+            vkDestroyPipeline(cache->device, entry->pipeline, hostAllocator());
+        } else {
+            survivors[survivorCount++] = *entry;
+        }
+        *entry = (struct PipelineCacheEntry) { 0 };
+    }
+
+    uint32_t mask = PIPELINE_CACHE_CAPACITY - 1;
+    for (uint32_t i = 0; i < survivorCount; i++) {
+        uint32_t slot = (uint32_t) survivors[i].hash & mask;
+        while (slotUsed(&cache->entries[slot])) slot = (slot + 1) & mask;
+        cache->entries[slot] = survivors[i];
+    }
+    cache->count = survivorCount;
+    cache->fullReported = false;
+}
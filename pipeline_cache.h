@@ -0,0 +1,143 @@
+#pragma once
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bindless.h"
+#include "layout_cache.h"
+
+// Graphics pipeline variants, built on first use from a compact state key.
+// Keys live in a fixed open-addressed table, so a lookup that hits is one
+// hash and a short linear probe with no allocation. Feature toggles are
+// specialization constants, one VkBool32 per bit of `PipelineKey.features`
+// with constant_id equal to the bit index. The bindless array sizes follow
+// from PIPELINE_BINDLESS_CONSTANT_ID, in enum BindlessBinding order.
+//
+// Programs are reflected when they're added (layout_cache.h): their layout
+// must come out as the shared one, and their vertex input can be derived
+// from the vertex shader instead of spelled out.
+
+#define PIPELINE_CACHE_CAPACITY 256 // power of two
+#define PIPELINE_CACHE_MAX_PROGRAMS 32
+#define PIPELINE_PROGRAM_MAX_ATTRIBUTES 8
+#define PIPELINE_FEATURE_COUNT 8
+#define PIPELINE_BINDLESS_CONSTANT_ID PIPELINE_FEATURE_COUNT
+
+#define PIPELINE_PROGRAM_INVALID UINT16_MAX
+
+enum PipelineKeyFlags {
+    PIPELINE_KEY_DEPTH_TEST = 1 << 0,
+    PIPELINE_KEY_DEPTH_WRITE = 1 << 1,
+    PIPELINE_KEY_VERTEX_ONLY = 1 << 2, // no fragment stage, e.g. depth-only passes
+};
+
+enum PipelineBlend {
+    PIPELINE_BLEND_OPAQUE,
+    PIPELINE_BLEND_ALPHA,
+    PIPELINE_BLEND_ADDITIVE,
+};
+
+// Must match the constant_id declarations in the shaders
+enum PipelineFeature {
+    PIPELINE_FEATURE_FLAT_COLOR = 1 << 0,
+    PIPELINE_FEATURE_SHOW_DEPTH = 1 << 1,
+};
+
+// Hashed and compared as raw bytes, so every byte is a named member and
+// keys must be built with an initializer (which zeroes the rest)
+struct PipelineKey {
+    VkRenderPass renderPass;
+    uint16_t program;
+    uint8_t subpass;
+    uint8_t topology;         // VkPrimitiveTopology
+    uint8_t polygonMode;      // VkPolygonMode
+    uint8_t cullMode;         // VkCullModeFlags
+    uint8_t frontFace;        // VkFrontFace
+    uint8_t depthCompareOp;   // VkCompareOp
+    uint8_t flags;            // enum PipelineKeyFlags
+    uint8_t blend;            // enum PipelineBlend
+    uint8_t colorAttachments;
+    uint8_t features;         // enum PipelineFeature
+    uint8_t reserved[4];
+};
+
+// With no attributes they're generated from the vertex shader's inputs,
+// tightly packed in location order as 32-bit components, which must fit
+// `binding.stride`. Vertex layouts that pack smaller formats or skip
+// fields list their attributes, and those are checked against the shader.
+struct PipelineProgramDesc {
+    const char *vertexPath;
+    const char *fragmentPath;
+
+    VkVertexInputBindingDescription binding;
+    uint32_t attributeCount;
+    VkVertexInputAttributeDescription attributes[PIPELINE_PROGRAM_MAX_ATTRIBUTES];
+};
+
+struct PipelineProgram {
+    VkShaderModule vertexModule;
+    VkShaderModule fragmentModule;
+    VkVertexInputBindingDescription binding;
+    uint32_t attributeCount;
+    VkVertexInputAttributeDescription attributes[PIPELINE_PROGRAM_MAX_ATTRIBUTES];
+};
+
+struct PipelineCacheEntry {
+    struct PipelineKey key;
+    uint64_t hash;
+    VkPipeline pipeline;
+    bool failed; // building it failed once, it isn't tried again
+};
+
+struct PipelineCache {
+    VkDevice device;
+    struct LayoutCache *layouts;
+    VkPipelineLayout layout;
+    VkPipelineCache driverCache;
+    uint32_t bindlessCapacities[BINDLESS_BINDING_COUNT];
+
+    uint32_t programCount;
+    struct PipelineProgram programs[PIPELINE_CACHE_MAX_PROGRAMS];
+
+    uint32_t count;
+    bool fullReported; // misses on a full table are only reported once
+    struct PipelineCacheEntry entries[PIPELINE_CACHE_CAPACITY];
+};
+
+// Every variant shares `layout`, the plain bindless layout from `layouts`
+VkResult createPipelineCache(
+    VkDevice device,
+    struct LayoutCache *layouts,
+    struct PipelineCache *cache
+);
+
+void cleanupPipelineCache(struct PipelineCache *cache);
+
+// Loads and reflects the shader modules once, returns
+// PIPELINE_PROGRAM_INVALID on failure or when the shaders don't fit the
+// shared layout or the vertex input
+uint16_t pipelineCacheAddProgram(
+    struct PipelineCache *cache,
+    const struct PipelineProgramDesc *desc
+);
+
+// Builds the variant on a miss. VK_NULL_HANDLE if that fails or the table is
+// full. A failed variant is reported once and keeps failing until its render
+// pass is evicted.
+VkPipeline pipelineCacheGet(
+    struct PipelineCache *cache,
+    const struct PipelineKey *key
+);
+
+// Destroys every variant built against `renderPass`. The caller makes sure
+// none of them are still in use.
+void pipelineCacheEvictRenderPass(
+    struct PipelineCache *cache,
+    VkRenderPass renderPass
+);
+
+#endif // PIPELINE_CACHE_H
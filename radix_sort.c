@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "radix_sort.h"
+
+#define RADIX_PASSES 8
+#define RADIX_BUCKETS 256
+#define RADIX_MAX_CHUNKS JOBS_MAX_WORKERS
+
+void radixSort(struct RadixItem *items, struct RadixItem *scratch, uint32_t count) {
+    if (count < 2) return;
+
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+    memset(histograms, 0, sizeof(histograms));
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t key = items[i].key;
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+            histograms[pass][(key >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    struct RadixItem *source = items;
+    struct RadixItem *destination = scratch;
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t *histogram = histograms[pass];
+        uint32_t shift = pass * 8;
+
+        // Every key has the same byte here, the order can't change
+        if (histogram[(source[0].key >> shift) & 0xff] == count) continue;
+
+        uint32_t offset = 0;
+        for (uint32_t b = 0; b < RADIX_BUCKETS; b++) {
+            uint32_t bucket = histogram[b];
+            histogram[b] = offset;
+            offset += bucket;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+        }
+
+        struct RadixItem *swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != items) memcpy(items, source, (size_t) count * sizeof(*items));
+}
+
+struct RadixPass {
+    const struct RadixItem *source;
+    struct RadixItem *destination;
+    uint32_t count;
+    uint32_t chunkSize;
+    uint32_t shift;
+    // Per chunk counts, then turned into each chunk's write cursors
+    uint32_t histograms[RADIX_MAX_CHUNKS][RADIX_BUCKETS];
+};
+
+static void chunkRange(const struct RadixPass *pass, uint32_t chunk, uint32_t *begin, uint32_t *end) {
+    *begin = chunk * pass->chunkSize;
+    *end = *begin + pass->chunkSize < pass->count ? *begin + pass->chunkSize : pass->count;
+    if (*begin > *end) *begin = *end;
+}
+
+static void histogramJob(void *data, uint32_t chunk) {
+    struct RadixPass *pass = data;
+    uint32_t *histogram = pass->histograms[chunk];
+    memset(histogram, 0, RADIX_BUCKETS * sizeof(uint32_t));
+
+    uint32_t begin, end;
+    chunkRange(pass, chunk, &begin, &end);
+    for (uint32_t i = begin; i < end; i++) {
+        histogram[(pass->source[i].key >> pass->shift) & 0xff]++;
+    }
+}
+
+static void scatterJob(void *data, uint32_t chunk) {
+    struct RadixPass *pass = data;
+    uint32_t *cursors = pass->histograms[chunk];
+
+    uint32_t begin, end;
+    chunkRange(pass, chunk, &begin, &end);
+    for (uint32_t i = begin; i < end; i++) {
+        pass->destination[cursors[(pass->source[i].key >> pass->shift) & 0xff]++] = pass->source[i];
+    }
+}
+
+void radixSortParallel(struct RadixItem *items, struct RadixItem *scratch, uint32_t count) {
+    uint32_t chunkCount = jobsWorkerCount();
+    if (chunkCount > RADIX_MAX_CHUNKS) chunkCount = RADIX_MAX_CHUNKS;
+    if (count < RADIX_PARALLEL_MIN_COUNT || chunkCount < 2) {
+        radixSort(items, scratch, count);
+        return;
+    }
+
+    // Main thread only in practice, and too big to want on the stack
+    static struct RadixPass pass;
+    pass.count = count;
+    pass.chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    struct RadixItem *source = items;
+    struct RadixItem *destination = scratch;
+    for (uint32_t p = 0; p < RADIX_PASSES; p++) {
+        pass.source = source;
+        pass.destination = destination;
+        pass.shift = p * 8;
+
+        struct JobCounter counter = { 0 };
+        jobsRunRange(histogramJob, &pass, chunkCount, &counter);
+        jobsWait(&counter);
+
+        // Every key has the same byte here, the order can't change
+        uint32_t first = (source[0].key >> pass.shift) & 0xff;
+        uint32_t firstTotal = 0;
+        for (uint32_t c = 0; c < chunkCount; c++) firstTotal += pass.histograms[c][first];
+        if (firstTotal == count) continue;
+
+        // Bucket-major, chunk-minor, so equal bytes keep their chunk order
+        uint32_t offset = 0;
+        for (uint32_t b = 0; b < RADIX_BUCKETS; b++) {
+            for (uint32_t c = 0; c < chunkCount; c++) {
+                uint32_t bucket = pass.histograms[c][b];
+                pass.histograms[c][b] = offset;
+                offset += bucket;
+            }
+        }
+
+        counter = (struct JobCounter) { 0 };
+        jobsRunRange(scatterJob, &pass, chunkCount, &counter);
+        jobsWait(&counter);
+
+        struct RadixItem *swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != items) memcpy(items, source, (size_t) count * sizeof(*items));
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdint.h>
+
+// Sort keys with a payload, usually an index into the array being ordered
+struct RadixItem {
+    uint64_t key;
+    uint32_t value;
+    uint32_t reserved;
+};
+
+// Stable least-significant-digit sort on the whole 64-bit key, a byte per
+// pass. One read builds every histogram up front, and passes where all keys
+// share the byte are skipped, so keys that only use a few bytes only pay for
+// those. `scratch` needs room for `count` items; the result is in `items`.
+void radixSort(struct RadixItem *items, struct RadixItem *scratch, uint32_t count);
+
+// Below this the job overhead costs more than the passes
+#define RADIX_PARALLEL_MIN_COUNT (1u << 14)
+
+// Same result as radixSort, with every pass split into a chunk per worker:
+// the chunks histogram in parallel, the histograms are prefix summed in chunk
+// order, which keeps the sort stable, and the chunks scatter in parallel.
+// Main thread only, the histograms live in static storage. Falls back to
+// radixSort for small inputs or a single worker.
+void radixSortParallel(struct RadixItem *items, struct RadixItem *scratch, uint32_t count);
+
+#endif // RADIX_SORT_H
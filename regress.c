@@ -0,0 +1,275 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regress.h"
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: vulkan_tutorial [--regress [directory]] [--output directory] [--update]\n"
+        "                       [--tolerance n] [--max-different fraction] [--timing [--threshold fraction]]\n");
+}
+
+bool regressParseArgs(int argc, char **argv, struct RegressOptions *options) {
+    *options = (struct RegressOptions) {
+        .directory = REGRESS_DEFAULT_DIRECTORY,
+        .output = REGRESS_DEFAULT_OUTPUT,
+        .tolerance = 2,
+        .maxDifferentPixels = 0.001,
+        .threshold = 0.1,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--regress") == 0) {
+            options->enabled = true;
+            if (value && value[0] != '-') {
+                options->directory = value;
+                i++;
+            }
+        } else if (strcmp(arg, "--output") == 0 && value) {
+            options->output = value;
+            i++;
+        } else if (strcmp(arg, "--update") == 0) {
+            options->update = true;
+        } else if (strcmp(arg, "--timing") == 0) {
+            options->timing = true;
+        } else if (strcmp(arg, "--tolerance") == 0 && value) {
+            options->tolerance = (uint8_t) strtoul(value, NULL, 10);
+            i++;
+        } else if (strcmp(arg, "--max-different") == 0 && value) {
+            options->maxDifferentPixels = strtod(value, NULL);
+            i++;
+        } else if (strcmp(arg, "--threshold") == 0 && value) {
+            options->threshold = strtod(value, NULL);
+            i++;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", arg);
+            usage();
+            return false;
+        }
+    }
+
+    if ((options->update || options->timing) && !options->enabled) {
+        fprintf(stderr, "--update and --timing need --regress\n");
+        return false;
+    }
+    return true;
+}
+
+static void buildPath(char *path, size_t size, const char *directory, const char *name, const char *suffix) {
+    snprintf(path, size, "%s/%s%s", directory, name, suffix);
+}
+
+// Opens a golden or baseline. Only a file that doesn't exist sets `missing`,
+// any other failure is reported.
+static FILE *openReference(const char *path, const char *mode, bool *missing) {
+    errno = 0;
+    FILE *file = fopen(path, mode);
+    *missing = !file && errno == ENOENT;
+    if (!file && !*missing) fprintf(stderr, "Regress: failed to open %s\n", path);
+    return file;
+}
+
+// Binary P6 with a maxval of 255, which is all writePpm produces
+static uint8_t *readPpm(const char *path, uint32_t *width, uint32_t *height, bool *missing) {
+    FILE *file = openReference(path, "rb", missing);
+    if (!file) return NULL;
+
+    unsigned w, h, maxval;
+    uint8_t *pixels = NULL;
+    if (fscanf(file, "P6 %u %u %u", &w, &h, &maxval) == 3 && maxval == 255 && fgetc(file) != EOF) {
+        size_t size = (size_t) w * h * 3;
+        pixels = statsMalloc(size);
+        if (pixels && fread(pixels, 1, size, file) != size) {
+            statsFree(pixels);
+            pixels = NULL;
+        }
+    }
+    fclose(file);
+
+    if (!pixels) {
+        fprintf(stderr, "Regress: %s isn't a valid golden image\n", path);
+        return NULL;
+    }
+    *width = w;
+    *height = h;
+    return pixels;
+}
+
+static bool writePpm(const char *path, uint32_t width, uint32_t height, const uint8_t *rgb) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Regress: failed to open %s\n", path);
+        return false;
+    }
+
+    size_t size = (size_t) width * height * 3;
+    bool ok = fprintf(file, "P6\n%u %u\n255\n", width, height) > 0;
+    ok = ok && fwrite(rgb, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "Regress: failed to write %s\n", path);
+    return ok;
+}
+
+// Writes the reference the run would have compared against to the output
+// directory. Without --update that leaves the scene unchecked.
+static enum RegressResult recordImage(
+    const struct RegressOptions *options,
+    const char *name,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *rgb
+) {
+    char path[512];
+    buildPath(path, sizeof(path), options->output, name, ".ppm");
+    if (!writePpm(path, width, height, rgb)) return REGRESS_FAILED;
+    fprintf(stderr, "Regress: %s: recorded %s%s\n", name, path, options->update ? "" : ", no reference to compare against");
+    return options->update ? REGRESS_PASSED : REGRESS_SKIPPED;
+}
+
+enum RegressResult regressCheckImage(
+    const struct RegressOptions *options,
+    const char *name,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *rgba
+) {
+    size_t pixelCount = (size_t) width * height;
+    uint8_t *rgb = statsMalloc(pixelCount * 3);
+    if (!rgb) return REGRESS_FAILED;
+    for (size_t i = 0; i < pixelCount; i++) {
+        memcpy(rgb + i * 3, rgba + i * 4, 3);
+    }
+
+    char path[512];
+    buildPath(path, sizeof(path), options->directory, name, ".ppm");
+
+    // A golden that's there but unreadable fails, it's never replaced
+    uint32_t goldenWidth = 0, goldenHeight = 0;
+    bool missing = options->update;
+    uint8_t *golden = options->update ? NULL : readPpm(path, &goldenWidth, &goldenHeight, &missing);
+    if (!golden) {
+        enum RegressResult result = missing ? recordImage(options, name, width, height, rgb) : REGRESS_FAILED;
+        statsFree(rgb);
+        return result;
+    }
+
+    bool pass = false;
+    if (goldenWidth != width || goldenHeight != height) {
+        fprintf(stderr, "Regress: %s: rendered %ux%u, golden is %ux%u\n",
+            name, width, height, goldenWidth, goldenHeight);
+    } else {
+        // The diff image shows differing pixels in red over a dimmed golden
+        uint8_t *diff = statsMalloc(pixelCount * 3);
+        size_t different = 0;
+        uint32_t maxDelta = 0;
+        for (size_t i = 0; i < pixelCount; i++) {
+            uint32_t delta = 0;
+            for (uint32_t c = 0; c < 3; c++) {
+                int d = abs((int) rgb[i * 3 + c] - (int) golden[i * 3 + c]);
+                if ((uint32_t) d > delta) delta = (uint32_t) d;
+            }
+            if (delta > maxDelta) maxDelta = delta;
+            if (delta > options->tolerance) different++;
+
+            if (diff) {
+                uint8_t gray = (uint8_t) ((golden[i * 3] + golden[i * 3 + 1] + golden[i * 3 + 2]) / 12);
+                diff[i * 3 + 0] = delta > options->tolerance ? 255 : gray;
+                diff[i * 3 + 1] = delta > options->tolerance ? 0 : gray;
+                diff[i * 3 + 2] = delta > options->tolerance ? 0 : gray;
+            }
+        }
+
+        double fraction = pixelCount > 0 ? (double) different / (double) pixelCount : 0.0;
+        pass = fraction <= options->maxDifferentPixels;
+        fprintf(stderr, "Regress: %s: %s, %zu pixels differ (%.4f%%), max delta %u\n",
+            name, pass ? "ok" : "FAILED", different, fraction * 100.0, maxDelta);
+
+        if (!pass && diff) {
+            char diffPath[512];
+            buildPath(diffPath, sizeof(diffPath), options->output, name, ".diff.ppm");
+            writePpm(diffPath, width, height, diff);
+        }
+        statsFree(diff);
+    }
+
+    statsFree(golden);
+    statsFree(rgb);
+    return pass ? REGRESS_PASSED : REGRESS_FAILED;
+}
+
+// One "name value" pair per line
+static bool readMetrics(const char *path, struct RegressMetrics *metrics, bool *missing) {
+    FILE *file = openReference(path, "r", missing);
+    if (!file) return false;
+
+    *metrics = (struct RegressMetrics) { -1.0, -1.0 };
+    char key[64];
+    double value;
+    while (fscanf(file, "%63s %lf", key, &value) == 2) {
+        if (strcmp(key, "startup_ms") == 0) metrics->startupMs = value;
+        else if (strcmp(key, "frame_ms") == 0) metrics->frameMs = value;
+    }
+    fclose(file);
+
+    if (metrics->startupMs < 0.0 || metrics->frameMs < 0.0) {
+        fprintf(stderr, "Regress: %s is missing metrics\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool writeMetrics(const char *path, const struct RegressMetrics *metrics) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Regress: failed to open %s\n", path);
+        return false;
+    }
+    bool ok = fprintf(file, "startup_ms %.3f\nframe_ms %.4f\n", metrics->startupMs, metrics->frameMs) > 0;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+static bool checkMetric(const char *name, double value, double baseline, double threshold) {
+    bool pass = value <= baseline * (1.0 + threshold);
+    fprintf(stderr, "Regress: %s: %s, %.3f ms against a baseline of %.3f ms (%+.1f%%)\n",
+        name, pass ? "ok" : "FAILED", value, baseline,
+        baseline > 0.0 ? (value / baseline - 1.0) * 100.0 : 0.0);
+    return pass;
+}
+
+enum RegressResult regressCheckMetrics(const struct RegressOptions *options, const struct RegressMetrics *metrics) {
+    char path[512];
+    buildPath(path, sizeof(path), options->directory, "baseline", ".txt");
+
+    struct RegressMetrics baseline;
+    bool missing = options->update;
+    if (options->update || !readMetrics(path, &baseline, &missing)) {
+        if (!missing) return REGRESS_FAILED;
+
+        buildPath(path, sizeof(path), options->output, "baseline", ".txt");
+        if (!writeMetrics(path, metrics)) return REGRESS_FAILED;
+        fprintf(stderr, "Regress: recorded %s, startup %.3f ms, frame %.3f ms%s\n",
+            path, metrics->startupMs, metrics->frameMs, options->update ? "" : ", no baseline to compare against");
+        return options->update ? REGRESS_PASSED : REGRESS_SKIPPED;
+    }
+
+    // Both are checked so one report shows everything that regressed
+    bool startup = checkMetric("startup", metrics->startupMs, baseline.startupMs, options->threshold);
+    bool frame = checkMetric("frame time", metrics->frameMs, baseline.frameMs, options->threshold);
+    return startup && frame ? REGRESS_PASSED : REGRESS_FAILED;
+}
+
+bool regressCheckSteadyState(const struct FrameStats *steady, uint32_t frameCount) {
+    if (frameStatsAllocationFree(steady)) {
+        fprintf(stderr, "Regress: %u steady state frames, no allocations\n", frameCount);
+        return true;
+    }
+    fprintf(stderr, "Regress: steady state frames allocate\n");
+    frameStatsPrint(stderr, "  over timed frames", steady);
+    return false;
+}
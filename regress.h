@@ -0,0 +1,73 @@
+#pragma once
+#ifndef REGRESS_H
+#define REGRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame_stats.h"
+
+// Golden image and performance regression checks, run with `--regress`.
+// Rendered scenes are compared against binary PPMs in the reference
+// directory, and the timed frames must not allocate or create Vulkan objects.
+// With `--timing`, startup and frame times are also compared against its
+// baseline.txt; they only mean something on the machine that recorded it.
+//
+// References are never written in place. Recordings and diff images go to
+// the output directory, to be looked at and copied over by hand. A missing
+// reference is recorded there and skips the run, an unreadable one fails it.
+
+#define REGRESS_DEFAULT_DIRECTORY "regress"
+#define REGRESS_DEFAULT_OUTPUT "."
+
+// Exit code of a run that had nothing to compare some scene against, the
+// test's SKIP_RETURN_CODE in CMakeLists.txt
+#define REGRESS_EXIT_SKIPPED 77
+
+// Ordered by severity, a run's result is the worst of its checks
+enum RegressResult {
+    REGRESS_PASSED,
+    REGRESS_SKIPPED, // no reference, recorded one instead
+    REGRESS_FAILED,
+};
+
+struct RegressOptions {
+    bool enabled;
+    bool update;               // record every reference instead of comparing
+    bool timing;               // compare startup and frame times too
+    const char *directory;     // references, only read
+    const char *output;        // recordings and diffs
+    uint8_t tolerance;         // per-channel difference that still counts as equal
+    double maxDifferentPixels; // fraction of pixels allowed past the tolerance
+    double threshold;          // allowed slowdown against the baseline, 0.1 is 10%
+};
+
+struct RegressMetrics {
+    double startupMs;
+    double frameMs;
+};
+
+// False on a malformed command line. Unknown arguments are errors, so a typo
+// can't silently skip the checks.
+bool regressParseArgs(int argc, char **argv, struct RegressOptions *options);
+
+static inline enum RegressResult regressWorst(enum RegressResult a, enum RegressResult b) {
+    return a > b ? a : b;
+}
+
+// `rgba` is tightly packed RGBA8. Writes <name>.diff.ppm to the output
+// directory on failure.
+enum RegressResult regressCheckImage(
+    const struct RegressOptions *options,
+    const char *name,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *rgba
+);
+
+enum RegressResult regressCheckMetrics(const struct RegressOptions *options, const struct RegressMetrics *metrics);
+
+// `steady` is the sum over `frameCount` settled frames
+bool regressCheckSteadyState(const struct FrameStats *steady, uint32_t frameCount);
+
+#endif // REGRESS_H
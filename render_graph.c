@@ -0,0 +1,794 @@
+#include <vulkan/vulkan.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "buffers.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "render_graph.h"
+
+struct AccessInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    VkImageUsageFlags imageUsage;
+};
+
+static const struct AccessInfo accessInfos[RENDER_GRAPH_ACCESS_COUNT] = {
+    [RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+    },
+    [RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE] = {
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+    },
+    [RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ] = {
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+    },
+    [RENDER_GRAPH_ACCESS_FRAGMENT_SAMPLED_READ] = {
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_USAGE_SAMPLED_BIT
+    },
+    [RENDER_GRAPH_ACCESS_COMPUTE_SAMPLED_READ] = {
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_USAGE_SAMPLED_BIT
+    },
+    [RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_READ] = {
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT
+    },
+    [RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_WRITE] = {
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT
+    },
+    [RENDER_GRAPH_ACCESS_VERTEX_BUFFER_READ] = {
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0
+    },
+    [RENDER_GRAPH_ACCESS_INDEX_BUFFER_READ] = {
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_INDEX_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0
+    },
+    [RENDER_GRAPH_ACCESS_VERTEX_SHADER_STORAGE_READ] = {
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT
+    },
+    [RENDER_GRAPH_ACCESS_INDIRECT_BUFFER_READ] = {
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0
+    },
+    [RENDER_GRAPH_ACCESS_TRANSFER_READ] = {
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+    },
+    [RENDER_GRAPH_ACCESS_TRANSFER_WRITE] = {
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT
+    },
+    [RENDER_GRAPH_ACCESS_HOST_READ] = {
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_HOST_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        0
+    },
+    [RENDER_GRAPH_ACCESS_PRESENT] = {
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        0
+    },
+};
+
+#define WRITE_ACCESS_MASK ( \
+    VK_ACCESS_SHADER_WRITE_BIT | \
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | \
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+    VK_ACCESS_TRANSFER_WRITE_BIT | \
+    VK_ACCESS_HOST_WRITE_BIT | \
+    VK_ACCESS_MEMORY_WRITE_BIT)
+
+#define ATTACHMENT_USAGE_MASK ( \
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | \
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | \
+    VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+
+void renderGraphReset(struct RenderGraph *graph) {
+    memset(graph, 0, sizeof(*graph));
+}
+
+static uint32_t addResource(struct RenderGraph *graph, const char *name, enum RenderGraphResourceType type) {
+    if (graph->resourceCount == RENDER_GRAPH_MAX_RESOURCES) {
+        fprintf(stderr, "Render graph: too many resources, dropping '%s'\n", name);
+        return RENDER_GRAPH_INVALID;
+    }
+
+    uint32_t index = graph->resourceCount++;
+    graph->resources[index] = (struct RenderGraphResource) {
+        .name = name,
+        .type = type,
+        .memoryBlock = RENDER_GRAPH_INVALID,
+        .firstPass = RENDER_GRAPH_INVALID,
+        .lastPass = RENDER_GRAPH_INVALID,
+    };
+    return index;
+}
+
+uint32_t renderGraphImportImage(
+    struct RenderGraph *graph,
+    const char *name,
+    VkImageAspectFlags aspect,
+    VkImageLayout initialLayout,
+    VkPipelineStageFlags initialStages
+) {
+    uint32_t index = addResource(graph, name, RENDER_GRAPH_RESOURCE_IMAGE);
+    if (index == RENDER_GRAPH_INVALID) return index;
+
+    struct RenderGraphResource *resource = &graph->resources[index];
+    resource->imported = true;
+    resource->aspect = aspect;
+    resource->initialLayout = initialLayout;
+    resource->initialStages = initialStages;
+    return index;
+}
+
+uint32_t renderGraphImportBuffer(
+    struct RenderGraph *graph,
+    const char *name,
+    VkPipelineStageFlags initialStages
+) {
+    uint32_t index = addResource(graph, name, RENDER_GRAPH_RESOURCE_BUFFER);
+    if (index == RENDER_GRAPH_INVALID) return index;
+
+    struct RenderGraphResource *resource = &graph->resources[index];
+    resource->imported = true;
+    resource->initialStages = initialStages;
+    return index;
+}
+
+static VkImageAspectFlags aspectForFormat(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+uint32_t renderGraphCreateImage(
+    struct RenderGraph *graph,
+    const char *name,
+    const struct RenderGraphImageDesc *desc
+) {
+    uint32_t index = addResource(graph, name, RENDER_GRAPH_RESOURCE_IMAGE);
+    if (index == RENDER_GRAPH_INVALID) return index;
+
+    struct RenderGraphResource *resource = &graph->resources[index];
+    resource->desc = *desc;
+    resource->aspect = aspectForFormat(desc->format);
+    resource->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return index;
+}
+
+void renderGraphMarkOutput(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    enum RenderGraphAccess finalAccess
+) {
+    if (resource == RENDER_GRAPH_INVALID) return;
+    graph->resources[resource].output = true;
+    graph->resources[resource].finalAccess = finalAccess;
+}
+
+uint32_t renderGraphAddPass(
+    struct RenderGraph *graph,
+    const char *name,
+    void (*execute)(VkCommandBuffer commandBuffer, void *user, const void *frame),
+    void *user
+) {
+    if (graph->passCount == RENDER_GRAPH_MAX_PASSES) {
+        fprintf(stderr, "Render graph: too many passes, dropping '%s'\n", name);
+        return RENDER_GRAPH_INVALID;
+    }
+
+    uint32_t index = graph->passCount++;
+    graph->passes[index] = (struct RenderGraphPass) {
+        .name = name,
+        .execute = execute,
+        .user = user,
+    };
+    return index;
+}
+
+void renderGraphPassSideEffects(struct RenderGraph *graph, uint32_t pass) {
+    if (pass == RENDER_GRAPH_INVALID) return;
+    graph->passes[pass].sideEffects = true;
+}
+
+void renderGraphPassUse(
+    struct RenderGraph *graph,
+    uint32_t pass,
+    uint32_t resource,
+    enum RenderGraphAccess access
+) {
+    if (pass == RENDER_GRAPH_INVALID || resource == RENDER_GRAPH_INVALID) return;
+
+    struct RenderGraphPass *p = &graph->passes[pass];
+    if (p->accessCount == RENDER_GRAPH_MAX_ACCESSES) {
+        fprintf(stderr, "Render graph: pass '%s' uses too many resources\n", p->name);
+        return;
+    }
+    p->accesses[p->accessCount++] = (struct RenderGraphPassAccess) {
+        .resource = resource,
+        .access = access,
+    };
+}
+
+static bool accessWrites(enum RenderGraphAccess access) {
+    return (accessInfos[access].access & WRITE_ACCESS_MASK) != 0;
+}
+
+// Passes are declared in submission order, so walking them backwards visits
+// every consumer before its producers. A pass survives if it has side effects
+// or writes something a surviving pass (or an output) still needs.
+static void cullPasses(struct RenderGraph *graph) {
+    bool needed[RENDER_GRAPH_MAX_RESOURCES] = { 0 };
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        needed[i] = graph->resources[i].output;
+    }
+
+    for (uint32_t p = graph->passCount; p-- > 0;) {
+        struct RenderGraphPass *pass = &graph->passes[p];
+
+        bool alive = pass->sideEffects;
+        for (uint32_t a = 0; a < pass->accessCount && !alive; a++) {
+            alive = accessWrites(pass->accesses[a].access) && needed[pass->accesses[a].resource];
+        }
+
+        pass->culled = !alive;
+        if (!alive) continue;
+
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            needed[pass->accesses[a].resource] = true;
+        }
+    }
+}
+
+// Synchronization state of one resource while walking the passes
+struct ResourceState {
+    VkImageLayout layout;
+    VkPipelineStageFlags writeStages;  // stages of the last write
+    VkAccessFlags writeAccess;
+    VkPipelineStageFlags readStages;   // stages that read since the last write
+    VkAccessFlags visibleAccess;       // accesses the last write is already visible to
+};
+
+// Every access a pass makes to one resource, merged
+struct MergedAccess {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    bool write;
+};
+
+static void addBarrier(
+    const struct RenderGraph *graph,
+    uint32_t resource,
+    struct ResourceState *state,
+    const struct MergedAccess *use,
+    struct RenderGraphBarrierBatch *batch
+) {
+    const struct RenderGraphResource *r = &graph->resources[resource];
+    bool isImage = r->type == RENDER_GRAPH_RESOURCE_IMAGE;
+    bool layoutChange = isImage && use->layout != state->layout;
+
+    VkPipelineStageFlags srcStages = 0;
+    VkAccessFlags srcAccess = 0;
+
+    if (use->write || layoutChange) {
+        // WAW and WAR. Reads only need an execution dependency.
+        srcStages = state->writeStages | state->readStages;
+        srcAccess = state->writeAccess;
+    } else if (state->writeStages && (use->access & ~state->visibleAccess)) {
+        // RAW the earlier barriers didn't already cover
+        srcStages = state->writeStages;
+        srcAccess = state->writeAccess;
+    }
+
+    // Waiting on the top of the pipe is a no-op unless there is a transition to do
+    if (!layoutChange) srcStages &= ~(VkPipelineStageFlags) VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+    if (srcStages || layoutChange) {
+        batch->srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        batch->dstStages |= use->stages;
+
+        if (layoutChange || (isImage && srcAccess)) {
+            assert(batch->imageBarrierCount < RENDER_GRAPH_MAX_ACCESSES);
+            batch->imageBarriers[batch->imageBarrierCount++] = (struct RenderGraphImageBarrier) {
+                .resource = resource,
+                .srcAccess = srcAccess,
+                .dstAccess = use->access,
+                .oldLayout = state->layout,
+                .newLayout = use->layout,
+            };
+        } else if (srcAccess) {
+            batch->memorySrcAccess |= srcAccess;
+            batch->memoryDstAccess |= use->access;
+        }
+    }
+
+    if (use->write || layoutChange) {
+        // A layout transition behaves like a write that finished before `use`
+        state->writeStages = use->stages;
+        state->writeAccess = use->access & WRITE_ACCESS_MASK;
+        state->readStages = use->write ? 0 : use->stages;
+        state->visibleAccess = use->write ? 0 : use->access;
+        state->layout = isImage ? use->layout : state->layout;
+    } else {
+        state->readStages |= use->stages;
+        state->visibleAccess |= use->access;
+    }
+}
+
+static bool mergePassAccesses(
+    const struct RenderGraph *graph,
+    const struct RenderGraphPass *pass,
+    uint32_t *outResources,
+    struct MergedAccess *outAccesses,
+    uint32_t *outCount
+) {
+    uint32_t count = 0;
+    for (uint32_t a = 0; a < pass->accessCount; a++) {
+        const struct RenderGraphPassAccess *use = &pass->accesses[a];
+        const struct AccessInfo *info = &accessInfos[use->access];
+
+        uint32_t slot = 0;
+        while (slot < count && outResources[slot] != use->resource) slot++;
+
+        if (slot == count) {
+            outResources[count++] = use->resource;
+            outAccesses[slot] = (struct MergedAccess) { .layout = info->layout };
+        } else if (graph->resources[use->resource].type == RENDER_GRAPH_RESOURCE_IMAGE
+            && outAccesses[slot].layout != info->layout) {
+            fprintf(stderr, "Render graph: pass '%s' needs '%s' in two layouts\n",
+                pass->name, graph->resources[use->resource].name);
+            return false;
+        }
+
+        outAccesses[slot].stages |= info->stages;
+        outAccesses[slot].access |= info->access;
+        outAccesses[slot].write |= accessWrites(use->access);
+    }
+
+    *outCount = count;
+    return true;
+}
+
+// Greedy interval packing: biggest images first, each goes into the first
+// block of a compatible memory type whose images are all dead by the time it
+// is first used (or not yet alive by the time it is last used).
+static VkResult allocateTransientMemory(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct RenderGraph *graph
+) {
+    VkResult result;
+
+    uint32_t order[RENDER_GRAPH_MAX_RESOURCES];
+    VkMemoryRequirements requirements[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t orderCount = 0;
+
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource *r = &graph->resources[i];
+        if (r->imported || r->firstPass == RENDER_GRAPH_INVALID) continue;
+
+        vkGetImageMemoryRequirements(device, r->image, &requirements[i]);
+
+        uint32_t at = orderCount++;
+        while (at > 0 && requirements[order[at - 1]].size < requirements[i].size) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+
+    for (uint32_t o = 0; o < orderCount; o++) {
+        uint32_t i = order[o];
+        struct RenderGraphResource *r = &graph->resources[i];
+        const VkMemoryRequirements *req = &requirements[i];
+
+        // Lazily allocated memory may never be backed, so sharing it buys nothing
+        bool lazy = (r->usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+        uint32_t memoryType = UINT32_MAX;
+        if (lazy) {
+            memoryType = findMemoryType(physicalDevice, req->memoryTypeBits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        }
+        if (memoryType == UINT32_MAX) {
+            lazy = false;
+            memoryType = findMemoryType(physicalDevice, req->memoryTypeBits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+        if (memoryType == UINT32_MAX) {
+            fprintf(stderr, "Render graph: no memory type for '%s'\n", r->name);
+            return VK_ERROR_FEATURE_NOT_PRESENT;
+        }
+
+        uint32_t block = RENDER_GRAPH_INVALID;
+        for (uint32_t b = 0; b < graph->memoryBlockCount && !lazy; b++) {
+            struct RenderGraphMemoryBlock *candidate = &graph->memoryBlocks[b];
+            if (candidate->memoryType != memoryType || candidate->size < req->size) continue;
+
+            bool overlaps = false;
+            for (uint32_t other = 0; other < graph->resourceCount && !overlaps; other++) {
+                const struct RenderGraphResource *o2 = &graph->resources[other];
+                if (o2->memoryBlock != b) continue;
+                overlaps = r->firstPass <= o2->lastPass && o2->firstPass <= r->lastPass;
+            }
+            if (!overlaps) {
+                block = b;
+                break;
+            }
+        }
+
+        if (block == RENDER_GRAPH_INVALID) {
+            if (graph->memoryBlockCount == RENDER_GRAPH_MAX_MEMORY_BLOCKS) {
+                fprintf(stderr, "Render graph: out of memory blocks\n");
+                return VK_ERROR_OUT_OF_HOST_MEMORY;
+            }
+
+            VkMemoryAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .allocationSize = req->size,
+                .memoryTypeIndex = memoryType,
+            };
+
+            block = graph->memoryBlockCount;
+            struct RenderGraphMemoryBlock *newBlock = &graph->memoryBlocks[block];
+            result = memoryAllocate(device, &allocInfo, MEMORY_CATEGORY_IMAGE, &newBlock->memory);
+            RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate render graph memory");
+
+            newBlock->memoryType = memoryType;
+            newBlock->size = req->size;
+            graph->memoryBlockCount++;
+        }
+
+        r->memoryBlock = block;
+        result = vkBindImageMemory(device, r->image, graph->memoryBlocks[block].memory, 0);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to bind render graph image memory");
+    }
+
+    return VK_SUCCESS;
+}
+
+static VkResult createTransientImages(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct RenderGraph *graph
+) {
+    VkResult result;
+
+    for (uint32_t p = 0; p < graph->passCount; p++) {
+        const struct RenderGraphPass *pass = &graph->passes[p];
+        if (pass->culled) continue;
+
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            struct RenderGraphResource *r = &graph->resources[pass->accesses[a].resource];
+            if (r->firstPass == RENDER_GRAPH_INVALID) r->firstPass = p;
+            r->lastPass = p;
+            r->usage |= accessInfos[pass->accesses[a].access].imageUsage;
+        }
+    }
+
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource *r = &graph->resources[i];
+        if (r->imported || r->firstPass == RENDER_GRAPH_INVALID) continue;
+
+        r->usage |= r->desc.extraUsage;
+        if (r->desc.lazilyAllocated && (r->usage & ~ATTACHMENT_USAGE_MASK) == 0) {
+            r->usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+
+        VkImageCreateInfo imageInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = r->desc.format,
+            .extent = { r->desc.extent.width, r->desc.extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = r->usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        result = COUNT_VK_CREATE(vkCreateImage(device, &imageInfo, hostAllocator(), &r->image));
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render graph image");
+    }
+
+    result = allocateTransientMemory(physicalDevice, device, graph);
+    if (result != VK_SUCCESS) return result;
+
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource *r = &graph->resources[i];
+        if (r->imported || r->image == VK_NULL_HANDLE) continue;
+
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = r->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = r->desc.format,
+            .subresourceRange = {
+                .aspectMask = r->aspect,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        };
+        result = COUNT_VK_CREATE(vkCreateImageView(device, &viewInfo, hostAllocator(), &r->imageView));
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render graph image view");
+    }
+
+    return VK_SUCCESS;
+}
+
+// Transient images start the frame undefined, but whatever last touched their
+// memory (this image last frame, or an alias earlier this frame) must be done
+static void initialState(const struct RenderGraph *graph, uint32_t resource, struct ResourceState *state) {
+    const struct RenderGraphResource *r = &graph->resources[resource];
+    *state = (struct ResourceState) { .layout = r->initialLayout };
+
+    if (r->imported) {
+        state->writeStages = r->initialStages;
+        return;
+    }
+
+    for (uint32_t p = 0; p < graph->passCount; p++) {
+        const struct RenderGraphPass *pass = &graph->passes[p];
+        if (pass->culled) continue;
+
+        for (uint32_t a = 0; a < pass->accessCount; a++) {
+            const struct RenderGraphResource *other = &graph->resources[pass->accesses[a].resource];
+            if (other->imported || other->memoryBlock != r->memoryBlock) continue;
+
+            const struct AccessInfo *info = &accessInfos[pass->accesses[a].access];
+            state->writeStages |= info->stages;
+            state->writeAccess |= info->access & WRITE_ACCESS_MASK;
+        }
+    }
+}
+
+VkResult renderGraphCompile(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct RenderGraph *graph
+) {
+    assert(!graph->compiled);
+    VkResult result;
+
+    cullPasses(graph);
+
+    result = createTransientImages(physicalDevice, device, graph);
+    if (result != VK_SUCCESS) {
+        cleanupRenderGraph(device, graph);
+        return result;
+    }
+
+    struct ResourceState states[RENDER_GRAPH_MAX_RESOURCES];
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        initialState(graph, i, &states[i]);
+    }
+
+    uint32_t livePasses = 0;
+    uint32_t batches = 0;
+    for (uint32_t p = 0; p < graph->passCount; p++) {
+        struct RenderGraphPass *pass = &graph->passes[p];
+        pass->barriers = (struct RenderGraphBarrierBatch) { 0 };
+        if (pass->culled) continue;
+
+        uint32_t resources[RENDER_GRAPH_MAX_ACCESSES];
+        struct MergedAccess uses[RENDER_GRAPH_MAX_ACCESSES];
+        uint32_t useCount;
+        if (!mergePassAccesses(graph, pass, resources, uses, &useCount)) {
+            cleanupRenderGraph(device, graph);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        for (uint32_t u = 0; u < useCount; u++) {
+            addBarrier(graph, resources[u], &states[resources[u]], &uses[u], &pass->barriers);
+        }
+
+        livePasses++;
+        if (pass->barriers.srcStages) batches++;
+    }
+
+    graph->finalBarriers = (struct RenderGraphBarrierBatch) { 0 };
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        const struct RenderGraphResource *r = &graph->resources[i];
+        if (!r->output) continue;
+
+        if (graph->finalBarriers.imageBarrierCount == RENDER_GRAPH_MAX_ACCESSES) {
+            fprintf(stderr, "Render graph: too many outputs\n");
+            cleanupRenderGraph(device, graph);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        const struct AccessInfo *info = &accessInfos[r->finalAccess];
+        struct MergedAccess use = {
+            .stages = info->stages,
+            .access = info->access,
+            .layout = info->layout,
+            .write = accessWrites(r->finalAccess),
+        };
+        addBarrier(graph, i, &states[i], &use, &graph->finalBarriers);
+    }
+    if (graph->finalBarriers.srcStages) batches++;
+
+    uint32_t transients = 0;
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        if (graph->resources[i].image != VK_NULL_HANDLE && !graph->resources[i].imported) transients++;
+    }
+
+    fprintf(stderr, "Render graph: %u/%u passes, %u barrier batches, %u transient images in %u memory blocks\n",
+        livePasses, graph->passCount, batches, transients, graph->memoryBlockCount);
+
+    graph->compiled = true;
+    return VK_SUCCESS;
+}
+
+void cleanupRenderGraph(
+    VkDevice device,
+    struct RenderGraph *graph
+) {
+    for (uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource *r = &graph->resources[i];
+        if (r->imported) continue;
+
+        vkDestroyImageView(device, r->imageView, hostAllocator());
+        vkDestroyImage(device, r->image, hostAllocator());
+        r->imageView = VK_NULL_HANDLE;
+        r->image = VK_NULL_HANDLE;
+        r->usage = 0;
+        r->memoryBlock = RENDER_GRAPH_INVALID;
+        r->firstPass = RENDER_GRAPH_INVALID;
+        r->lastPass = RENDER_GRAPH_INVALID;
+    }
+
+    for (uint32_t b = 0; b < graph->memoryBlockCount; b++) {
+        memoryFree(device, graph->memoryBlocks[b].memory);
+    }
+    graph->memoryBlockCount = 0;
+    graph->compiled = false;
+}
+
+void renderGraphBindImage(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    VkImage image,
+    VkImageView imageView
+) {
+    assert(graph->resources[resource].imported);
+    graph->resources[resource].image = image;
+    graph->resources[resource].imageView = imageView;
+}
+
+void renderGraphBindBuffer(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    VkBuffer buffer
+) {
+    assert(graph->resources[resource].imported);
+    graph->resources[resource].buffer = buffer;
+}
+
+VkImageView renderGraphGetImageView(const struct RenderGraph *graph, uint32_t resource) {
+    return graph->resources[resource].imageView;
+}
+
+static void recordBarriers(
+    const struct RenderGraph *graph,
+    const struct RenderGraphBarrierBatch *batch,
+    VkCommandBuffer commandBuffer
+) {
+    if (batch->srcStages == 0) return;
+
+    VkImageMemoryBarrier imageBarriers[RENDER_GRAPH_MAX_ACCESSES];
+    for (uint32_t i = 0; i < batch->imageBarrierCount; i++) {
+        const struct RenderGraphImageBarrier *b = &batch->imageBarriers[i];
+        const struct RenderGraphResource *r = &graph->resources[b->resource];
+
+        imageBarriers[i] = (VkImageMemoryBarrier) {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = b->srcAccess,
+            .dstAccessMask = b->dstAccess,
+            .oldLayout = b->oldLayout,
+            .newLayout = b->newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = r->image,
+            .subresourceRange = {
+                .aspectMask = r->aspect,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS,
+            },
+        };
+    }
+
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = batch->memorySrcAccess,
+        .dstAccessMask = batch->memoryDstAccess,
+    };
+    uint32_t memoryBarrierCount = batch->memorySrcAccess ? 1 : 0;
+
+    VKD(vkCmdPipelineBarrier)(
+        commandBuffer,
+        batch->srcStages,
+        batch->dstStages,
+        0,
+        memoryBarrierCount, &memoryBarrier,
+        0, NULL,
+        batch->imageBarrierCount, imageBarriers
+    );
+}
+
+void renderGraphExecute(
+    const struct RenderGraph *graph,
+    VkCommandBuffer commandBuffer,
+    const void *frame,
+    const struct RenderGraphPassHooks *hooks
+) {
+    assert(graph->compiled);
+
+    for (uint32_t p = 0; p < graph->passCount; p++) {
+        const struct RenderGraphPass *pass = &graph->passes[p];
+        if (pass->culled) continue;
+
+        recordBarriers(graph, &pass->barriers, commandBuffer);
+        if (hooks) hooks->begin(commandBuffer, hooks->user, pass->name, frame);
+        pass->execute(commandBuffer, pass->user, frame);
+        if (hooks) hooks->end(commandBuffer, hooks->user, pass->name, frame);
+    }
+
+    recordBarriers(graph, &graph->finalBarriers, commandBuffer);
+}
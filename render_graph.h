@@ -0,0 +1,226 @@
+#pragma once
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame graph. Passes declare how they use each resource, and compiling the
+// graph turns that into one batched vkCmdPipelineBarrier per pass, drops
+// passes that don't contribute to an output and lets transient images whose
+// lifetimes don't overlap share memory. Compile once per configuration (e.g.
+// on swap chain recreation); executing only resolves imported handles.
+
+#define RENDER_GRAPH_MAX_RESOURCES 32
+#define RENDER_GRAPH_MAX_PASSES 32
+#define RENDER_GRAPH_MAX_ACCESSES 8   // per pass
+#define RENDER_GRAPH_MAX_MEMORY_BLOCKS 16
+
+#define RENDER_GRAPH_INVALID UINT32_MAX
+
+enum RenderGraphAccess {
+    RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE,
+    RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE,
+    RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ,
+    RENDER_GRAPH_ACCESS_FRAGMENT_SAMPLED_READ,
+    RENDER_GRAPH_ACCESS_COMPUTE_SAMPLED_READ,
+    RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_READ,
+    RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_WRITE,
+    RENDER_GRAPH_ACCESS_VERTEX_BUFFER_READ,
+    RENDER_GRAPH_ACCESS_INDEX_BUFFER_READ,
+    RENDER_GRAPH_ACCESS_VERTEX_SHADER_STORAGE_READ,
+    RENDER_GRAPH_ACCESS_INDIRECT_BUFFER_READ,
+    RENDER_GRAPH_ACCESS_TRANSFER_READ,
+    RENDER_GRAPH_ACCESS_TRANSFER_WRITE,
+    RENDER_GRAPH_ACCESS_HOST_READ,
+    RENDER_GRAPH_ACCESS_PRESENT,
+    RENDER_GRAPH_ACCESS_COUNT
+};
+
+enum RenderGraphResourceType {
+    RENDER_GRAPH_RESOURCE_IMAGE,
+    RENDER_GRAPH_RESOURCE_BUFFER,
+};
+
+struct RenderGraphImageDesc {
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags extraUsage; // on top of what the declared accesses need
+    bool lazilyAllocated;         // prefer LAZILY_ALLOCATED memory (attachments only)
+};
+
+struct RenderGraphResource {
+    const char *name;
+    enum RenderGraphResourceType type;
+    bool imported;
+    bool output;
+    enum RenderGraphAccess finalAccess;
+
+    // Imported: the state the resource is in when the graph starts
+    VkPipelineStageFlags initialStages;
+    VkImageLayout initialLayout;
+
+    // Transient images
+    struct RenderGraphImageDesc desc;
+    VkImageAspectFlags aspect;
+    VkImageUsageFlags usage;
+    uint32_t memoryBlock;
+    uint32_t firstPass;
+    uint32_t lastPass;
+
+    // Bound per frame for imported resources, owned by the graph otherwise
+    VkImage image;
+    VkImageView imageView;
+    VkBuffer buffer;
+};
+
+struct RenderGraphPassAccess {
+    uint32_t resource;
+    enum RenderGraphAccess access;
+};
+
+struct RenderGraphImageBarrier {
+    uint32_t resource;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+};
+
+struct RenderGraphBarrierBatch {
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    VkAccessFlags memorySrcAccess; // buffers share one global memory barrier
+    VkAccessFlags memoryDstAccess;
+    uint32_t imageBarrierCount;
+    struct RenderGraphImageBarrier imageBarriers[RENDER_GRAPH_MAX_ACCESSES];
+};
+
+struct RenderGraphPass {
+    const char *name;
+    void (*execute)(VkCommandBuffer commandBuffer, void *user, const void *frame);
+    void *user;
+    bool sideEffects; // never culled, e.g. passes that write to host memory
+
+    uint32_t accessCount;
+    struct RenderGraphPassAccess accesses[RENDER_GRAPH_MAX_ACCESSES];
+
+    bool culled;
+    struct RenderGraphBarrierBatch barriers;
+};
+
+struct RenderGraphMemoryBlock {
+    uint32_t memoryType;
+    VkDeviceSize size;
+    VkDeviceMemory memory;
+};
+
+struct RenderGraph {
+    uint32_t resourceCount;
+    struct RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+
+    uint32_t passCount;
+    struct RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+
+    // Transitions outputs into their final access after the last pass
+    struct RenderGraphBarrierBatch finalBarriers;
+
+    uint32_t memoryBlockCount;
+    struct RenderGraphMemoryBlock memoryBlocks[RENDER_GRAPH_MAX_MEMORY_BLOCKS];
+
+    bool compiled;
+};
+
+// Clears all declarations. Call cleanupRenderGraph first if it was compiled.
+void renderGraphReset(struct RenderGraph *graph);
+
+uint32_t renderGraphImportImage(
+    struct RenderGraph *graph,
+    const char *name,
+    VkImageAspectFlags aspect,
+    VkImageLayout initialLayout,
+    VkPipelineStageFlags initialStages
+);
+
+uint32_t renderGraphImportBuffer(
+    struct RenderGraph *graph,
+    const char *name,
+    VkPipelineStageFlags initialStages
+);
+
+uint32_t renderGraphCreateImage(
+    struct RenderGraph *graph,
+    const char *name,
+    const struct RenderGraphImageDesc *desc
+);
+
+// Culling keeps whatever contributes to an output
+void renderGraphMarkOutput(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    enum RenderGraphAccess finalAccess
+);
+
+uint32_t renderGraphAddPass(
+    struct RenderGraph *graph,
+    const char *name,
+    void (*execute)(VkCommandBuffer commandBuffer, void *user, const void *frame),
+    void *user
+);
+
+void renderGraphPassSideEffects(struct RenderGraph *graph, uint32_t pass);
+
+void renderGraphPassUse(
+    struct RenderGraph *graph,
+    uint32_t pass,
+    uint32_t resource,
+    enum RenderGraphAccess access
+);
+
+VkResult renderGraphCompile(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct RenderGraph *graph
+);
+
+// Destroys transient images and their memory, the declarations are kept
+void cleanupRenderGraph(
+    VkDevice device,
+    struct RenderGraph *graph
+);
+
+void renderGraphBindImage(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    VkImage image,
+    VkImageView imageView
+);
+
+void renderGraphBindBuffer(
+    struct RenderGraph *graph,
+    uint32_t resource,
+    VkBuffer buffer
+);
+
+VkImageView renderGraphGetImageView(const struct RenderGraph *graph, uint32_t resource);
+
+// Called around every pass that isn't culled, after its barriers, e.g. to
+// wrap it in queries
+struct RenderGraphPassHooks {
+    void (*begin)(VkCommandBuffer commandBuffer, void *user, const char *pass, const void *frame);
+    void (*end)(VkCommandBuffer commandBuffer, void *user, const char *pass, const void *frame);
+    void *user;
+};
+
+// `frame` is handed to every pass, `user` is fixed when the pass is added.
+// `hooks` may be NULL.
+void renderGraphExecute(
+    const struct RenderGraph *graph,
+    VkCommandBuffer commandBuffer,
+    const void *frame,
+    const struct RenderGraphPassHooks *hooks
+);
+
+#endif // RENDER_GRAPH_H
@@ -1,5 +1,14 @@
 #include <vulkan/vulkan.h>
-//#include <shaderc/shaderc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "embedded_shaders.h"
+#include "file_io.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "shader_modules.h"
 
 VkResult createShaderModule(
     VkDevice device,
@@ -12,6 +21,64 @@ VkResult createShaderModule(
     createInfo.codeSize = shaderCodeSize;
     createInfo.pCode = (uint32_t*)shaderCode;
 
-    return vkCreateShaderModule(device, &createInfo, NULL, shaderModule);
+    return COUNT_VK_CREATE(vkCreateShaderModule(device, &createInfo, hostAllocator(), shaderModule));
+}
+
+#ifdef EMBED_SHADERS
+static const struct EmbeddedShader *findEmbeddedShader(const char *path) {
+    for (uint32_t i = 0; i < embeddedShaderCount; i++) {
+        if (strcmp(embeddedShaders[i].path, path) == 0) return &embeddedShaders[i];
+    }
+    return NULL;
+}
+#endif
+
+// The embedded copy if there is one, otherwise the file's contents, which
+// the caller frees through `owned`
+static const uint32_t *loadShaderCode(const char *path, size_t *size, void **owned) {
+    *owned = NULL;
+#ifdef EMBED_SHADERS
+    const struct EmbeddedShader *embedded = findEmbeddedShader(path);
+    if (embedded) {
+        *size = embedded->size;
+        return embedded->code;
+    }
+#endif
+
+    const char *code = read_entire_file(path, size);
+    if (!code) {
+        fprintf(stderr, "Failed to read shader %s\n", path);
+        return NULL;
+    }
+    *owned = (void *) code;
+    return (const uint32_t *) code;
 }
 
+VkResult loadShaderModule(VkDevice device, const char *path, VkShaderModule *shaderModule) {
+    return loadReflectedShaderModule(device, NULL, path, shaderModule, NULL);
+}
+
+VkResult loadReflectedShaderModule(
+    VkDevice device,
+    struct LayoutCache *layouts,
+    const char *path,
+    VkShaderModule *shaderModule,
+    const struct ShaderReflection **reflection
+) {
+    size_t size;
+    void *owned;
+    const uint32_t *code = loadShaderCode(path, &size, &owned);
+    if (!code) return VK_ERROR_INITIALIZATION_FAILED;
+
+    VkResult result = VK_SUCCESS;
+    if (layouts) {
+        *reflection = layoutCacheReflect(layouts, code, size);
+        if (!*reflection) {
+            fprintf(stderr, "Failed to reflect shader %s\n", path);
+            result = VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
+    if (result == VK_SUCCESS) result = createShaderModule(device, (const char *) code, size, shaderModule);
+    free(owned);
+    return result;
+}
@@ -3,7 +3,8 @@
 #define SHADER_MODULES_H
 
 #include <vulkan/vulkan.h>
-//#include <shaderc/shaderc.h>
+
+#include "layout_cache.h"
 
 VkResult createShaderModule(
     VkDevice device,
@@ -12,4 +13,18 @@ VkResult createShaderModule(
     VkShaderModule *shaderModule
 );
 
+// From the SPIR-V embedded at build time (see embedded_shaders.h), or from
+// the file at `path` when the build didn't embed it
+VkResult loadShaderModule(VkDevice device, const char *path, VkShaderModule *shaderModule);
+
+// loadShaderModule that also reflects the code through `layouts`, which
+// keeps the reflection. With no `layouts` it's just loadShaderModule.
+VkResult loadReflectedShaderModule(
+    VkDevice device,
+    struct LayoutCache *layouts,
+    const char *path,
+    VkShaderModule *shaderModule,
+    const struct ShaderReflection **reflection
+);
+
 #endif // SHADER_MODULES_H
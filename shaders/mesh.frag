@@ -0,0 +1,19 @@
+#version 450
+
+// Specialization constants, see enum PipelineFeature
+layout(constant_id = 1) const bool SHOW_DEPTH = false;
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 0) out vec4 outColor;
+
+const vec3 LIGHT = vec3(0.4, 0.8, 0.45);
+
+void main() {
+    if (SHOW_DEPTH) {
+        outColor = vec4(vec3(gl_FragCoord.z), 1.0);
+        return;
+    }
+    // Half-Lambert, so the side facing away still reads as a shape
+    float lambert = dot(normalize(fragNormal), normalize(LIGHT)) * 0.5 + 0.5;
+    outColor = vec4(vec3(0.85, 0.75, 0.6) * lambert * lambert, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 450
+
+// Meshlet mesh vertices, indexed by the compacted stream meshlets.comp
+// writes. The camera is picked through the bindless push constants.
+
+// Bindless array sizes, see PIPELINE_BINDLESS_CONSTANT_ID
+layout(constant_id = 10) const uint MAX_BUFFERS = 32;
+
+struct Camera {
+    mat4 viewProjection;
+    vec4 planes[6];
+    vec4 position;
+};
+
+layout(set = 0, binding = 2) readonly buffer Cameras { Camera cameras[]; } cameraBuffers[MAX_BUFFERS];
+
+layout(push_constant) uniform PushConstants {
+    uint imageIndex;
+    uint samplerIndex;
+    uint bufferIndex;    // camera ring
+    uint instanceOffset; // this frame's camera
+} pc;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragNormal;
+
+// The depth pre-pass and the EQUAL-tested shading pass are separate
+// pipelines, their depths have to come out bit-identical
+invariant gl_Position;
+
+void main() {
+    mat4 viewProjection = cameraBuffers[pc.bufferIndex].cameras[pc.instanceOffset].viewProjection;
+    gl_Position = viewProjection * vec4(inPosition, 1.0);
+    fragNormal = inNormal;
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// One quad per particle instance, the attributes come straight from the
+// particle array (see addParticleProgram).
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inAgeLifetime;
+layout(location = 2) in float inSize;
+layout(location = 3) in vec4 inColor;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main() {
+    vec2 corner = corners[gl_VertexIndex];
+    float fade = 1.0 - inAgeLifetime.x / inAgeLifetime.y;
+
+    gl_Position = vec4(inPosition + corner * inSize, 0.0, 1.0);
+    fragColor = vec4(inColor.rgb, inColor.a * fade);
+    fragCorner = corner;
+}
@@ -1,8 +1,18 @@
 #version 450
 
+// Specialization constants, see enum PipelineFeature
+layout(constant_id = 0) const bool FLAT_COLOR = false;
+layout(constant_id = 1) const bool SHOW_DEPTH = false;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    if (SHOW_DEPTH) {
+        outColor = vec4(vec3(gl_FragCoord.z), 1.0);
+    } else if (FLAT_COLOR) {
+        outColor = vec4(1.0);
+    } else {
+        outColor = vec4(fragColor, 1.0);
+    }
 }
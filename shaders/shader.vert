@@ -1,30 +1,37 @@
 #version 450
 
-/*
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
-*/
+// One triangle per scene object, placed by the world matrices streamed into
+// the instance ring. The ring and this frame's region of it come through
+// the bindless push constants.
+
+// Bindless array sizes, see PIPELINE_BINDLESS_CONSTANT_ID
+layout(constant_id = 10) const uint MAX_BUFFERS = 32;
+
+layout(set = 0, binding = 2) readonly buffer Instances { mat4 worlds[]; } instanceBuffers[MAX_BUFFERS];
+
+layout(push_constant) uniform PushConstants {
+    uint imageIndex;
+    uint samplerIndex;
+    uint bufferIndex;    // instance ring
+    uint instanceOffset; // this frame's first world matrix
+} pc;
+
+// The demo scene's roots span about 40 by 25 units around the origin
+const vec2 VIEW_SCALE = vec2(1.0 / 21.0, 1.0 / 14.0);
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
 
-void main() {
-    /*
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-    */
+// The depth pre-pass and the EQUAL-tested shading pass are separate
+// pipelines, their depths have to come out bit-identical
+invariant gl_Position;
 
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+void main() {
+    mat4 world = instanceBuffers[pc.bufferIndex].worlds[pc.instanceOffset + gl_InstanceIndex];
+    vec4 position = world * vec4(inPosition, 0.0, 1.0);
+    // Children sit up to half a unit above their roots, nearer is smaller depth
+    gl_Position = vec4(position.xy * VIEW_SCALE, 0.5 - position.z * 0.5, 1.0);
     fragColor = inColor;
 }
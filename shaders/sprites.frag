@@ -0,0 +1,32 @@
+#version 450
+
+// The image index is pushed per batch, so it's uniform across the draw
+
+// Bindless array sizes, see PIPELINE_BINDLESS_CONSTANT_ID
+layout(constant_id = 8) const uint MAX_IMAGES = 64;
+layout(constant_id = 9) const uint MAX_SAMPLERS = 16;
+
+layout(set = 0, binding = 0) uniform texture2D images[MAX_IMAGES];
+layout(set = 0, binding = 1) uniform sampler samplers[MAX_SAMPLERS];
+
+layout(push_constant) uniform PushConstants {
+    uint imageIndex;
+    uint samplerIndex;
+    uint bufferIndex;
+    uint instanceOffset;
+} pc;
+
+layout(location = 0) in vec2 fragUv;
+layout(location = 1) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+const uint INVALID_INDEX = 0xffffffffu;
+
+void main() {
+    vec4 texel = vec4(1.0);
+    if (pc.imageIndex != INVALID_INDEX) {
+        texel = texture(sampler2D(images[pc.imageIndex], samplers[pc.samplerIndex]), fragUv);
+    }
+    outColor = texel * fragColor;
+}
@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "frame_stats.h"
+#include "spirv_reflect.h"
+
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_HEADER_WORDS 5
+
+// The few opcodes, decorations and enums read here, from the SPIR-V spec
+enum SpirvOp {
+    OP_ENTRY_POINT = 15,
+    OP_TYPE_BOOL = 20,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_MATRIX = 24,
+    OP_TYPE_IMAGE = 25,
+    OP_TYPE_SAMPLER = 26,
+    OP_TYPE_SAMPLED_IMAGE = 27,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_CONSTANT = 43,
+    OP_SPEC_CONSTANT = 50,
+    OP_VARIABLE = 59,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72,
+};
+
+enum SpirvDecoration {
+    DECORATION_BUFFER_BLOCK = 3,
+    DECORATION_ARRAY_STRIDE = 6,
+    DECORATION_MATRIX_STRIDE = 7,
+    DECORATION_BUILT_IN = 11,
+    DECORATION_LOCATION = 30,
+    DECORATION_BINDING = 33,
+    DECORATION_DESCRIPTOR_SET = 34,
+    DECORATION_OFFSET = 35,
+};
+
+enum SpirvStorageClass {
+    STORAGE_UNIFORM_CONSTANT = 0,
+    STORAGE_INPUT = 1,
+    STORAGE_UNIFORM = 2,
+    STORAGE_PUSH_CONSTANT = 9,
+    STORAGE_STORAGE_BUFFER = 12,
+};
+
+enum SpirvExecutionModel {
+    EXECUTION_VERTEX = 0,
+    EXECUTION_TESSELLATION_CONTROL = 1,
+    EXECUTION_TESSELLATION_EVALUATION = 2,
+    EXECUTION_GEOMETRY = 3,
+    EXECUTION_FRAGMENT = 4,
+    EXECUTION_GL_COMPUTE = 5,
+};
+
+#define SPIRV_DIM_BUFFER 5
+
+enum IdFlags {
+    ID_BUILT_IN = 1 << 0,
+    ID_BUFFER_BLOCK = 1 << 1,
+    ID_LOCATION = 1 << 2,
+};
+
+struct SpirvId {
+    const uint32_t *instruction; // the type, constant or variable declaring it
+    uint32_t location;
+    uint32_t binding;
+    uint32_t set;
+    uint32_t arrayStride;
+    uint32_t flags; // enum IdFlags
+};
+
+struct Reflector {
+    const uint32_t *code;
+    uint32_t wordCount;
+    uint32_t bound;
+    struct SpirvId *ids;
+    // OpMemberDecorate instructions, read when sizing a struct
+    const uint32_t **memberDecorations;
+    uint32_t memberDecorationCount;
+};
+
+uint64_t spirvHash(const uint32_t *code, size_t size) {
+    // FNV-1a over the bytes
+    const uint8_t *bytes = (const uint8_t *) code;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint32_t wordCountOf(const uint32_t *instruction) { return instruction[0] >> 16; }
+static uint32_t opcodeOf(const uint32_t *instruction) { return instruction[0] & 0xffffu; }
+
+// The instruction declaring `id`, if it's one of `opcode`
+static const uint32_t *declaration(const struct Reflector *r, uint32_t id, uint32_t opcode) {
+    if (id >= r->bound || !r->ids[id].instruction) return NULL;
+    return opcodeOf(r->ids[id].instruction) == opcode ? r->ids[id].instruction : NULL;
+}
+
+static uint32_t opcodeOfId(const struct Reflector *r, uint32_t id) {
+    if (id >= r->bound || !r->ids[id].instruction) return 0;
+    return opcodeOf(r->ids[id].instruction);
+}
+
+static uint32_t memberDecoration(const struct Reflector *r, uint32_t structId, uint32_t member, uint32_t decoration, uint32_t fallback) {
+    for (uint32_t i = 0; i < r->memberDecorationCount; i++) {
+        const uint32_t *instruction = r->memberDecorations[i];
+        if (instruction[1] == structId && instruction[2] == member && instruction[3] == decoration) {
+            return wordCountOf(instruction) > 4 ? instruction[4] : 1;
+        }
+    }
+    return fallback;
+}
+
+// Array length, 0 when it's a specialization constant
+static uint32_t arrayLength(const struct Reflector *r, uint32_t lengthId) {
+    const uint32_t *constant = declaration(r, lengthId, OP_CONSTANT);
+    return constant && wordCountOf(constant) > 3 ? constant[3] : 0;
+}
+
+// Bytes `typeId` covers in a block, laid out by its Offset and stride
+// decorations. Matrices are column major, which is all glslang emits.
+static uint32_t typeSize(const struct Reflector *r, uint32_t typeId, uint32_t matrixStride, uint32_t depth) {
+    if (depth > 16 || typeId >= r->bound || !r->ids[typeId].instruction) return 0;
+    const uint32_t *type = r->ids[typeId].instruction;
+    uint32_t words = wordCountOf(type);
+
+    switch (opcodeOf(type)) {
+    case OP_TYPE_BOOL: return 4;
+    case OP_TYPE_INT:
+    case OP_TYPE_FLOAT: return words > 2 ? type[2] / 8 : 0;
+    case OP_TYPE_VECTOR: return words > 3 ? type[3] * typeSize(r, type[2], 0, depth + 1) : 0;
+    case OP_TYPE_MATRIX: {
+        if (words <= 3) return 0;
+        uint32_t column = matrixStride ? matrixStride : typeSize(r, type[2], 0, depth + 1);
+        return type[3] * column;
+    }
+    case OP_TYPE_ARRAY: {
+        if (words <= 3) return 0;
+        uint32_t stride = r->ids[typeId].arrayStride;
+        if (!stride) stride = typeSize(r, type[2], matrixStride, depth + 1);
+        return arrayLength(r, type[3]) * stride;
+    }
+    case OP_TYPE_STRUCT: {
+        uint32_t size = 0;
+        uint32_t next = 0;
+        for (uint32_t member = 0; member + 2 < words; member++) {
+            uint32_t offset = memberDecoration(r, typeId, member, DECORATION_OFFSET, next);
+            uint32_t stride = memberDecoration(r, typeId, member, DECORATION_MATRIX_STRIDE, 0);
+            next = offset + typeSize(r, type[member + 2], stride, depth + 1);
+            if (next > size) size = next;
+        }
+        return size;
+    }
+    default: return 0; // runtime arrays and opaque types take no block space
+    }
+}
+
+// Unwraps arrays of descriptors, multiplying their lengths into `count`
+static uint32_t unwrapArrays(const struct Reflector *r, uint32_t typeId, uint32_t *count) {
+    *count = 1;
+    for (uint32_t depth = 0; depth < 8; depth++) {
+        const uint32_t *array = declaration(r, typeId, OP_TYPE_ARRAY);
+        const uint32_t *runtime = declaration(r, typeId, OP_TYPE_RUNTIME_ARRAY);
+        if (array && wordCountOf(array) > 3) {
+            *count *= arrayLength(r, array[3]);
+            typeId = array[2];
+        } else if (runtime && wordCountOf(runtime) > 2) {
+            *count = 0;
+            typeId = runtime[2];
+        } else {
+            break;
+        }
+    }
+    return typeId;
+}
+
+static bool descriptorType(const struct Reflector *r, uint32_t typeId, uint32_t storageClass, VkDescriptorType *out) {
+    const uint32_t *image = declaration(r, typeId, OP_TYPE_IMAGE);
+    switch (storageClass) {
+    case STORAGE_UNIFORM_CONSTANT:
+        if (image && wordCountOf(image) > 7) {
+            bool storage = image[7] == 2;
+            if (image[3] == SPIRV_DIM_BUFFER) {
+                *out = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else {
+                *out = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+            return true;
+        }
+        if (opcodeOfId(r, typeId) == OP_TYPE_SAMPLER) {
+            *out = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        }
+        if (opcodeOfId(r, typeId) == OP_TYPE_SAMPLED_IMAGE) {
+            *out = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        }
+        return false;
+    case STORAGE_UNIFORM:
+        // Pre-1.3 SPIR-V marks storage buffers as BufferBlock uniforms
+        if (typeId >= r->bound) return false;
+        *out = (r->ids[typeId].flags & ID_BUFFER_BLOCK)
+            ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+            : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+    case STORAGE_STORAGE_BUFFER:
+        *out = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool reflectInput(const struct Reflector *r, uint32_t variableId, uint32_t typeId, struct ShaderReflection *reflection) {
+    const struct SpirvId *variable = &r->ids[variableId];
+    if (variable->flags & ID_BUILT_IN) return true;
+    if (!(variable->flags & ID_LOCATION)) {
+        fprintf(stderr, "SPIR-V reflection: input %u has no location\n", variableId);
+        return false;
+    }
+    if (reflection->inputCount == SHADER_REFLECTION_MAX_INPUTS) {
+        fprintf(stderr, "SPIR-V reflection: more than %u inputs\n", SHADER_REFLECTION_MAX_INPUTS);
+        return false;
+    }
+
+    struct ShaderInput input = { .location = variable->location, .baseType = SHADER_BASE_OTHER, .componentCount = 1 };
+    const uint32_t *vector = declaration(r, typeId, OP_TYPE_VECTOR);
+    if (vector && wordCountOf(vector) > 3) {
+        input.componentCount = (uint8_t) vector[3];
+        typeId = vector[2];
+    }
+    const uint32_t *scalar = declaration(r, typeId, OP_TYPE_FLOAT);
+    if (scalar && wordCountOf(scalar) > 2) {
+        input.baseType = SHADER_BASE_FLOAT;
+        input.componentSize = (uint8_t) (scalar[2] / 8);
+    }
+    scalar = declaration(r, typeId, OP_TYPE_INT);
+    if (scalar && wordCountOf(scalar) > 3) {
+        input.baseType = scalar[3] ? SHADER_BASE_INT : SHADER_BASE_UINT;
+        input.componentSize = (uint8_t) (scalar[2] / 8);
+    }
+    if (input.baseType == SHADER_BASE_OTHER || input.componentCount < 1 || input.componentCount > 4) {
+        fprintf(stderr, "SPIR-V reflection: input at location %u is not a scalar or vector\n", input.location);
+        return false;
+    }
+
+    uint32_t i = reflection->inputCount++;
+    for (; i > 0 && reflection->inputs[i - 1].location > input.location; i--) {
+        reflection->inputs[i] = reflection->inputs[i - 1];
+    }
+    reflection->inputs[i] = input;
+    return true;
+}
+
+static bool reflectBinding(const struct Reflector *r, uint32_t variableId, uint32_t typeId, uint32_t storageClass, struct ShaderReflection *reflection) {
+    const struct SpirvId *variable = &r->ids[variableId];
+    struct ShaderBinding binding = { .set = variable->set, .binding = variable->binding };
+    typeId = unwrapArrays(r, typeId, &binding.count);
+    if (!descriptorType(r, typeId, storageClass, &binding.type)) {
+        fprintf(stderr, "SPIR-V reflection: unsupported resource at set %u binding %u\n", binding.set, binding.binding);
+        return false;
+    }
+
+    // Several declarations of one binding, as the bindless buffers use
+    for (uint32_t i = 0; i < reflection->bindingCount; i++) {
+        struct ShaderBinding *existing = &reflection->bindings[i];
+        if (existing->set != binding.set || existing->binding != binding.binding) continue;
+        if (existing->type != binding.type || existing->count != binding.count) {
+            fprintf(stderr, "SPIR-V reflection: set %u binding %u is declared with two different types\n", binding.set, binding.binding);
+            return false;
+        }
+        return true;
+    }
+
+    if (reflection->bindingCount == SHADER_REFLECTION_MAX_BINDINGS) {
+        fprintf(stderr, "SPIR-V reflection: more than %u bindings\n", SHADER_REFLECTION_MAX_BINDINGS);
+        return false;
+    }
+    uint32_t i = reflection->bindingCount++;
+    for (; i > 0; i--) {
+        const struct ShaderBinding *previous = &reflection->bindings[i - 1];
+        if (previous->set < binding.set || (previous->set == binding.set && previous->binding < binding.binding)) break;
+        reflection->bindings[i] = *previous;
+    }
+    reflection->bindings[i] = binding;
+    return true;
+}
+
+static bool reflectVariable(const struct Reflector *r, const uint32_t *instruction, struct ShaderReflection *reflection) {
+    if (wordCountOf(instruction) < 4) return false;
+    uint32_t variableId = instruction[2];
+    uint32_t storageClass = instruction[3];
+    const uint32_t *pointer = declaration(r, instruction[1], OP_TYPE_POINTER);
+    if (!pointer || wordCountOf(pointer) < 4 || variableId >= r->bound) {
+        fprintf(stderr, "SPIR-V reflection: variable %u has no pointer type\n", variableId);
+        return false;
+    }
+    uint32_t typeId = pointer[3];
+
+    switch (storageClass) {
+    case STORAGE_INPUT:
+        return reflection->stage != VK_SHADER_STAGE_VERTEX_BIT || reflectInput(r, variableId, typeId, reflection);
+    case STORAGE_PUSH_CONSTANT:
+        reflection->pushConstantSize = typeSize(r, typeId, 0, 0);
+        return true;
+    case STORAGE_UNIFORM_CONSTANT:
+    case STORAGE_UNIFORM:
+    case STORAGE_STORAGE_BUFFER:
+        return reflectBinding(r, variableId, typeId, storageClass, reflection);
+    default:
+        return true; // outputs, private and workgroup memory
+    }
+}
+
+// Records declarations and decorations by id. Returns false on a truncated
+// instruction or an id past the bound.
+static bool indexModule(struct Reflector *r, struct ShaderReflection *reflection) {
+    bool haveEntryPoint = false;
+    for (uint32_t word = SPIRV_HEADER_WORDS; word < r->wordCount;) {
+        const uint32_t *instruction = &r->code[word];
+        uint32_t words = wordCountOf(instruction);
+        if (words == 0 || words > r->wordCount - word) return false;
+        word += words;
+
+        uint32_t opcode = opcodeOf(instruction);
+        switch (opcode) {
+        case OP_ENTRY_POINT: {
+            if (haveEntryPoint || words < 3) break;
+            haveEntryPoint = true;
+            switch (instruction[1]) {
+            case EXECUTION_VERTEX: reflection->stage = VK_SHADER_STAGE_VERTEX_BIT; break;
+            case EXECUTION_TESSELLATION_CONTROL: reflection->stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; break;
+            case EXECUTION_TESSELLATION_EVALUATION: reflection->stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; break;
+            case EXECUTION_GEOMETRY: reflection->stage = VK_SHADER_STAGE_GEOMETRY_BIT; break;
+            case EXECUTION_FRAGMENT: reflection->stage = VK_SHADER_STAGE_FRAGMENT_BIT; break;
+            case EXECUTION_GL_COMPUTE: reflection->stage = VK_SHADER_STAGE_COMPUTE_BIT; break;
+            default: return false;
+            }
+        } break;
+        case OP_DECORATE: {
+            if (words < 3 || instruction[1] >= r->bound) return false;
+            struct SpirvId *target = &r->ids[instruction[1]];
+            uint32_t value = words > 3 ? instruction[3] : 0;
+            switch (instruction[2]) {
+            case DECORATION_BUFFER_BLOCK: target->flags |= ID_BUFFER_BLOCK; break;
+            case DECORATION_ARRAY_STRIDE: target->arrayStride = value; break;
+            case DECORATION_BUILT_IN: target->flags |= ID_BUILT_IN; break;
+            case DECORATION_LOCATION: target->location = value; target->flags |= ID_LOCATION; break;
+            case DECORATION_BINDING: target->binding = value; break;
+            case DECORATION_DESCRIPTOR_SET: target->set = value; break;
+            default: break;
+            }
+        } break;
+        case OP_MEMBER_DECORATE: {
+            if (words < 4) return false;
+            r->memberDecorations[r->memberDecorationCount++] = instruction;
+        } break;
+        case OP_TYPE_BOOL:
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+        case OP_TYPE_VECTOR:
+        case OP_TYPE_MATRIX:
+        case OP_TYPE_IMAGE:
+        case OP_TYPE_SAMPLER:
+        case OP_TYPE_SAMPLED_IMAGE:
+        case OP_TYPE_ARRAY:
+        case OP_TYPE_RUNTIME_ARRAY:
+        case OP_TYPE_STRUCT:
+        case OP_TYPE_POINTER: {
+            if (words < 2 || instruction[1] >= r->bound) return false;
+            r->ids[instruction[1]].instruction = instruction;
+        } break;
+        case OP_CONSTANT:
+        case OP_SPEC_CONSTANT: {
+            if (words < 4 || instruction[2] >= r->bound) return false;
+            r->ids[instruction[2]].instruction = instruction;
+        } break;
+        default: break;
+        }
+    }
+    return haveEntryPoint;
+}
+
+bool spirvReflect(const uint32_t *code, size_t size, struct ShaderReflection *reflection) {
+    memset(reflection, 0, sizeof(*reflection));
+    if (size % 4 != 0 || size / 4 <= SPIRV_HEADER_WORDS || size / 4 > UINT32_MAX || code[0] != SPIRV_MAGIC) {
+        fprintf(stderr, "SPIR-V reflection: not a SPIR-V module\n");
+        return false;
+    }
+    reflection->hash = spirvHash(code, size);
+
+    struct Reflector r = {
+        .code = code,
+        .wordCount = (uint32_t) (size / 4),
+        .bound = code[3],
+    };
+    // A member decoration takes at least 4 words, which bounds their count
+    r.ids = statsCalloc(r.bound, sizeof(struct SpirvId));
+    r.memberDecorations = statsMalloc((size_t) (r.wordCount / 4) * sizeof(*r.memberDecorations));
+    bool ok = r.ids && r.memberDecorations && indexModule(&r, reflection);
+    if (!ok) fprintf(stderr, "SPIR-V reflection: malformed module\n");
+
+    for (uint32_t word = SPIRV_HEADER_WORDS; ok && word < r.wordCount; word += wordCountOf(&code[word])) {
+        if (opcodeOf(&code[word]) == OP_VARIABLE) ok = reflectVariable(&r, &code[word], reflection);
+    }
+
+    statsFree(r.ids);
+    statsFree(r.memberDecorations);
+    return ok;
+}
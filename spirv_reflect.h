@@ -0,0 +1,61 @@
+#pragma once
+#ifndef SPIRV_REFLECT_H
+#define SPIRV_REFLECT_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Just enough SPIR-V reflection to build pipeline state from the shaders
+// instead of keeping it in sync with them by hand: the vertex inputs, the
+// descriptor bindings and the size of the push constant block of the first
+// entry point. One pass over the words, no allocation beyond a table sized
+// by the module's id bound. See layout_cache.h for what's built from it.
+
+#define SHADER_REFLECTION_MAX_INPUTS 16
+#define SHADER_REFLECTION_MAX_BINDINGS 16
+
+enum ShaderBaseType {
+    SHADER_BASE_FLOAT,
+    SHADER_BASE_INT,
+    SHADER_BASE_UINT,
+    SHADER_BASE_OTHER, // bool, matrices, structs: not a vertex attribute
+};
+
+struct ShaderInput {
+    uint32_t location;
+    uint8_t baseType;       // enum ShaderBaseType
+    uint8_t componentCount; // 1 to 4
+    uint8_t componentSize;  // in bytes
+    uint8_t reserved;
+};
+
+// Aliased declarations of one binding are merged. `count` is 0 for runtime
+// arrays and arrays sized by a specialization constant, whose size is only
+// known once the pipeline is built.
+struct ShaderBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count;
+};
+
+struct ShaderReflection {
+    uint64_t hash; // of the code, see spirvHash
+    VkShaderStageFlagBits stage;
+    uint32_t inputCount; // vertex shaders only, sorted by location
+    struct ShaderInput inputs[SHADER_REFLECTION_MAX_INPUTS];
+    uint32_t bindingCount; // sorted by set, then binding
+    struct ShaderBinding bindings[SHADER_REFLECTION_MAX_BINDINGS];
+    uint32_t pushConstantSize;
+};
+
+uint64_t spirvHash(const uint32_t *code, size_t size);
+
+// `size` in bytes. Malformed modules, and ones using more than the fixed
+// limits above, are reported and fail.
+bool spirvReflect(const uint32_t *code, size_t size, struct ShaderReflection *reflection);
+
+#endif // SPIRV_REFLECT_H
@@ -0,0 +1,251 @@
+#include <vulkan/vulkan.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "bindless.h"
+#include "buffers.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "sprites.h"
+
+_Static_assert(BINDLESS_MAX_SAMPLED_IMAGES < 0xffff, "image indices must fit the 16-bit key field");
+
+VkResult createSpriteRenderer(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t capacity,
+    uint32_t framesInFlight,
+    struct SpriteRenderer *renderer
+) {
+    VkResult result;
+
+    *renderer = (struct SpriteRenderer) { 0 };
+    renderer->capacity = capacity;
+
+    renderer->sprites = statsMalloc((size_t) capacity * sizeof(struct Sprite));
+    renderer->keys = statsMalloc((size_t) capacity * sizeof(struct RadixItem));
+    renderer->scratch = statsMalloc((size_t) capacity * sizeof(struct RadixItem));
+    renderer->batches = statsMalloc((size_t) capacity * sizeof(struct SpriteBatch));
+    if (!renderer->sprites || !renderer->keys || !renderer->scratch || !renderer->batches) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    // Every quad is the same two triangles, so the indices never change
+    VkDeviceSize indexSize = (VkDeviceSize) capacity * SPRITE_INDICES * sizeof(uint32_t);
+    result = createBuffer(
+        physicalDevice,
+        device,
+        indexSize,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &renderer->indexBuffer,
+        &renderer->indexMemory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create sprite index buffer");
+
+    void *data;
+    result = vkMapMemory(device, renderer->indexMemory, 0, indexSize, 0, &data);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to map sprite index buffer");
+
+    static const uint32_t pattern[SPRITE_INDICES] = { 0, 1, 2, 2, 3, 0 };
+    uint32_t *indices = data;
+    for (uint32_t quad = 0; quad < capacity; quad++) {
+        for (uint32_t i = 0; i < SPRITE_INDICES; i++) {
+            indices[quad * SPRITE_INDICES + i] = quad * SPRITE_VERTICES + pattern[i];
+        }
+    }
+    vkUnmapMemory(device, renderer->indexMemory);
+
+    result = createFrameRing(
+        physicalDevice,
+        device,
+        (VkDeviceSize) capacity * SPRITE_VERTICES * sizeof(struct SpriteVertex),
+        framesInFlight,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        &renderer->vertexRing
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create sprite vertex ring");
+
+    return VK_SUCCESS;
+}
+
+void cleanupSpriteRenderer(VkDevice device, struct SpriteRenderer *renderer) {
+    if (renderer->vertexRing.buffer != VK_NULL_HANDLE) cleanupFrameRing(device, &renderer->vertexRing);
+    vkDestroyBuffer(device, renderer->indexBuffer, hostAllocator());
+    if (renderer->indexMemory != VK_NULL_HANDLE) memoryFree(device, renderer->indexMemory);
+
+    statsFree(renderer->sprites);
+    statsFree(renderer->keys);
+    statsFree(renderer->scratch);
+    statsFree(renderer->batches);
+    *renderer = (struct SpriteRenderer) { 0 };
+}
+
+uint16_t addSpriteProgram(struct PipelineCache *cache) {
+    struct PipelineProgramDesc desc = {
+        .vertexPath = "shaders/sprites_vert.spv",
+        .fragmentPath = "shaders/sprites_frag.spv",
+        .binding = {
+            .binding = 0,
+            .stride = sizeof(struct SpriteVertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        },
+        .attributeCount = 3,
+        .attributes = {
+            { .location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(struct SpriteVertex, position) },
+            { .location = 1, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(struct SpriteVertex, uv) },
+            { .location = 2, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(struct SpriteVertex, color) },
+        },
+    };
+    return pipelineCacheAddProgram(cache, &desc);
+}
+
+uint64_t spriteSortKey(const struct Sprite *sprite) {
+    // Non-negative floats order like their bits, inverted to draw far first
+    float depth = sprite->depth < 0.0f ? 0.0f : sprite->depth > 1.0f ? 1.0f : sprite->depth;
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    uint64_t texture = sprite->texture == BINDLESS_INVALID_INDEX ? 0xffff : sprite->texture;
+    return (uint64_t) sprite->layer << SPRITE_KEY_LAYER_SHIFT
+        | (uint64_t) sprite->pipeline << SPRITE_KEY_PIPELINE_SHIFT
+        | texture << SPRITE_KEY_TEXTURE_SHIFT
+        | (uint64_t) ~depthBits << SPRITE_KEY_DEPTH_SHIFT;
+}
+
+void spritesBegin(struct SpriteRenderer *renderer, uint32_t frame) {
+    frameRingBegin(&renderer->vertexRing, frame);
+    renderer->count = 0;
+    renderer->batchCount = 0;
+    renderer->stats = (struct SpriteStats) { 0 };
+}
+
+bool spritesPush(struct SpriteRenderer *renderer, const struct Sprite *sprite) {
+    if (renderer->count == renderer->capacity) return false;
+
+    uint32_t index = renderer->count++;
+    renderer->sprites[index] = *sprite;
+    renderer->keys[index] = (struct RadixItem) { .key = spriteSortKey(sprite), .value = index };
+    return true;
+}
+
+void spritesEnd(struct SpriteRenderer *renderer, VkExtent2D extent) {
+    uint32_t count = renderer->count;
+    renderer->batchCount = 0;
+    if (count == 0) return;
+
+    struct SpriteVertex *vertices = frameRingAlloc(
+        &renderer->vertexRing,
+        (VkDeviceSize) count * SPRITE_VERTICES * sizeof(struct SpriteVertex),
+        sizeof(struct SpriteVertex),
+        &renderer->vertexOffset
+    );
+    if (!vertices) {
+        // Sized for the capacity, so only a second spritesEnd in a frame gets here
+        fprintf(stderr, "Sprites: vertex ring exhausted\n");
+        renderer->count = 0;
+        return;
+    }
+
+    radixSort(renderer->keys, renderer->scratch, count);
+
+    float scaleX = 2.0f / (float) extent.width;
+    float scaleY = 2.0f / (float) extent.height;
+    struct SpriteBatch *batch = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const struct Sprite *sprite = &renderer->sprites[renderer->keys[i].value];
+
+        if (!batch || batch->pipeline != sprite->pipeline || batch->texture != sprite->texture) {
+            batch = &renderer->batches[renderer->batchCount++];
+            *batch = (struct SpriteBatch) {
+                .first = i,
+                .count = 0,
+                .texture = sprite->texture,
+                .pipeline = sprite->pipeline,
+            };
+        }
+        batch->count++;
+
+        float x0 = sprite->position[0] * scaleX - 1.0f;
+        float y0 = sprite->position[1] * scaleY - 1.0f;
+        float x1 = (sprite->position[0] + sprite->size[0]) * scaleX - 1.0f;
+        float y1 = (sprite->position[1] + sprite->size[1]) * scaleY - 1.0f;
+        const float *uv = sprite->uv;
+
+        struct SpriteVertex *quad = &vertices[i * SPRITE_VERTICES];
+        quad[0] = (struct SpriteVertex) { { x0, y0 }, { uv[0], uv[1] }, sprite->color };
+        quad[1] = (struct SpriteVertex) { { x1, y0 }, { uv[2], uv[1] }, sprite->color };
+        quad[2] = (struct SpriteVertex) { { x1, y1 }, { uv[2], uv[3] }, sprite->color };
+        quad[3] = (struct SpriteVertex) { { x0, y1 }, { uv[0], uv[3] }, sprite->color };
+    }
+
+    // What spritesRecordDraw will do, for the report
+    struct SpriteStats stats = { .sprites = count, .draws = renderer->batchCount };
+    for (uint32_t b = 0; b < renderer->batchCount; b++) {
+        const struct SpriteBatch *current = &renderer->batches[b];
+        const struct SpriteBatch *previous = b > 0 ? &renderer->batches[b - 1] : NULL;
+        if (!previous || previous->pipeline != current->pipeline) stats.pipelineBinds++;
+        if (!previous || previous->texture != current->texture) stats.textureChanges++;
+    }
+    renderer->stats = stats;
+}
+
+void spritesRecordDraw(
+    const struct SpriteRenderer *renderer,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    const VkPipeline pipelines[SPRITE_PIPELINE_COUNT],
+    const struct BindlessPushConstants *pushConstants
+) {
+    if (renderer->batchCount == 0) return;
+
+    VkBuffer vertexBuffers[] = { renderer->vertexRing.buffer };
+    VkDeviceSize offsets[] = { renderer->vertexOffset };
+    VKD(vkCmdBindVertexBuffers)(commandBuffer, 0, 1, vertexBuffers, offsets);
+    VKD(vkCmdBindIndexBuffer)(commandBuffer, renderer->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    VkPushConstantRange pushConstantRange = bindlessPushConstantRange();
+    struct BindlessPushConstants constants = *pushConstants;
+    uint8_t boundPipeline = SPRITE_PIPELINE_COUNT;
+    bool pushed = false;
+
+    for (uint32_t b = 0; b < renderer->batchCount; b++) {
+        const struct SpriteBatch *batch = &renderer->batches[b];
+        if (pipelines[batch->pipeline] == VK_NULL_HANDLE) continue;
+
+        if (batch->pipeline != boundPipeline) {
+            VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[batch->pipeline]);
+            boundPipeline = batch->pipeline;
+        }
+        if (!pushed || constants.imageIndex != batch->texture) {
+            constants.imageIndex = batch->texture;
+            VKD(vkCmdPushConstants)(
+                commandBuffer,
+                layout,
+                pushConstantRange.stageFlags,
+                0, sizeof(constants),
+                &constants
+            );
+            pushed = true;
+        }
+
+        VKD(vkCmdDrawIndexed)(commandBuffer, batch->count * SPRITE_INDICES, 1, batch->first * SPRITE_INDICES, 0, 0);
+    }
+}
+
+void spritesReport(const struct SpriteRenderer *renderer, FILE *out) {
+    const struct SpriteStats *stats = &renderer->stats;
+    fprintf(
+        out,
+        "Sprites last frame: %u in %u draws, %u pipeline binds, %u texture changes\n",
+        stats->sprites,
+        stats->draws,
+        stats->pipelineBinds,
+        stats->textureChanges
+    );
+}
@@ -0,0 +1,129 @@
+#pragma once
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "buffers.h"
+#include "pipeline_cache.h"
+#include "radix_sort.h"
+
+// Batched 2D quads. Sprites are collected on the CPU during the frame, sorted
+// by a 64-bit key and streamed as vertices into a per-frame ring region in
+// sorted order. The index buffer is generated once at creation since every
+// quad uses the same pattern. Consecutive sprites with the same pipeline and
+// texture become one indexed draw, and the pipeline or texture is only
+// changed where the sorted run changes it.
+
+#define SPRITE_DEFAULT_CAPACITY (1u << 16)
+#define SPRITE_VERTICES 4
+#define SPRITE_INDICES 6
+
+// What a sprite is drawn with, one pipeline variant each
+enum SpritePipeline {
+    SPRITE_PIPELINE_ALPHA,
+    SPRITE_PIPELINE_ADDITIVE,
+    SPRITE_PIPELINE_COUNT
+};
+
+// Sort key, most significant first. Layers are drawn in increasing order,
+// depth is only an order within a layer, far to near for blending.
+#define SPRITE_KEY_LAYER_SHIFT 56    // 8 bits
+#define SPRITE_KEY_PIPELINE_SHIFT 48 // 8 bits, enum SpritePipeline
+#define SPRITE_KEY_TEXTURE_SHIFT 32  // 16 bits, the bindless index
+#define SPRITE_KEY_DEPTH_SHIFT 0     // 32 bits
+
+struct Sprite {
+    float position[2]; // top left, in pixels
+    float size[2];     // in pixels
+    float uv[4];       // u0, v0, u1, v1
+    uint32_t color;    // RGBA8, multiplies the texture
+    uint32_t texture;  // bindless image index, BINDLESS_INVALID_INDEX for flat color
+    float depth;       // [0, 1], larger is farther
+    uint8_t layer;
+    uint8_t pipeline;  // enum SpritePipeline
+};
+
+struct SpriteVertex {
+    float position[2]; // normalized device coordinates
+    float uv[2];
+    uint32_t color;
+};
+
+// A run of sorted sprites drawn together
+struct SpriteBatch {
+    uint32_t first;
+    uint32_t count;
+    uint32_t texture;
+    uint8_t pipeline;
+};
+
+struct SpriteStats {
+    uint32_t sprites;
+    uint32_t draws;
+    uint32_t pipelineBinds;
+    uint32_t textureChanges;
+};
+
+struct SpriteRenderer {
+    uint32_t capacity;
+
+    VkBuffer indexBuffer;
+    VkDeviceMemory indexMemory;
+    struct FrameRing vertexRing; // one region per frame in flight
+
+    // Collected this frame
+    uint32_t count;
+    struct Sprite *sprites;
+    struct RadixItem *keys;
+    struct RadixItem *scratch;
+
+    // Built by spritesEnd
+    VkDeviceSize vertexOffset;
+    uint32_t batchCount;
+    struct SpriteBatch *batches;
+    struct SpriteStats stats;
+};
+
+VkResult createSpriteRenderer(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t capacity,
+    uint32_t framesInFlight,
+    struct SpriteRenderer *renderer
+);
+
+void cleanupSpriteRenderer(VkDevice device, struct SpriteRenderer *renderer);
+
+uint16_t addSpriteProgram(struct PipelineCache *cache);
+
+uint64_t spriteSortKey(const struct Sprite *sprite);
+
+// Once per frame after the frame's fence has signalled
+void spritesBegin(struct SpriteRenderer *renderer, uint32_t frame);
+
+// Returns false once the frame is full
+bool spritesPush(struct SpriteRenderer *renderer, const struct Sprite *sprite);
+
+// Sorts, streams the vertices and builds the batches. `extent` is the target
+// the pixel coordinates are relative to.
+void spritesEnd(struct SpriteRenderer *renderer, VkExtent2D extent);
+
+// Inside the render pass with the bindless set bound. `pushConstants` is the
+// rest of what the draws push, the image index is replaced per batch.
+void spritesRecordDraw(
+    const struct SpriteRenderer *renderer,
+    VkCommandBuffer commandBuffer,
+    VkPipelineLayout layout,
+    const VkPipeline pipelines[SPRITE_PIPELINE_COUNT],
+    const struct BindlessPushConstants *pushConstants
+);
+
+// Last frame's sprites, draws and state changes
+void spritesReport(const struct SpriteRenderer *renderer, FILE *out);
+
+#endif // SPRITES_H
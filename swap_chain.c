@@ -2,10 +2,14 @@
 //#include <cglm/cglm.h>
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "defines.h"
+#include "arena.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
 #include "swap_chain.h"
 
 // TODO: internal headers
@@ -13,6 +17,7 @@ static VkSurfaceFormatKHR getSurfaceFormat(VkPhysicalDevice physicalDevice, VkSu
 static VkPresentModeKHR getPresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 static VkExtent2D chooseExtent(VkSurfaceCapabilitiesKHR capabilities, uint32_t width, uint32_t height);
 static VkResult createImageViews(VkDevice device, VkImage *images, uint32_t count, VkFormat format, VkImageView *imageViews);
+static VkFormat getDepthFormat(VkPhysicalDevice physicalDevice);
 
 VkResult createSwapChain(
     VkPhysicalDevice physicalDevice,
@@ -35,8 +40,17 @@ VkResult createSwapChain(
 
     uint32_t minImageCount = capabilities.minImageCount + 1;
     if (capabilities.maxImageCount > 0 && minImageCount > capabilities.maxImageCount) {
-        swapChain->imageCount = capabilities.maxImageCount;
+        minImageCount = capabilities.maxImageCount;
     }
+    if (minImageCount > SWAP_CHAIN_MAX_IMAGES) {
+        fprintf(stderr, "Swap chain needs %u images, at most %u are supported\n", minImageCount, SWAP_CHAIN_MAX_IMAGES);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // Transfer source lets frames be read back for capture, sampled lets them
+    // be converted to YUV first
+    VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+        | (capabilities.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT));
 
     VkSwapchainCreateInfoKHR createInfo = {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -46,7 +60,7 @@ VkResult createSwapChain(
         .imageColorSpace = surfaceFormat.colorSpace,
         .imageExtent = extent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = imageUsage,
     };
 
     uint32_t queueFamilyIndices[] = { graphicsFamily, presentFamily };
@@ -65,29 +79,33 @@ VkResult createSwapChain(
     createInfo.clipped = VK_TRUE;
     createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-    result = vkCreateSwapchainKHR(device, &createInfo, NULL, &swapChain->vkSwapChain);
+    result = COUNT_VK_CREATE(vkCreateSwapchainKHR(device, &createInfo, hostAllocator(), &swapChain->vkSwapChain));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create swap chain");
 
-    vkGetSwapchainImagesKHR(device, swapChain->vkSwapChain, &minImageCount, NULL);
-    VkImage *images = malloc(minImageCount * sizeof(VkImage));
-    vkGetSwapchainImagesKHR(device, swapChain->vkSwapChain, &minImageCount, images);
+    // The driver may create more than asked for
+    uint32_t imageCount = SWAP_CHAIN_MAX_IMAGES;
+    result = vkGetSwapchainImagesKHR(device, swapChain->vkSwapChain, &imageCount, swapChain->images);
+    if (result == VK_INCOMPLETE) {
+        fprintf(stderr, "Swap chain has more than %u images\n", SWAP_CHAIN_MAX_IMAGES);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get swap chain images");
 
-    VkImageView *imageViews;
-    imageViews = malloc(minImageCount * sizeof(VkImageView));
     result = createImageViews(
         device,
-        images,
-        minImageCount,
+        swapChain->images,
+        imageCount,
         surfaceFormat.format,
-        imageViews
+        swapChain->imageViews
     );
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create image views");
 
-    swapChain->images = images;
-    swapChain->imageCount = minImageCount;
+    swapChain->imageCount = imageCount;
     swapChain->imageFormat = surfaceFormat.format;
+    swapChain->imageUsage = imageUsage;
     swapChain->extent = extent;
-    swapChain->imageViews = imageViews;
+
+    swapChain->depthFormat = getDepthFormat(physicalDevice);
 
     return VK_SUCCESS;
 }
@@ -97,12 +115,13 @@ void cleanupSwapChain(
     struct SwapChain *swapChain
 ) {
     for (uint32_t i = 0; i < swapChain->imageCount; i++) {
-        vkDestroyFramebuffer(device, swapChain->framebuffers[i], NULL);
+        vkDestroyFramebuffer(device, swapChain->framebuffers[i], hostAllocator());
+        swapChain->framebuffers[i] = VK_NULL_HANDLE;
     }
     for (uint32_t i = 0; i < swapChain->imageCount; i++) {
-        vkDestroyImageView(device, swapChain->imageViews[i], NULL);
+        vkDestroyImageView(device, swapChain->imageViews[i], hostAllocator());
     }
-    vkDestroySwapchainKHR(device, swapChain->vkSwapChain, NULL);
+    vkDestroySwapchainKHR(device, swapChain->vkSwapChain, hostAllocator());
 }
 
 static VkSurfaceFormatKHR getSurfaceFormat(
@@ -113,7 +132,7 @@ static VkSurfaceFormatKHR getSurfaceFormat(
     vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &count, NULL);
     assert(count > 0);
 
-    VkSurfaceFormatKHR *formats = alloca(count * sizeof(VkSurfaceFormatKHR));
+    VkSurfaceFormatKHR *formats = ARENA_ARRAY(frameArena(), VkSurfaceFormatKHR, count);
     vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &count, formats);
 
     VkSurfaceFormatKHR format = formats[0];
@@ -134,7 +153,7 @@ static VkPresentModeKHR getPresentMode(
     vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, NULL);
     assert(count > 0);
 
-    VkPresentModeKHR *modes = alloca(count * sizeof(VkPresentModeKHR));
+    VkPresentModeKHR *modes = ARENA_ARRAY(frameArena(), VkPresentModeKHR, count);
     vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, modes);
 
     static const VkPresentModeKHR modePriority[] = {
@@ -154,19 +173,19 @@ static VkPresentModeKHR getPresentMode(
 
     switch (mode) {
         case VK_PRESENT_MODE_IMMEDIATE_KHR:
-            printf("Present mode: immediate\n");
+            fprintf(stderr, "Present mode: immediate\n");
             break;
         case VK_PRESENT_MODE_MAILBOX_KHR:
-            printf("Present mode: mailbox\n");
+            fprintf(stderr, "Present mode: mailbox\n");
             break;
         case VK_PRESENT_MODE_FIFO_KHR:
-            printf("Present mode: fifo\n");
+            fprintf(stderr, "Present mode: fifo\n");
             break;
         case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
-            printf("Present mode: fifo relaxed\n");
+            fprintf(stderr, "Present mode: fifo relaxed\n");
             break;
         default:
-            printf("Present mode: unknown\n");
+            fprintf(stderr, "Present mode: unknown\n");
             break;
     }
 
@@ -227,9 +246,29 @@ VkResult createImageViews(
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
 
-        result = vkCreateImageView(device, &createInfo, NULL, &swapChainImageViews[i]);
+        result = COUNT_VK_CREATE(vkCreateImageView(device, &createInfo, hostAllocator(), &swapChainImageViews[i]));
         if (result != VK_SUCCESS) break;
     }
 
     return result;
 }
+
+// Depth only, the renderer has no use for stencil. The spec guarantees
+// D16_UNORM and one of the other two.
+static VkFormat getDepthFormat(VkPhysicalDevice physicalDevice) {
+    static const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM
+    };
+
+    for (uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidates[i], &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            return candidates[i];
+        }
+    }
+
+    return VK_FORMAT_D16_UNORM;
+}
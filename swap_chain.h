@@ -4,14 +4,21 @@
 
 #include <vulkan/vulkan.h>
 
+// Fixed so recreation never reallocates, drivers hand out three or four
+#define SWAP_CHAIN_MAX_IMAGES 8
+
 struct SwapChain {
     VkSwapchainKHR vkSwapChain;
     uint32_t imageCount;
-    VkImage *images;             // has `imageCount` elements
-    VkImageView *imageViews;     // has `imageCount` elements
-    VkFramebuffer *framebuffers; // has `imageCount` elements
+    VkImage images[SWAP_CHAIN_MAX_IMAGES];
+    VkImageView imageViews[SWAP_CHAIN_MAX_IMAGES];
+    VkFramebuffer framebuffers[SWAP_CHAIN_MAX_IMAGES];
     VkFormat imageFormat;
+    VkImageUsageFlags imageUsage;
     VkExtent2D extent;
+
+    // The depth buffer itself is a render graph transient of this size
+    VkFormat depthFormat;
 };
 
 VkResult createSwapChain(
@@ -0,0 +1,748 @@
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "buffers.h"
+#include "device_dispatch.h"
+#include "device_memory.h"
+#include "file_io.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "textures.h"
+
+static const uint8_t ktx2Identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+#define KTX2_SUPERCOMPRESSION_NONE 0
+
+struct FormatBlock {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+};
+
+// Formats we accept straight from a KTX2 file
+static const struct FormatBlock formatBlocks[] = {
+    { VK_FORMAT_R8G8B8A8_UNORM, 1, 1, 4 },
+    { VK_FORMAT_R8G8B8A8_SRGB, 1, 1, 4 },
+    { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 4, 4, 8 },
+    { VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 4, 4, 8 },
+    { VK_FORMAT_BC3_UNORM_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_BC3_SRGB_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_BC5_UNORM_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_BC7_UNORM_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_BC7_SRGB_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, 4, 4, 8 },
+    { VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 4, 4, 16 },
+    { VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 4, 4, 16 },
+};
+
+static inline uint32_t uint_max(uint32_t a, uint32_t b) { return a > b ? a : b; }
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// KTX2 is little-endian, like every platform we run on
+bool ktx2Parse(const void *data, size_t size, struct Ktx2File *outFile) {
+    const uint8_t *bytes = data;
+    if (size < KTX2_HEADER_SIZE || memcmp(bytes, ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+        fprintf(stderr, "KTX2: bad identifier\n");
+        return false;
+    }
+
+    struct Ktx2File file = {
+        .data = bytes,
+        .size = size,
+        .vkFormat = read32(bytes + 12),
+        .width = read32(bytes + 20),
+        .height = read32(bytes + 24),
+        .levelCount = uint_max(read32(bytes + 40), 1),
+        .supercompression = read32(bytes + 44),
+        .sgdOffset = read64(bytes + 64),
+        .sgdLength = read64(bytes + 72),
+    };
+
+    uint32_t depth = read32(bytes + 28);
+    uint32_t layerCount = read32(bytes + 32);
+    uint32_t faceCount = read32(bytes + 36);
+    if (depth > 1 || layerCount > 1 || faceCount != 1) {
+        fprintf(stderr, "KTX2: only single 2D images are supported\n");
+        return false;
+    }
+
+    if (file.width == 0 || file.height == 0 || file.levelCount > TEXTURE_MAX_LEVELS) {
+        fprintf(stderr, "KTX2: bad dimensions or level count\n");
+        return false;
+    }
+
+    size_t indexEnd = KTX2_HEADER_SIZE + (size_t) file.levelCount * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    if (indexEnd > size || file.sgdLength > size || file.sgdOffset > size - file.sgdLength) {
+        fprintf(stderr, "KTX2: truncated file\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < file.levelCount; i++) {
+        const uint8_t *entry = bytes + KTX2_HEADER_SIZE + i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        struct Ktx2Level level = {
+            .offset = read64(entry),
+            .length = read64(entry + 8),
+            .uncompressedLength = read64(entry + 16),
+        };
+        if (level.length > size || level.offset > size - level.length) {
+            fprintf(stderr, "KTX2: level %u is out of bounds\n", i);
+            return false;
+        }
+        file.levels[i] = level;
+    }
+
+    *outFile = file;
+    return true;
+}
+
+static bool formatSampleable(VkPhysicalDevice physicalDevice, VkFormat format) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+        | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+static const struct FormatBlock *findFormatBlock(VkFormat format) {
+    for (uint32_t i = 0; i < sizeof(formatBlocks) / sizeof(formatBlocks[0]); i++) {
+        if (formatBlocks[i].format == format) return &formatBlocks[i];
+    }
+    return NULL;
+}
+
+static uint32_t levelExtent(uint32_t extent, uint32_t level) {
+    return uint_max(extent >> level, 1);
+}
+
+static VkDeviceSize levelSize(const struct Texture *texture, uint32_t level) {
+    uint32_t width = levelExtent(texture->file.width, level);
+    uint32_t height = levelExtent(texture->file.height, level);
+    uint32_t blocksX = (width + texture->blockWidth - 1) / texture->blockWidth;
+    uint32_t blocksY = (height + texture->blockHeight - 1) / texture->blockHeight;
+    return (VkDeviceSize) blocksX * blocksY * texture->blockBytes;
+}
+
+VkResult createTextureSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkQueue queue,
+    uint32_t queueFamily,
+    struct BindlessHeap *bindlessHeap,
+    uint32_t framesInFlight,
+    VkDeviceSize budget,
+    struct TextureSystem *system
+) {
+    VkResult result;
+
+    *system = (struct TextureSystem) { 0 };
+    system->physicalDevice = physicalDevice;
+    system->device = device;
+    system->queue = queue;
+    system->bindlessHeap = bindlessHeap;
+    system->framesInFlight = framesInFlight;
+    system->budget = budget;
+    system->samplerIndex = BINDLESS_INVALID_INDEX;
+
+    fprintf(stderr, "Textures: %llu MiB budget\n", (unsigned long long) (budget >> 20));
+
+    result = createBuffer(
+        physicalDevice,
+        device,
+        TEXTURE_STAGING_SIZE,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &system->staging,
+        &system->stagingMemory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture staging buffer");
+
+    void *mapped;
+    result = vkMapMemory(device, system->stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to map texture staging buffer");
+    system->stagingMapped = mapped;
+
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueFamily,
+    };
+    result = COUNT_VK_CREATE(vkCreateCommandPool(device, &poolInfo, hostAllocator(), &system->commandPool));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture command pool");
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = system->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    result = COUNT_VK_CREATE(vkAllocateCommandBuffers(device, &allocInfo, &system->commandBuffer));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate texture command buffer");
+
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    };
+    result = COUNT_VK_CREATE(vkCreateFence(device, &fenceInfo, hostAllocator(), &system->fence));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture fence");
+
+    // Levels appear over time, so clamping to what's resident is implicit:
+    // each image only ever contains resident levels
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .maxLod = VK_LOD_CLAMP_NONE,
+    };
+    result = COUNT_VK_CREATE(vkCreateSampler(device, &samplerInfo, hostAllocator(), &system->sampler));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture sampler");
+
+    system->samplerIndex = bindlessRegisterSampler(device, bindlessHeap, system->sampler);
+    return VK_SUCCESS;
+}
+
+static void destroyImage(VkDevice device, VkImage image, VkDeviceMemory memory, VkImageView imageView) {
+    vkDestroyImageView(device, imageView, hostAllocator());
+    vkDestroyImage(device, image, hostAllocator());
+    memoryFree(device, memory);
+}
+
+void cleanupTextureSystem(struct TextureSystem *system) {
+    VkDevice device = system->device;
+
+    // Jobs write into the staging buffer, let them finish first
+    if (system->batchState == TEXTURE_BATCH_FILLING) {
+        jobsWait(&system->jobs);
+    }
+    for (uint32_t i = 0; i < system->batchCount; i++) {
+        const struct TextureStep *step = &system->batch[i];
+        destroyImage(device, step->image, step->memory, step->imageView);
+    }
+    for (uint32_t i = 0; i < system->retiredCount; i++) {
+        const struct TextureRetired *retired = &system->retired[i];
+        destroyImage(device, retired->image, retired->memory, retired->imageView);
+    }
+    for (uint32_t i = 0; i < system->count; i++) {
+        struct Texture *texture = &system->textures[i];
+        destroyImage(device, texture->image, texture->memory, texture->imageView);
+        unmap_file(texture->mapped, texture->mappedSize);
+    }
+    statsFree(system->textures);
+
+    vkDestroySampler(device, system->sampler, hostAllocator());
+    vkDestroyFence(device, system->fence, hostAllocator());
+    vkDestroyCommandPool(device, system->commandPool, hostAllocator());
+    vkDestroyBuffer(device, system->staging, hostAllocator());
+    memoryFree(device, system->stagingMemory);
+
+    *system = (struct TextureSystem) { 0 };
+}
+
+uint32_t texturesLoad(struct TextureSystem *system, const char *path) {
+    size_t size;
+    const void *mapped = map_entire_file(path, &size);
+    if (!mapped) return TEXTURE_INVALID;
+
+    struct Texture texture = {
+        .mapped = mapped,
+        .mappedSize = size,
+        .bindlessIndex = BINDLESS_INVALID_INDEX,
+    };
+
+    if (!ktx2Parse(mapped, size, &texture.file)) {
+        fprintf(stderr, "Textures: failed to parse %s\n", path);
+        unmap_file(mapped, size);
+        return TEXTURE_INVALID;
+    }
+
+    // Payloads go straight to the staging buffer
+    if (texture.file.supercompression != KTX2_SUPERCOMPRESSION_NONE || texture.file.vkFormat == VK_FORMAT_UNDEFINED) {
+        TODO("Transcode BasisLZ/UASTC/zstd on the job system to BC7, ASTC or ETC2, whichever the device samples");
+        fprintf(stderr, "Textures: %s is supercompressed, which isn't supported yet\n", path);
+        unmap_file(mapped, size);
+        return TEXTURE_INVALID;
+    }
+    const struct FormatBlock *block = findFormatBlock((VkFormat) texture.file.vkFormat);
+    if (!block || !formatSampleable(system->physicalDevice, block->format)) {
+        fprintf(stderr, "Textures: %s is in format %u, which this device can't sample\n", path, texture.file.vkFormat);
+        unmap_file(mapped, size);
+        return TEXTURE_INVALID;
+    }
+
+    texture.format = block->format;
+    texture.blockWidth = block->width;
+    texture.blockHeight = block->height;
+    texture.blockBytes = block->bytes;
+    texture.levelCount = texture.file.levelCount;
+    texture.residentBase = texture.levelCount;
+
+    // Payloads are copied verbatim, so their sizes must match ours
+    for (uint32_t level = 0; level < texture.levelCount; level++) {
+        if (texture.file.levels[level].length != levelSize(&texture, level)) {
+            fprintf(stderr, "Textures: %s level %u has an unexpected size\n", path, level);
+            unmap_file(mapped, size);
+            return TEXTURE_INVALID;
+        }
+    }
+
+    if (system->count == system->capacity) {
+        // Fill jobs read the table on the workers, it can't move under them
+        if (system->batchState == TEXTURE_BATCH_FILLING) {
+            jobsWait(&system->jobs);
+        }
+        uint32_t capacity = system->capacity ? system->capacity * 2 : 64;
+        struct Texture *textures = statsRealloc(system->textures, capacity * sizeof(struct Texture));
+        if (!textures) {
+            fprintf(stderr, "Textures: failed to grow texture table\n");
+            unmap_file(mapped, size);
+            return TEXTURE_INVALID;
+        }
+        system->textures = textures;
+        system->capacity = capacity;
+    }
+
+    uint32_t handle = system->count++;
+    system->textures[handle] = texture;
+
+    fprintf(stderr, "Textures: %s, %ux%u, %u levels\n",
+        path, texture.file.width, texture.file.height, texture.levelCount);
+    return handle;
+}
+
+bool texturesSettled(const struct TextureSystem *system) {
+    return system->batchState == TEXTURE_BATCH_IDLE && system->batchCount == 0;
+}
+
+uint32_t texturesGetBindlessIndex(const struct TextureSystem *system, uint32_t texture) {
+    if (texture == TEXTURE_INVALID) return BINDLESS_INVALID_INDEX;
+    return system->textures[texture].bindlessIndex;
+}
+
+// The first step brings in every level up to TEXTURE_TAIL_SIZE at once
+static uint32_t nextBase(const struct Texture *texture) {
+    if (texture->residentBase < texture->levelCount) {
+        return texture->residentBase - 1;
+    }
+
+    uint32_t base = texture->levelCount - 1;
+    while (base > 0
+        && levelExtent(texture->file.width, base - 1) <= TEXTURE_TAIL_SIZE
+        && levelExtent(texture->file.height, base - 1) <= TEXTURE_TAIL_SIZE) {
+        base--;
+    }
+    return base;
+}
+
+static VkResult createStepImage(
+    struct TextureSystem *system,
+    const struct Texture *texture,
+    struct TextureStep *step
+) {
+    VkResult result;
+    VkDevice device = system->device;
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = texture->format,
+        .extent = {
+            levelExtent(texture->file.width, step->newBase),
+            levelExtent(texture->file.height, step->newBase),
+            1
+        },
+        .mipLevels = texture->levelCount - step->newBase,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT
+            | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+            | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, // the next step copies out of it
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    result = COUNT_VK_CREATE(vkCreateImage(device, &imageInfo, hostAllocator(), &step->image));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture image");
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, step->image, &memRequirements);
+
+    uint32_t memoryType = findMemoryType(
+        system->physicalDevice,
+        memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+    if (memoryType == UINT32_MAX) {
+        fprintf(stderr, "No suitable memory type for texture\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = memoryType,
+    };
+    result = memoryAllocate(device, &allocInfo, MEMORY_CATEGORY_IMAGE, &step->memory);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate texture memory");
+    step->size = memRequirements.size;
+
+    result = vkBindImageMemory(device, step->image, step->memory, 0);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to bind texture memory");
+
+    VkImageViewCreateInfo viewInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = step->image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = texture->format,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = texture->levelCount - step->newBase,
+            .layerCount = 1,
+        },
+    };
+    result = COUNT_VK_CREATE(vkCreateImageView(device, &viewInfo, hostAllocator(), &step->imageView));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture image view");
+
+    return VK_SUCCESS;
+}
+
+// Picks at most one step per texture, starting where the last batch stopped,
+// so every texture gets its mip tail before any gets a finer level
+static void planBatch(struct TextureSystem *system) {
+    VkDeviceSize stagingUsed = 0;
+    VkDeviceSize projected = system->residentBytes;
+    system->batchCount = 0;
+
+    for (uint32_t n = 0; n < system->count && system->batchCount < TEXTURE_MAX_BATCH; n++) {
+        uint32_t index = (system->cursor + n) % system->count;
+        struct Texture *texture = &system->textures[index];
+        if (texture->failed || texture->busy || texture->residentBase == 0) continue;
+
+        struct TextureStep step = {
+            .texture = index,
+            .newBase = nextBase(texture),
+            .oldBase = texture->residentBase,
+        };
+
+        VkDeviceSize stagingEnd = stagingUsed;
+        for (uint32_t level = step.newBase; level < step.oldBase; level++) {
+            stagingEnd = (stagingEnd + 15) & ~(VkDeviceSize) 15;
+            step.stagingOffsets[level] = stagingEnd;
+            stagingEnd += levelSize(texture, level);
+        }
+
+        // The new image holds every level from newBase down and replaces the old one
+        VkDeviceSize estimate = 0;
+        for (uint32_t level = step.newBase; level < texture->levelCount; level++) {
+            estimate += levelSize(texture, level);
+        }
+
+        // Over budget, this texture stays at its current resolution for now.
+        // The device heap filling up counts too, whoever else is using it.
+        if (projected - texture->residentBytes + estimate > system->budget) continue;
+        if (estimate > memoryHeadroom(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) continue;
+        if (stagingEnd > TEXTURE_STAGING_SIZE) {
+            if (stagingEnd - stagingUsed > TEXTURE_STAGING_SIZE) {
+                fprintf(stderr, "Textures: level %u of texture %u doesn't fit in staging\n",
+                    step.newBase, index);
+                texture->failed = true;
+                continue;
+            }
+            break;
+        }
+
+        if (createStepImage(system, texture, &step) != VK_SUCCESS) {
+            destroyImage(system->device, step.image, step.memory, step.imageView);
+            texture->failed = true;
+            continue;
+        }
+
+        stagingUsed = stagingEnd;
+        projected += step.size - texture->residentBytes;
+        texture->busy = true;
+        system->batch[system->batchCount++] = step;
+        system->cursor = (index + 1) % system->count;
+    }
+}
+
+static void fillStepJob(void *data, uint32_t index) {
+    struct TextureSystem *system = data;
+    const struct TextureStep *step = &system->batch[index];
+    const struct Texture *texture = &system->textures[step->texture];
+
+    for (uint32_t level = step->newBase; level < step->oldBase; level++) {
+        char *out = system->stagingMapped + step->stagingOffsets[level];
+        memcpy(out, texture->file.data + texture->file.levels[level].offset, (size_t) levelSize(texture, level));
+    }
+}
+
+static VkImageMemoryBarrier imageBarrier(
+    VkImage image,
+    VkAccessFlags srcAccess,
+    VkAccessFlags dstAccess,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout
+) {
+    return (VkImageMemoryBarrier) {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .layerCount = 1,
+        },
+    };
+}
+
+#define SHADER_STAGES (VK_PIPELINE_STAGE_VERTEX_SHADER_BIT \
+    | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT \
+    | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+// New levels come from staging, resident ones are copied image to image.
+// The old image goes back to SHADER_READ_ONLY because frames recorded before
+// the swap keep sampling it.
+static VkResult recordUploads(struct TextureSystem *system) {
+    VkResult result;
+    VkCommandBuffer cmd = system->commandBuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vkBeginCommandBuffer(cmd, &beginInfo);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to begin texture upload");
+
+    VkImageMemoryBarrier barriers[TEXTURE_MAX_BATCH * 2];
+    uint32_t barrierCount = 0;
+    for (uint32_t i = 0; i < system->batchCount; i++) {
+        const struct TextureStep *step = &system->batch[i];
+        const struct Texture *texture = &system->textures[step->texture];
+
+        barriers[barrierCount++] = imageBarrier(step->image,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        if (texture->image != VK_NULL_HANDLE) {
+            barriers[barrierCount++] = imageBarrier(texture->image,
+                0, VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        }
+    }
+    VKD(vkCmdPipelineBarrier)(cmd,
+        SHADER_STAGES | VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, NULL, 0, NULL, barrierCount, barriers);
+
+    for (uint32_t i = 0; i < system->batchCount; i++) {
+        const struct TextureStep *step = &system->batch[i];
+        const struct Texture *texture = &system->textures[step->texture];
+
+        VkBufferImageCopy bufferCopies[TEXTURE_MAX_LEVELS];
+        uint32_t bufferCopyCount = 0;
+        for (uint32_t level = step->newBase; level < step->oldBase; level++) {
+            bufferCopies[bufferCopyCount++] = (VkBufferImageCopy) {
+                .bufferOffset = step->stagingOffsets[level],
+                .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level - step->newBase,
+                    .layerCount = 1,
+                },
+                .imageExtent = {
+                    levelExtent(texture->file.width, level),
+                    levelExtent(texture->file.height, level),
+                    1
+                },
+            };
+        }
+        VKD(vkCmdCopyBufferToImage)(cmd, system->staging, step->image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyCount, bufferCopies);
+
+        if (texture->image == VK_NULL_HANDLE) continue;
+
+        VkImageCopy imageCopies[TEXTURE_MAX_LEVELS];
+        uint32_t imageCopyCount = 0;
+        for (uint32_t level = step->oldBase; level < texture->levelCount; level++) {
+            imageCopies[imageCopyCount++] = (VkImageCopy) {
+                .srcSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level - step->oldBase,
+                    .layerCount = 1,
+                },
+                .dstSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level - step->newBase,
+                    .layerCount = 1,
+                },
+                .extent = {
+                    levelExtent(texture->file.width, level),
+                    levelExtent(texture->file.height, level),
+                    1
+                },
+            };
+        }
+        VKD(vkCmdCopyImage)(cmd,
+            texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            step->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            imageCopyCount, imageCopies);
+    }
+
+    barrierCount = 0;
+    for (uint32_t i = 0; i < system->batchCount; i++) {
+        const struct TextureStep *step = &system->batch[i];
+        const struct Texture *texture = &system->textures[step->texture];
+
+        barriers[barrierCount++] = imageBarrier(step->image,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        if (texture->image != VK_NULL_HANDLE) {
+            barriers[barrierCount++] = imageBarrier(texture->image,
+                0, VK_ACCESS_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+    VKD(vkCmdPipelineBarrier)(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_STAGES, 0,
+        0, NULL, 0, NULL, barrierCount, barriers);
+
+    result = vkEndCommandBuffer(cmd);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to end texture upload");
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmd,
+    };
+    result = vkQueueSubmit(system->queue, 1, &submitInfo, system->fence);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to submit texture upload");
+
+    return VK_SUCCESS;
+}
+
+static void retire(struct TextureSystem *system, VkImage image, VkDeviceMemory memory, VkImageView imageView) {
+    if (image == VK_NULL_HANDLE) return;
+
+    // Sized for several batches of frames in flight, so this only trips on a stall
+    if (system->retiredCount == sizeof(system->retired) / sizeof(system->retired[0])) {
+        vkDeviceWaitIdle(system->device);
+        for (uint32_t i = 0; i < system->retiredCount; i++) {
+            const struct TextureRetired *old = &system->retired[i];
+            destroyImage(system->device, old->image, old->memory, old->imageView);
+        }
+        system->retiredCount = 0;
+    }
+
+    system->retired[system->retiredCount++] = (struct TextureRetired) {
+        .image = image,
+        .memory = memory,
+        .imageView = imageView,
+        .frame = system->frameNumber,
+    };
+}
+
+static void dropStep(struct TextureSystem *system, struct TextureStep *step) {
+    struct Texture *texture = &system->textures[step->texture];
+    destroyImage(system->device, step->image, step->memory, step->imageView);
+    texture->busy = false;
+    texture->failed = true;
+}
+
+static void finishBatch(struct TextureSystem *system) {
+    for (uint32_t i = 0; i < system->batchCount; i++) {
+        struct TextureStep *step = &system->batch[i];
+        struct Texture *texture = &system->textures[step->texture];
+
+        if (texture->bindlessIndex != BINDLESS_INVALID_INDEX) {
+            bindlessRelease(system->bindlessHeap, BINDLESS_BINDING_SAMPLED_IMAGES, texture->bindlessIndex);
+        }
+        retire(system, texture->image, texture->memory, texture->imageView);
+
+        system->residentBytes += step->size - texture->residentBytes;
+        texture->image = step->image;
+        texture->memory = step->memory;
+        texture->imageView = step->imageView;
+        texture->residentBytes = step->size;
+        texture->residentBase = step->newBase;
+        texture->busy = false;
+        texture->bindlessIndex = bindlessRegisterImage(
+            system->device,
+            system->bindlessHeap,
+            step->imageView,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+    }
+    system->batchCount = 0;
+}
+
+void texturesUpdate(struct TextureSystem *system) {
+    system->frameNumber++;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < system->retiredCount; i++) {
+        const struct TextureRetired *retired = &system->retired[i];
+        if (retired->frame + system->framesInFlight < system->frameNumber) {
+            destroyImage(system->device, retired->image, retired->memory, retired->imageView);
+        } else {
+            system->retired[kept++] = *retired;
+        }
+    }
+    system->retiredCount = kept;
+
+    if (system->batchState == TEXTURE_BATCH_UPLOADING) {
+        if (vkGetFenceStatus(system->device, system->fence) != VK_SUCCESS) return;
+        vkResetFences(system->device, 1, &system->fence);
+        finishBatch(system);
+        system->batchState = TEXTURE_BATCH_IDLE;
+    }
+
+    if (system->batchState == TEXTURE_BATCH_IDLE) {
+        planBatch(system);
+        if (system->batchCount == 0) return;
+
+        jobsRunRange(fillStepJob, system, system->batchCount, &system->jobs);
+        system->batchState = TEXTURE_BATCH_FILLING;
+
+        // Nobody else would ever pick the jobs up
+        if (jobsWorkerCount() == 1) jobsWait(&system->jobs);
+    }
+
+    if (system->batchState == TEXTURE_BATCH_FILLING) {
+        if (!jobsDone(&system->jobs)) return;
+
+        if (recordUploads(system) != VK_SUCCESS) {
+            for (uint32_t i = 0; i < system->batchCount; i++) dropStep(system, &system->batch[i]);
+            system->batchCount = 0;
+            system->batchState = TEXTURE_BATCH_IDLE;
+            return;
+        }
+        system->batchState = TEXTURE_BATCH_UPLOADING;
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+#ifndef TEXTURES_H
+#define TEXTURES_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bindless.h"
+#include "jobs.h"
+
+// KTX2 textures, memory mapped and streamed in coarse to fine. The first step
+// for a texture uploads its whole mip tail, every later step adds one finer
+// level by building a bigger image and copying the resident levels across on
+// the GPU. Steps are taken round-robin across textures for as long as the
+// total stays under the residency budget.
+//
+// Only payloads already in a GPU format are loaded. Supercompressed files
+// (BasisLZ/ETC1S, UASTC, zstd) are still open: they need a transcoder run
+// per level on the job system, with the target picked from BC7, ASTC and
+// ETC2 by what the device samples.
+
+#define TEXTURE_MAX_LEVELS 16
+#define TEXTURE_INVALID UINT32_MAX
+
+#define TEXTURE_TAIL_SIZE 64             // levels this size and smaller arrive together
+#define TEXTURE_STAGING_SIZE (16u << 20) // upper bound for one batch of steps
+#define TEXTURE_MAX_BATCH 32
+#define TEXTURE_DEFAULT_BUDGET (256ull << 20)
+
+struct Ktx2Level {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressedLength;
+};
+
+struct Ktx2File {
+    const uint8_t *data;
+    size_t size;
+
+    uint32_t vkFormat;   // VK_FORMAT_UNDEFINED for Basis Universal payloads
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t supercompression;
+
+    uint64_t sgdOffset;  // supercompression global data, used by BasisLZ
+    uint64_t sgdLength;
+
+    struct Ktx2Level levels[TEXTURE_MAX_LEVELS];
+};
+
+struct Texture {
+    const void *mapped;
+    size_t mappedSize;
+    struct Ktx2File file;
+
+    VkFormat format;
+    uint32_t blockWidth;
+    uint32_t blockHeight;
+    uint32_t blockBytes;
+
+    uint32_t levelCount;
+    uint32_t residentBase;  // finest resident level, `levelCount` when nothing is resident
+    bool busy;              // a step for this texture is in flight
+    bool failed;
+
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView imageView;
+    VkDeviceSize residentBytes;
+    uint32_t bindlessIndex;
+};
+
+struct TextureStep {
+    uint32_t texture;
+    uint32_t newBase;
+    uint32_t oldBase;
+
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView imageView;
+    VkDeviceSize size;
+    VkDeviceSize stagingOffsets[TEXTURE_MAX_LEVELS];
+};
+
+struct TextureRetired {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView imageView;
+    uint64_t frame;
+};
+
+enum TextureBatchState {
+    TEXTURE_BATCH_IDLE,
+    TEXTURE_BATCH_FILLING,   // worker jobs are copying level data into staging
+    TEXTURE_BATCH_UPLOADING, // copies submitted, waiting on the fence
+};
+
+struct TextureSystem {
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkQueue queue;
+    struct BindlessHeap *bindlessHeap;
+
+    VkDeviceSize budget;
+    VkDeviceSize residentBytes;
+
+    uint32_t count;
+    uint32_t capacity;
+    struct Texture *textures;
+    uint32_t cursor; // round-robin start for the next batch
+
+    VkSampler sampler;
+    uint32_t samplerIndex;
+
+    VkBuffer staging;
+    VkDeviceMemory stagingMemory;
+    char *stagingMapped;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+
+    enum TextureBatchState batchState;
+    struct JobCounter jobs;
+    uint32_t batchCount;
+    struct TextureStep batch[TEXTURE_MAX_BATCH];
+
+    uint32_t retiredCount;
+    struct TextureRetired retired[TEXTURE_MAX_BATCH * 4];
+
+    uint32_t framesInFlight;
+    uint64_t frameNumber;
+};
+
+bool ktx2Parse(const void *data, size_t size, struct Ktx2File *outFile);
+
+VkResult createTextureSystem(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkQueue queue,
+    uint32_t queueFamily,
+    struct BindlessHeap *bindlessHeap,
+    uint32_t framesInFlight,
+    VkDeviceSize budget,
+    struct TextureSystem *system
+);
+
+// Waits for in-flight work, call after vkDeviceWaitIdle
+void cleanupTextureSystem(struct TextureSystem *system);
+
+// Maps and validates the file, which has to hold a format the device samples
+// without supercompression. Nothing is resident until texturesUpdate runs.
+uint32_t texturesLoad(struct TextureSystem *system, const char *path);
+
+// Once per frame, after the frame's fence has been waited on
+void texturesUpdate(struct TextureSystem *system);
+
+// As of the last texturesUpdate, nothing is in flight and no texture can step
+// further within the budget
+bool texturesSettled(const struct TextureSystem *system);
+
+// BINDLESS_INVALID_INDEX until the first step lands. The index changes as
+// finer levels arrive, so look it up every frame.
+uint32_t texturesGetBindlessIndex(const struct TextureSystem *system, uint32_t texture);
+
+#endif // TEXTURES_H
@@ -0,0 +1,268 @@
+#include <cglm/cglm.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defines.h"
+#include "frame_stats.h"
+#include "jobs.h"
+#include "transforms.h"
+
+// 32 covers both the SSE and AVX paths of glm_mat4_mul
+#define MATRIX_ALIGNMENT 32
+
+static mat4 *allocMatrices(uint32_t count) {
+    return statsAlignedAlloc(MATRIX_ALIGNMENT, (size_t) count * sizeof(mat4));
+}
+
+bool createTransformSystem(uint32_t capacity, struct TransformSystem *system) {
+    *system = (struct TransformSystem) { 0 };
+    system->capacity = capacity;
+
+    system->parent = statsMalloc(capacity * sizeof(uint32_t));
+    system->depth = statsMalloc(capacity * sizeof(uint32_t));
+    system->handle = statsMalloc(capacity * sizeof(uint32_t));
+    system->position = statsMalloc(capacity * sizeof(uint32_t));
+    system->local = allocMatrices(capacity);
+    system->world = allocMatrices(capacity);
+
+    if (!system->parent || !system->depth || !system->handle
+        || !system->position || !system->local || !system->world) {
+        fprintf(stderr, "Failed to allocate transform system for %u objects\n", capacity);
+        cleanupTransformSystem(system);
+        return false;
+    }
+
+    return true;
+}
+
+void cleanupTransformSystem(struct TransformSystem *system) {
+    statsFree(system->parent);
+    statsFree(system->depth);
+    statsFree(system->handle);
+    statsFree(system->position);
+    statsAlignedFree(system->local);
+    statsAlignedFree(system->world);
+    statsFree(system->levelChunkStart);
+    statsFree(system->chunks);
+    *system = (struct TransformSystem) { 0 };
+}
+
+uint32_t transformsCreate(struct TransformSystem *system, uint32_t parent, mat4 local) {
+    if (system->count == system->capacity) {
+        fprintf(stderr, "Transform system is full (%u objects)\n", system->capacity);
+        return TRANSFORM_INVALID;
+    }
+
+    // Handles are never recycled, so the next handle is always `count`
+    uint32_t handle = system->count;
+    uint32_t position = system->count++;
+
+    uint32_t parentPosition = TRANSFORM_INVALID;
+    uint32_t depth = 0;
+    if (parent != TRANSFORM_INVALID) {
+        assert(parent < handle);
+        parentPosition = system->position[parent];
+        depth = system->depth[parentPosition] + 1;
+    }
+
+    system->parent[position] = parentPosition;
+    system->depth[position] = depth;
+    system->handle[position] = handle;
+    system->position[handle] = position;
+    glm_mat4_copy(local, system->local[position]);
+    glm_mat4_copy(local, system->world[position]);
+
+    system->orderDirty = true;
+    return handle;
+}
+
+void transformsSetLocal(struct TransformSystem *system, uint32_t handle, mat4 local) {
+    glm_mat4_copy(local, system->local[system->position[handle]]);
+}
+
+void transformsGetWorld(const struct TransformSystem *system, uint32_t handle, mat4 dest) {
+    memcpy(dest, system->world[system->position[handle]], sizeof(mat4));
+}
+
+// Stable counting sort by depth. Parents always have a smaller depth than
+// their children, so the result is still topologically ordered.
+static bool sortByDepth(struct TransformSystem *system) {
+    uint32_t count = system->count;
+    if (count == 0) return true;
+
+    uint32_t levelCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (system->depth[i] + 1 > levelCount) levelCount = system->depth[i] + 1;
+    }
+
+    // Both only live for the sort, the rest replace the system's arrays
+    struct Arena *scratch = frameArena();
+    size_t mark = arenaMark(scratch);
+    uint32_t *levelStart = ARENA_ARRAY(scratch, uint32_t, levelCount + 1);
+    uint32_t *newPosition = ARENA_ARRAY(scratch, uint32_t, count);
+    memset(levelStart, 0, (levelCount + 1) * sizeof(uint32_t));
+    uint32_t *parent = statsMalloc(system->capacity * sizeof(uint32_t));
+    uint32_t *depth = statsMalloc(system->capacity * sizeof(uint32_t));
+    uint32_t *handle = statsMalloc(system->capacity * sizeof(uint32_t));
+    mat4 *local = allocMatrices(system->capacity);
+    mat4 *world = allocMatrices(system->capacity);
+
+    if (!parent || !depth || !handle || !local || !world) {
+        fprintf(stderr, "Failed to allocate transform sort buffers\n");
+        arenaReset(scratch, mark);
+        statsFree(parent); statsFree(depth); statsFree(handle);
+        statsAlignedFree(local); statsAlignedFree(world);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) levelStart[system->depth[i] + 1]++;
+    for (uint32_t l = 0; l < levelCount; l++) levelStart[l + 1] += levelStart[l];
+
+    // levelStart doubles as the scatter cursor for each level
+    for (uint32_t i = 0; i < count; i++) {
+        newPosition[i] = levelStart[system->depth[i]]++;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t to = newPosition[i];
+        uint32_t oldParent = system->parent[i];
+        parent[to] = oldParent == TRANSFORM_INVALID ? TRANSFORM_INVALID : newPosition[oldParent];
+        depth[to] = system->depth[i];
+        handle[to] = system->handle[i];
+        system->position[handle[to]] = to;
+        memcpy(local[to], system->local[i], sizeof(mat4));
+        memcpy(world[to], system->world[i], sizeof(mat4));
+    }
+
+    statsFree(system->parent); system->parent = parent;
+    statsFree(system->depth); system->depth = depth;
+    statsFree(system->handle); system->handle = handle;
+    statsAlignedFree(system->local); system->local = local;
+    statsAlignedFree(system->world); system->world = world;
+
+    arenaReset(scratch, mark);
+    return true;
+}
+
+static bool buildChunks(struct TransformSystem *system) {
+    uint32_t count = system->count;
+
+    uint32_t levelCount = count > 0 ? system->depth[count - 1] + 1 : 0;
+    uint32_t maxChunks = count / TRANSFORM_CHUNK_SIZE + levelCount;
+
+    uint32_t *levelChunkStart = statsRealloc(system->levelChunkStart, (levelCount + 1) * sizeof(uint32_t));
+    struct TransformChunk *chunks = statsRealloc(system->chunks, (maxChunks + 1) * sizeof(struct TransformChunk));
+    if (!levelChunkStart || !chunks) {
+        fprintf(stderr, "Failed to allocate transform chunk table\n");
+        if (levelChunkStart) system->levelChunkStart = levelChunkStart;
+        if (chunks) system->chunks = chunks;
+        return false;
+    }
+    system->levelChunkStart = levelChunkStart;
+    system->chunks = chunks;
+
+    uint32_t chunkCount = 0;
+    uint32_t begin = 0;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        levelChunkStart[level] = chunkCount;
+
+        uint32_t end = begin;
+        while (end < count && system->depth[end] == level) end++;
+
+        for (uint32_t i = begin; i < end; i += TRANSFORM_CHUNK_SIZE) {
+            uint32_t chunkEnd = i + TRANSFORM_CHUNK_SIZE < end ? i + TRANSFORM_CHUNK_SIZE : end;
+            chunks[chunkCount++] = (struct TransformChunk) { .begin = i, .end = chunkEnd };
+        }
+        begin = end;
+    }
+    levelChunkStart[levelCount] = chunkCount;
+
+    system->levelCount = levelCount;
+    system->chunkCount = chunkCount;
+    return true;
+}
+
+void transformsPrepare(struct TransformSystem *system) {
+    if (!system->orderDirty) return;
+
+    if (!sortByDepth(system)) return;
+    if (!buildChunks(system)) return;
+
+    system->orderDirty = false;
+    fprintf(stderr, "Transforms: %u objects, %u levels, %u chunks\n",
+        system->count, system->levelCount, system->chunkCount);
+}
+
+void transformsUpdateChunk(
+    struct TransformSystem *system,
+    const struct TransformChunk *chunk,
+    mat4 *out
+) {
+    mat4 *local = system->local;
+    mat4 *world = system->world;
+    const uint32_t *parent = system->parent;
+
+    // glm_mat4_mul picks the AVX or SSE kernel from the compiler flags
+    for (uint32_t i = chunk->begin; i < chunk->end; i++) {
+        if (parent[i] == TRANSFORM_INVALID) {
+            glm_mat4_copy(local[i], world[i]);
+        } else {
+            glm_mat4_mul(world[parent[i]], local[i], world[i]);
+        }
+    }
+
+    // Mapped GPU memory is usually write-combined, so write it once,
+    // sequentially, and never read it back
+    if (out) {
+        memcpy(out + chunk->begin, world + chunk->begin, (chunk->end - chunk->begin) * sizeof(mat4));
+    }
+}
+
+void transformsUpdate(struct TransformSystem *system, mat4 *out) {
+    transformsPrepare(system);
+
+    for (uint32_t i = 0; i < system->chunkCount; i++) {
+        transformsUpdateChunk(system, &system->chunks[i], out);
+    }
+}
+
+struct TransformLevelJob {
+    struct TransformSystem *system;
+    const struct TransformChunk *chunks;
+    mat4 *out;
+};
+
+static void updateChunkJob(void *data, uint32_t index) {
+    struct TransformLevelJob *job = data;
+    transformsUpdateChunk(job->system, &job->chunks[index], job->out);
+}
+
+void transformsUpdateParallel(struct TransformSystem *system, mat4 *out) {
+    transformsPrepare(system);
+
+    // Levels depend on each other, chunks within a level don't
+    for (uint32_t level = 0; level < system->levelCount; level++) {
+        uint32_t first = system->levelChunkStart[level];
+        uint32_t count = system->levelChunkStart[level + 1] - first;
+
+        // Not worth the scheduling overhead for a single chunk
+        if (count == 1) {
+            transformsUpdateChunk(system, &system->chunks[first], out);
+            continue;
+        }
+
+        struct TransformLevelJob job = {
+            .system = system,
+            .chunks = &system->chunks[first],
+            .out = out,
+        };
+        struct JobCounter counter = { 0 };
+        jobsRunRange(updateChunkJob, &job, count, &counter);
+        jobsWait(&counter);
+    }
+}
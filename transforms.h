@@ -0,0 +1,71 @@
+#pragma once
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <cglm/cglm.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRANSFORM_INVALID UINT32_MAX
+#define TRANSFORM_CHUNK_SIZE 1024
+
+// A contiguous run of objects on one hierarchy level. Chunks on the same
+// level never depend on each other, so they can be updated in parallel.
+struct TransformChunk {
+    uint32_t begin;
+    uint32_t end;
+};
+
+// Structure-of-arrays scene transforms. Objects are kept sorted by depth in
+// the hierarchy, so every parent sits on an earlier level than its children
+// and a single forward pass computes all world matrices.
+struct TransformSystem {
+    uint32_t count;
+    uint32_t capacity;
+
+    // Indexed by sorted position
+    uint32_t *parent;       // sorted position of the parent, or TRANSFORM_INVALID
+    uint32_t *depth;
+    uint32_t *handle;       // sorted position -> handle
+    mat4 *local;            // aligned to CGLM_ALIGN_MAT for the SIMD kernels
+    mat4 *world;
+
+    // Indexed by handle
+    uint32_t *position;     // handle -> sorted position
+
+    bool orderDirty;
+    uint32_t levelCount;
+    uint32_t *levelChunkStart; // has `levelCount + 1` elements, indexes `chunks`
+    uint32_t chunkCount;
+    struct TransformChunk *chunks;
+};
+
+bool createTransformSystem(uint32_t capacity, struct TransformSystem *system);
+void cleanupTransformSystem(struct TransformSystem *system);
+
+// Returns a handle that stays valid while objects are reordered.
+// `parent` must be TRANSFORM_INVALID or a handle created earlier.
+uint32_t transformsCreate(struct TransformSystem *system, uint32_t parent, mat4 local);
+
+void transformsSetLocal(struct TransformSystem *system, uint32_t handle, mat4 local);
+void transformsGetWorld(const struct TransformSystem *system, uint32_t handle, mat4 dest);
+
+// Re-sorts by depth and rebuilds the chunk table if objects were added
+void transformsPrepare(struct TransformSystem *system);
+
+// Updates one chunk and streams its world matrices to `out`, which is indexed
+// by sorted position. `out` may be NULL.
+void transformsUpdateChunk(
+    struct TransformSystem *system,
+    const struct TransformChunk *chunk,
+    mat4 *out
+);
+
+// Single-threaded update of every level in order
+void transformsUpdate(struct TransformSystem *system, mat4 *out);
+
+// Same result, with each level's chunks spread over the job system
+void transformsUpdateParallel(struct TransformSystem *system, mat4 *out);
+
+#endif // TRANSFORMS_H
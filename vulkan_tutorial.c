@@ -2,10 +2,31 @@
 #include <GLFW/glfw3.h>
 
 #include "defines.h"
+#include "arena.h"
 #include "debug_messenger.h"
+#include "device_dispatch.h"
+#include "draw_queue.h"
 #include "extensions.h"
+#include "frame_stats.h"
+#include "frame_trace.h"
+#include "gpu_queries.h"
+#include "host_allocator.h"
+#include "jobs.h"
+#include "layout_cache.h"
+#include "meshlets.h"
+#include "particles.h"
+#include "bindless.h"
+#include "buffers.h"
+#include "capture.h"
+#include "device_memory.h"
+#include "pipeline_cache.h"
+#include "regress.h"
+#include "render_graph.h"
 #include "shader_modules.h"
+#include "sprites.h"
 #include "swap_chain.h"
+#include "textures.h"
+#include "transforms.h"
 
 #ifdef __cplusplus
 #include <vulkan/vk_enum_string_helper.h>
@@ -17,9 +38,12 @@
 #define FILE_IO_IMPLEMENTATION
 #include "file_io.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
 #include <math.h>
 
 #define REQUESTED_VALIDATION_LAYERS 1
@@ -29,12 +53,16 @@ static const char* validationLayers[REQUESTED_VALIDATION_LAYERS] = {
 
 #define REQUESTED_DEVICE_EXTENSIONS 1
 static const char* deviceExtensions[] = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME // optional, enabled after the required ones
 };
 
 const uint32_t initialWindowWidth = 800;
 const uint32_t initialWindowHeight = 600;
 const uint32_t maxFramesInFlight = 2;
+#define MAX_FRAMES_IN_FLIGHT 4 // bound for the per-window arrays
+#define MAX_WINDOWS 4
+const uint32_t sceneObjectCount = 100000;
 
 bool checkValidationLayers(void) {
     uint32_t layerCount;
@@ -44,8 +72,7 @@ bool checkValidationLayers(void) {
 
     if (layerCount == 0) return false;
 
-    // Smh, MSVC, I can't use a VLA here
-    VkLayerProperties *availableLayers = alloca(layerCount * sizeof(VkLayerProperties));
+    VkLayerProperties *availableLayers = ARENA_ARRAY(frameArena(), VkLayerProperties, layerCount);
     vkEnumerateInstanceLayerProperties(&layerCount, availableLayers);
 
     for (uint32_t i = 0; i < REQUESTED_VALIDATION_LAYERS; i++) {
@@ -83,7 +110,7 @@ VkResult createVulkanInstance(VkInstance *outInstance) {
         .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
         .pEngineName = "No Engine",
         .engineVersion = VK_MAKE_VERSION(0, 1, 0),
-        .apiVersion = VK_API_VERSION_1_0,
+        .apiVersion = VK_API_VERSION_1_2,
     };
 
     VkInstanceCreateInfo instanceCreateInfo = {
@@ -114,7 +141,7 @@ VkResult createVulkanInstance(VkInstance *outInstance) {
     const char* debugExtension = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
     if (ENABLE_VALIDATION_LAYERS) extensionCount++;
 
-    const char** extensions = alloca(extensionCount * sizeof(const char*));
+    const char** extensions = ARENA_ARRAY(frameArena(), const char *, extensionCount);
     for (uint32_t i = 0; i < glfwExtensionCount; i++) {
         extensions[i] = glfwExtensions[i];
     }
@@ -126,7 +153,7 @@ VkResult createVulkanInstance(VkInstance *outInstance) {
     instanceCreateInfo.enabledExtensionCount = extensionCount;
     instanceCreateInfo.ppEnabledExtensionNames = extensions;
 
-    result = vkCreateInstance(&instanceCreateInfo, NULL, outInstance);
+    result = COUNT_VK_CREATE(vkCreateInstance(&instanceCreateInfo, hostAllocator(), outInstance));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create instance");
     return VK_SUCCESS;
 }
@@ -140,7 +167,7 @@ VkResult getQueueFamilies(
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
 
     VkQueueFamilyProperties *queueFamilies;
-    queueFamilies = alloca(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    queueFamilies = ARENA_ARRAY(frameArena(), VkQueueFamilyProperties, queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(
         device,
         &queueFamilyCount,
@@ -166,7 +193,7 @@ VkResult getPresentQueueFamilies(
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
 
     VkQueueFamilyProperties *queueFamilies;
-    queueFamilies = alloca(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+    queueFamilies = ARENA_ARRAY(frameArena(), VkQueueFamilyProperties, queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(
         device,
         &queueFamilyCount,
@@ -230,7 +257,7 @@ int scoreDeviceCapabilities(
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
 
-    VkExtensionProperties *availableExtensions = alloca(extensionCount * sizeof(VkExtensionProperties));
+    VkExtensionProperties *availableExtensions = ARENA_ARRAY(frameArena(), VkExtensionProperties, extensionCount);
     vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions);
 
     for (uint32_t i = 0; i < REQUESTED_DEVICE_EXTENSIONS; i++) {
@@ -286,7 +313,7 @@ VkResult getPhysicalDevice(
         return VK_ERROR_INITIALIZATION_FAILED;
     }
 
-    VkPhysicalDevice *devices = alloca(deviceCount * sizeof(VkPhysicalDevice));
+    VkPhysicalDevice *devices = ARENA_ARRAY(frameArena(), VkPhysicalDevice, deviceCount);
     result = vkEnumeratePhysicalDevices(instance, &deviceCount, devices);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to enumerate physical devices");
 
@@ -314,6 +341,8 @@ VkResult getPhysicalDevice(
 VkResult createLogicalDevice(
     VkPhysicalDevice physicalDevice,
     uint32_t graphicsFamily,
+    const void *featureChain,
+    bool memoryBudget,
     VkDevice *outDevice
 ) {
     VkResult result;
@@ -329,10 +358,11 @@ VkResult createLogicalDevice(
 
     VkDeviceCreateInfo deviceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = featureChain,
         .pQueueCreateInfos = &queueCreateInfo,
         .queueCreateInfoCount = 1,
         .pEnabledFeatures = &deviceFeatures,
-        .enabledExtensionCount = REQUESTED_DEVICE_EXTENSIONS,
+        .enabledExtensionCount = REQUESTED_DEVICE_EXTENSIONS + (memoryBudget ? 1 : 0),
         .ppEnabledExtensionNames = deviceExtensions
     };
 
@@ -341,25 +371,43 @@ VkResult createLogicalDevice(
         deviceCreateInfo.ppEnabledLayerNames = validationLayers;
     }
 
-    result = vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, outDevice);
+    result = COUNT_VK_CREATE(vkCreateDevice(physicalDevice, &deviceCreateInfo, hostAllocator(), outDevice));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create logical device");
     return VK_SUCCESS;
 }
 
+// With the depth pre-pass, subpass 0 only lays down depth and subpass 1
+// shades with an EQUAL test, so every pixel runs the fragment shader once
 VkResult createRenderPass(
     VkDevice device,
     VkFormat imageFormat,
+    VkFormat depthFormat,
+    bool depthPrePass,
     VkRenderPass *outRenderPass
 ) {
-    VkAttachmentDescription colorAttachment = {
-        .format = imageFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+    VkAttachmentDescription attachments[] = {
+        {
+            .format = imageFormat,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            // The render graph moves the image in and out of this layout
+            .initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        },
+        {
+            .format = depthFormat,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            // Never read after the pass, so it never has to leave tile memory
+            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        }
     };
 
     VkAttachmentReference colorAttachmentRef = {
@@ -367,32 +415,57 @@ VkResult createRenderPass(
         .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
     };
 
-    VkSubpassDescription subpass = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colorAttachmentRef
+    VkAttachmentReference depthAttachmentRef = {
+        .attachment = 1,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    };
+
+    VkAttachmentReference depthReadOnlyRef = {
+        .attachment = 1,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    };
+
+    VkSubpassDescription subpasses[] = {
+        {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachmentRef,
+            .pDepthStencilAttachment = &depthAttachmentRef
+        },
+        {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachmentRef,
+            .pDepthStencilAttachment = &depthReadOnlyRef
+        }
     };
 
+    if (depthPrePass) {
+        subpasses[0].colorAttachmentCount = 0;
+        subpasses[0].pColorAttachments = NULL;
+    }
+
     VkSubpassDependency dependency = {
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        .srcSubpass = 0,
+        .dstSubpass = 1,
+        .srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+        .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT
     };
 
     VkRenderPassCreateInfo renderPassInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &colorAttachment,
-        .subpassCount = 1,
-        .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency
+        .attachmentCount = 2,
+        .pAttachments = attachments,
+        .subpassCount = depthPrePass ? 2 : 1,
+        .pSubpasses = subpasses,
+        .dependencyCount = depthPrePass ? 1 : 0,
+        .pDependencies = depthPrePass ? &dependency : NULL
     };
 
-    VkResult result = vkCreateRenderPass(device, &renderPassInfo, NULL, outRenderPass);
+    VkResult result = COUNT_VK_CREATE(vkCreateRenderPass(device, &renderPassInfo, hostAllocator(), outRenderPass));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render pass");
     return result;
 }
@@ -410,184 +483,144 @@ const struct Vertex vertices[] = {
     { { -0.5f,  0.5f }, { 0.0f, 0.0f, 1.0f } }
 };
 
-static VkVertexInputBindingDescription getBindingDescription(void) {
-    VkVertexInputBindingDescription bindingDescription = {
-        .binding = 0,
-        .stride = sizeof(struct Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-    };
-    return bindingDescription;
-}
-
-struct AttributeDescriptions {
-    VkVertexInputAttributeDescription pos;
-    VkVertexInputAttributeDescription color;
+enum DepthMode {
+    DEPTH_MODE_TEST,      // single pass, test and write
+    DEPTH_MODE_PRE_PASS,  // vertex shader only, subpass 0 of the pre-pass
+    DEPTH_MODE_EQUAL,     // shading after the pre-pass, subpass 1
 };
 
-static struct AttributeDescriptions getAttributeDescriptions(void) {
-    struct AttributeDescriptions attributeDescriptions = { 0 };
-
-    attributeDescriptions.pos = (VkVertexInputAttributeDescription) {
-        .binding = 0,
-        .location = 0,
-        .format = VK_FORMAT_R32G32_SFLOAT,
-        .offset = offsetof(struct Vertex, pos)
-    };
-
-    attributeDescriptions.color = (VkVertexInputAttributeDescription) {
-        .binding = 0,
-        .location = 1,
-        .format = VK_FORMAT_R32G32B32_SFLOAT,
-        .offset = offsetof(struct Vertex, color)
+// Both depth modes of the shading pass run the same vertex shader with the
+// same layout and specialization, which gives the bit-identical depth the
+// EQUAL test relies on
+static struct PipelineKey scenePipelineKey(
+    VkRenderPass renderPass,
+    uint16_t program,
+    enum DepthMode depthMode,
+    uint8_t features
+) {
+    uint8_t flags = PIPELINE_KEY_DEPTH_TEST;
+    if (depthMode != DEPTH_MODE_EQUAL) flags |= PIPELINE_KEY_DEPTH_WRITE;
+    if (depthMode == DEPTH_MODE_PRE_PASS) flags |= PIPELINE_KEY_VERTEX_ONLY;
+
+    return (struct PipelineKey) {
+        .renderPass = renderPass,
+        .program = program,
+        .subpass = depthMode == DEPTH_MODE_EQUAL ? 1 : 0,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_BACK_BIT,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthCompareOp = depthMode == DEPTH_MODE_EQUAL ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS,
+        .flags = flags,
+        .blend = PIPELINE_BLEND_OPAQUE,
+        .colorAttachments = depthMode == DEPTH_MODE_PRE_PASS ? 0 : 1,
+        .features = features,
     };
-
-    return attributeDescriptions;
 }
 
-static const VkDynamicState dynamicStates[] = {
-    VK_DYNAMIC_STATE_VIEWPORT,
-    VK_DYNAMIC_STATE_SCISSOR
-};
-
-VkResult createGraphicsPipeline(
-    VkDevice device,
+// The scene's depth modes, with the meshlet mesh's winding
+static struct PipelineKey meshletPipelineKey(
     VkRenderPass renderPass,
-    VkPipelineLayout *pipelineLayout,
-    VkPipeline *outGraphicsPipeline
+    uint16_t program,
+    enum DepthMode depthMode,
+    uint8_t features
 ) {
-    VkResult result;
+    struct PipelineKey key = scenePipelineKey(renderPass, program, depthMode, features);
+    key.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    return key;
+}
 
-    size_t size;
-    const char *vertShaderCode = read_entire_file("shaders/vert.spv", &size);
-    VkShaderModule vertShaderModule;
-    result = createShaderModule(device, vertShaderCode, size, &vertShaderModule);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create vertex shader module");
-    free((void *) vertShaderCode);
-
-    const char *fragShaderCode = read_entire_file("shaders/frag.spv", &size);
-    VkShaderModule fragShaderModule;
-    result = createShaderModule(device, fragShaderCode, size, &fragShaderModule);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create fragment shader module");
-    free((void *) fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo = { 0 };
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo = { 0 };
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        vertShaderStageInfo,
-        fragShaderStageInfo
+// Drawn last in the final subpass, over the scene and without touching depth
+static struct PipelineKey particlePipelineKey(VkRenderPass renderPass, uint16_t program, bool depthPrePass) {
+    return (struct PipelineKey) {
+        .renderPass = renderPass,
+        .program = program,
+        .subpass = depthPrePass ? 1 : 0,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthCompareOp = VK_COMPARE_OP_ALWAYS,
+        .flags = 0,
+        .blend = PIPELINE_BLEND_ADDITIVE,
+        .colorAttachments = 1,
     };
+}
 
-    VkVertexInputBindingDescription bindingDescription = getBindingDescription();
-    struct AttributeDescriptions attributeDescriptions = getAttributeDescriptions();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .vertexAttributeDescriptionCount = 2,
-        .pVertexBindingDescriptions = &bindingDescription,
-        .pVertexAttributeDescriptions = (VkVertexInputAttributeDescription[]) {
-            attributeDescriptions.pos,
-            attributeDescriptions.color
-        }
+// Over everything else, in the same subpass as the particles
+static struct PipelineKey spritePipelineKey(
+    VkRenderPass renderPass,
+    uint16_t program,
+    bool depthPrePass,
+    enum SpritePipeline pipeline
+) {
+    return (struct PipelineKey) {
+        .renderPass = renderPass,
+        .program = program,
+        .subpass = depthPrePass ? 1 : 0,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthCompareOp = VK_COMPARE_OP_ALWAYS,
+        .flags = 0,
+        .blend = pipeline == SPRITE_PIPELINE_ADDITIVE ? PIPELINE_BLEND_ADDITIVE : PIPELINE_BLEND_ALPHA,
+        .colorAttachments = 1,
     };
+}
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = { 0 };
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineDynamicStateCreateInfo dynamicState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .dynamicStateCount = 2,
-        .pDynamicStates = dynamicStates
+// Attributes from the shader, struct Vertex is its inputs packed
+uint16_t addSceneProgram(struct PipelineCache *cache) {
+    struct PipelineProgramDesc desc = {
+        .vertexPath = "shaders/vert.spv",
+        .fragmentPath = "shaders/frag.spv",
+        .binding = {
+            .binding = 0,
+            .stride = sizeof(struct Vertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        },
     };
+    return pipelineCacheAddProgram(cache, &desc);
+}
 
-    VkPipelineViewportStateCreateInfo viewportState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .scissorCount = 1
-    };
+// The render pass, plus the variants the current configuration draws with so
+// the first frame doesn't have to build them
+VkResult createScenePasses(
+    VkDevice device,
+    VkFormat imageFormat,
+    VkFormat depthFormat,
+    struct PipelineCache *pipelines,
+    uint16_t sceneProgram,
+    uint8_t sceneFeatures,
+    bool depthPrePass,
+    VkRenderPass *outRenderPass
+) {
+    VkResult result;
 
-    VkPipelineRasterizationStateCreateInfo rasterizer = { 0 };
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling = { 0 };
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = { 0 };
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-        | VK_COLOR_COMPONENT_G_BIT
-        | VK_COLOR_COMPONENT_B_BIT
-        | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending = { 0 };
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = { 0 };
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-    result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, pipelineLayout);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create pipeline layout");
-
-    VkGraphicsPipelineCreateInfo pipelineInfo = { 0 };
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.layout = *pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.pDynamicState = &dynamicState;
-
-    result = vkCreateGraphicsPipelines(
-        device,
-        VK_NULL_HANDLE,
-        1,
-        &pipelineInfo,
-        NULL,
-        outGraphicsPipeline
+    result = createRenderPass(device, imageFormat, depthFormat, depthPrePass, outRenderPass);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render pass");
+
+    struct PipelineKey key = scenePipelineKey(
+        *outRenderPass,
+        sceneProgram,
+        depthPrePass ? DEPTH_MODE_EQUAL : DEPTH_MODE_TEST,
+        sceneFeatures
     );
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create graphics pipeline");
+    if (pipelineCacheGet(pipelines, &key) == VK_NULL_HANDLE) {
+        fprintf(stderr, "Error: Failed to create graphics pipeline\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
 
-    vkDestroyShaderModule(device, vertShaderModule, NULL);
-    vkDestroyShaderModule(device, fragShaderModule, NULL);
+    if (depthPrePass) {
+        key = scenePipelineKey(*outRenderPass, sceneProgram, DEPTH_MODE_PRE_PASS, sceneFeatures);
+        if (pipelineCacheGet(pipelines, &key) == VK_NULL_HANDLE) {
+            fprintf(stderr, "Error: Failed to create depth pre-pass pipeline\n");
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
 
-    return result;
+    fprintf(stderr, "Depth pre-pass: %s\n", depthPrePass ? "on" : "off");
+    return VK_SUCCESS;
 }
 
 VkResult createFramebuffers(
@@ -595,24 +628,25 @@ VkResult createFramebuffers(
     VkRenderPass renderPass,
     VkExtent2D swapChainExtent,
     VkImageView *swapChainImageViews,
+    VkImageView depthImageView,
     uint32_t imageCount,
     VkFramebuffer *framebuffers
 ) {
     VkResult result = VK_SUCCESS;
 
     for (uint32_t i = 0; i < imageCount; i++) {
-        VkImageView attachments[] = { swapChainImageViews[i] };
+        VkImageView attachments[] = { swapChainImageViews[i], depthImageView };
 
         VkFramebufferCreateInfo framebufferInfo = { 0 };
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.attachmentCount = 2;
         framebufferInfo.pAttachments = attachments;
         framebufferInfo.width = swapChainExtent.width;
         framebufferInfo.height = swapChainExtent.height;
         framebufferInfo.layers = 1;
 
-        result = vkCreateFramebuffer(device, &framebufferInfo, NULL, &framebuffers[i]); 
+        result = COUNT_VK_CREATE(vkCreateFramebuffer(device, &framebufferInfo, hostAllocator(), &framebuffers[i])); 
         RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create framebuffer");
     }
 
@@ -629,7 +663,7 @@ VkResult createCommandPool(
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     poolInfo.queueFamilyIndex = graphicsFamily;
 
-    return vkCreateCommandPool(device, &poolInfo, NULL, commandPool);
+    return COUNT_VK_CREATE(vkCreateCommandPool(device, &poolInfo, hostAllocator(), commandPool));
 }
 
 VkResult createCommandBuffers(
@@ -644,122 +678,444 @@ VkResult createCommandBuffers(
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = commandBufferCount;
 
-    return vkAllocateCommandBuffers(device, &allocInfo, *commandBuffers);
+    return COUNT_VK_CREATE(vkAllocateCommandBuffers(device, &allocInfo, *commandBuffers));
 }
 
-VkResult recordCommandBuffer(
-    VkCommandBuffer commandBuffer,
-    VkBuffer vertexBuffer,
-    uint32_t imageIndex,
+// Everything the passes need to record one frame
+struct FrameContext {
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    VkPipelineLayout pipelineLayout;
+    bool depthPrePass;
+    struct DrawQueue *drawQueue; // sorted, the scene's draws for both subpasses
+    VkDescriptorSet bindlessSet;
+    struct BindlessPushConstants pushConstants;
+    uint32_t swapChainImageIndex;
+    uint32_t captureSlot;
+    VkBuffer captureBuffer; // VK_NULL_HANDLE unless this frame is captured
+    const struct ParticleSystem *particles; // NULL when particles are off
+    VkPipeline particlePipeline;
+    VkBuffer particleBuffer;
+    const struct MeshletSystem *meshlets; // NULL when the mesh is off
+    VkPipeline meshletPipelines[2];       // pre-pass and shading, by subpass
+    struct BindlessPushConstants meshletPushConstants;
+    VkBuffer meshletBuffer;
+    const struct SpriteRenderer *sprites; // NULL when there are none this frame
+    VkPipeline spritePipelines[SPRITE_PIPELINE_COUNT];
+};
+
+// Draw queue layers, one per subpass of the main pass
+enum DrawLayer {
+    DRAW_LAYER_DEPTH_PRE_PASS,
+    DRAW_LAYER_SHADING,
+};
+
+#define SCENE_MAX_DRAWS 2
+
+// The scene is one triangle per object, instanced, drawn in every subpass
+// it takes part in
+static uint32_t demoSceneDraws(
+    bool depthPrePass,
+    uint8_t features,
+    uint32_t objectCount,
+    struct SceneDraw draws[SCENE_MAX_DRAWS]
+) {
+    struct SceneDraw draw = {
+        .features = features,
+        .vertexCount = 3,
+        .instanceCount = objectCount,
+    };
+
+    uint32_t count = 0;
+    if (depthPrePass) {
+        draw.layer = DRAW_LAYER_DEPTH_PRE_PASS;
+        draw.depthMode = DEPTH_MODE_PRE_PASS;
+        draws[count++] = draw;
+    }
+    draw.layer = DRAW_LAYER_SHADING;
+    draw.depthMode = depthPrePass ? DEPTH_MODE_EQUAL : DEPTH_MODE_TEST;
+    draws[count++] = draw;
+    return count;
+}
+
+// Resolves each draw's pipeline variant, hits after the first frame, and
+// queues it. Variants that failed to build are skipped.
+static void pushSceneDraws(
+    struct DrawQueue *queue,
+    struct PipelineCache *cache,
     VkRenderPass renderPass,
-    VkFramebuffer *swapChainFramebuffers,
-    VkExtent2D swapChainExtent,
-    VkPipeline graphicsPipeline
+    uint16_t program,
+    VkBuffer vertexBuffer,
+    const struct SceneDraw *draws,
+    uint32_t count,
+    const struct BindlessPushConstants *pushConstants
 ) {
-    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < count; i++) {
+        const struct SceneDraw *draw = &draws[i];
+        if (draw->depthMode > DEPTH_MODE_EQUAL) continue;
+
+        struct PipelineKey key = scenePipelineKey(renderPass, program, (enum DepthMode) draw->depthMode, draw->features);
+        VkPipeline pipeline = pipelineCacheGet(cache, &key);
+        if (pipeline == VK_NULL_HANDLE) continue;
+
+        struct DrawPacket packet = {
+            .key = drawPacketKey(draw->layer, pipeline, vertexBuffer, 0.0f),
+            .pipeline = pipeline,
+            .vertexBuffer = vertexBuffer,
+            .vertexOffset = 0,
+            .pushConstants = *pushConstants,
+            .vertexCount = draw->vertexCount,
+            .instanceCount = draw->instanceCount,
+            .firstVertex = draw->firstVertex,
+            .firstInstance = draw->firstInstance,
+        };
+        drawQueuePush(queue, &packet);
+    }
+}
 
-    VkCommandBufferBeginInfo beginInfo = { 0 };
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    beginInfo.pInheritanceInfo = NULL;
+// The culled mesh after the queue's draws of the same subpass. It rebinds
+// binding 0, which is fine since every drawQueueRecord binds from scratch.
+static void recordMeshletDraw(const struct FrameContext *frame, VkCommandBuffer commandBuffer, enum DrawLayer layer) {
+    VkPipeline pipeline = frame->meshlets ? frame->meshletPipelines[layer] : VK_NULL_HANDLE;
+    if (pipeline == VK_NULL_HANDLE) return;
 
-    result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-    PANIC_IF_NOT_VK_SUCCESS(result, "Failed to begin recording command buffer");
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    meshletsRecordDraw(frame->meshlets, commandBuffer, frame->pipelineLayout, &frame->meshletPushConstants);
+}
+
+static void recordMainPass(VkCommandBuffer commandBuffer, void *user, const void *frameData) {
+    UNUSED_INTENTIONAL(user);
+    const struct FrameContext *frame = frameData;
 
     VkRenderPassBeginInfo renderPassInfo = { 0 };
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderPass = frame->renderPass;
+    renderPassInfo.framebuffer = frame->framebuffer;
 
     renderPassInfo.renderArea.offset = (VkOffset2D) { 0, 0 };
-    renderPassInfo.renderArea.extent = swapChainExtent;
+    renderPassInfo.renderArea.extent = frame->extent;
 
-    VkClearValue clearColor = { .color = { { 0.0f, 0.0f, 0.0f, 1.0f } } };
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    VkClearValue clearValues[] = {
+        { .color = { { 0.0f, 0.0f, 0.0f, 1.0f } } },
+        { .depthStencil = { 1.0f, 0 } }
+    };
+    renderPassInfo.clearValueCount = 2;
+    renderPassInfo.pClearValues = clearValues;
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    VKD(vkCmdBeginRenderPass)(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
     {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-        VkBuffer vertexBuffers[] = { vertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        // Bound once, every draw picks its resources through push constants.
+        // All pipelines share the layout, so the set survives subpass changes.
+        VKD(vkCmdBindDescriptorSets)(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            frame->pipelineLayout,
+            0, 1, &frame->bindlessSet,
+            0, NULL
+        );
 
         VkViewport viewport = {
             .x = 0.0f,
             .y = 0.0f,
-            .width = (float) swapChainExtent.width,
-            .height = (float) swapChainExtent.height,
+            .width = (float) frame->extent.width,
+            .height = (float) frame->extent.height,
             .minDepth = 0.0f,
             .maxDepth = 1.0f
         };
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VKD(vkCmdSetViewport)(commandBuffer, 0, 1, &viewport);
 
         VkRect2D scissor = {
             .offset = { 0, 0 },
-            .extent = swapChainExtent
+            .extent = frame->extent
         };
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        VKD(vkCmdSetScissor)(commandBuffer, 0, 1, &scissor);
+
+        // The queue binds pipelines, vertex buffers and constants as they change
+        if (frame->depthPrePass) {
+            drawQueueRecord(frame->drawQueue, commandBuffer, frame->pipelineLayout, DRAW_LAYER_DEPTH_PRE_PASS);
+            recordMeshletDraw(frame, commandBuffer, DRAW_LAYER_DEPTH_PRE_PASS);
+            VKD(vkCmdNextSubpass)(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        }
+        drawQueueRecord(frame->drawQueue, commandBuffer, frame->pipelineLayout, DRAW_LAYER_SHADING);
+        recordMeshletDraw(frame, commandBuffer, DRAW_LAYER_SHADING);
+
+        if (frame->particles && frame->particlePipeline != VK_NULL_HANDLE) {
+            VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frame->particlePipeline);
+            particlesRecordDraw(frame->particles, commandBuffer);
+        }
+
+        if (frame->sprites) {
+            spritesRecordDraw(
+                frame->sprites,
+                commandBuffer,
+                frame->pipelineLayout,
+                frame->spritePipelines,
+                &frame->pushConstants
+            );
+        }
+    }
+    VKD(vkCmdEndRenderPass)(commandBuffer);
+}
+
+// Always in the graph, records nothing while particles are off
+static void recordParticlePass(VkCommandBuffer commandBuffer, void *user, const void *frameData) {
+    UNUSED_INTENTIONAL(user);
+    const struct FrameContext *frame = frameData;
+    if (!frame->particles) return;
+
+    particlesRecordSimulate(frame->particles, commandBuffer, frame->bindlessSet);
+}
+
+// Always in the graph, records nothing while the mesh is off
+static void recordMeshletPass(VkCommandBuffer commandBuffer, void *user, const void *frameData) {
+    UNUSED_INTENTIONAL(user);
+    const struct FrameContext *frame = frameData;
+    if (!frame->meshlets) return;
+
+    meshletsRecordCull(frame->meshlets, commandBuffer, frame->bindlessSet);
+}
+
+// Skipped when capture is on but this frame's readback slot is still busy
+static void recordCapturePass(VkCommandBuffer commandBuffer, void *user, const void *frameData) {
+    const struct CaptureSystem *capture = user;
+    const struct FrameContext *frame = frameData;
+    if (frame->captureBuffer == VK_NULL_HANDLE) return;
+
+    captureRecord(capture, commandBuffer, frame->captureSlot, frame->swapChainImageIndex);
+}
+
+// Graph handles for the window's images and the buffers bound per frame
+struct GraphResources {
+    uint32_t swapChainImage;
+    uint32_t depthImage;    // a transient the graph owns
+    uint32_t captureBuffer; // RENDER_GRAPH_INVALID when capture is off
+    uint32_t particleBuffer; // RENDER_GRAPH_INVALID outside the primary window
+    uint32_t meshletBuffer;  // likewise
+};
+
+// Everything that follows one window's surface. Window 0 is the primary: it
+// was used to pick the device, and it alone captures, draws sprites,
+// simulates particles and culls meshlets. Closing it ends the program.
+struct Window {
+    GLFWwindow *glfwWindow; // NULL for an unused slot
+    VkSurfaceKHR surface;
+    struct SwapChain swapChain;
+    struct RenderGraph renderGraph;
+    struct GraphResources graphResources;
+
+    // Per frame in flight, the one submit waits on and signals every window's
+    VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
+    VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
+
+    bool framebufferResized;
+    bool swapChainStale; // needs recreating before it can be drawn to again
+    uint32_t imageIndex; // acquired this frame
+};
+
+// Declares the frame's passes and compiles them. The swap chain image is
+// imported fresh every frame; the acquire semaphore is waited on at the
+// color attachment stage, which is where the graph picks it up. Only the
+// primary window's graph simulates particles and culls meshlets, the other
+// windows draw them after it in the same command buffer.
+VkResult buildRenderGraph(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    struct RenderGraph *graph,
+    const struct SwapChain *swapChain,
+    bool primary,
+    struct CaptureSystem *capture, // NULL when capture is off
+    struct GraphResources *outResources
+) {
+    renderGraphReset(graph);
+
+    uint32_t swapChainImage = renderGraphImportImage(
+        graph,
+        "swap chain image",
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+    );
+    renderGraphMarkOutput(graph, swapChainImage, RENDER_GRAPH_ACCESS_PRESENT);
+
+    // Cleared on load and discarded on store, so it never leaves the main
+    // pass and tile-based GPUs can keep it in tile memory
+    struct RenderGraphImageDesc depthDesc = {
+        .format = swapChain->depthFormat,
+        .extent = swapChain->extent,
+        .lazilyAllocated = true,
+    };
+    uint32_t depthImage = renderGraphCreateImage(graph, "depth", &depthDesc);
+
+    // Last frame's draws read it as vertices and indirect arguments
+    uint32_t particleBuffer = RENDER_GRAPH_INVALID;
+    if (primary) {
+        particleBuffer = renderGraphImportBuffer(
+            graph,
+            "particles",
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+        );
+        uint32_t particlePass = renderGraphAddPass(graph, "particles", recordParticlePass, NULL);
+        renderGraphPassUse(graph, particlePass, particleBuffer, RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_WRITE);
+    }
+
+    // Likewise read as indices and indirect arguments
+    uint32_t meshletBuffer = RENDER_GRAPH_INVALID;
+    if (primary) {
+        meshletBuffer = renderGraphImportBuffer(
+            graph,
+            "meshlets",
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+        );
+        uint32_t meshletPass = renderGraphAddPass(graph, "meshlets", recordMeshletPass, NULL);
+        renderGraphPassUse(graph, meshletPass, meshletBuffer, RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_WRITE);
+    }
+
+    uint32_t mainPass = renderGraphAddPass(graph, "main", recordMainPass, NULL);
+    renderGraphPassUse(graph, mainPass, swapChainImage, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    renderGraphPassUse(graph, mainPass, depthImage, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE);
+    if (primary) {
+        renderGraphPassUse(graph, mainPass, particleBuffer, RENDER_GRAPH_ACCESS_VERTEX_BUFFER_READ);
+        renderGraphPassUse(graph, mainPass, particleBuffer, RENDER_GRAPH_ACCESS_INDIRECT_BUFFER_READ);
+        renderGraphPassUse(graph, mainPass, meshletBuffer, RENDER_GRAPH_ACCESS_INDEX_BUFFER_READ);
+        renderGraphPassUse(graph, mainPass, meshletBuffer, RENDER_GRAPH_ACCESS_INDIRECT_BUFFER_READ);
+    }
+
+    // Host reads of the readback buffer finish before the frame is submitted
+    uint32_t captureBuffer = RENDER_GRAPH_INVALID;
+    if (capture) {
+        captureBuffer = renderGraphImportBuffer(graph, "capture", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        renderGraphMarkOutput(graph, captureBuffer, RENDER_GRAPH_ACCESS_HOST_READ);
+
+        // Y4M converts in a compute pass instead of copying
+        bool convert = capture->format == CAPTURE_FORMAT_Y4M;
+        uint32_t capturePass = renderGraphAddPass(graph, "capture", recordCapturePass, capture);
+        renderGraphPassUse(graph, capturePass, swapChainImage,
+            convert ? RENDER_GRAPH_ACCESS_COMPUTE_SAMPLED_READ : RENDER_GRAPH_ACCESS_TRANSFER_READ);
+        renderGraphPassUse(graph, capturePass, captureBuffer,
+            convert ? RENDER_GRAPH_ACCESS_COMPUTE_STORAGE_WRITE : RENDER_GRAPH_ACCESS_TRANSFER_WRITE);
+    }
+
+    VkResult result = renderGraphCompile(physicalDevice, device, graph);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to compile render graph");
+
+    outResources->swapChainImage = swapChainImage;
+    outResources->depthImage = depthImage;
+    outResources->captureBuffer = captureBuffer;
+    outResources->particleBuffer = particleBuffer;
+    outResources->meshletBuffer = meshletBuffer;
+    return VK_SUCCESS;
+}
+
+static void beginPassQueries(VkCommandBuffer commandBuffer, void *user, const char *pass, const void *frameData) {
+    const struct FrameContext *frame = frameData;
+    uint64_t pixels = (uint64_t) frame->extent.width * frame->extent.height;
+    gpuQueriesBeginPass(user, commandBuffer, pass, pixels);
+}
+
+static void endPassQueries(VkCommandBuffer commandBuffer, void *user, const char *pass, const void *frameData) {
+    UNUSED_INTENTIONAL(pass);
+    UNUSED_INTENTIONAL(frameData);
+    gpuQueriesEndPass(user, commandBuffer);
+}
+
+// Every window's graph goes into the one command buffer, primary first so
+// the particles are simulated and the meshlets culled before any window
+// draws them
+VkResult recordCommandBuffer(
+    VkCommandBuffer commandBuffer,
+    struct Window *const *windows,
+    const struct FrameContext *frames,
+    uint32_t windowCount,
+    struct GpuQueries *queries, // NULL when queries are off
+    uint32_t frameIndex
+) {
+    VkResult result = VK_SUCCESS;
+
+    VkCommandBufferBeginInfo beginInfo = { 0 };
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    beginInfo.pInheritanceInfo = NULL;
+
+    result = VKD(vkBeginCommandBuffer)(commandBuffer, &beginInfo);
+    PANIC_IF_NOT_VK_SUCCESS(result, "Failed to begin recording command buffer");
 
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    struct RenderGraphPassHooks queryHooks = {
+        .begin = beginPassQueries,
+        .end = endPassQueries,
+        .user = queries,
+    };
+    if (queries) gpuQueriesBeginFrame(queries, commandBuffer, frameIndex);
+
+    for (uint32_t w = 0; w < windowCount; w++) {
+        struct RenderGraph *graph = &windows[w]->renderGraph;
+        const struct GraphResources *resources = &windows[w]->graphResources;
+        const struct SwapChain *swapChain = &windows[w]->swapChain;
+        const struct FrameContext *frame = &frames[w];
+        uint32_t imageIndex = windows[w]->imageIndex;
+
+        renderGraphBindImage(
+            graph,
+            resources->swapChainImage,
+            swapChain->images[imageIndex],
+            swapChain->imageViews[imageIndex]
+        );
+        if (resources->captureBuffer != RENDER_GRAPH_INVALID) {
+            renderGraphBindBuffer(graph, resources->captureBuffer, frame->captureBuffer);
+        }
+        if (resources->particleBuffer != RENDER_GRAPH_INVALID) {
+            renderGraphBindBuffer(graph, resources->particleBuffer, frame->particleBuffer);
+        }
+        if (resources->meshletBuffer != RENDER_GRAPH_INVALID) {
+            renderGraphBindBuffer(graph, resources->meshletBuffer, frame->meshletBuffer);
+        }
+        renderGraphExecute(graph, commandBuffer, frame, queries ? &queryHooks : NULL);
     }
-    vkCmdEndRenderPass(commandBuffer);
+    if (queries) gpuQueriesEndFrame(queries);
 
-    result = vkEndCommandBuffer(commandBuffer);
+    result = VKD(vkEndCommandBuffer)(commandBuffer);
     PANIC_IF_NOT_VK_SUCCESS(result, "Failed to record command buffer");
 
     return result;
 }
 
+// One fence per frame in flight, shared by every window since they're
+// submitted together
 VkResult createSyncObjects(
     VkDevice device,
-    VkSemaphore *imageAvailableSemaphores[],
-    VkSemaphore *renderFinishedSemaphores[],
     VkFence *inFlightFences[]
 ) {
     VkResult result = VK_SUCCESS;
 
-    VkSemaphoreCreateInfo semaphoreInfo = { 0 };
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
     VkFenceCreateInfo fenceInfo = { 0 };
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (uint32_t i = 0; i < maxFramesInFlight; i++) {
-        result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &(*imageAvailableSemaphores)[i]);
-        if (result != VK_SUCCESS) return result;
-
-        result = vkCreateSemaphore(device, &semaphoreInfo, NULL, &(*renderFinishedSemaphores)[i]);
-        if (result != VK_SUCCESS) return result;
-
-        result = vkCreateFence(device, &fenceInfo, NULL, &(*inFlightFences)[i]);
+        result = COUNT_VK_CREATE(vkCreateFence(device, &fenceInfo, hostAllocator(), &(*inFlightFences)[i]));
         if (result != VK_SUCCESS) return result;
     }
 
     return result;
 }
 
-uint32_t findMemoryType(
-    VkPhysicalDevice physicalDevice,
-    uint32_t typeFilter,
-    VkMemoryPropertyFlags properties
-) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if (
-            (typeFilter & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & properties) == properties
-        ) {
-            return i;
-        }
+VkResult createWindowSemaphores(VkDevice device, struct Window *window) {
+    VkResult result = VK_SUCCESS;
+    assert(maxFramesInFlight <= MAX_FRAMES_IN_FLIGHT);
+
+    VkSemaphoreCreateInfo semaphoreInfo = { 0 };
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+        result = COUNT_VK_CREATE(vkCreateSemaphore(device, &semaphoreInfo, hostAllocator(), &window->imageAvailableSemaphores[i]));
+        if (result != VK_SUCCESS) return result;
+
+        result = COUNT_VK_CREATE(vkCreateSemaphore(device, &semaphoreInfo, hostAllocator(), &window->renderFinishedSemaphores[i]));
+        if (result != VK_SUCCESS) return result;
     }
 
-    return -1;
+    return result;
 }
 
 VkResult createVertexBuffer(
@@ -771,38 +1127,22 @@ VkResult createVertexBuffer(
     VkResult result;
     fprintf(stderr, "sizeof(vertices) = %lu\n", sizeof(vertices));
     fprintf(stderr, "sizeof(vertices[0]) = %lu\n", sizeof(vertices[0]));
-    VkBufferCreateInfo bufferInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = sizeof(vertices),
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
-    };
-    
-    VkBuffer vertexBuffer;
-    result = vkCreateBuffer(device, &bufferInfo, NULL, &vertexBuffer);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create vertex buffer");
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = findMemoryType(
-            physicalDevice,
-            memRequirements.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        )
-    };
-    
+    VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
-    result = vkAllocateMemory(device, &allocInfo, NULL, &vertexBufferMemory);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to allocate vertex buffer memory");
-
-    vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+    result = createBuffer(
+        physicalDevice,
+        device,
+        sizeof(vertices),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &vertexBuffer,
+        &vertexBufferMemory
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create vertex buffer");
 
     void *data;
-    vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
+    vkMapMemory(device, vertexBufferMemory, 0, sizeof(vertices), 0, &data);
     memcpy(data, vertices, sizeof(vertices));
     vkUnmapMemory(device, vertexBufferMemory);
 
@@ -812,12 +1152,176 @@ VkResult createVertexBuffer(
     return VK_SUCCESS;
 }
 
+// 1000 spinning roots, each with 9 children that carry 10 children of their own
+#define DEMO_SCENE_ROOTS 1000
+#define DEMO_SCENE_CHILDREN 9
+#define DEMO_SCENE_GRANDCHILDREN 10
+
+bool createDemoScene(struct TransformSystem *transforms, uint32_t *roots) {
+    for (uint32_t r = 0; r < DEMO_SCENE_ROOTS; r++) {
+        mat4 local;
+        glm_translate_make(local, (vec3) { (float) (r % 40) - 20.0f, (float) (r / 40) - 12.5f, 0.0f });
+        roots[r] = transformsCreate(transforms, TRANSFORM_INVALID, local);
+        if (roots[r] == TRANSFORM_INVALID) return false;
+
+        for (uint32_t c = 0; c < DEMO_SCENE_CHILDREN; c++) {
+            float angle = (float) c * GLM_PIf * 2.0f / DEMO_SCENE_CHILDREN;
+            glm_translate_make(local, (vec3) { cosf(angle) * 0.4f, sinf(angle) * 0.4f, 0.0f });
+            uint32_t child = transformsCreate(transforms, roots[r], local);
+            if (child == TRANSFORM_INVALID) return false;
+
+            for (uint32_t g = 0; g < DEMO_SCENE_GRANDCHILDREN; g++) {
+                glm_translate_make(local, (vec3) { 0.0f, 0.0f, (float) g * 0.05f });
+                glm_scale_uni(local, 0.1f);
+                if (transformsCreate(transforms, child, local) == TRANSFORM_INVALID) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void animateDemoScene(struct TransformSystem *transforms, const uint32_t *roots, float time) {
+    for (uint32_t r = 0; r < DEMO_SCENE_ROOTS; r++) {
+        mat4 local;
+        glm_translate_make(local, (vec3) { (float) (r % 40) - 20.0f, (float) (r / 40) - 12.5f, 0.0f });
+        glm_rotate_z(local, time + (float) r * 0.01f, local);
+        transformsSetLocal(transforms, roots[r], local);
+    }
+}
+
+// A bumpy sphere dense enough for vertex work to show, emitted in tiles of
+// 7x7 quads: 64 vertices and 98 triangles, so every tile is one meshlet
+#define DEMO_MESH_TILE 7
+#define DEMO_MESH_RINGS (DEMO_MESH_TILE * 36)
+#define DEMO_MESH_SEGMENTS (DEMO_MESH_TILE * 72)
+
+bool createDemoMesh(struct MeshletMesh *mesh) {
+    uint32_t columns = DEMO_MESH_SEGMENTS + 1;
+    uint32_t vertexCount = (DEMO_MESH_RINGS + 1) * columns;
+    uint32_t indexCount = DEMO_MESH_RINGS * DEMO_MESH_SEGMENTS * 6;
+    struct MeshVertex *vertices = statsMalloc((size_t) vertexCount * sizeof(struct MeshVertex));
+    uint32_t *indices = statsMalloc((size_t) indexCount * sizeof(uint32_t));
+    if (!vertices || !indices) {
+        statsFree(vertices);
+        statsFree(indices);
+        return false;
+    }
+
+    // The seam column and the pole rings repeat positions, which have to
+    // come out bit identical or simplification sees a border down the seam
+    // and a ring of slivers at each pole, and keeps them at every level
+    for (uint32_t ring = 0; ring <= DEMO_MESH_RINGS; ring++) {
+        float theta = GLM_PIf * (float) ring / DEMO_MESH_RINGS;
+        bool pole = ring == 0 || ring == DEMO_MESH_RINGS;
+        for (uint32_t segment = 0; segment <= DEMO_MESH_SEGMENTS; segment++) {
+            float phi = 2.0f * GLM_PIf * (float) (segment % DEMO_MESH_SEGMENTS) / DEMO_MESH_SEGMENTS;
+            float radius = 1.0f + 0.04f * sinf(theta * 24.0f) * sinf(phi * 24.0f);
+            struct MeshVertex *vertex = &vertices[ring * columns + segment];
+            if (pole) {
+                *vertex = (struct MeshVertex) { .position = { 0.0f, ring == 0 ? 1.0f : -1.0f, 0.0f } };
+                continue;
+            }
+            *vertex = (struct MeshVertex) {
+                .position = {
+                    radius * sinf(theta) * cosf(phi),
+                    radius * cosf(theta),
+                    radius * sinf(theta) * sinf(phi),
+                },
+            };
+        }
+    }
+
+    uint32_t count = 0;
+    for (uint32_t tileRing = 0; tileRing < DEMO_MESH_RINGS; tileRing += DEMO_MESH_TILE) {
+        for (uint32_t tileSegment = 0; tileSegment < DEMO_MESH_SEGMENTS; tileSegment += DEMO_MESH_TILE) {
+            for (uint32_t ring = tileRing; ring < tileRing + DEMO_MESH_TILE; ring++) {
+                for (uint32_t segment = tileSegment; segment < tileSegment + DEMO_MESH_TILE; segment++) {
+                    // Counter-clockwise seen from outside
+                    uint32_t a = ring * columns + segment;
+                    uint32_t b = a + 1;
+                    uint32_t c = a + columns;
+                    uint32_t d = c + 1;
+                    indices[count++] = a;
+                    indices[count++] = b;
+                    indices[count++] = c;
+                    indices[count++] = b;
+                    indices[count++] = d;
+                    indices[count++] = c;
+                }
+            }
+        }
+    }
+
+    meshletsComputeNormals(vertices, vertexCount, indices, indexCount);
+    bool built = meshletsBuild(vertices, vertexCount, indices, indexCount, MESHLET_MAX_LODS, mesh);
+    statsFree(vertices);
+    statsFree(indices);
+    return built;
+}
+
+#define DEMO_MESH_FOV (GLM_PIf / 3.0f)
+#define DEMO_MESH_NEAR_ORBIT 1.5f
+#define DEMO_MESH_FAR_ORBIT 40.0f
+
+// Orbits while drifting in and out: close up part of the sphere is off
+// screen, so both the frustum and the cone test have clusters to drop, and
+// far out the coarsest level of detail is picked. Returns the LOD scale
+// meshletsUpdate wants.
+float demoMeshCamera(VkExtent2D extent, float time, struct MeshletCamera *camera) {
+    float angle = time * 0.3f;
+    float drift = 0.5f - 0.5f * cosf(time * 0.15f);
+    float orbit = DEMO_MESH_NEAR_ORBIT + (DEMO_MESH_FAR_ORBIT - DEMO_MESH_NEAR_ORBIT) * drift;
+    vec3 eye = { cosf(angle) * orbit, 0.5f, sinf(angle) * orbit };
+    vec3 target = { 0.0f, 0.0f, 0.0f };
+    float aspect = extent.height > 0 ? (float) extent.width / (float) extent.height : 1.0f;
+    meshletCameraLookAt(eye, target, DEMO_MESH_FOV, aspect, 0.05f, DEMO_MESH_FAR_ORBIT * 2.0f, camera);
+    return (float) extent.height / (2.0f * tanf(DEMO_MESH_FOV * 0.5f));
+}
+
+// A grid of small quads over the screen, interleaving layers, blend modes and
+// textures so that only the sort keeps them down to a handful of draws
+#define DEMO_SPRITE_COLUMNS 96
+#define DEMO_SPRITE_ROWS 54
+#define DEMO_SPRITE_LAYERS 3
+
+void drawDemoSprites(struct SpriteRenderer *sprites, VkExtent2D extent, uint32_t texture, float time) {
+    float cellWidth = (float) extent.width / DEMO_SPRITE_COLUMNS;
+    float cellHeight = (float) extent.height / DEMO_SPRITE_ROWS;
+
+    for (uint32_t y = 0; y < DEMO_SPRITE_ROWS; y++) {
+        for (uint32_t x = 0; x < DEMO_SPRITE_COLUMNS; x++) {
+            uint32_t i = y * DEMO_SPRITE_COLUMNS + x;
+            float phase = time * 2.0f + (float) x * 0.2f + (float) y * 0.3f;
+            float size = 0.5f + 0.25f * sinf(phase);
+            uint8_t red = (uint8_t) (x * 255 / DEMO_SPRITE_COLUMNS);
+            uint8_t green = (uint8_t) (y * 255 / DEMO_SPRITE_ROWS);
+
+            struct Sprite sprite = {
+                .position = {
+                    ((float) x + 0.5f - size * 0.5f) * cellWidth,
+                    ((float) y + 0.5f - size * 0.5f) * cellHeight,
+                },
+                .size = { size * cellWidth, size * cellHeight },
+                .uv = { 0.0f, 0.0f, 1.0f, 1.0f },
+                .color = (uint32_t) red | (uint32_t) green << 8 | 0xc0u << 16 | 0xa0u << 24,
+                .texture = i % 3 == 0 ? texture : BINDLESS_INVALID_INDEX,
+                .depth = 0.5f + 0.5f * cosf(phase),
+                .layer = (uint8_t) (i % DEMO_SPRITE_LAYERS),
+                .pipeline = i % 5 == 0 ? SPRITE_PIPELINE_ADDITIVE : SPRITE_PIPELINE_ALPHA,
+            };
+            if (!spritesPush(sprites, &sprite)) return;
+        }
+    }
+}
+
 #define QUEUE_FAMILIES_COUNT 2
 static struct RenderState {
     VkInstance instance;
 
-    GLFWwindow* window;
-    VkSurfaceKHR windowSurface;
+    struct Window windows[MAX_WINDOWS];
+    uint32_t windowRequests; // secondary windows to open before the next frame
+    bool hiddenWindow;
 
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice;
@@ -829,107 +1333,331 @@ static struct RenderState {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
 
-    bool framebufferResized;
-    struct SwapChain swapChain;
-
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    struct PipelineCache pipelines;
+    uint16_t sceneProgram;
+    uint8_t sceneFeatures;          // enum PipelineFeature
+    bool depthPrePass;
+    bool depthPrePassRequested;
+
+    struct CaptureSystem capture;
+    bool capturing;
+    bool captureRequested;
+    uint32_t captureWindow; // the primary, except in the regression run
+
+    struct BindlessHeap bindlessHeap;
+    struct LayoutCache layouts;
 
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
 
+    struct TransformSystem transforms;
+    uint32_t sceneRoots[DEMO_SCENE_ROOTS];
+    struct FrameRing instanceRing;     // world matrices, one region per frame in flight
+    uint32_t instanceBufferIndex;      // the ring's slot in the bindless heap
+
+    struct TextureSystem textures;
+    uint32_t demoTexture;
+
+    struct ParticleSystem particles;
+    uint16_t particleProgram;
+    bool particlesEnabled;
+
+    struct MeshletSystem meshlets;
+    uint16_t meshletProgram;
+    bool meshletsEnabled;
+
+    struct DrawQueue drawQueue;
+
+    struct GpuQueries gpuQueries;
+    bool queriesEnabled;
+
+    struct SpriteRenderer sprites;
+    uint16_t spriteProgram;
+    bool spritesEnabled;
+
     VkCommandPool commandPool;
     VkCommandBuffer *commandBuffers;
 
-    VkSemaphore *imageAvailableSemaphores;
-    VkSemaphore *renderFinishedSemaphores;
     VkFence *inFlightFences;
 
     uint32_t currentFrame;
+    float fixedTime; // animation time in seconds, negative to follow the clock
+    float lastTime;  // animation time of the previous frame
+
+    struct FrameTraceWriter trace;
+    bool recording;
+    struct FrameTraceReader replay;
+    bool replaying;
+    bool replayPending;  // replayFrame's state is applied, its draws not yet drawn
+    bool replayFinished;
+    struct FrameTraceEntry replayFrame;
 } state;
 
-VkResult recreateSwapChain(
-    VkPhysicalDevice physicalDevice,
-    VkDevice device,
-    VkSurfaceKHR surface,
-    uint32_t graphicsFamily,
-    uint32_t presentFamily,
-    VkRenderPass renderPass,
-    uint32_t fenceCount,
-    VkFence *inFlightFences,
-    struct SwapChain *activeSwapChain
-) {
+static VkResult createWindowFramebuffers(struct Window *window) {
+    struct SwapChain *swapChain = &window->swapChain;
+    const struct RenderGraphResource *depth = &window->renderGraph.resources[window->graphResources.depthImage];
+    return createFramebuffers(
+        state.device,
+        state.renderPass,
+        swapChain->extent,
+        swapChain->imageViews,
+        depth->imageView,
+        swapChain->imageCount,
+        swapChain->framebuffers
+    );
+}
+
+static void destroyWindowFramebuffers(struct Window *window) {
+    struct SwapChain *swapChain = &window->swapChain;
+    for (uint32_t i = 0; i < swapChain->imageCount; i++) {
+        vkDestroyFramebuffer(state.device, swapChain->framebuffers[i], hostAllocator());
+        swapChain->framebuffers[i] = VK_NULL_HANDLE;
+    }
+}
+
+// Compiling the graph recreates its transients, the depth buffer among
+// them, so the framebuffers are recreated with it. The device must be idle.
+static VkResult rebuildWindowGraph(struct Window *window, struct CaptureSystem *capture) {
+    destroyWindowFramebuffers(window);
+    cleanupRenderGraph(state.device, &window->renderGraph);
+
+    VkResult result = buildRenderGraph(
+        state.physicalDevice,
+        state.device,
+        &window->renderGraph,
+        &window->swapChain,
+        window == &state.windows[0],
+        capture,
+        &window->graphResources
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to build render graph");
+
+    result = createWindowFramebuffers(window);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create framebuffers");
+    return VK_SUCCESS;
+}
+
+// Leaves the window stale while it has no area, e.g. when minimized
+VkResult recreateWindowSwapChain(struct Window *window) {
     VkResult result;
 
     int width = 0, height = 0;
-    glfwGetFramebufferSize(state.window, &width, &height);
-    while (width == 0 || height == 0) {
-        glfwGetFramebufferSize(state.window, &width, &height);
-        glfwWaitEvents();
+    glfwGetFramebufferSize(window->glfwWindow, &width, &height);
+    if (width == 0 || height == 0) {
+        window->swapChainStale = true;
+        return VK_SUCCESS;
     }
 
     fprintf(stderr, "New dimensions: %dx%d\n", width, height);
 
-    result = vkDeviceWaitIdle(device);
+    result = vkDeviceWaitIdle(state.device);
     PANIC_IF_NOT_VK_SUCCESS(result, "Failed to wait for device to be idle");
 
-    result = vkWaitForFences(device, fenceCount, inFlightFences, VK_TRUE, UINT64_MAX);
+    result = vkWaitForFences(state.device, maxFramesInFlight, state.inFlightFences, VK_TRUE, UINT64_MAX);
     PANIC_IF_NOT_VK_SUCCESS(result, "Failed to wait for frames in-flight to finish");
 
-    cleanupSwapChain(device, activeSwapChain);
+    struct SwapChain *swapChain = &window->swapChain;
+    cleanupSwapChain(state.device, swapChain);
     result = createSwapChain(
-        physicalDevice,
-        device,
-        surface,
-        graphicsFamily,
-        presentFamily,
+        state.physicalDevice,
+        state.device,
+        window->surface,
+        state.graphicsFamily,
+        state.presentFamily,
         width,
         height,
-        activeSwapChain
+        swapChain
     );
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
 
-    result = createFramebuffers(
-        device,
-        renderPass,
-        activeSwapChain->extent,
-        activeSwapChain->imageViews,
-        activeSwapChain->imageCount,
-        activeSwapChain->framebuffers
-    );
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to recreate framebuffers");
+    bool primary = window == &state.windows[0];
+    bool captured = window == &state.windows[state.captureWindow];
+    struct CaptureSystem *capture = captured && state.capturing ? &state.capture : NULL;
+    if (capture) {
+        result = captureResize(capture, swapChain);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to resize capture buffers");
+    }
+
+    // Transient sizes follow the swap chain
+    result = rebuildWindowGraph(window, capture);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to rebuild render graph");
 
+    if (primary && state.recording) {
+        frameTraceWriteResize(&state.trace, 0, swapChain->extent.width, swapChain->extent.height);
+    }
+
+    window->swapChainStale = false;
+    window->framebufferResized = false;
     return VK_SUCCESS;
 }
 
-VkResult renderInit(void) {
-    VkResult result;
+// Applies trace records up to the next frame's: resizes happen now, the
+// frame's state toggles go through the same requests the keys make
+static void replayAdvance(void) {
+    struct FrameTraceEntry entry;
+    while (frameTraceNext(&state.replay, &entry)) {
+        if (entry.type == FRAME_TRACE_RECORD_RESIZE) {
+            // Only the primary window is replayed
+            if (entry.resize.window != 0) continue;
+
+            struct Window *window = &state.windows[0];
+            glfwSetWindowSize(window->glfwWindow, (int) entry.resize.width, (int) entry.resize.height);
+            VkResult result = recreateWindowSwapChain(window);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
+            continue;
+        }
 
-    if (!glfwInit()) {
-        fprintf(stderr, "Failed to initialize GLFW\n");
-        exit(1);
+        state.replayFrame = entry;
+        state.replayPending = true;
+        state.sceneFeatures = entry.frame.sceneFeatures;
+        state.depthPrePassRequested = entry.frame.depthPrePass;
+        state.particlesEnabled = entry.frame.particles;
+        state.spritesEnabled = entry.frame.sprites;
+        state.meshletsEnabled = entry.frame.meshlets;
+        return;
     }
-    fprintf(stderr, "GLFW initialized: %s\n", glfwGetVersionString());
-    fprintf(stderr, "Vulkan supported: %s\n", glfwVulkanSupported() ? "yes" : "no");
+    state.replayFinished = true;
+}
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-    FIXME("Crashes during window resizing. Seems to be supressed by using robustBufferAccess");
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
 
-    state.window = glfwCreateWindow(
+static GLFWwindow *createGlfwWindow(struct Window *window, const char *title) {
+    window->glfwWindow = glfwCreateWindow(
         initialWindowWidth,
         initialWindowHeight,
-        "Vulkan Triangle",
+        title,
         NULL,
         NULL
     );
+    if (!window->glfwWindow) return NULL;
+
+    glfwSetWindowUserPointer(window->glfwWindow, window);
+    glfwSetKeyCallback(window->glfwWindow, key_callback);
+    glfwSetFramebufferSizeCallback(window->glfwWindow, framebuffer_resize_callback);
+    return window->glfwWindow;
+}
+
+// A secondary window on the device the primary one picked. Its swap chain
+// has to match the render pass, which was made for the primary's formats.
+VkResult openWindow(struct Window *window, uint32_t number) {
+    VkResult result;
+
+    char title[64];
+    snprintf(title, sizeof(title), "Vulkan Triangle (%u)", number + 1);
+    if (!createGlfwWindow(window, title)) {
+        fprintf(stderr, "Failed to create window %u\n", number + 1);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    result = COUNT_VK_CREATE(glfwCreateWindowSurface(state.instance, window->glfwWindow, hostAllocator(), &window->surface));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create window surface");
+
+    VkBool32 presentSupport = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(state.physicalDevice, state.presentFamily, window->surface, &presentSupport);
+    if (!presentSupport) {
+        fprintf(stderr, "Window %u: the present queue can't present to it\n", number + 1);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    result = createSwapChain(
+        state.physicalDevice,
+        state.device,
+        window->surface,
+        state.graphicsFamily,
+        state.presentFamily,
+        initialWindowWidth, initialWindowHeight,
+        &window->swapChain
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create swap chain");
+
+    const struct SwapChain *primary = &state.windows[0].swapChain;
+    if (window->swapChain.imageFormat != primary->imageFormat || window->swapChain.depthFormat != primary->depthFormat) {
+        fprintf(stderr, "Window %u: swap chain formats differ from the primary window's\n", number + 1);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    result = rebuildWindowGraph(window, NULL);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to build render graph");
+
+    result = createWindowSemaphores(state.device, window);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create window semaphores");
+
+    fprintf(stderr, "Window %u opened\n", number + 1);
+    return VK_SUCCESS;
+}
+
+// Safe on a partially opened window. The caller makes sure the device is idle.
+void closeWindow(struct Window *window) {
+    for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+        vkDestroySemaphore(state.device, window->renderFinishedSemaphores[i], hostAllocator());
+        vkDestroySemaphore(state.device, window->imageAvailableSemaphores[i], hostAllocator());
+    }
+    cleanupRenderGraph(state.device, &window->renderGraph);
+    if (window->swapChain.vkSwapChain != VK_NULL_HANDLE) cleanupSwapChain(state.device, &window->swapChain);
+    vkDestroySurfaceKHR(state.instance, window->surface, hostAllocator());
+    if (window->glfwWindow) glfwDestroyWindow(window->glfwWindow);
+    *window = (struct Window) { 0 };
+}
+
+// Opens requested windows and closes secondary ones the user closed
+void updateWindows(void) {
+    for (uint32_t w = 1; w < MAX_WINDOWS; w++) {
+        struct Window *window = &state.windows[w];
+        if (window->glfwWindow && glfwWindowShouldClose(window->glfwWindow)) {
+            VkResult result = vkDeviceWaitIdle(state.device);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to wait for device to be idle");
+            closeWindow(window);
+            fprintf(stderr, "Window %u closed\n", w + 1);
+            if (w == state.captureWindow) {
+                state.captureWindow = 0;
+                state.capturing = false;
+                state.captureRequested = false;
+            }
+        }
+    }
+
+    for (uint32_t w = 1; w < MAX_WINDOWS && state.windowRequests > 0; w++) {
+        struct Window *window = &state.windows[w];
+        if (window->glfwWindow) continue;
+
+        state.windowRequests--;
+        if (openWindow(window, w) != VK_SUCCESS) {
+            vkDeviceWaitIdle(state.device);
+            closeWindow(window);
+        }
+    }
+    if (state.windowRequests > 0) {
+        fprintf(stderr, "At most %u windows\n", MAX_WINDOWS);
+        state.windowRequests = 0;
+    }
+}
+
+VkResult renderInit(void) {
+    VkResult result;
+
+    if (!glfwInit()) {
+        fprintf(stderr, "Failed to initialize GLFW\n");
+        exit(1);
+    }
+    fprintf(stderr, "GLFW initialized: %s\n", glfwGetVersionString());
+    fprintf(stderr, "Vulkan supported: %s\n", glfwVulkanSupported() ? "yes" : "no");
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, state.hiddenWindow ? GLFW_FALSE : GLFW_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, state.hiddenWindow ? GLFW_FALSE : GLFW_TRUE);
+    FIXME("Crashes during window resizing. Seems to be supressed by using robustBufferAccess");
+
+    struct Window *window = &state.windows[0];
+    createGlfwWindow(window, "Vulkan Triangle");
 
     fprintf(stderr, "Initializing Vulkan\n");
     result = createVulkanInstance(&state.instance);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create Vulkan instance");
 
-    result = glfwCreateWindowSurface(state.instance, state.window, NULL, &state.windowSurface);
+    result = COUNT_VK_CREATE(glfwCreateWindowSurface(state.instance, window->glfwWindow, hostAllocator(), &window->surface));
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create window surface");
 
     state.debugMessenger = VK_NULL_HANDLE;
@@ -938,7 +1666,7 @@ VkResult renderInit(void) {
         RETURN_IF_NOT_VK_SUCCESS(result, "Failed to initialize debug messenger");
     }
 
-    result = getPhysicalDevice(state.instance, state.windowSurface, &state.physicalDevice);
+    result = getPhysicalDevice(state.instance, window->surface, &state.physicalDevice);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get physical device");
 
     uint32_t graphicsFamily;
@@ -947,17 +1675,31 @@ VkResult renderInit(void) {
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get graphics queue family");
     state.graphicsFamily = graphicsFamily;
 
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = { 0 };
+    bool descriptorIndexing = queryDescriptorIndexingSupport(state.physicalDevice, &indexingFeatures);
+    bool memoryBudget = queryMemoryBudgetSupport(state.physicalDevice);
+
     VkDevice device;
-    result = createLogicalDevice(state.physicalDevice, graphicsFamily, &device);
+    result = createLogicalDevice(
+        state.physicalDevice,
+        graphicsFamily,
+        descriptorIndexing ? &indexingFeatures : NULL,
+        memoryBudget,
+        &device
+    );
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create logical device");
     state.device = device;
 
+    result = loadDeviceDispatch(device);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to load device functions");
+    memoryInit(state.physicalDevice, memoryBudget);
+
     VkQueue deviceQueue;
     vkGetDeviceQueue(device, graphicsFamily, 0, &deviceQueue);
     state.deviceQueue = deviceQueue;
 
     uint32_t presentFamily;
-    result = getPresentQueueFamilies(state.physicalDevice, state.windowSurface, &presentFamily);
+    result = getPresentQueueFamilies(state.physicalDevice, window->surface, &presentFamily);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to get present queue family");
     state.presentFamily = presentFamily;
 
@@ -965,47 +1707,81 @@ VkResult renderInit(void) {
     vkGetDeviceQueue(device, presentFamily, 0, &presentQueue);
     state.presentQueue = presentQueue;
 
-    struct SwapChain swapChain;
+    struct SwapChain swapChain = { 0 };
     result = createSwapChain(
         state.physicalDevice,
         device,
-        state.windowSurface,
+        window->surface,
         graphicsFamily,
         presentFamily,
         initialWindowWidth, initialWindowHeight,
         &swapChain
     );
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create swap chain");
-    state.swapChain = swapChain;
+    window->swapChain = swapChain;
 
-    VkRenderPass renderPass;
-    result = createRenderPass(device, swapChain.imageFormat, &renderPass);
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render pass");
-    state.renderPass = renderPass;
+    result = createBindlessHeap(
+        state.physicalDevice,
+        device,
+        descriptorIndexing,
+        maxFramesInFlight,
+        &state.bindlessHeap
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create bindless descriptor heap");
 
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
-    result = createGraphicsPipeline(
+    createLayoutCache(device, &state.bindlessHeap, &state.layouts);
+
+    result = createPipelineCache(device, &state.layouts, &state.pipelines);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create pipeline cache");
+    // The plain bindless layout, every graphics pipeline draws with it
+    state.pipelineLayout = state.pipelines.layout;
+
+    state.sceneProgram = addSceneProgram(&state.pipelines);
+    if (state.sceneProgram == PIPELINE_PROGRAM_INVALID) {
+        fprintf(stderr, "Failed to load scene shaders\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    state.particleProgram = addParticleProgram(&state.pipelines);
+    if (state.particleProgram == PIPELINE_PROGRAM_INVALID) {
+        fprintf(stderr, "Failed to load particle shaders\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    state.spriteProgram = addSpriteProgram(&state.pipelines);
+    if (state.spriteProgram == PIPELINE_PROGRAM_INVALID) {
+        fprintf(stderr, "Failed to load sprite shaders\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    state.meshletProgram = addMeshletProgram(&state.pipelines);
+    if (state.meshletProgram == PIPELINE_PROGRAM_INVALID) {
+        fprintf(stderr, "Failed to load mesh shaders\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    result = createScenePasses(
         device,
-        renderPass,
-        &pipelineLayout,
-        &graphicsPipeline
+        swapChain.imageFormat,
+        swapChain.depthFormat,
+        &state.pipelines,
+        state.sceneProgram,
+        state.sceneFeatures,
+        state.depthPrePass,
+        &state.renderPass
     );
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create graphics pipeline");
-    state.pipelineLayout = pipelineLayout;
-    state.graphicsPipeline = graphicsPipeline;
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create render pass and pipelines");
 
-    VkFramebuffer *framebuffers = malloc(swapChain.imageCount * sizeof(VkFramebuffer));
-    result = createFramebuffers(
+    result = createCaptureSystem(
+        state.physicalDevice,
         device,
-        renderPass,
-        swapChain.extent,
-        swapChain.imageViews,
-        swapChain.imageCount,
-        framebuffers
+        &state.bindlessHeap,
+        state.pipelineLayout,
+        maxFramesInFlight,
+        CAPTURE_FORMAT_PNG,
+        &state.capture
     );
-    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create framebuffers");
-    state.swapChain.framebuffers = framebuffers;
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create capture system");
+
+    result = rebuildWindowGraph(window, NULL);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to build render graph");
 
     VkCommandPool commandPool;
     result = createCommandPool(device, graphicsFamily, &commandPool);
@@ -1019,74 +1795,438 @@ VkResult renderInit(void) {
     state.vertexBuffer = vertexBuffer;
     state.vertexBufferMemory = vertexBufferMemory;
 
-    VkCommandBuffer *commandBuffers = malloc(sizeof(VkCommandBuffer) * maxFramesInFlight);
+    if (!createTransformSystem(sceneObjectCount, &state.transforms)) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    if (!createDemoScene(&state.transforms, state.sceneRoots)) {
+        fprintf(stderr, "Failed to create demo scene\n");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    transformsPrepare(&state.transforms);
+
+    result = createFrameRing(
+        state.physicalDevice,
+        device,
+        (VkDeviceSize) sceneObjectCount * sizeof(mat4),
+        maxFramesInFlight,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &state.instanceRing
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create instance ring");
+
+    state.instanceBufferIndex = bindlessRegisterBuffer(
+        device,
+        &state.bindlessHeap,
+        state.instanceRing.buffer,
+        0,
+        VK_WHOLE_SIZE
+    );
+
+    result = createTextureSystem(
+        state.physicalDevice,
+        device,
+        state.deviceQueue,
+        state.graphicsFamily,
+        &state.bindlessHeap,
+        maxFramesInFlight,
+        TEXTURE_DEFAULT_BUDGET,
+        &state.textures
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create texture system");
+
+    // Optional, the scene renders untextured without it
+    state.demoTexture = texturesLoad(&state.textures, "textures/demo.ktx2");
+
+    result = createParticleSystem(
+        state.physicalDevice,
+        device,
+        &state.bindlessHeap,
+        &state.layouts,
+        PARTICLE_DEFAULT_CAPACITY,
+        &state.particles
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create particle system");
+    state.particlesEnabled = true;
+
+    // Baked offline by meshlet_bake when there is one, else built here
+    struct MeshletMesh mesh;
+    if (!meshletsRead("meshes/demo.meshlets", &mesh) && !createDemoMesh(&mesh)) {
+        fprintf(stderr, "Failed to create demo mesh\n");
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    result = createMeshletSystem(state.physicalDevice, device, &state.bindlessHeap, &state.layouts, maxFramesInFlight, &mesh, &state.meshlets);
+    meshletsFree(&mesh);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create meshlet system");
+
+    if (!createDrawQueue(DRAW_QUEUE_DEFAULT_CAPACITY, &state.drawQueue)) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    result = createGpuQueries(state.physicalDevice, device, maxFramesInFlight, &state.gpuQueries);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create GPU queries");
+
+    result = createSpriteRenderer(
+        state.physicalDevice,
+        device,
+        SPRITE_DEFAULT_CAPACITY,
+        maxFramesInFlight,
+        &state.sprites
+    );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create sprite renderer");
+
+    // Lives until shutdown, nothing here is ever resized
+    struct Arena *persistent = persistentArena();
+    VkCommandBuffer *commandBuffers = ARENA_ARRAY(persistent, VkCommandBuffer, maxFramesInFlight);
     result = createCommandBuffers(device, commandPool, &commandBuffers, maxFramesInFlight);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create command buffer");
     state.commandBuffers = commandBuffers;
 
-    VkSemaphore *imageAvailableSemaphores = malloc(sizeof(VkSemaphore) * maxFramesInFlight);
-    VkSemaphore *renderFinishedSemaphores = malloc(sizeof(VkSemaphore) * maxFramesInFlight);
-    VkFence *inFlightFences = malloc(sizeof(VkFence) * maxFramesInFlight);
-    result = createSyncObjects(
-        device,
-        &imageAvailableSemaphores,
-        &renderFinishedSemaphores,
-        &inFlightFences
-    );
+    VkFence *inFlightFences = ARENA_ARRAY(persistent, VkFence, maxFramesInFlight);
+    result = createSyncObjects(device, &inFlightFences);
     RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create sync objects");
-    state.imageAvailableSemaphores = imageAvailableSemaphores;
-    state.renderFinishedSemaphores = renderFinishedSemaphores;
     state.inFlightFences = inFlightFences;
 
+    result = createWindowSemaphores(device, window);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create window semaphores");
+
     fprintf(stderr, "Vulkan context initialized successfully\n");
     return VK_SUCCESS;
 }
 
-void drawFrame(void) {
-    vkWaitForFences(state.device, 1, &state.inFlightFences[state.currentFrame], VK_TRUE, UINT64_MAX);
+// Switching the pre-pass changes the subpass layout, so the render pass,
+// its pipelines and the framebuffers are all rebuilt
+VkResult applyDepthPrePass(void) {
+    VkResult result = vkDeviceWaitIdle(state.device);
+    PANIC_IF_NOT_VK_SUCCESS(result, "Failed to wait for device to be idle");
+
+    for (uint32_t w = 0; w < MAX_WINDOWS; w++) {
+        if (state.windows[w].glfwWindow) destroyWindowFramebuffers(&state.windows[w]);
+    }
+    pipelineCacheEvictRenderPass(&state.pipelines, state.renderPass);
+    vkDestroyRenderPass(state.device, state.renderPass, hostAllocator());
 
-    uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(
+    // Every window's swap chain shares the primary's formats
+    state.depthPrePass = state.depthPrePassRequested;
+    result = createScenePasses(
         state.device,
-        state.swapChain.vkSwapChain,
-        UINT64_MAX,
-        state.imageAvailableSemaphores[state.currentFrame],
-        VK_NULL_HANDLE,
-        &imageIndex
+        state.windows[0].swapChain.imageFormat,
+        state.windows[0].swapChain.depthFormat,
+        &state.pipelines,
+        state.sceneProgram,
+        state.sceneFeatures,
+        state.depthPrePass,
+        &state.renderPass
     );
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to recreate render pass and pipelines");
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-        const char *result_str = string_VkResult(result);
-        fprintf(stderr, "Recreating swap chain. Reason: %s\n", result_str);
-        recreateSwapChain(
-            state.physicalDevice,
+    for (uint32_t w = 0; w < MAX_WINDOWS; w++) {
+        if (!state.windows[w].glfwWindow) continue;
+        result = createWindowFramebuffers(&state.windows[w]);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to recreate framebuffers");
+    }
+
+    return VK_SUCCESS;
+}
+
+// Capture adds a pass to the captured window's graph, so it's rebuilt.
+// Captures still in flight are flushed by captureBeginFrame either way.
+VkResult applyCapture(void) {
+    struct Window *window = &state.windows[state.captureWindow];
+    VkImageUsageFlags readUsage = state.capture.format == CAPTURE_FORMAT_Y4M
+        ? VK_IMAGE_USAGE_SAMPLED_BIT
+        : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (state.captureRequested && !(window->swapChain.imageUsage & readUsage)) {
+        fprintf(stderr, "Capture: swap chain images can't be read back\n");
+        state.captureRequested = false;
+        return VK_SUCCESS;
+    }
+
+    VkResult result = vkDeviceWaitIdle(state.device);
+    PANIC_IF_NOT_VK_SUCCESS(result, "Failed to wait for device to be idle");
+
+    state.capturing = state.captureRequested;
+    if (state.capturing) {
+        result = captureResize(&state.capture, &window->swapChain);
+        RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create capture buffers");
+    }
+
+    result = rebuildWindowGraph(window, state.capturing ? &state.capture : NULL);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to rebuild render graph");
+
+    fprintf(stderr, "Capture: %s\n", state.capturing ? "on" : "off");
+    return VK_SUCCESS;
+}
+
+void drawFrame(void) {
+    // Scratch from the previous frame, or from init before the first one
+    arenaReset(frameArena(), 0);
+    frameStatsBeginFrame();
+    dispatchBeginFrame();
+
+    updateWindows();
+    if (state.replaying && !state.replayPending) {
+        replayAdvance();
+        if (state.replayFinished) return;
+    }
+    if (state.depthPrePass != state.depthPrePassRequested) {
+        VkResult result = applyDepthPrePass();
+        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to switch depth pre-pass");
+    }
+    if (state.capturing != state.captureRequested) {
+        VkResult result = applyCapture();
+        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to switch capture");
+    }
+
+    VKD(vkWaitForFences)(state.device, 1, &state.inFlightFences[state.currentFrame], VK_TRUE, UINT64_MAX);
+    gpuQueriesCollect(&state.gpuQueries, state.currentFrame);
+
+    // Windows that couldn't be drawn to last time get another go first
+    for (uint32_t w = 0; w < MAX_WINDOWS; w++) {
+        struct Window *window = &state.windows[w];
+        if (window->glfwWindow && window->swapChainStale) {
+            VkResult result = recreateWindowSwapChain(window);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
+        }
+    }
+
+    // Every window that has an image this frame, primary first
+    struct Window *acquired[MAX_WINDOWS];
+    uint32_t acquiredCount = 0;
+    for (uint32_t w = 0; w < MAX_WINDOWS; w++) {
+        struct Window *window = &state.windows[w];
+        if (!window->glfwWindow || window->swapChainStale) continue;
+
+        VkResult result = VKD(vkAcquireNextImageKHR)(
             state.device,
-            state.windowSurface,
-            state.graphicsFamily,
-            state.presentFamily,
-            state.renderPass,
-            maxFramesInFlight,
-            state.inFlightFences,
-            &state.swapChain
+            window->swapChain.vkSwapChain,
+            UINT64_MAX,
+            window->imageAvailableSemaphores[state.currentFrame],
+            VK_NULL_HANDLE,
+            &window->imageIndex
         );
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            const char *result_str = string_VkResult(result);
+            fprintf(stderr, "Recreating swap chain. Reason: %s\n", result_str);
+            result = recreateWindowSwapChain(window);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
+            continue;
+        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            const char *result_str = string_VkResult(result);
+            fprintf(stderr, "Result: %s\n", result_str);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to acquire swap chain image");
+        }
+        acquired[acquiredCount++] = window;
+    }
+
+    if (acquiredCount == 0) {
+        // Nothing to draw to, e.g. minimized. Sleep until that changes.
+        if (state.windows[0].swapChainStale) glfwWaitEvents();
         return;
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-        const char *result_str = string_VkResult(result);
-        fprintf(stderr, "Result: %s\n", result_str);
-        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to acquire swap chain image");
+    }
+    bool primaryAcquired = acquired[0] == &state.windows[0];
+    bool capturedAcquired = false;
+    for (uint32_t w = 0; w < acquiredCount; w++) {
+        if (acquired[w] == &state.windows[state.captureWindow]) capturedAcquired = true;
     }
 
-    vkResetFences(state.device, 1, &state.inFlightFences[state.currentFrame]);
+    VKD(vkResetFences)(state.device, 1, &state.inFlightFences[state.currentFrame]);
+
+    memoryBeginFrame();
+
+    bindlessBeginFrame(&state.bindlessHeap);
+    texturesUpdate(&state.textures);
+    // Indices pushed this frame must already be written in its set
+    bindlessFlushWrites(state.device, &state.bindlessHeap, state.currentFrame);
+
+    // The fence covers this slot's previous copy, so it can go to disk now
+    bool captureFrame = captureBeginFrame(&state.capture, state.currentFrame, state.capturing && capturedAcquired);
+
+    // What every window shares; the per window fields are filled in below
+    struct FrameContext frame = {
+        .renderPass = state.renderPass,
+        .pipelineLayout = state.pipelineLayout,
+        .depthPrePass = state.depthPrePass,
+        .drawQueue = &state.drawQueue,
+        .bindlessSet = bindlessGetSet(&state.bindlessHeap, state.currentFrame),
+        .pushConstants = {
+            .imageIndex = texturesGetBindlessIndex(&state.textures, state.demoTexture),
+            .samplerIndex = state.textures.samplerIndex,
+            .bufferIndex = state.instanceBufferIndex,
+            .instanceOffset = 0,
+        },
+        .captureSlot = state.currentFrame,
+        .captureBuffer = VK_NULL_HANDLE,
+        .particles = NULL,
+        .particlePipeline = VK_NULL_HANDLE,
+        .particleBuffer = state.particles.buffer,
+        .meshlets = NULL,
+        .meshletBuffer = state.meshlets.outputBuffer,
+        .sprites = NULL,
+    };
 
-    vkResetCommandBuffer(state.commandBuffers[state.currentFrame], 0);
-    result = recordCommandBuffer(
-        state.commandBuffers[state.currentFrame],
-        state.vertexBuffer,
-        imageIndex,
+    // The GPU is done with this frame's region of the ring, so the world
+    // matrices can be streamed straight into it
+    const struct FrameTraceEntry *replay = state.replaying ? &state.replayFrame : NULL;
+    float time = state.fixedTime >= 0.0f ? state.fixedTime : (float) glfwGetTime();
+    if (replay) time = replay->frame.time;
+    animateDemoScene(&state.transforms, state.sceneRoots, time);
+
+    // A fixed step under a fixed clock keeps regression frames reproducible
+    float deltaTime = state.fixedTime >= 0.0f ? 1.0f / 60.0f : time - state.lastTime;
+    if (deltaTime < 0.0f || deltaTime > 0.1f) deltaTime = 0.1f;
+    if (replay) deltaTime = replay->frame.deltaTime;
+    state.lastTime = time;
+
+    // Only the primary's graph orders the simulation before the draws, so
+    // without it this frame nobody draws particles
+    if (state.particlesEnabled && primaryAcquired) {
+        struct PipelineKey particleKey = particlePipelineKey(state.renderPass, state.particleProgram, state.depthPrePass);
+        frame.particles = &state.particles;
+        frame.particlePipeline = pipelineCacheGet(&state.pipelines, &particleKey);
+        particlesUpdate(&state.particles, deltaTime, time);
+    }
+
+    // Culled against the primary's camera, every window draws the result
+    VkExtent2D primaryExtent = state.windows[0].swapChain.extent;
+    if (state.meshletsEnabled && primaryAcquired) {
+        struct MeshletCamera camera;
+        float lodScale = demoMeshCamera(primaryExtent, time, &camera);
+        if (meshletsUpdate(&state.meshlets, state.currentFrame, &camera, lodScale, &frame.meshletPushConstants)) {
+            frame.meshlets = &state.meshlets;
+        }
+
+        enum DepthMode shading = state.depthPrePass ? DEPTH_MODE_EQUAL : DEPTH_MODE_TEST;
+        struct PipelineKey meshletKey = meshletPipelineKey(state.renderPass, state.meshletProgram, shading, state.sceneFeatures);
+        frame.meshletPipelines[DRAW_LAYER_SHADING] = pipelineCacheGet(&state.pipelines, &meshletKey);
+        if (state.depthPrePass) {
+            meshletKey = meshletPipelineKey(state.renderPass, state.meshletProgram, DEPTH_MODE_PRE_PASS, state.sceneFeatures);
+            frame.meshletPipelines[DRAW_LAYER_DEPTH_PRE_PASS] = pipelineCacheGet(&state.pipelines, &meshletKey);
+        }
+    }
+
+    spritesBegin(&state.sprites, state.currentFrame);
+    if (replay) {
+        // Bindless indices depend on load order and streaming, only the
+        // demo texture's is tracked
+        for (uint32_t i = 0; i < replay->frame.spriteCount; i++) {
+            struct Sprite sprite = replay->sprites[i];
+            bool demoTexture = sprite.texture != BINDLESS_INVALID_INDEX && sprite.texture == replay->frame.textureIndex;
+            if (demoTexture) sprite.texture = frame.pushConstants.imageIndex;
+            if (!spritesPush(&state.sprites, &sprite)) break;
+        }
+    } else if (state.spritesEnabled && primaryAcquired) {
+        drawDemoSprites(&state.sprites, primaryExtent, frame.pushConstants.imageIndex, time);
+    }
+    spritesEnd(&state.sprites, primaryExtent);
+    VkPipeline spritePipelines[SPRITE_PIPELINE_COUNT] = { VK_NULL_HANDLE };
+    if (state.sprites.batchCount > 0) {
+        for (uint32_t p = 0; p < SPRITE_PIPELINE_COUNT; p++) {
+            struct PipelineKey spriteKey = spritePipelineKey(state.renderPass, state.spriteProgram, state.depthPrePass, p);
+            spritePipelines[p] = pipelineCacheGet(&state.pipelines, &spriteKey);
+        }
+    }
+    frameRingBegin(&state.instanceRing, state.currentFrame);
+
+    VkDeviceSize instanceOffset;
+    mat4 *instances = frameRingAlloc(
+        &state.instanceRing,
+        (VkDeviceSize) state.transforms.count * sizeof(mat4),
+        sizeof(mat4),
+        &instanceOffset
+    );
+    if (instances) {
+        transformsUpdateParallel(&state.transforms, instances);
+        frame.pushConstants.instanceOffset = (uint32_t) (instanceOffset / sizeof(mat4));
+    } else {
+        fprintf(stderr, "Instance ring full, the scene is skipped this frame\n");
+    }
+
+    struct SceneDraw demoDraws[SCENE_MAX_DRAWS];
+    const struct SceneDraw *sceneDraws = demoDraws;
+    uint32_t sceneDrawCount;
+    if (replay) {
+        sceneDraws = replay->draws;
+        sceneDrawCount = replay->frame.drawCount;
+    } else {
+        sceneDrawCount = demoSceneDraws(state.depthPrePass, state.sceneFeatures, state.transforms.count, demoDraws);
+    }
+    // Nothing to place the objects with
+    if (!instances) sceneDrawCount = 0;
+
+    // Sorted once, every window records the same packets
+    drawQueueBegin(&state.drawQueue);
+    pushSceneDraws(
+        &state.drawQueue,
+        &state.pipelines,
         state.renderPass,
-        state.swapChain.framebuffers,
-        state.swapChain.extent,
-        state.graphicsPipeline
+        state.sceneProgram,
+        state.vertexBuffer,
+        sceneDraws,
+        sceneDrawCount,
+        &frame.pushConstants
+    );
+    drawQueueSort(&state.drawQueue);
+
+    if (state.recording) {
+        struct FrameTraceFrame traced = {
+            .time = time,
+            .deltaTime = deltaTime,
+            .instanceCount = state.transforms.count,
+            .textureIndex = frame.pushConstants.imageIndex,
+            .drawCount = sceneDrawCount,
+            .spriteCount = state.sprites.count,
+            .sceneFeatures = state.sceneFeatures,
+            .depthPrePass = state.depthPrePass,
+            .particles = state.particlesEnabled,
+            .sprites = state.spritesEnabled,
+            .meshlets = state.meshletsEnabled,
+        };
+        frameTraceWriteFrame(&state.trace, &traced, sceneDraws, state.sprites.sprites);
+    }
+    state.replayPending = false;
+
+    struct FrameContext frames[MAX_WINDOWS];
+    VkSemaphore waitSemaphores[MAX_WINDOWS];
+    VkPipelineStageFlags waitStages[MAX_WINDOWS];
+    VkSemaphore signalSemaphores[MAX_WINDOWS];
+    VkSwapchainKHR swapChains[MAX_WINDOWS];
+    uint32_t imageIndices[MAX_WINDOWS];
+    VkResult presentResults[MAX_WINDOWS];
+    for (uint32_t w = 0; w < acquiredCount; w++) {
+        struct Window *window = acquired[w];
+        bool primary = window == &state.windows[0];
+
+        frames[w] = frame;
+        frames[w].framebuffer = window->swapChain.framebuffers[window->imageIndex];
+        frames[w].extent = window->swapChain.extent;
+        frames[w].swapChainImageIndex = window->imageIndex;
+        if (window == &state.windows[state.captureWindow]) {
+            frames[w].captureBuffer = captureFrame ? state.capture.slots[state.currentFrame].buffer : VK_NULL_HANDLE;
+        }
+        if (primary) {
+            if (state.sprites.batchCount > 0) {
+                frames[w].sprites = &state.sprites;
+                memcpy(frames[w].spritePipelines, spritePipelines, sizeof(spritePipelines));
+            }
+        }
+
+        waitSemaphores[w] = window->imageAvailableSemaphores[state.currentFrame];
+        waitStages[w] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        signalSemaphores[w] = window->renderFinishedSemaphores[state.currentFrame];
+        swapChains[w] = window->swapChain.vkSwapChain;
+        imageIndices[w] = window->imageIndex;
+        presentResults[w] = VK_SUCCESS;
+    }
+
+    VKD(vkResetCommandBuffer)(state.commandBuffers[state.currentFrame], 0);
+    VkResult result = recordCommandBuffer(
+        state.commandBuffers[state.currentFrame],
+        acquired,
+        frames,
+        acquiredCount,
+        state.queriesEnabled ? &state.gpuQueries : NULL,
+        state.currentFrame
     );
 
     if (result != VK_SUCCESS) {
@@ -1095,22 +2235,18 @@ void drawFrame(void) {
         PANIC_IF_NOT_VK_SUCCESS(result, "Failed to record command buffer");
     }
 
-    VkSemaphore waitSemaphores[] = { state.imageAvailableSemaphores[state.currentFrame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    VkSemaphore signalSemaphores[] = { state.renderFinishedSemaphores[state.currentFrame] };
-
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .commandBufferCount = 1,
-        .pCommandBuffers = state.commandBuffers,
-        .waitSemaphoreCount = 1,
+        .pCommandBuffers = &state.commandBuffers[state.currentFrame],
+        .waitSemaphoreCount = acquiredCount,
         .pWaitSemaphores = waitSemaphores,
         .pWaitDstStageMask = waitStages,
-        .signalSemaphoreCount = 1,
+        .signalSemaphoreCount = acquiredCount,
         .pSignalSemaphores = signalSemaphores
     };
 
-    result = vkQueueSubmit(
+    result = VKD(vkQueueSubmit)(
         state.deviceQueue,
         1,
         &submitInfo,
@@ -1123,44 +2259,43 @@ void drawFrame(void) {
         PANIC_IF_NOT_VK_SUCCESS(result, "Failed to submit draw command buffer");
     }
 
+    // One present for every window, each swap chain reports on its own
     VkPresentInfoKHR presentInfo = { 0 };
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.waitSemaphoreCount = acquiredCount;
     presentInfo.pWaitSemaphores = signalSemaphores;
-
-    VkSwapchainKHR swapChains[] = { state.swapChain.vkSwapChain };
-    presentInfo.swapchainCount = 1;
+    presentInfo.swapchainCount = acquiredCount;
     presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = NULL;
-
-    result = vkQueuePresentKHR(state.presentQueue, &presentInfo);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || state.framebufferResized) {
-        if (state.framebufferResized) {
-            state.framebufferResized = false;
-            fprintf(stderr, "Recreating swap chain. Reason: Framebuffer resized\n");
-        } else {
-            const char *result_str = string_VkResult(result);
-            fprintf(stderr, "Recreating swap chain. Reason: %s\n", result_str);
-        }
+    presentInfo.pImageIndices = imageIndices;
+    presentInfo.pResults = presentResults;
 
-        recreateSwapChain(
-            state.physicalDevice,
-            state.device,
-            state.windowSurface,
-            state.graphicsFamily,
-            state.presentFamily,
-            state.renderPass,
-            maxFramesInFlight,
-            state.inFlightFences,
-            &state.swapChain
-        );
-    } else if (result != VK_SUCCESS) {
+    result = VKD(vkQueuePresentKHR)(state.presentQueue, &presentInfo);
+    if (result != VK_SUCCESS && result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR) {
         const char *result_str = string_VkResult(result);
         fprintf(stderr, "Result: %s\n", result_str);
         PANIC_IF_NOT_VK_SUCCESS(result, "Failed to present swap chain image");
     }
 
+    for (uint32_t w = 0; w < acquiredCount; w++) {
+        struct Window *window = acquired[w];
+        VkResult windowResult = presentResults[w];
+        if (windowResult == VK_ERROR_OUT_OF_DATE_KHR || windowResult == VK_SUBOPTIMAL_KHR || window->framebufferResized) {
+            if (window->framebufferResized) {
+                fprintf(stderr, "Recreating swap chain. Reason: Framebuffer resized\n");
+            } else {
+                const char *result_str = string_VkResult(windowResult);
+                fprintf(stderr, "Recreating swap chain. Reason: %s\n", result_str);
+            }
+
+            result = recreateWindowSwapChain(window);
+            PANIC_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
+        } else if (windowResult != VK_SUCCESS) {
+            const char *result_str = string_VkResult(windowResult);
+            fprintf(stderr, "Result: %s\n", result_str);
+            PANIC_IF_NOT_VK_SUCCESS(windowResult, "Failed to present swap chain image");
+        }
+    }
+
     state.currentFrame = (state.currentFrame + 1) % maxFramesInFlight;
 }
 
@@ -1175,45 +2310,241 @@ void vulkanCleanup(void) {
     }
 
     for (uint32_t i = 0; i < maxFramesInFlight; i++) {
-        vkDestroySemaphore(state.device, state.renderFinishedSemaphores[i], NULL);
-        vkDestroySemaphore(state.device, state.imageAvailableSemaphores[i], NULL);
-        vkDestroyFence(state.device, state.inFlightFences[i], NULL);
+        vkDestroyFence(state.device, state.inFlightFences[i], hostAllocator());
     }
-    free(state.renderFinishedSemaphores);
-    free(state.imageAvailableSemaphores);
-    free(state.inFlightFences);
 
     vkFreeCommandBuffers(state.device, state.commandPool, 1, state.commandBuffers);
-    vkDestroyCommandPool(state.device, state.commandPool, NULL);
+    vkDestroyCommandPool(state.device, state.commandPool, hostAllocator());
+
+    cleanupCaptureSystem(&state.capture);
+
+    vkDestroyBuffer(state.device, state.vertexBuffer, hostAllocator());
+    memoryFree(state.device, state.vertexBufferMemory);
+
+    cleanupTextureSystem(&state.textures);
+    cleanupParticleSystem(&state.particles);
+    cleanupMeshletSystem(&state.meshlets);
+    cleanupSpriteRenderer(state.device, &state.sprites);
+    cleanupDrawQueue(&state.drawQueue);
+    cleanupGpuQueries(&state.gpuQueries);
+    cleanupFrameRing(state.device, &state.instanceRing);
+    cleanupTransformSystem(&state.transforms);
+
+    cleanupPipelineCache(&state.pipelines);
+    cleanupLayoutCache(&state.layouts);
+    cleanupBindlessHeap(state.device, &state.bindlessHeap);
+    vkDestroyRenderPass(state.device, state.renderPass, hostAllocator());
+
+    // Surfaces go before the instance, the primary last since it picked the device
+    for (uint32_t w = MAX_WINDOWS; w-- > 0;) {
+        if (state.windows[w].glfwWindow) closeWindow(&state.windows[w]);
+    }
 
-    cleanupSwapChain(state.device, &state.swapChain);
-    free(state.swapChain.framebuffers);
-    free(state.swapChain.imageViews);
-    free(state.swapChain.images);
+    vkDestroyDevice(state.device, hostAllocator());
+    vkDestroyInstance(state.instance, hostAllocator());
 
-    vkDestroyBuffer(state.device, state.vertexBuffer, NULL);
-    vkFreeMemory(state.device, state.vertexBufferMemory, NULL);
+    glfwTerminate();
+}
 
-    vkDestroyPipeline(state.device, state.graphicsPipeline, NULL);
-    vkDestroyPipelineLayout(state.device, state.pipelineLayout, NULL);
-    vkDestroyRenderPass(state.device, state.renderPass, NULL);
+#define REGRESS_SETTLE_FRAMES 600
+#define REGRESS_WARMUP_FRAMES 30
+#define REGRESS_TIMED_FRAMES 300
+
+// Each scene is a fixed animation time and pipeline configuration
+static const struct RegressScene {
+    const char *name;
+    float time;
+    uint8_t features; // enum PipelineFeature
+    bool depthPrePass;
+} regressScenes[] = {
+    { "default", 0.0f, 0, false },
+    { "flat_color", 0.5f, PIPELINE_FEATURE_FLAT_COLOR, false },
+    { "show_depth", 1.0f, PIPELINE_FEATURE_SHOW_DEPTH, false },
+    { "depth_pre_pass", 1.5f, 0, true },
+};
 
-    vkDestroyDevice(state.device, NULL);
-    vkDestroySurfaceKHR(state.instance, state.windowSurface, NULL);
-    vkDestroyInstance(state.instance, NULL);
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
 
-    glfwDestroyWindow(state.window);
-    glfwTerminate();
+// Captures the next frame that gets drawn and compares it to the golden
+static enum RegressResult checkRegressScene(const struct RegressOptions *options, const char *name) {
+    // A frame that had to recreate the swap chain captured nothing, retry
+    uint8_t *rgba = NULL;
+    bool taken = false;
+    for (uint32_t attempt = 0; attempt < 3 && !taken; attempt++) {
+        uint32_t slot = state.currentFrame;
+        glfwPollEvents();
+        drawFrame();
+        vkDeviceWaitIdle(state.device);
+
+        statsFree(rgba);
+        rgba = statsMalloc((size_t) state.capture.extent.width * state.capture.extent.height * 4);
+        if (!rgba) break;
+        taken = captureTake(&state.capture, slot, rgba);
+    }
+
+    enum RegressResult result = REGRESS_FAILED;
+    if (taken) {
+        result = regressCheckImage(options, name, state.capture.extent.width, state.capture.extent.height, rgba);
+    } else {
+        fprintf(stderr, "Regress: %s: failed to capture\n", name);
+    }
+    statsFree(rgba);
+    return result;
+}
+
+// Renders the scenes into raw captures and compares them, then times frames
+// at a fixed animation step. Frame times include presentation, so they are
+// only compared with --timing, on the machine and present mode that recorded
+// the baseline.
+static enum RegressResult runRegression(const struct RegressOptions *options, double startupMs) {
+    // Goldens need every texture at its final resolution
+    state.fixedTime = 0.0f;
+    for (uint32_t i = 0; i < REGRESS_SETTLE_FRAMES && !texturesSettled(&state.textures); i++) {
+        glfwPollEvents();
+        drawFrame();
+    }
+    if (!texturesSettled(&state.textures)) {
+        fprintf(stderr, "Regress: textures still streaming after %u frames\n", REGRESS_SETTLE_FRAMES);
+    }
+
+    for (uint32_t i = 0; i < REGRESS_WARMUP_FRAMES; i++) {
+        glfwPollEvents();
+        drawFrame();
+    }
+    vkDeviceWaitIdle(state.device);
+
+    struct FrameStats steadyStart = frameStatsTotal();
+    double start = nowSeconds();
+    for (uint32_t i = 0; i < REGRESS_TIMED_FRAMES; i++) {
+        glfwPollEvents();
+        state.fixedTime = (float) i / 60.0f;
+        drawFrame();
+    }
+    vkDeviceWaitIdle(state.device);
+    struct FrameStats steady = frameStatsTotal();
+    for (uint32_t c = 0; c < FRAME_COUNTER_COUNT; c++) steady.counters[c] -= steadyStart.counters[c];
+
+    struct RegressMetrics metrics = {
+        .startupMs = startupMs,
+        .frameMs = (nowSeconds() - start) * 1000.0 / REGRESS_TIMED_FRAMES,
+    };
+
+    enum RegressResult result = regressCheckSteadyState(&steady, REGRESS_TIMED_FRAMES) ? REGRESS_PASSED : REGRESS_FAILED;
+    captureSetFormat(&state.capture, CAPTURE_FORMAT_RAW);
+    state.captureRequested = true;
+
+    // Same particles in every run, however many frames settling took
+    particlesReset(&state.particles);
+
+    for (size_t i = 0; i < sizeof(regressScenes) / sizeof(regressScenes[0]); i++) {
+        const struct RegressScene *scene = &regressScenes[i];
+        state.fixedTime = scene->time;
+        state.sceneFeatures = scene->features;
+        state.depthPrePassRequested = scene->depthPrePass;
+        result = regressWorst(result, checkRegressScene(options, scene->name));
+    }
+
+    // A secondary window records after the primary's particles and sprites
+    // have rebound binding 0, so its scene draws can't lean on binds that
+    // were made for the primary
+    state.fixedTime = 0.0f;
+    state.sceneFeatures = 0;
+    state.depthPrePassRequested = false;
+    state.windowRequests = 1;
+    updateWindows();
+    if (state.windows[1].glfwWindow) {
+        state.captureRequested = false;
+        VkResult result = applyCapture();
+        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to switch capture");
+        state.captureWindow = 1;
+        state.captureRequested = true;
+        result = applyCapture();
+        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to switch capture");
+        result = regressWorst(result, checkRegressScene(options, "second_window"));
+    } else {
+        fprintf(stderr, "Regress: second_window: failed to open the window\n");
+        result = REGRESS_FAILED;
+    }
+
+    state.captureRequested = false;
+    state.fixedTime = -1.0f;
+
+    if (options->timing) result = regressWorst(result, regressCheckMetrics(options, &metrics));
+    static const char *resultNames[] = { "passed", "skipped, references missing", "FAILED" };
+    fprintf(stderr, "Regress: %s\n", resultNames[result]);
+    return result;
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     UNUSED_INTENTIONAL(scancode);
-    UNUSED_INTENTIONAL(mods);
     if (action == GLFW_PRESS) {
         switch (key) {
         case GLFW_KEY_ESCAPE: {
             glfwSetWindowShouldClose(window, GLFW_TRUE);
         } break;
+        case GLFW_KEY_N: {
+            // Opened before the next frame, so not from inside a callback
+            state.windowRequests++;
+        } break;
+        case GLFW_KEY_P: {
+            state.depthPrePassRequested = !state.depthPrePassRequested;
+        } break;
+        case GLFW_KEY_F: {
+            // Cycles through the specialization constant toggles, each
+            // combination is its own cached variant
+            uint8_t mask = PIPELINE_FEATURE_FLAT_COLOR | PIPELINE_FEATURE_SHOW_DEPTH;
+            state.sceneFeatures = (state.sceneFeatures + 1) & mask;
+            fprintf(stderr, "Scene features: 0x%x\n", state.sceneFeatures);
+        } break;
+        case GLFW_KEY_F12: {
+            // Shift+F12 records a Y4M video, plain F12 a PNG per frame
+            if (!state.capturing) {
+                bool video = mods & GLFW_MOD_SHIFT;
+                if (!captureSetFormat(&state.capture, video ? CAPTURE_FORMAT_Y4M : CAPTURE_FORMAT_PNG)) {
+                    fprintf(stderr, "Capture: video unavailable, writing PNG\n");
+                    captureSetFormat(&state.capture, CAPTURE_FORMAT_PNG);
+                }
+            }
+            state.captureRequested = !state.captureRequested;
+        } break;
+        case GLFW_KEY_E: {
+            state.particlesEnabled = !state.particlesEnabled;
+            fprintf(stderr, "Particles: %s\n", state.particlesEnabled ? "on" : "off");
+        } break;
+        case GLFW_KEY_C: {
+            // Shift+C compares against drawing every cluster
+            if (mods & GLFW_MOD_SHIFT) {
+                state.meshlets.cullFlags = state.meshlets.cullFlags ? 0 : MESHLET_CULL_ALL;
+                fprintf(stderr, "Cluster culling: %s\n", state.meshlets.cullFlags ? "on" : "off");
+            } else {
+                state.meshletsEnabled = !state.meshletsEnabled;
+                fprintf(stderr, "Meshlets: %s\n", state.meshletsEnabled ? "on" : "off");
+            }
+        } break;
+        case GLFW_KEY_Q: {
+            state.queriesEnabled = !state.queriesEnabled;
+            fprintf(stderr, "GPU queries: %s\n", state.queriesEnabled ? "on" : "off");
+        } break;
+        case GLFW_KEY_H: {
+            state.spritesEnabled = !state.spritesEnabled;
+            fprintf(stderr, "Sprites: %s\n", state.spritesEnabled ? "on" : "off");
+        } break;
+        case GLFW_KEY_M: {
+            memoryReport(stderr);
+            hostAllocatorReport(stderr);
+            arenaReport(stderr);
+            frameStatsReport(stderr);
+            dispatchReport(stderr);
+            drawQueueReport(&state.drawQueue, stderr);
+            gpuQueriesReport(&state.gpuQueries, stderr);
+            spritesReport(&state.sprites, stderr);
+            meshletsReport(&state.meshlets, stderr);
+            layoutCacheReport(&state.layouts, stderr);
+        } break;
         case GLFW_KEY_R: {
             fprintf(stderr, "Reloading shaders...\n");
             TODO("Reload shaders");
@@ -1224,13 +2555,138 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 }
 
 static void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
-    UNUSED_INTENTIONAL(window);
     UNUSED_INTENTIONAL(width);
     UNUSED_INTENTIONAL(height);
-    state.framebufferResized = true;
+    struct Window *resized = glfwGetWindowUserPointer(window);
+    resized->framebufferResized = true;
 }
 
-int main(void) {
+struct AppOptions {
+    uint32_t windowCount;
+    const char *recordPath; // NULL unless recording a trace
+    const char *replayPath; // NULL unless replaying one
+};
+
+// Takes the app's own arguments out, the rest are for regress
+static bool parseAppArgs(int *argc, char **argv, struct AppOptions *options) {
+    *options = (struct AppOptions) { .windowCount = 1 };
+
+    int kept = 1;
+    for (int i = 1; i < *argc; i++) {
+        const char *value = i + 1 < *argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--windows") == 0 && value) {
+            options->windowCount = (uint32_t) strtoul(value, NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--record") == 0 && value) {
+            options->recordPath = value;
+            i++;
+        } else if (strcmp(argv[i], "--replay") == 0 && value) {
+            options->replayPath = value;
+            i++;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    *argc = kept;
+
+    if (options->windowCount < 1) options->windowCount = 1;
+    if (options->windowCount > MAX_WINDOWS) {
+        fprintf(stderr, "At most %u windows\n", MAX_WINDOWS);
+        options->windowCount = MAX_WINDOWS;
+    }
+    if (options->recordPath && options->replayPath) {
+        fprintf(stderr, "--record and --replay can't be combined\n");
+        return false;
+    }
+    return true;
+}
+
+// Runs the trace's frames back to back in a hidden window. Times include
+// presentation, which is uncapped wherever mailbox or immediate exist.
+static bool runReplay(void) {
+    struct Window *window = &state.windows[0];
+    const struct FrameTraceHeader *header = &state.replay.header;
+    if (window->swapChain.extent.width != header->width || window->swapChain.extent.height != header->height) {
+        glfwSetWindowSize(window->glfwWindow, (int) header->width, (int) header->height);
+        VkResult result = recreateWindowSwapChain(window);
+        PANIC_IF_NOT_VK_SUCCESS(result, "Failed to recreate swap chain");
+    }
+
+    uint32_t frames = 0;
+    uint64_t draws = 0;
+    uint64_t sprites = 0;
+    double slowest = 0.0;
+    double fastest = 1e9;
+    double start = nowSeconds();
+    while (!state.replayFinished) {
+        double frameStart = nowSeconds();
+        glfwPollEvents();
+        drawFrame();
+        if (state.replayFinished) break;
+
+        double frameMs = (nowSeconds() - frameStart) * 1000.0;
+        if (frameMs > slowest) slowest = frameMs;
+        if (frameMs < fastest) fastest = frameMs;
+        if (!state.replayPending) {
+            frames++;
+            draws += state.replayFrame.frame.drawCount;
+            sprites += state.replayFrame.frame.spriteCount;
+        }
+    }
+    vkDeviceWaitIdle(state.device);
+    double totalMs = (nowSeconds() - start) * 1000.0;
+
+    if (frames == 0) {
+        fprintf(stderr, "Replay: no frames\n");
+        return false;
+    }
+    fprintf(
+        stderr,
+        "Replay: %u frames in %.1f ms, %.3f ms/frame (min %.3f, max %.3f), %llu scene draws, %llu sprites\n",
+        frames,
+        totalMs,
+        totalMs / frames,
+        fastest,
+        slowest,
+        (unsigned long long) draws,
+        (unsigned long long) sprites
+    );
+    return !state.replay.failed;
+}
+
+int main(int argc, char **argv) {
+    double startTime = nowSeconds();
+
+    struct AppOptions app;
+    if (!parseAppArgs(&argc, argv, &app)) exit(2);
+
+    struct RegressOptions regress;
+    if (!regressParseArgs(argc, argv, &regress)) exit(2);
+    if (regress.enabled && (app.recordPath || app.replayPath)) {
+        fprintf(stderr, "--regress can't be combined with --record or --replay\n");
+        exit(2);
+    }
+    state.hiddenWindow = regress.enabled || app.replayPath;
+
+    // Goldens and replays are of the primary window alone
+    state.windowRequests = regress.enabled || app.replayPath ? 0 : app.windowCount - 1;
+
+    if (app.replayPath) {
+        if (!frameTraceOpen(app.replayPath, &state.replay)) exit(1);
+        state.replaying = true;
+    }
+    state.fixedTime = -1.0f;
+
+    // Before the instance, everything is created and destroyed through it
+    hostAllocatorInit(true);
+    if (!arenasInit()) exit(1);
+
+    // The main thread becomes worker 0
+    if (!jobsInit(0)) {
+        fprintf(stderr, "Failed to start job system\n");
+        exit(1);
+    }
+
     VkResult result = renderInit();
     if (result != VK_SUCCESS) {
         const char *result_str = string_VkResult(result);
@@ -1238,16 +2694,35 @@ int main(void) {
         exit(1);
     }
 
-    glfwSetKeyCallback(state.window, key_callback);
-    glfwSetFramebufferSizeCallback(state.window, framebuffer_resize_callback);
+    if (app.recordPath) {
+        VkExtent2D extent = state.windows[0].swapChain.extent;
+        if (!frameTraceCreate(app.recordPath, extent.width, extent.height, &state.trace)) exit(1);
+        state.recording = true;
+    }
 
-    while (!glfwWindowShouldClose(state.window)) {
-        glfwPollEvents();
-        drawFrame();
+    bool pass = true;
+    enum RegressResult regressResult = REGRESS_PASSED;
+    if (regress.enabled) {
+        regressResult = runRegression(&regress, (nowSeconds() - startTime) * 1000.0);
+        pass = regressResult != REGRESS_FAILED;
+    } else if (state.replaying) {
+        pass = runReplay();
+    } else {
+        while (!glfwWindowShouldClose(state.windows[0].glfwWindow)) {
+            glfwPollEvents();
+            drawFrame();
+        }
     }
 
     vkDeviceWaitIdle(state.device);
 
+    if (state.recording) pass = frameTraceClose(&state.trace) && pass;
+    if (state.replaying) frameTraceCloseReader(&state.replay);
+
     vulkanCleanup();
-    exit(0);
+    hostAllocatorShutdown();
+    arenasShutdown();
+    jobsShutdown();
+    if (!pass) exit(1);
+    exit(regressResult == REGRESS_SKIPPED ? REGRESS_EXIT_SKIPPED : 0);
 }
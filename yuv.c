@@ -0,0 +1,181 @@
+#include <vulkan/vulkan.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "device_dispatch.h"
+#include "frame_stats.h"
+#include "host_allocator.h"
+#include "shader_modules.h"
+#include "yuv.h"
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct YuvLayout yuvLayout(VkExtent2D extent) {
+    struct YuvLayout layout = {
+        .width = extent.width,
+        .height = extent.height,
+        .chromaWidth = (extent.width + 1) / 2,
+        .chromaHeight = (extent.height + 1) / 2,
+        .lumaStride = alignUp(extent.width, YUV_BLOCK_WIDTH),
+    };
+    layout.chromaStride = layout.lumaStride / 2;
+
+    // The last block row writes two luma rows even when the height is odd
+    VkDeviceSize lumaSize = (VkDeviceSize) layout.lumaStride * layout.chromaHeight * 2;
+    VkDeviceSize chromaSize = (VkDeviceSize) layout.chromaStride * layout.chromaHeight;
+    layout.uOffset = lumaSize;
+    layout.vOffset = lumaSize + chromaSize;
+    layout.size = lumaSize + chromaSize * 2;
+    return layout;
+}
+
+VkResult createYuvConverter(
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    VkPipelineLayout layout,
+    struct YuvConverter *converter
+) {
+    VkResult result;
+
+    *converter = (struct YuvConverter) {
+        .device = device,
+        .bindlessHeap = bindlessHeap,
+        .layout = layout,
+        .samplerIndex = BINDLESS_INVALID_INDEX,
+    };
+
+    result = loadShaderModule(device, "shaders/rgb_to_yuv.spv", &converter->module);
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create RGB to YUV shader module");
+
+    // Only used for texelFetch, which ignores filtering
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+    result = COUNT_VK_CREATE(vkCreateSampler(device, &samplerInfo, hostAllocator(), &converter->sampler));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create RGB to YUV sampler");
+
+    converter->samplerIndex = bindlessRegisterSampler(device, bindlessHeap, converter->sampler);
+    return VK_SUCCESS;
+}
+
+void cleanupYuvConverter(struct YuvConverter *converter) {
+    VkDevice device = converter->device;
+    if (converter->samplerIndex != BINDLESS_INVALID_INDEX) {
+        bindlessRelease(converter->bindlessHeap, BINDLESS_BINDING_SAMPLERS, converter->samplerIndex);
+    }
+    vkDestroyPipeline(device, converter->pipeline, hostAllocator());
+    vkDestroySampler(device, converter->sampler, hostAllocator());
+    vkDestroyShaderModule(device, converter->module, hostAllocator());
+    *converter = (struct YuvConverter) { 0 };
+}
+
+VkResult yuvConverterPrepare(struct YuvConverter *converter, bool srgbInput) {
+    if (converter->pipeline != VK_NULL_HANDLE && converter->srgbInput == srgbInput) {
+        return VK_SUCCESS;
+    }
+    vkDestroyPipeline(converter->device, converter->pipeline, hostAllocator());
+    converter->pipeline = VK_NULL_HANDLE;
+
+    // The descriptor arrays are sized by specialization so the shader works
+    // with and without descriptor indexing
+    const struct BindlessSlots *slots = converter->bindlessHeap->slots;
+    uint32_t constants[] = {
+        srgbInput ? VK_TRUE : VK_FALSE,
+        slots[BINDLESS_BINDING_SAMPLED_IMAGES].capacity,
+        slots[BINDLESS_BINDING_SAMPLERS].capacity,
+        slots[BINDLESS_BINDING_STORAGE_BUFFERS].capacity,
+    };
+    VkSpecializationMapEntry entries[sizeof(constants) / sizeof(constants[0])];
+    for (uint32_t i = 0; i < sizeof(constants) / sizeof(constants[0]); i++) {
+        entries[i] = (VkSpecializationMapEntry) {
+            .constantID = i,
+            .offset = i * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+    VkSpecializationInfo specialization = {
+        .mapEntryCount = sizeof(entries) / sizeof(entries[0]),
+        .pMapEntries = entries,
+        .dataSize = sizeof(constants),
+        .pData = constants,
+    };
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = converter->module,
+            .pName = "main",
+            .pSpecializationInfo = &specialization,
+        },
+        .layout = converter->layout,
+    };
+    VkResult result = COUNT_VK_CREATE(vkCreateComputePipelines(
+        converter->device,
+        VK_NULL_HANDLE,
+        1,
+        &pipelineInfo,
+        hostAllocator(),
+        &converter->pipeline
+    ));
+    RETURN_IF_NOT_VK_SUCCESS(result, "Failed to create RGB to YUV pipeline");
+
+    converter->srgbInput = srgbInput;
+    return VK_SUCCESS;
+}
+
+void yuvRecord(
+    const struct YuvConverter *converter,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet,
+    uint32_t imageIndex,
+    uint32_t bufferIndex,
+    VkExtent2D extent
+) {
+    struct YuvLayout layout = yuvLayout(extent);
+
+    VKD(vkCmdBindPipeline)(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, converter->pipeline);
+    VKD(vkCmdBindDescriptorSets)(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        converter->layout,
+        0, 1, &bindlessSet,
+        0, NULL
+    );
+
+    struct BindlessPushConstants pushConstants = {
+        .imageIndex = imageIndex,
+        .samplerIndex = converter->samplerIndex,
+        .bufferIndex = bufferIndex,
+        .instanceOffset = 0,
+    };
+    VkPushConstantRange pushConstantRange = bindlessPushConstantRange();
+    VKD(vkCmdPushConstants)(
+        commandBuffer,
+        converter->layout,
+        pushConstantRange.stageFlags,
+        0, sizeof(pushConstants),
+        &pushConstants
+    );
+
+    uint32_t blocksX = layout.lumaStride / YUV_BLOCK_WIDTH;
+    uint32_t blocksY = layout.chromaHeight;
+    VKD(vkCmdDispatch)(
+        commandBuffer,
+        (blocksX + YUV_GROUP_SIZE - 1) / YUV_GROUP_SIZE,
+        (blocksY + YUV_GROUP_SIZE - 1) / YUV_GROUP_SIZE,
+        1
+    );
+}
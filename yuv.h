@@ -0,0 +1,72 @@
+#pragma once
+#ifndef YUV_H
+#define YUV_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bindless.h"
+
+// Compute pass that turns an RGB image into planar YUV 4:2:0 (full range
+// BT.601, as Y4M's C420jpeg expects) in a storage buffer. Each invocation
+// converts an 8x2 block so every plane is written a whole word at a time.
+
+#define YUV_BLOCK_WIDTH 8
+#define YUV_GROUP_SIZE 8 // matches local_size_x/y in rgb_to_yuv.comp
+
+// Rows are padded to YUV_BLOCK_WIDTH luma samples, readers skip the padding
+struct YuvLayout {
+    uint32_t width;
+    uint32_t height;
+    uint32_t chromaWidth;
+    uint32_t chromaHeight;
+    uint32_t lumaStride;
+    uint32_t chromaStride;
+    VkDeviceSize uOffset;
+    VkDeviceSize vOffset;
+    VkDeviceSize size;
+};
+
+struct YuvConverter {
+    VkDevice device;
+    struct BindlessHeap *bindlessHeap;
+    VkPipelineLayout layout;
+
+    VkShaderModule module;
+    VkSampler sampler;
+    uint32_t samplerIndex;
+
+    VkPipeline pipeline;
+    bool srgbInput; // what `pipeline` was specialized for
+};
+
+struct YuvLayout yuvLayout(VkExtent2D extent);
+
+// `layout` is the bindless pipeline layout
+VkResult createYuvConverter(
+    VkDevice device,
+    struct BindlessHeap *bindlessHeap,
+    VkPipelineLayout layout,
+    struct YuvConverter *converter
+);
+
+void cleanupYuvConverter(struct YuvConverter *converter);
+
+// sRGB views hand the shader linear values, which have to be re-encoded
+// before conversion. Rebuilds the pipeline when that changes.
+VkResult yuvConverterPrepare(struct YuvConverter *converter, bool srgbInput);
+
+// `imageIndex` and `bufferIndex` are bindless slots. The image must be in
+// SHADER_READ_ONLY_OPTIMAL.
+void yuvRecord(
+    const struct YuvConverter *converter,
+    VkCommandBuffer commandBuffer,
+    VkDescriptorSet bindlessSet,
+    uint32_t imageIndex,
+    uint32_t bufferIndex,
+    VkExtent2D extent
+);
+
+#endif // YUV_H